@@ -8,9 +8,16 @@
 
 #if DEPENDENCY_SQLITE
 
+// C++
+#include <algorithm> // std::stable_sort, std::remove_if
+#include <numeric>   // std::iota
+#include <set>
+
 /* QT 5.13.2
  * License: LGPLv3
  */
+#include <QDataStream>
+#include <QFile>
 #include <QStringList>
 
 // Local Project
@@ -22,6 +29,37 @@
 namespace bookfiler {
 namespace widget {
 
+/* mime type of the row ids dragged from the model
+ */
+static const char *idListMimeType = "application/x-bookfiler-tree-id-list";
+
+/* Ids moved by a drop, per database and table, until the mime data of the
+ * drag is destroyed. The dragging view calls removeRows() on the moved rows
+ * after a move drop, by then they are already at their new parent. Shared
+ * by the models so a drag between two models of a table is covered too.
+ */
+static std::unordered_map<std::string, std::unordered_set<std::string>>
+    droppedIdMap;
+
+/* sorts ranges of rows {first, last} and merges the overlapping and adjacent
+ * ones
+ */
+static void mergeRowRangeList(std::vector<std::pair<int, int>> &rangeList) {
+  std::sort(rangeList.begin(), rangeList.end());
+  std::size_t mergedNum = 0;
+  for (std::size_t rangeNum = 1; rangeNum < rangeList.size(); rangeNum++) {
+    if (rangeList[rangeNum].first <= rangeList[mergedNum].second + 1) {
+      rangeList[mergedNum].second =
+          std::max(rangeList[mergedNum].second, rangeList[rangeNum].second);
+    } else {
+      rangeList[++mergedNum] = rangeList[rangeNum];
+    }
+  }
+  if (!rangeList.empty()) {
+    rangeList.resize(mergedNum + 1);
+  }
+}
+
 SqliteModel::SqliteModel(
     std::shared_ptr<sqlite3> database_, std::string tableName_,
     std::vector<boost::bimap<std::string, std::string>::value_type> columnMap_,
@@ -34,19 +72,35 @@ SqliteModel::SqliteModel(
   columnMap = std::make_shared<boost::bimap<std::string, std::string>>();
   columnNumMap = std::make_shared<boost::bimap<int, int>>();
   columnToNumMap = std::make_shared<boost::bimap<std::string, int>>();
+  deferredColumnList = std::make_shared<std::vector<int>>();
+  indexLru = std::make_shared<SqliteModelIndexLru>();
+  nodeTable = std::make_shared<SqliteModelNodeTable>();
+  idInterner = std::make_shared<SqliteIdInterner>();
+  instrumentation = std::make_shared<SqliteInstrumentation>();
+  writeBackTimer = new QTimer(this);
+  writeBackTimer->setSingleShot(true);
+  connect(writeBackTimer, &QTimer::timeout, this, [this]() { commit(); });
   setData(database_, tableName_, columnMap_);
-  // create root index
-  rootIndex = std::make_shared<SqliteModelIndex>(database, tableName, columnMap,
-                                                 columnNumMap, columnToNumMap);
-  rootIndex->setSortOrder(sortOrder);
-  rootIndex->setFilterList(filterList);
+  // create root index. The data is fetched the first time it is needed.
+  rootIndex = createIndexNode();
   rootIndex->setParentId("*");
-
-  // Perform a full fetch for data and cache
-  rootIndex->getDataBackend();
+  indexRegistry.insert({rootIndex->getParentIdNum(), rootIndex.get()});
 }
 
-SqliteModel::~SqliteModel() {}
+SqliteModel::~SqliteModel() {
+  commit();
+  // waits for the index builds and drops the created indexes
+  indexAdvisor.reset();
+  // the hooks must not call into the model while it is destroyed
+  changeCapture.reset();
+  // the threads must not deliver results while the model is destroyed
+  if (queryWorker) {
+    queryWorker->close();
+  }
+  if (queryPool) {
+    queryPool->close();
+  }
+}
 
 /* Custom methods
  *
@@ -60,16 +114,36 @@ int SqliteModel::setData(
     std::vector<boost::bimap<std::string, std::string>::value_type>
         columnMap_) {
   int rc = 0;
+  // the buffered edits belong to the previous table
+  if (writeBuffer) {
+    commit();
+  }
+
+  // the snapshot pragmas and capture hooks belong to the previous connection
+  snapshot.reset();
+  changeCapture.reset();
+  if (changelogTimer) {
+    changelogTimer->stop();
+  }
 
   // Set sqlite database information
   database = database_;
   tableName = tableName_;
+  statementCache = std::make_shared<SqliteStatementCache>(database);
+  statementCache->setInstrumentation(instrumentation);
+  filter = std::make_shared<SqliteFilter>(database, tableName);
 
   // Use default column map if none provided
   if (!columnMap_.empty()) {
     columnMap = std::make_shared<boost::bimap<std::string, std::string>>(
         columnMap_.begin(), columnMap_.end());
   }
+  // without a column map the id column has its code name
+  auto idColumnIt = columnMap->left.find("id");
+  writeBuffer = std::make_shared<SqliteWriteBuffer>(
+      database, statementCache, tableName,
+      idColumnIt != columnMap->left.end() ? idColumnIt->second : "id");
+  writeBuffer->setInstrumentation(instrumentation);
 
   /* Get the table headers */
   std::string sqlQuery =
@@ -81,55 +155,2101 @@ int SqliteModel::setData(
     return rc;
 
   int rowCount = 0;
+  std::vector<std::string> columnNameList;
   rc = sqlite3_step(stmt);
   while (rc != SQLITE_DONE && rc != SQLITE_OK) {
     int colCount = sqlite3_column_count(stmt);
     for (int colIndex = 0; colIndex < colCount; colIndex++) {
-      int type = sqlite3_column_type(stmt, colIndex);
-      const char *columnName = sqlite3_column_name(stmt, colIndex);
       const unsigned char *valueUChar = sqlite3_column_text(stmt, colIndex);
       std::string valueStr =
           std::string(reinterpret_cast<const char *>(valueUChar));
       headerList.push_back(reinterpret_cast<const char *>(valueUChar));
       columnToNumMap->insert({valueStr, rowCount});
+      columnNameList.push_back(valueStr);
       // use the database column names if no column map provided
       if (columnMap_.empty()) {
         columnMap->insert({valueStr, valueStr});
       }
-#if BOOKFILER_QMODEL_SQLITE_MODEL_setData
-      std::cout << BOOST_CURRENT_FUNCTION << " row: " << rowCount
-                << ", col: " << colCount << ", colName: " << columnName
-                << ", valueUChar: " << valueUChar << std::endl;
-#endif
     }
     rowCount++;
     rc = sqlite3_step(stmt);
   }
 
-  rc = sqlite3_finalize(stmt);
-  if (rc != 0) {
-    return rc;
+  rc = sqlite3_finalize(stmt);
+  if (rc != 0) {
+    return rc;
+  }
+
+  /* Fill out the column num map at the same size as actual columns
+   */
+  for (int i = 0; i < rowCount; i++) {
+    columnNumMap->insert({i, i});
+  }
+  sampleColumnByteSize();
+  updateDeferredColumns();
+
+  auto parentIdColumnIt = columnMap->left.find("parentId");
+  treeEditor = std::make_shared<SqliteTreeEditor>(
+      database, statementCache, tableName,
+      idColumnIt != columnMap->left.end() ? idColumnIt->second : "id",
+      parentIdColumnIt != columnMap->left.end() ? parentIdColumnIt->second
+                                                : "parentId",
+      columnNameList);
+
+  return 0;
+}
+
+int SqliteModel::setRoot(std::string id) {
+  int rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+  viewRootId = std::make_shared<std::string>(id);
+  indexRegistry.erase(rootIndex->getParentIdNum());
+  rootIndex->setParentId(*viewRootId);
+  indexRegistry[rootIndex->getParentIdNum()] = rootIndex.get();
+  if (rootIndex->isLoaded()) {
+    rootIndex->getDataBackend();
+  }
+  if (flatTree) {
+    flatTree->setRootId(*viewRootId);
+    flatTree->load();
+  }
+  return 0;
+}
+
+int SqliteModel::setFetchBlockSize(int blockSize) {
+  fetchBlockSize = blockSize < 0 ? 0 : blockSize;
+  rootIndex->setFetchBlockSize(fetchBlockSize);
+  if (rootIndex->isLoaded()) {
+    rootIndex->getDataBackend();
+  }
+  return 0;
+}
+
+QModelIndex SqliteModel::getParentModelIndex(SqliteModelIndex *indexPtr) const {
+  if (indexPtr == rootIndex.get())
+    return QModelIndex();
+
+  /* The parent row lives in the parent index at the row number this index
+   * was created for
+   */
+  SqliteModelIndex *parentIndexPtr = indexPtr->getParent();
+  if (!parentIndexPtr) {
+    return QModelIndex();
+  }
+
+  return createIndex(indexPtr->getRowNum(), 0, parentIndexPtr);
+}
+
+void SqliteModel::pruneIndex(SqliteModelIndex *indexPtr, std::uint32_t idNum) {
+  std::shared_ptr<SqliteModelIndex> childIndexPtr =
+      indexPtr->removeIndex(idNum);
+  if (childIndexPtr) {
+    unregisterIndex(childIndexPtr.get());
+  }
+}
+
+void SqliteModel::unregisterIndex(SqliteModelIndex *indexPtr) {
+  auto findIt = indexRegistry.find(indexPtr->getParentIdNum());
+  if (findIt != indexRegistry.end() && findIt->second == indexPtr) {
+    indexRegistry.erase(findIt);
+  }
+  for (SqliteModelIndex *childIndexPtr : indexPtr->getIndexList()) {
+    unregisterIndex(childIndexPtr);
+  }
+}
+
+int SqliteModel::updateIdHint(std::vector<std::string> addedIdList,
+                              std::vector<std::string> updatedIdList,
+                              std::vector<std::string> deletedIdList) {
+  int rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+  // the parent of added and updated rows is read from the database
+  std::unordered_map<std::string, std::string> parentIdMap;
+  if (!flatTree) {
+    std::vector<std::string> changedIdList(addedIdList);
+    changedIdList.insert(changedIdList.end(), updatedIdList.begin(),
+                         updatedIdList.end());
+    parentIdMap = getParentIdBackend(changedIdList);
+  }
+  return applyIdHint(addedIdList, updatedIdList, deletedIdList, parentIdMap,
+                     std::unordered_set<std::string>());
+}
+
+int SqliteModel::applyIdHint(
+    const std::vector<std::string> &addedIdList,
+    const std::vector<std::string> &updatedIdList,
+    const std::vector<std::string> &deletedIdList,
+    const std::unordered_map<std::string, std::string> &parentIdMap,
+    const std::unordered_set<std::string> &previousParentIdSet) {
+  // the changed rows may enter or leave the tree filter match set
+  if (filter->isTreeMode()) {
+    filter->refresh();
+  }
+  // the changed rows may move anywhere in the pre-order
+  if (flatTree) {
+    beginResetModel();
+    flatTree->load();
+    endResetModel();
+    return 0;
+  }
+
+  // deleted and updated rows are found where they are cached
+  std::unordered_set<std::string> cachedIdSet(updatedIdList.begin(),
+                                              updatedIdList.end());
+  cachedIdSet.insert(deletedIdList.begin(), deletedIdList.end());
+  std::unordered_map<std::string, std::pair<SqliteModelIndex *, int>>
+      cachedIdMap = findIdList(cachedIdSet);
+  std::unordered_map<std::string, SqliteModelIndex *> evictedIdMap =
+      findEvictedIdList(cachedIdSet);
+
+  /* Collect the parent id of every index to refresh and of every row whose
+   * child count changes
+   */
+  std::map<std::string, int> refreshParentIdMap;
+  std::unordered_set<std::string> countParentIdSet;
+  for (auto &id : deletedIdList) {
+    auto findIt = cachedIdMap.find(id);
+    if (findIt != cachedIdMap.end()) {
+      refreshParentIdMap.insert({findIt->second.first->getParentId(), 0});
+      countParentIdSet.insert(findIt->second.first->getParentId());
+    }
+  }
+  /* Rows updated under the parent they are cached at are re-read one by
+   * one, other updated rows may have moved to another parent
+   */
+  std::unordered_map<SqliteModelIndex *, std::vector<int>> updatedRowMap;
+  std::unordered_set<std::string> inPlaceIdSet;
+  for (auto &id : updatedIdList) {
+    auto findIt = cachedIdMap.find(id);
+    if (findIt == cachedIdMap.end()) {
+      continue;
+    }
+    SqliteModelIndex *indexPtr = findIt->second.first;
+    auto parentIdIt = parentIdMap.find(id);
+    if (parentIdIt != parentIdMap.end() &&
+        parentIdIt->second == indexPtr->getParentId()) {
+      updatedRowMap[indexPtr].push_back(findIt->second.second);
+      inPlaceIdSet.insert(id);
+      continue;
+    }
+    refreshParentIdMap.insert({indexPtr->getParentId(), 0});
+    countParentIdSet.insert(indexPtr->getParentId());
+  }
+  for (auto &parentIdPair : parentIdMap) {
+    if (inPlaceIdSet.count(parentIdPair.first)) {
+      continue;
+    }
+    refreshParentIdMap[parentIdPair.second]++;
+    countParentIdSet.insert(parentIdPair.second);
+  }
+  // evicted rows that were deleted or moved away change the row count
+  for (auto &evictedPair : evictedIdMap) {
+    std::string evictedParentId = evictedPair.second->getParentId();
+    auto parentIdIt = parentIdMap.find(evictedPair.first);
+    if (parentIdIt == parentIdMap.end() ||
+        parentIdIt->second != evictedParentId) {
+      refreshParentIdMap.insert({evictedParentId, 0});
+      countParentIdSet.insert(evictedParentId);
+    }
+  }
+  // rows that were not cached, or whose index was evicted
+  for (auto &parentId : previousParentIdSet) {
+    refreshParentIdMap.insert({parentId, 0});
+    countParentIdSet.insert(parentId);
+  }
+  // ids never seen are not cached and need no dataChanged()
+  std::unordered_set<std::uint32_t> updatedIdSet;
+  for (auto &id : updatedIdList) {
+    auto idNumOpt = idInterner->find(id);
+    if (idNumOpt) {
+      updatedIdSet.insert(*idNumOpt);
+    }
+  }
+
+  /* The rows are re-read before any refresh may prune their index. A sort
+   * key or filter change moves the row, so its index is refreshed instead.
+   * Indexes refreshed as a whole pick up the updated rows too.
+   */
+  int columnLast = columnCount() - 1;
+  for (auto &updatedPair : updatedRowMap) {
+    SqliteModelIndex *indexPtr = updatedPair.first;
+    if (refreshParentIdMap.count(indexPtr->getParentId())) {
+      continue;
+    }
+    // a running query may have read the rows before the change
+    if (indexPtr->getPendingTicket() != 0 ||
+        indexPtr->refreshRowsBackend(updatedPair.second) != 0) {
+      refreshParentIdMap.insert({indexPtr->getParentId(), 0});
+      countParentIdSet.insert(indexPtr->getParentId());
+      continue;
+    }
+    for (int rowNum : updatedPair.second) {
+      emit dataChanged(createIndex(rowNum, 0, indexPtr),
+                       createIndex(rowNum, columnLast, indexPtr));
+    }
+  }
+
+  /* Refresh from the top of the tree down. Indexes are looked up by parent id
+   * each time because refreshing a parent may prune its child indexes.
+   */
+  int rc = 0;
+  for (auto &refreshPair : refreshParentIdMap) {
+    auto idNumOpt = idInterner->find(refreshPair.first);
+    auto findIt =
+        idNumOpt ? indexRegistry.find(*idNumOpt) : indexRegistry.end();
+    if (findIt == indexRegistry.end()) {
+      continue;
+    }
+    int rcRefresh = refreshIndex(findIt->second, updatedIdSet,
+                                 refreshPair.second);
+    rc = rc == 0 ? rcRefresh : rc;
+  }
+
+  invalidateChildCount(countParentIdSet);
+  return rc;
+}
+
+void SqliteModel::invalidateChildCount(
+    std::unordered_set<std::string> parentIdSet) {
+  parentIdSet.erase("*");
+  std::unordered_map<std::string, std::pair<SqliteModelIndex *, int>>
+      parentIdMap = findIdList(parentIdSet);
+  for (auto &parentPair : parentIdMap) {
+    SqliteModelIndex *indexPtr = parentPair.second.first;
+    int rowNum = parentPair.second.second;
+    indexPtr->invalidateChildCount(rowNum);
+    QModelIndex rowModelIndex = createIndex(rowNum, 0, indexPtr);
+    emit dataChanged(rowModelIndex, rowModelIndex);
+  }
+}
+
+int SqliteModel::setChangeCapture(bool captureFlag, int pollDelay) {
+  if (changelogTimer) {
+    changelogTimer->stop();
+  }
+  if (!captureFlag) {
+    // the destructor removes the hooks
+    changeCapture.reset();
+    return 0;
+  }
+  if (pollDelay == 0 || pollDelay < -1) {
+    return -1;
+  }
+  auto idColumnIt = columnMap->left.find("id");
+  auto parentIdColumnIt = columnMap->left.find("parentId");
+  std::shared_ptr<SqliteChangeCapture> changeCaptureNew =
+      std::make_shared<SqliteChangeCapture>(
+          database, statementCache, tableName,
+          idColumnIt != columnMap->left.end() ? idColumnIt->second : "id",
+          parentIdColumnIt != columnMap->left.end() ? parentIdColumnIt->second
+                                                    : "parentId");
+  // the old hooks are removed before the new ones are registered
+  changeCapture.reset();
+
+  /* The commit hook runs on the thread that committed. The changes are
+   * applied on the GUI thread, the queued call is dropped if the model is
+   * destroyed first.
+   */
+  int rc = changeCaptureNew->openHooks([this]() {
+    QMetaObject::invokeMethod(
+        this, [this]() { takeCapturedChanges(); }, Qt::QueuedConnection);
+  });
+  if (rc == 0 && pollDelay > 0) {
+    rc = changeCaptureNew->openChangelog();
+  }
+  if (rc != 0) {
+    return rc;
+  }
+  changeCapture = changeCaptureNew;
+  if (pollDelay > 0) {
+    if (!changelogTimer) {
+      changelogTimer = new QTimer(this);
+      connect(changelogTimer, &QTimer::timeout, this,
+              [this]() { pollChangelog(); });
+    }
+    changelogTimer->start(pollDelay);
+  }
+  return 0;
+}
+
+int SqliteModel::dropChangelog() {
+  if (snapshot) {
+    return -1;
+  }
+  if (changelogTimer) {
+    changelogTimer->stop();
+  }
+  if (changeCapture) {
+    return changeCapture->dropChangelog();
+  }
+  // the changelog may be left by an earlier session
+  auto idColumnIt = columnMap->left.find("id");
+  auto parentIdColumnIt = columnMap->left.find("parentId");
+  SqliteChangeCapture changeCaptureDrop(
+      database, statementCache, tableName,
+      idColumnIt != columnMap->left.end() ? idColumnIt->second : "id",
+      parentIdColumnIt != columnMap->left.end() ? parentIdColumnIt->second
+                                                : "parentId");
+  return changeCaptureDrop.dropChangelog();
+}
+
+void SqliteModel::takeCapturedChanges() {
+  if (!changeCapture) {
+    return;
+  }
+  SqliteChangeCapture::ChangeSet changeSet;
+  if (changeCapture->takeChangeSet(changeSet) != 0 || changeSet.empty()) {
+    return;
+  }
+  writeBack();
+  applyIdHint(changeSet.addedIdList, changeSet.updatedIdList,
+              changeSet.deletedIdList, changeSet.parentIdMap,
+              changeSet.previousParentIdSet);
+}
+
+void SqliteModel::pollChangelog() {
+  if (!changeCapture || !changeCapture->isChangelogOpen()) {
+    return;
+  }
+  SqliteChangeCapture::ChangeSet changeSet;
+  int rc = changeCapture->pollChangelog(changeSet);
+  if (rc < 0 || (rc == 0 && changeSet.empty())) {
+    return;
+  }
+  writeBack();
+  if (rc > 0) {
+    // changes were trimmed before they were read
+    if (filter->isTreeMode()) {
+      filter->refresh();
+    }
+    refreshAllIndexes();
+  } else {
+    applyIdHint(changeSet.addedIdList, changeSet.updatedIdList,
+                changeSet.deletedIdList, changeSet.parentIdMap,
+                changeSet.previousParentIdSet);
+  }
+}
+
+void SqliteModel::refreshAllIndexes() {
+  if (flatTree) {
+    beginResetModel();
+    flatTree->load();
+    endResetModel();
+    return;
+  }
+  bool idleFlag = staleIndexQueue.empty();
+  staleIndexQueue.clear();
+  std::deque<SqliteModelIndex *> indexQueue;
+  indexQueue.push_back(rootIndex.get());
+  while (!indexQueue.empty()) {
+    SqliteModelIndex *indexPtr = indexQueue.front();
+    indexQueue.pop_front();
+    staleIndexQueue.push_back(indexPtr->getParentIdNum());
+    for (SqliteModelIndex *childIndexPtr : indexPtr->getIndexList()) {
+      indexQueue.push_back(childIndexPtr);
+    }
+  }
+  // a refresh already scheduled continues with the new queue
+  if (idleFlag) {
+    QTimer::singleShot(0, this, [this]() { refreshStaleIndex(); });
+  }
+}
+
+std::unordered_map<std::string, std::string>
+SqliteModel::getParentIdBackend(const std::vector<std::string> &idList) {
+  std::unordered_map<std::string, std::string> parentIdMap;
+  const int pageSize = SqliteModelIndex::childCountPageSize;
+  for (std::size_t pageBegin = 0; pageBegin < idList.size();
+       pageBegin += pageSize) {
+    /* The IN list always has pageSize parameters so a single statement is
+     * cached. Unused parameters stay NULL and match nothing.
+     */
+    std::shared_ptr<sqlite3_stmt> stmt =
+        statementCache->get("parentIdList", [this, pageSize]() {
+          std::string idColumn = "`" + columnMap->left.at("id") + "`";
+          std::string sqlQuery = "SELECT " + idColumn + ", `" +
+                                 columnMap->left.at("parentId") + "` FROM `" +
+                                 tableName + "` WHERE " + idColumn + " IN (";
+          for (int paramNum = 1; paramNum <= pageSize; paramNum++) {
+            sqlQuery.append((paramNum == 1 ? "?" : ",?") +
+                            std::to_string(paramNum));
+          }
+          sqlQuery.append(");");
+          return sqlQuery;
+        });
+    if (!stmt) {
+      break;
+    }
+    for (std::size_t idNum = pageBegin;
+         idNum < idList.size() && idNum < pageBegin + pageSize; idNum++) {
+      sqlite3_bind_text(stmt.get(), static_cast<int>(idNum - pageBegin + 1),
+                        idList[idNum].c_str(),
+                        static_cast<int>(idList[idNum].size()),
+                        SQLITE_TRANSIENT);
+    }
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+      const unsigned char *idChar = sqlite3_column_text(stmt.get(), 0);
+      const unsigned char *parentChar = sqlite3_column_text(stmt.get(), 1);
+      if (!idChar) {
+        continue;
+      }
+      parentIdMap.insert(
+          {reinterpret_cast<const char *>(idChar),
+           parentChar ? reinterpret_cast<const char *>(parentChar) : "*"});
+    }
+  }
+  return parentIdMap;
+}
+
+std::unordered_map<std::string, std::pair<SqliteModelIndex *, int>>
+SqliteModel::findIdList(const std::unordered_set<std::string> &idSet) {
+  std::unordered_map<std::string, std::pair<SqliteModelIndex *, int>>
+      idLocationMap;
+  for (auto &id : idSet) {
+    auto idNumOpt = idInterner->find(id);
+    auto locationOpt = idNumOpt ? nodeTable->find(*idNumOpt)
+                                : std::optional<std::pair<int, int>>();
+    if (!locationOpt) {
+      continue;
+    }
+    SqliteModelIndex *indexPtr = nodeTable->get(locationOpt->first);
+    if (indexPtr && indexPtr->isLoaded()) {
+      idLocationMap.insert({id, {indexPtr, locationOpt->second}});
+    }
+  }
+  return idLocationMap;
+}
+
+std::unordered_map<std::string, SqliteModelIndex *>
+SqliteModel::findEvictedIdList(const std::unordered_set<std::string> &idSet) {
+  std::unordered_map<std::string, SqliteModelIndex *> evictedIdMap;
+  for (auto &id : idSet) {
+    auto idNumOpt = idInterner->find(id);
+    auto handleOpt =
+        idNumOpt ? nodeTable->findEvicted(*idNumOpt) : std::optional<int>();
+    SqliteModelIndex *indexPtr =
+        handleOpt ? nodeTable->get(*handleOpt) : nullptr;
+    if (indexPtr && !indexPtr->isLoaded()) {
+      evictedIdMap.insert({id, indexPtr});
+    }
+  }
+  return evictedIdMap;
+}
+
+int SqliteModel::refreshIndex(
+    SqliteModelIndex *indexPtr,
+    const std::unordered_set<std::uint32_t> &updatedIdSet, int addedCount) {
+  QModelIndex parentModelIndex = getParentModelIndex(indexPtr);
+  // evicted indexes still know the ids of the rows the view counts
+  std::vector<std::uint32_t> oldIdList = indexPtr->isLoaded()
+                                             ? indexPtr->getRowIdNumList()
+                                             : indexPtr->getEvictedIdNumList();
+  int oldRowCount = static_cast<int>(oldIdList.size());
+  if (!indexPtr->isLoaded() && oldRowCount == 0) {
+    // never shown, the next use loads the current rows
+    if (indexPtr->getPendingTicket() != 0) {
+      // the running query may have read the rows before the change
+      postQuery(indexPtr, indexPtr->getLoadQuery(), false);
+    }
+    return 0;
+  }
+  // a pending query result would be stale
+  indexPtr->setPendingTicket(0);
+
+  // fetch the current rows, windowed indexes keep the size of their window
+  int limit = -1;
+  if (indexPtr->getFetchBlockSize() > 0) {
+    limit = std::max(indexPtr->getFetchBlockSize(), oldRowCount + addedCount);
+  }
+  SqliteRowBlock freshData;
+  int fetchedCount = indexPtr->fetchDataBackend(freshData, limit);
+  if (fetchedCount < 0) {
+    return fetchedCount;
+  }
+  bool fetchedAll = limit < 0 || fetchedCount < limit;
+  std::vector<std::uint32_t> newIdList = indexPtr->getRowIdNumList(freshData);
+  std::unordered_map<std::uint32_t, int> newRowMap;
+  for (int rowNum = 0; rowNum < static_cast<int>(newIdList.size()); rowNum++) {
+    newRowMap.insert({newIdList[rowNum], rowNum});
+  }
+
+  // remove rows that are gone, last to first in contiguous ranges
+  bool evictedFlag = !indexPtr->isLoaded();
+  for (int rowNum = static_cast<int>(oldIdList.size()) - 1; rowNum >= 0;
+       rowNum--) {
+    if (newRowMap.count(oldIdList[rowNum])) {
+      continue;
+    }
+    int rowLast = rowNum;
+    while (rowNum > 0 && !newRowMap.count(oldIdList[rowNum - 1])) {
+      rowNum--;
+    }
+    beginRemoveRows(parentModelIndex, rowNum, rowLast);
+    if (!evictedFlag) {
+      indexPtr->removeRows(rowNum, rowLast - rowNum + 1);
+    }
+    endRemoveRows();
+    for (int prunedNum = rowNum; prunedNum <= rowLast; prunedNum++) {
+      pruneIndex(indexPtr, oldIdList[prunedNum]);
+    }
+    oldIdList.erase(oldIdList.begin() + rowNum,
+                    oldIdList.begin() + rowLast + 1);
+  }
+
+  /* The kept rows of evicted data are filled from the fresh rows in their
+   * old order, the view already counts them
+   */
+  if (evictedFlag) {
+    SqliteRowBlock keptData(freshData.getColumnCount());
+    for (std::uint32_t idNum : oldIdList) {
+      keptData.insertRows(keptData.getRowCount(), freshData,
+                          newRowMap.at(idNum), 1);
+    }
+    indexPtr->replaceData(std::move(keptData), fetchedAll);
+  }
+
+  /* The remaining rows must keep their relative order for insertions to line
+   * up. If a sort key changed, move them into place with a layout change.
+   */
+  bool orderedFlag = true;
+  for (int rowNum = 1; rowNum < static_cast<int>(oldIdList.size()); rowNum++) {
+    if (newRowMap.at(oldIdList[rowNum - 1]) > newRowMap.at(oldIdList[rowNum])) {
+      orderedFlag = false;
+      break;
+    }
+  }
+  if (!orderedFlag) {
+    std::unordered_set<std::uint32_t> keptIdSet(oldIdList.begin(),
+                                                oldIdList.end());
+    SqliteRowBlock reorderedData(freshData.getColumnCount());
+    std::vector<std::uint32_t> reorderedIdList;
+    for (int rowNum = 0; rowNum < static_cast<int>(newIdList.size());
+         rowNum++) {
+      if (keptIdSet.count(newIdList[rowNum])) {
+        reorderedData.insertRows(reorderedData.getRowCount(), freshData,
+                                 rowNum, 1);
+        reorderedIdList.push_back(newIdList[rowNum]);
+      }
+    }
+    std::unordered_map<std::uint32_t, int> reorderedRowMap;
+    for (int rowNum = 0; rowNum < static_cast<int>(reorderedIdList.size());
+         rowNum++) {
+      reorderedRowMap.insert({reorderedIdList[rowNum], rowNum});
+    }
+
+    emit layoutAboutToBeChanged({QPersistentModelIndex(parentModelIndex)});
+    QModelIndexList fromList, toList;
+    for (const QModelIndex &persistentIndex : persistentIndexList()) {
+      if (persistentIndex.internalPointer() != indexPtr ||
+          persistentIndex.row() >= static_cast<int>(oldIdList.size())) {
+        continue;
+      }
+      fromList.append(persistentIndex);
+      toList.append(createIndex(
+          reorderedRowMap.at(oldIdList[persistentIndex.row()]),
+          persistentIndex.column(), indexPtr));
+    }
+    indexPtr->replaceData(std::move(reorderedData), fetchedAll);
+    changePersistentIndexList(fromList, toList);
+    emit layoutChanged({QPersistentModelIndex(parentModelIndex)});
+    oldIdList = reorderedIdList;
+  }
+
+  // insert new rows in contiguous ranges
+  std::size_t keptNum = 0;
+  for (int rowNum = 0; rowNum < static_cast<int>(newIdList.size()); rowNum++) {
+    if (keptNum < oldIdList.size() && newIdList[rowNum] == oldIdList[keptNum]) {
+      keptNum++;
+      continue;
+    }
+    int rowLast = rowNum;
+    while (rowLast + 1 < static_cast<int>(newIdList.size()) &&
+           !(keptNum < oldIdList.size() &&
+             newIdList[rowLast + 1] == oldIdList[keptNum])) {
+      rowLast++;
+    }
+    beginInsertRows(parentModelIndex, rowNum, rowLast);
+    indexPtr->insertRows(rowNum, freshData, rowNum, rowLast - rowNum + 1);
+    endInsertRows();
+    rowNum = rowLast;
+  }
+
+  // the cached rows now match the current rows, take the fresh values
+  indexPtr->replaceData(std::move(freshData), fetchedAll);
+  int columnLast = columnCount() - 1;
+  for (int rowNum = 0; rowNum < static_cast<int>(newIdList.size()); rowNum++) {
+    if (updatedIdSet.count(newIdList[rowNum])) {
+      emit dataChanged(createIndex(rowNum, 0, indexPtr),
+                       createIndex(rowNum, columnLast, indexPtr));
+    }
+  }
+  return 0;
+}
+
+int SqliteModel::setAsync(bool asyncFlag) {
+  if (queryWorker) {
+    cancelQueries(false);
+    queryWorker->close();
+    queryWorker.reset();
+    // the loading rows are replaced with the rows loaded synchronously
+    std::vector<SqliteModelIndex *> loadingIndexList;
+    for (auto &indexPair : indexRegistry) {
+      if (indexPair.second->hasLoadingRow()) {
+        loadingIndexList.push_back(indexPair.second);
+      }
+    }
+    for (SqliteModelIndex *indexPtr : loadingIndexList) {
+      loadIndexNow(indexPtr);
+    }
+  }
+  if (!asyncFlag) {
+    return 0;
+  }
+
+  // in-memory and temporary databases have no file name
+  const char *fileName = sqlite3_db_filename(database.get(), "main");
+  if (!fileName || fileName[0] == '\0') {
+    return -1;
+  }
+  std::shared_ptr<SqliteQueryWorker> queryWorkerNew =
+      std::make_shared<SqliteQueryWorker>();
+  int rc = queryWorkerNew->open(
+      fileName, snapshot ? snapshot->getConnectionSQL() : std::string());
+  if (rc != 0) {
+    return rc;
+  }
+  queryWorker = queryWorkerNew;
+  return 0;
+}
+
+int SqliteModel::postQuery(SqliteModelIndex *indexPtr,
+                           SqliteModelIndexQuery query,
+                           bool appendFlag) const {
+  // the worker connection only sees committed edits
+  writeBack();
+  std::uint64_t ticket = ++queryTicket;
+  indexPtr->setPendingTicket(ticket);
+
+  /* QAbstractItemModel overrided methods are const, the result is applied
+   * later on the GUI thread
+   */
+  SqliteModel *modelPtr = const_cast<SqliteModel *>(this);
+  std::shared_ptr<SqliteModelIndexQuery> queryPtr =
+      std::make_shared<SqliteModelIndexQuery>(std::move(query));
+  std::shared_ptr<SqliteInstrumentation> instrumentationPtr = instrumentation;
+  SqliteInstrumentation::Query expandQuery =
+      indexPtr->isWarm() ? SqliteInstrumentation::Query::ExpandWarm
+                         : SqliteInstrumentation::Query::ExpandCold;
+  int rc = queryWorker->post([modelPtr, queryPtr, ticket, appendFlag,
+                              instrumentationPtr,
+                              expandQuery](SqliteStatementCache &cache) {
+    std::shared_ptr<SqliteRowBlock> rowDataPtr =
+        std::make_shared<SqliteRowBlock>();
+    int fetchedCount = -1;
+    {
+      SqliteInstrumentation::Timer timer(
+          instrumentationPtr.get(),
+          appendFlag ? SqliteInstrumentation::Query::FetchMore
+                     : SqliteInstrumentation::Query::DataLoad);
+      SqliteInstrumentation::Timer expandTimer(
+          appendFlag ? nullptr : instrumentationPtr.get(), expandQuery);
+      std::shared_ptr<sqlite3_stmt> stmt;
+      if (queryPtr->setup(cache) == 0) {
+        stmt = cache.get(queryPtr->sql, [&]() { return queryPtr->sql; });
+      }
+      if (stmt) {
+        fetchedCount = queryPtr->run(stmt.get(), *rowDataPtr);
+      }
+      timer.setResult(fetchedCount);
+      expandTimer.setResult(fetchedCount);
+    }
+    QMetaObject::invokeMethod(
+        modelPtr,
+        [modelPtr, queryPtr, ticket, appendFlag, fetchedCount, rowDataPtr]() {
+          modelPtr->commitQuery(queryPtr, ticket, appendFlag, fetchedCount,
+                                rowDataPtr);
+        },
+        Qt::QueuedConnection);
+  });
+  if (rc != 0) {
+    indexPtr->setPendingTicket(0);
+  }
+  return rc;
+}
+
+void SqliteModel::commitQuery(std::shared_ptr<SqliteModelIndexQuery> queryPtr,
+                              std::uint64_t ticket, bool appendFlag,
+                              int fetchedCount,
+                              std::shared_ptr<SqliteRowBlock> rowDataPtr) {
+  // the index was removed or a newer query replaced this one
+  auto idNumOpt = idInterner->find(queryPtr->parentId);
+  auto findIt = idNumOpt ? indexRegistry.find(*idNumOpt) : indexRegistry.end();
+  if (findIt == indexRegistry.end() ||
+      findIt->second->getPendingTicket() != ticket) {
+    return;
+  }
+  SqliteModelIndex *indexPtr = findIt->second;
+  indexPtr->setPendingTicket(0);
+
+  if (fetchedCount < 0) {
+    rowDataPtr->clear();
+  }
+  bool fetchedAll = fetchedCount < 0 || queryPtr->limit < 0 ||
+                    fetchedCount < queryPtr->limit;
+  if (!appendFlag) {
+    commitLoad(indexPtr, std::move(*rowDataPtr), fetchedAll);
+    return;
+  }
+
+  // the data was evicted since the fetch was posted
+  if (!indexPtr->isLoaded()) {
+    return;
+  }
+  int rowBegin = indexPtr->getRowCount();
+  int rowCount = rowDataPtr->getRowCount();
+  if (rowCount == 0) {
+    indexPtr->appendData(std::move(*rowDataPtr), fetchedAll);
+    return;
+  }
+  beginInsertRows(getParentModelIndex(indexPtr), rowBegin,
+                  rowBegin + rowCount - 1);
+  indexPtr->appendData(std::move(*rowDataPtr), fetchedAll);
+  endInsertRows();
+}
+
+void SqliteModel::commitLoad(SqliteModelIndex *indexPtr,
+                             SqliteRowBlock &&rowData, bool fetchedAll) {
+  QModelIndex parentModelIndex = getParentModelIndex(indexPtr);
+  if (indexPtr->isLoaded()) {
+    QList<QPersistentModelIndex> parentList;
+    if (parentModelIndex.isValid()) {
+      parentList.append(QPersistentModelIndex(parentModelIndex));
+    }
+    std::vector<std::uint32_t> oldIdList = indexPtr->getRowIdNumList();
+    std::vector<std::uint32_t> newIdList = indexPtr->getRowIdNumList(rowData);
+    std::unordered_map<std::uint32_t, int> newRowMap;
+    for (int rowNum = 0; rowNum < static_cast<int>(newIdList.size());
+         rowNum++) {
+      newRowMap.insert({newIdList[rowNum], rowNum});
+    }
+
+    emit layoutAboutToBeChanged(parentList);
+    QModelIndexList fromList, toList;
+    for (const QModelIndex &persistentIndex : persistentIndexList()) {
+      if (persistentIndex.internalPointer() != indexPtr ||
+          persistentIndex.row() >= static_cast<int>(oldIdList.size())) {
+        continue;
+      }
+      auto findIt = newRowMap.find(oldIdList[persistentIndex.row()]);
+      fromList.append(persistentIndex);
+      toList.append(findIt == newRowMap.end()
+                        ? QModelIndex()
+                        : createIndex(findIt->second, persistentIndex.column(),
+                                      indexPtr));
+    }
+    indexPtr->replaceData(std::move(rowData), fetchedAll);
+    changePersistentIndexList(fromList, toList);
+    emit layoutChanged(parentList);
+    return;
+  }
+
+  // first load, the loading row is replaced by the rows
+  if (indexPtr->hasLoadingRow()) {
+    beginRemoveRows(parentModelIndex, 0, 0);
+    indexPtr->setLoadingRow(false);
+    indexPtr->replaceData(SqliteRowBlock(rowData.getColumnCount()), true);
+    endRemoveRows();
+  }
+  int rowCount = rowData.getRowCount();
+  if (rowCount == 0) {
+    indexPtr->replaceData(std::move(rowData), fetchedAll);
+    return;
+  }
+  beginInsertRows(parentModelIndex, 0, rowCount - 1);
+  indexPtr->replaceData(std::move(rowData), fetchedAll);
+  endInsertRows();
+}
+
+int SqliteModel::cancelQueries(bool repostFlag) {
+  if (!queryWorker) {
+    return 0;
+  }
+  queryWorker->cancel();
+  std::vector<SqliteModelIndex *> loadingIndexList;
+  for (auto &indexPair : indexRegistry) {
+    SqliteModelIndex *indexPtr = indexPair.second;
+    if (indexPtr->getPendingTicket() == 0) {
+      continue;
+    }
+    indexPtr->setPendingTicket(0);
+    if (!indexPtr->isLoaded()) {
+      loadingIndexList.push_back(indexPtr);
+    }
+  }
+  // fetch more queries are not reposted, the view asks again on scroll
+  if (repostFlag) {
+    for (SqliteModelIndex *indexPtr : loadingIndexList) {
+      postQuery(indexPtr, indexPtr->getLoadQuery(), false);
+    }
+  }
+  return 0;
+}
+
+void SqliteModel::loadIndexNow(SqliteModelIndex *indexPtr) {
+  if (indexPtr->isLoaded()) {
+    return;
+  }
+  indexPtr->setPendingTicket(0);
+  if (!indexPtr->hasLoadingRow()) {
+    indexPtr->getDataBackend();
+    return;
+  }
+  int limit =
+      indexPtr->getFetchBlockSize() > 0 ? indexPtr->getFetchBlockSize() : -1;
+  SqliteRowBlock rowData;
+  int rc = indexPtr->fetchDataBackend(rowData, limit);
+  commitLoad(indexPtr, std::move(rowData), rc < 0 || limit < 0 || rc < limit);
+}
+
+int SqliteModel::setPrefetchThreadCount(int threadCount) {
+  prefetchThreadCount = threadCount < 0 ? 0 : threadCount;
+  cancelPrefetch();
+  if (queryPool) {
+    queryPool->close();
+    queryPool.reset();
+  }
+  return 0;
+}
+
+int SqliteModel::setSnapshotMode(bool snapshotFlag,
+                                 SqliteSnapshot::Settings settings) {
+  int rc = 0;
+  if (snapshotFlag) {
+    // a snapshot refuses writes, the buffered edits and indexes go first
+    rc = commit();
+    if (rc != 0) {
+      return rc;
+    }
+    indexAdvisor.reset();
+    /* An active snapshot restores the original pragmas first, else the new
+     * one would record the snapshot pragmas as the ones to restore
+     */
+    snapshot.reset();
+    auto parentIdColumnIt = columnMap->left.find("parentId");
+    std::shared_ptr<SqliteSnapshot> snapshotNew =
+        std::make_shared<SqliteSnapshot>(
+            database, tableName,
+            parentIdColumnIt != columnMap->left.end()
+                ? parentIdColumnIt->second
+                : "parentId");
+    // the other connections are opened again even if the snapshot failed
+    rc = snapshotNew->open(settings);
+    if (rc == 0) {
+      snapshot = snapshotNew;
+      // the warm up returns the number of rows read
+      if (settings.warmFlag) {
+        rc = std::min(snapshot->warm(instrumentation.get()), 0);
+      }
+    }
+  } else if (snapshot) {
+    // the destructor restores the pragmas
+    snapshot.reset();
+  } else {
+    return 0;
+  }
+
+  // the other connections are opened again with the new pragmas
+  if (queryWorker) {
+    setAsync(true);
+  }
+  setPrefetchThreadCount(prefetchThreadCount);
+  return rc;
+}
+
+bool SqliteModel::isSnapshotMode() const { return static_cast<bool>(snapshot); }
+
+int SqliteModel::prefetch(const QModelIndex &parent, int depth,
+                          std::function<void()> callback) {
+  cancelPrefetch();
+  int rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+
+  // the index holding the children of parent
+  SqliteModelIndex *indexPtr = rootIndex.get();
+  if (parent.isValid() && parent.internalPointer()) {
+    SqliteModelIndex *parentIndexPtr =
+        loadIndex(static_cast<SqliteModelIndex *>(parent.internalPointer()));
+    auto rowIdOpt = parentIndexPtr->getRowIdNum(parent.row());
+    if (!rowIdOpt) {
+      return -1;
+    }
+    indexPtr = createChildIndex(parentIndexPtr, parent.row(), *rowIdOpt);
+  }
+  if (depth == 0) {
+    return 0;
+  }
+
+  // in-memory and temporary databases have no file name
+  if (!queryPool && prefetchThreadCount > 0) {
+    const char *fileName = sqlite3_db_filename(database.get(), "main");
+    if (fileName && fileName[0] != '\0') {
+      std::shared_ptr<SqliteQueryPool> queryPoolNew =
+          std::make_shared<SqliteQueryPool>();
+      if (queryPoolNew->open(fileName, prefetchThreadCount,
+                             snapshot ? snapshot->getConnectionSQL()
+                                      : std::string()) == 0) {
+        queryPool = queryPoolNew;
+      }
+    }
+  }
+  if (!queryPool) {
+    int rc = prefetchSerial(indexPtr, depth);
+    if (callback) {
+      callback();
+    }
+    return rc;
+  }
+
+  std::shared_ptr<PrefetchState> statePtr = std::make_shared<PrefetchState>();
+  statePtr->modelPtr = this;
+  statePtr->queryPool = queryPool.get();
+  statePtr->instrumentation = instrumentation;
+  // any parent id other than "*" gives the query of a child row
+  statePtr->childQuery = indexPtr->getLoadQuery(std::string());
+  statePtr->idColumnNum = indexPtr->getIdColumnNum();
+  statePtr->depth = depth;
+  statePtr->callback = callback;
+  statePtr->outstandingCount = 1;
+  prefetchState = statePtr;
+
+  SqliteModelIndexQuery query = indexPtr->getLoadQuery();
+  std::string containerId =
+      indexPtr->getParent() ? indexPtr->getParent()->getParentId() : "";
+  rc = queryPool->post(
+      [statePtr, query, containerId](SqliteStatementCache &statementCache,
+                                     int workerNum) {
+        prefetchBackend(statePtr, query, containerId, 0, statementCache,
+                        workerNum);
+      });
+  if (rc != 0) {
+    prefetchState.reset();
+  }
+  return rc;
+}
+
+void SqliteModel::prefetchBackend(std::shared_ptr<PrefetchState> statePtr,
+                                  SqliteModelIndexQuery query,
+                                  std::string containerId, int depth,
+                                  SqliteStatementCache &statementCache,
+                                  int workerNum) {
+  if (!statePtr->cancelFlag) {
+    PrefetchResult result;
+    result.parentId = query.parentId;
+    result.containerId = containerId;
+    result.depth = depth;
+    int fetchedCount = -1;
+    {
+      SqliteInstrumentation::Timer timer(
+          statePtr->instrumentation.get(),
+          SqliteInstrumentation::Query::DataLoad);
+      std::shared_ptr<sqlite3_stmt> stmt;
+      if (query.setup(statementCache) == 0) {
+        stmt = statementCache.get(query.sql, [&]() { return query.sql; });
+      }
+      if (stmt) {
+        fetchedCount = query.run(stmt.get(), result.rowData);
+      }
+      timer.setResult(fetchedCount);
+    }
+
+    /* Queue the rows on this thread before this job counts as finished.
+     * Idle threads steal the oldest queued rows, which are the largest
+     * subtrees left.
+     */
+    if (fetchedCount > 0 &&
+        (statePtr->depth < 0 || depth + 1 < statePtr->depth)) {
+      for (int rowNum = 0; rowNum < result.rowData.getRowCount(); rowNum++) {
+        if (result.rowData.isNull(rowNum, statePtr->idColumnNum)) {
+          continue;
+        }
+        SqliteModelIndexQuery childQuery = statePtr->childQuery;
+        childQuery.parentId =
+            result.rowData.getString(rowNum, statePtr->idColumnNum);
+        std::string childContainerId = query.parentId;
+        statePtr->outstandingCount++;
+        int rc = statePtr->queryPool->post(
+            [statePtr, childQuery, childContainerId,
+             depth](SqliteStatementCache &statementCache_, int workerNum_) {
+              prefetchBackend(statePtr, childQuery, childContainerId,
+                              depth + 1, statementCache_, workerNum_);
+            },
+            workerNum);
+        if (rc != 0) {
+          statePtr->outstandingCount--;
+        }
+      }
+    }
+
+    // rows without children are not kept, except for the prefetched row
+    if (fetchedCount > 0 || (fetchedCount == 0 && depth == 0)) {
+      result.fetchedAll = query.limit < 0 || fetchedCount < query.limit;
+      std::lock_guard<std::mutex> lock(statePtr->resultMutex);
+      statePtr->resultList.push_back(std::move(result));
+    }
+  }
+
+  if (--statePtr->outstandingCount == 0 && !statePtr->cancelFlag) {
+    SqliteModel *modelPtr = statePtr->modelPtr;
+    QMetaObject::invokeMethod(
+        modelPtr, [modelPtr, statePtr]() { modelPtr->commitPrefetch(statePtr); },
+        Qt::QueuedConnection);
+  }
+}
+
+void SqliteModel::commitPrefetch(std::shared_ptr<PrefetchState> statePtr) {
+  // a newer prefetch or a sort replaced this one
+  if (statePtr != prefetchState) {
+    return;
+  }
+  prefetchState.reset();
+
+  // parents before children so every container exists when it is needed
+  std::vector<PrefetchResult> &resultList = statePtr->resultList;
+  std::stable_sort(resultList.begin(), resultList.end(),
+                   [](const PrefetchResult &a, const PrefetchResult &b) {
+                     return a.depth < b.depth;
+                   });
+  for (PrefetchResult &result : resultList) {
+    // the row was cached by its container, so its id is interned
+    auto idNumOpt = idInterner->find(result.parentId);
+    if (!idNumOpt) {
+      continue;
+    }
+    SqliteModelIndex *indexPtr = nullptr;
+    auto findIt = indexRegistry.find(*idNumOpt);
+    if (findIt != indexRegistry.end()) {
+      indexPtr = findIt->second;
+    } else {
+      // the row is found where its container cached it
+      auto locationOpt = nodeTable->find(*idNumOpt);
+      SqliteModelIndex *containerPtr =
+          locationOpt ? nodeTable->get(locationOpt->first) : nullptr;
+      if (!containerPtr || !containerPtr->isLoaded() ||
+          containerPtr->getParentId() != result.containerId) {
+        continue;
+      }
+      indexPtr = createChildIndex(containerPtr, locationOpt->second, *idNumOpt);
+    }
+
+    /* Loaded rows are kept. The view already knows the row count of evicted
+     * data, it is reloaded synchronously when needed.
+     */
+    if (indexPtr->isLoaded() || indexPtr->getEvictedRowCount() > 0) {
+      continue;
+    }
+    indexPtr->setPendingTicket(0);
+    if (indexPtr->hasLoadingRow()) {
+      commitLoad(indexPtr, std::move(result.rowData), result.fetchedAll);
+    } else {
+      indexPtr->replaceData(std::move(result.rowData), result.fetchedAll);
+    }
+  }
+
+  if (statePtr->callback) {
+    statePtr->callback();
+  }
+}
+
+int SqliteModel::prefetchSerial(SqliteModelIndex *indexPtr, int depth) {
+  std::deque<std::pair<SqliteModelIndex *, int>> indexQueue;
+  indexQueue.emplace_back(indexPtr, 0);
+  while (!indexQueue.empty()) {
+    SqliteModelIndex *currentIndexPtr = indexQueue.front().first;
+    int currentDepth = indexQueue.front().second;
+    indexQueue.pop_front();
+    if (currentIndexPtr->isLoaded()) {
+      indexLru->touch(currentIndexPtr);
+    } else {
+      loadIndexNow(currentIndexPtr);
+    }
+    if (depth >= 0 && currentDepth + 1 >= depth) {
+      continue;
+    }
+
+    // the child count cache skips rows without children
+    std::vector<std::uint32_t> rowIdList = currentIndexPtr->getRowIdNumList();
+    for (int rowNum = 0; rowNum < static_cast<int>(rowIdList.size());
+         rowNum++) {
+      if (currentIndexPtr->getChildCount(rowNum) > 0) {
+        indexQueue.emplace_back(
+            createChildIndex(currentIndexPtr, rowNum, rowIdList[rowNum]),
+            currentDepth + 1);
+      }
+    }
+  }
+  return 0;
+}
+
+int SqliteModel::cancelPrefetch() {
+  if (!prefetchState) {
+    return 0;
+  }
+  prefetchState->cancelFlag = true;
+  prefetchState.reset();
+  if (queryPool) {
+    queryPool->cancel();
+  }
+  return 0;
+}
+
+int SqliteModel::setWriteBackDelay(int delayMsec) {
+  if (delayMsec < -1) {
+    return -1;
+  }
+  writeBackDelay = delayMsec;
+  writeBackTimer->stop();
+  if (writeBackDelay >= 0 &&
+      (!writeBuffer->empty() || !writtenIdList.empty())) {
+    writeBackTimer->start(writeBackDelay);
+  }
+  return 0;
+}
+
+int SqliteModel::commit() {
+  writeBackTimer->stop();
+  int rc = writeBack();
+  if (!writtenIdList.empty()) {
+    std::vector<std::string> updatedIdList;
+    updatedIdList.swap(writtenIdList);
+    updateSignal(std::vector<std::string>(), updatedIdList,
+                 std::vector<std::string>());
+  }
+  return rc;
+}
+
+std::size_t SqliteModel::getPendingWriteCount() const {
+  return writeBuffer->size();
+}
+
+int SqliteModel::writeBack() const {
+  if (writeBuffer->empty()) {
+    return 0;
+  }
+  // the edits are signaled by commit(), not captured again
+  SqliteChangeCapture::IgnoreScope ignoreScope(changeCapture.get());
+  std::vector<SqliteWriteBuffer::Rejected> rejectedList;
+  int rc = writeBuffer->flush(writtenIdList, rejectedList);
+  if (rc != 0) {
+    writeErrorSignal(std::string(), std::string(),
+                     writeBuffer->getErrorMessage());
+  }
+  /* writeBack() runs inside const QAbstractItemModel methods, the refused
+   * cells are reverted later on the GUI thread
+   */
+  if (!rejectedList.empty()) {
+    SqliteModel *modelPtr = const_cast<SqliteModel *>(this);
+    QMetaObject::invokeMethod(
+        modelPtr,
+        [modelPtr, rejectedList]() {
+          modelPtr->revertRejectedEdits(rejectedList);
+        },
+        Qt::QueuedConnection);
+  }
+  // the update signal is sent by commit() from the event loop
+  if (rc == 0 && writeBackDelay >= 0 && !writeBackTimer->isActive()) {
+    writeBackTimer->start(0);
+  }
+  return rc;
+}
+
+void SqliteModel::revertRejectedEdits(
+    std::vector<SqliteWriteBuffer::Rejected> rejectedList) {
+  std::vector<std::string> rejectedIdList;
+  std::unordered_set<std::string> rejectedIdSet;
+  for (auto &rejected : rejectedList) {
+    if (rejectedIdSet.insert(rejected.id).second) {
+      rejectedIdList.push_back(rejected.id);
+    }
+  }
+  updateIdHint(std::vector<std::string>(), rejectedIdList,
+               std::vector<std::string>());
+  // report the code column name the edit was made with
+  for (auto &rejected : rejectedList) {
+    auto findIt = columnMap->right.find(rejected.columnName);
+    writeErrorSignal(rejected.id,
+                     findIt != columnMap->right.end() ? findIt->second
+                                                      : rejected.columnName,
+                     rejected.message);
+  }
+}
+
+int SqliteModel::moveIdList(std::vector<std::string> idList,
+                            std::string parentId) {
+  if (flatTree || snapshot) {
+    return -1;
+  }
+  int rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+  // a row can not be moved below itself
+  std::unordered_set<std::string> ancestorIdSet =
+      treeEditor->getAncestorIdSet(parentId);
+  for (auto &id : idList) {
+    if (ancestorIdSet.count(id)) {
+      return -1;
+    }
+  }
+
+  // the old parents of the cached rows lose children
+  std::unordered_set<std::string> countParentIdSet{parentId};
+  std::vector<std::uint32_t> movedIdNumList;
+  std::unordered_map<std::string, std::pair<SqliteModelIndex *, int>>
+      cachedIdMap =
+          findIdList(std::unordered_set<std::string>(idList.begin(),
+                                                     idList.end()));
+  for (auto &cachedPair : cachedIdMap) {
+    countParentIdSet.insert(cachedPair.second.first->getParentId());
+    movedIdNumList.push_back(*idInterner->find(cachedPair.first));
+  }
+  // evicted old parents are refreshed to remove the rows the view counts
+  std::unordered_set<std::string> evictedParentIdSet;
+  for (auto &evictedPair :
+       findEvictedIdList(std::unordered_set<std::string>(idList.begin(),
+                                                         idList.end()))) {
+    if (evictedPair.second->getParentId() != parentId) {
+      evictedParentIdSet.insert(evictedPair.second->getParentId());
+      countParentIdSet.insert(evictedPair.second->getParentId());
+    }
+  }
+
+  {
+    SqliteChangeCapture::IgnoreScope ignoreScope(changeCapture.get());
+    rc = treeEditor->moveRows(idList, parentId);
+  }
+  if (rc != 0) {
+    return rc;
+  }
+  if (filter->isTreeMode()) {
+    filter->refresh();
+  }
+  rc = commitMove(movedIdNumList, parentId, static_cast<int>(idList.size()));
+  for (auto &evictedParentId : evictedParentIdSet) {
+    // the index may have been pruned or reloaded by the move
+    auto idNumOpt = idInterner->find(evictedParentId);
+    auto findIt =
+        idNumOpt ? indexRegistry.find(*idNumOpt) : indexRegistry.end();
+    if (findIt != indexRegistry.end() && !findIt->second->isLoaded()) {
+      int rcRefresh = refreshIndex(
+          findIt->second, std::unordered_set<std::uint32_t>(), 0);
+      rc = rc == 0 ? rcRefresh : rc;
+    }
+  }
+  invalidateChildCount(countParentIdSet);
+  updateSignal(std::vector<std::string>(), idList,
+               std::vector<std::string>());
+  return rc;
+}
+
+int SqliteModel::commitMove(const std::vector<std::uint32_t> &movedIdNumList,
+                            const std::string &parentId, int addedCount) {
+  SqliteModelIndex *destIndexPtr = nullptr;
+  auto parentIdNumOpt = idInterner->find(parentId);
+  auto findIt = parentIdNumOpt ? indexRegistry.find(*parentIdNumOpt)
+                               : indexRegistry.end();
+  if (findIt != indexRegistry.end()) {
+    destIndexPtr = findIt->second;
+  }
+
+  /* A loaded destination is patched in place. Its cached rows must still be
+   * in the fresh rows in the same order for the moved rows to be placed
+   * between them, otherwise it is refreshed.
+   */
+  bool patchFlag = destIndexPtr && destIndexPtr->isLoaded();
+  SqliteRowBlock freshData;
+  std::vector<std::uint32_t> oldIdList, newIdList;
+  bool fetchedAll = true;
+  if (patchFlag) {
+    oldIdList = destIndexPtr->getRowIdNumList();
+    int limit = -1;
+    if (destIndexPtr->getFetchBlockSize() > 0) {
+      limit = std::max(destIndexPtr->getFetchBlockSize(),
+                       static_cast<int>(oldIdList.size()) + addedCount);
+    }
+    int fetchedCount = destIndexPtr->fetchDataBackend(freshData, limit);
+    fetchedAll = limit < 0 || fetchedCount < limit;
+    newIdList = destIndexPtr->getRowIdNumList(freshData);
+    std::size_t keptNum = 0;
+    for (std::size_t rowNum = 0;
+         rowNum < newIdList.size() && keptNum < oldIdList.size(); rowNum++) {
+      if (newIdList[rowNum] == oldIdList[keptNum]) {
+        keptNum++;
+      }
+    }
+    patchFlag = fetchedCount >= 0 && keptNum == oldIdList.size();
+  }
+
+  if (patchFlag) {
+    destIndexPtr->setPendingTicket(0);
+    QModelIndex destModelIndex = getParentModelIndex(destIndexPtr);
+    std::size_t keptNum = 0;
+    for (int rowNum = 0; rowNum < static_cast<int>(newIdList.size());
+         rowNum++) {
+      if (keptNum < oldIdList.size() &&
+          newIdList[rowNum] == oldIdList[keptNum]) {
+        keptNum++;
+        continue;
+      }
+      auto isKept = [&](int nextNum) {
+        return keptNum < oldIdList.size() &&
+               newIdList[nextNum] == oldIdList[keptNum];
+      };
+      auto locationOpt = nodeTable->find(newIdList[rowNum]);
+      SqliteModelIndex *srcIndexPtr =
+          locationOpt ? nodeTable->get(locationOpt->first) : nullptr;
+      int rowLast = rowNum;
+
+      // rows not cached anywhere are inserted
+      if (!srcIndexPtr || !srcIndexPtr->isLoaded()) {
+        while (rowLast + 1 < static_cast<int>(newIdList.size()) &&
+               !isKept(rowLast + 1) &&
+               !nodeTable->find(newIdList[rowLast + 1])) {
+          rowLast++;
+        }
+        beginInsertRows(destModelIndex, rowNum, rowLast);
+        destIndexPtr->insertRows(rowNum, freshData, rowNum,
+                                 rowLast - rowNum + 1);
+        endInsertRows();
+        rowNum = rowLast;
+        continue;
+      }
+
+      // rows cached next to each other in one index move together
+      int srcRowNum = locationOpt->second;
+      while (rowLast + 1 < static_cast<int>(newIdList.size()) &&
+             !isKept(rowLast + 1)) {
+        auto nextOpt = nodeTable->find(newIdList[rowLast + 1]);
+        if (!nextOpt || nextOpt->first != locationOpt->first ||
+            nextOpt->second != srcRowNum + rowLast + 1 - rowNum) {
+          break;
+        }
+        rowLast++;
+      }
+      int count = rowLast - rowNum + 1;
+      QModelIndex srcModelIndex = getParentModelIndex(srcIndexPtr);
+      bool moveFlag =
+          beginMoveRows(srcModelIndex, srcRowNum, srcRowNum + count - 1,
+                        destModelIndex, rowNum);
+      if (!moveFlag) {
+        beginRemoveRows(srcModelIndex, srcRowNum, srcRowNum + count - 1);
+      }
+      // the cached subtrees move with their rows
+      for (int movedNum = rowNum; movedNum <= rowLast; movedNum++) {
+        std::shared_ptr<SqliteModelIndex> childIndexPtr =
+            srcIndexPtr->removeIndex(newIdList[movedNum]);
+        if (childIndexPtr) {
+          childIndexPtr->setParent(destIndexPtr);
+          destIndexPtr->insertIndex(newIdList[movedNum], childIndexPtr);
+        }
+      }
+      srcIndexPtr->removeRows(srcRowNum, count);
+      if (!moveFlag) {
+        endRemoveRows();
+        beginInsertRows(destModelIndex, rowNum, rowLast);
+      }
+      destIndexPtr->insertRows(rowNum, freshData, rowNum, count);
+      if (moveFlag) {
+        endMoveRows();
+      } else {
+        endInsertRows();
+      }
+      rowNum = rowLast;
+    }
+    // the cached rows now match the fresh rows
+    destIndexPtr->replaceData(std::move(freshData), fetchedAll);
+  }
+
+  /* Moved rows still cached at their old parent are not shown by the
+   * destination, they are removed last to first in contiguous ranges
+   */
+  std::unordered_map<SqliteModelIndex *, std::vector<int>> leftRowMap;
+  for (std::uint32_t idNum : movedIdNumList) {
+    auto locationOpt = nodeTable->find(idNum);
+    SqliteModelIndex *srcIndexPtr =
+        locationOpt ? nodeTable->get(locationOpt->first) : nullptr;
+    if (srcIndexPtr && srcIndexPtr != destIndexPtr &&
+        srcIndexPtr->isLoaded()) {
+      leftRowMap[srcIndexPtr].push_back(locationOpt->second);
+    }
+  }
+  for (auto &leftPair : leftRowMap) {
+    SqliteModelIndex *srcIndexPtr = leftPair.first;
+    std::vector<int> &rowList = leftPair.second;
+    std::sort(rowList.begin(), rowList.end());
+    QModelIndex srcModelIndex = getParentModelIndex(srcIndexPtr);
+    for (int listNum = static_cast<int>(rowList.size()) - 1; listNum >= 0;
+         listNum--) {
+      int rowLast = rowList[listNum];
+      while (listNum > 0 && rowList[listNum - 1] == rowList[listNum] - 1) {
+        listNum--;
+      }
+      int rowNum = rowList[listNum];
+      std::vector<std::uint32_t> prunedIdList(
+          srcIndexPtr->getRowIdNumList().begin() + rowNum,
+          srcIndexPtr->getRowIdNumList().begin() + rowLast + 1);
+      beginRemoveRows(srcModelIndex, rowNum, rowLast);
+      srcIndexPtr->removeRows(rowNum, rowLast - rowNum + 1);
+      endRemoveRows();
+      for (std::uint32_t prunedIdNum : prunedIdList) {
+        pruneIndex(srcIndexPtr, prunedIdNum);
+      }
+    }
+  }
+
+  if (destIndexPtr && !patchFlag) {
+    return refreshIndex(destIndexPtr, std::unordered_set<std::uint32_t>(),
+                        addedCount);
+  }
+  return 0;
+}
+
+int SqliteModel::copyIdList(std::vector<std::string> idList,
+                            std::string parentId,
+                            std::vector<std::string> &newIdList) {
+  if (flatTree || snapshot) {
+    return -1;
+  }
+  int rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+  std::vector<std::string> copyIdList;
+  {
+    SqliteChangeCapture::IgnoreScope ignoreScope(changeCapture.get());
+    rc = treeEditor->copyRows(idList, parentId, copyIdList);
+  }
+  if (rc != 0) {
+    return rc;
+  }
+  if (filter->isTreeMode()) {
+    filter->refresh();
+  }
+
+  // only the destination gains rows, the copied subtrees are not loaded
+  auto parentIdNumOpt = idInterner->find(parentId);
+  auto findIt = parentIdNumOpt ? indexRegistry.find(*parentIdNumOpt)
+                               : indexRegistry.end();
+  if (findIt != indexRegistry.end()) {
+    rc = refreshIndex(findIt->second, std::unordered_set<std::uint32_t>(),
+                      static_cast<int>(idList.size()));
+  }
+  invalidateChildCount(std::unordered_set<std::string>{parentId});
+  newIdList.insert(newIdList.end(), copyIdList.begin(), copyIdList.end());
+  updateSignal(copyIdList, std::vector<std::string>(),
+               std::vector<std::string>());
+  return rc;
+}
+
+int SqliteModel::exportSelection(const QItemSelection &selection,
+                                 SqliteRowWriter::Format format,
+                                 bool headerFlag, SqliteRowWriter::Sink sink,
+                                 std::vector<int> columnList) {
+  int rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+  int columnCountNum = columnCount();
+  if (columnList.empty()) {
+    columnList.resize(columnCountNum);
+    std::iota(columnList.begin(), columnList.end(), 0);
+  }
+  columnList.erase(std::remove_if(columnList.begin(), columnList.end(),
+                                  [columnCountNum](int columnNum) {
+                                    return columnNum < 0 ||
+                                           columnNum >= columnCountNum;
+                                  }),
+                   columnList.end());
+  SqliteRowWriter writer(format, sink);
+  if (headerFlag) {
+    std::vector<std::string> nameList;
+    for (int columnNum : columnList) {
+      nameList.push_back(
+          headerData(columnNum, Qt::Horizontal).toString().toStdString());
+    }
+    writer.writeHeader(nameList);
+  }
+
+  // flat rows are all children of the root
+  int exportCount = 0;
+  if (flatTree) {
+    std::vector<std::pair<int, int>> rangeList;
+    for (const QItemSelectionRange &range : selection) {
+      if (range.isValid() && !range.parent().isValid()) {
+        rangeList.push_back({range.top(), range.bottom()});
+      }
+    }
+    mergeRowRangeList(rangeList);
+    for (auto &range : rangeList) {
+      writer.writeRows(flatTree->getRowData(), range.first, range.second + 1,
+                       columnList);
+      exportCount += range.second - range.first + 1;
+    }
+    writer.finish();
+    return exportCount;
+  }
+
+  // the selected rows of every index
+  std::unordered_map<SqliteModelIndex *, std::vector<std::pair<int, int>>>
+      rangeMap;
+  for (const QItemSelectionRange &range : selection) {
+    if (!range.isValid()) {
+      continue;
+    }
+    SqliteModelIndex *indexPtr = rootIndex.get();
+    QModelIndex parentModelIndex = range.parent();
+    if (parentModelIndex.isValid()) {
+      SqliteModelIndex *containerPtr =
+          static_cast<SqliteModelIndex *>(parentModelIndex.internalPointer());
+      indexPtr =
+          containerPtr ? containerPtr->getChildAt(parentModelIndex.row())
+                       : nullptr;
+    }
+    if (indexPtr) {
+      rangeMap[indexPtr].push_back({range.top(), range.bottom()});
+    }
+  }
+
+  /* The view shows the rows in pre-order. The selected rows of an index are
+   * cut into segments after every row holding selected descendants, and the
+   * segments are sorted by the row path from the view root to their first
+   * row.
+   */
+  struct ExportSegment {
+    std::vector<int> rowPath;
+    SqliteModelIndex *indexPtr;
+    int rowBegin, rowEnd;
+  };
+  std::unordered_map<SqliteModelIndex *, std::vector<int>> pathMap;
+  std::unordered_map<SqliteModelIndex *, std::set<int>> splitMap;
+  for (auto &rangePair : rangeMap) {
+    std::vector<int> rowPath;
+    SqliteModelIndex *indexPtr = rangePair.first;
+    while (indexPtr && indexPtr != rootIndex.get()) {
+      rowPath.push_back(indexPtr->getRowNum());
+      SqliteModelIndex *parentIndexPtr = indexPtr->getParent();
+      if (parentIndexPtr && rangeMap.count(parentIndexPtr)) {
+        splitMap[parentIndexPtr].insert(indexPtr->getRowNum());
+      }
+      indexPtr = parentIndexPtr;
+    }
+    // an index pruned from the tree is not shown
+    if (indexPtr) {
+      std::reverse(rowPath.begin(), rowPath.end());
+      pathMap.insert({rangePair.first, rowPath});
+    }
+  }
+  std::vector<ExportSegment> segmentList;
+  for (auto &pathPair : pathMap) {
+    std::vector<std::pair<int, int>> &rangeList = rangeMap[pathPair.first];
+    std::set<int> &splitSet = splitMap[pathPair.first];
+    mergeRowRangeList(rangeList);
+    for (auto &range : rangeList) {
+      int rowBegin = range.first;
+      for (auto splitIt = splitSet.lower_bound(range.first);
+           splitIt != splitSet.end() && *splitIt < range.second; ++splitIt) {
+        segmentList.push_back(
+            {pathPair.second, pathPair.first, rowBegin, *splitIt + 1});
+        segmentList.back().rowPath.push_back(rowBegin);
+        rowBegin = *splitIt + 1;
+      }
+      segmentList.push_back(
+          {pathPair.second, pathPair.first, rowBegin, range.second + 1});
+      segmentList.back().rowPath.push_back(rowBegin);
+    }
+  }
+  std::sort(segmentList.begin(), segmentList.end(),
+            [](const ExportSegment &a, const ExportSegment &b) {
+              return a.rowPath < b.rowPath;
+            });
+
+  // the cached rows lack the deferred cells, hidden columns are deferred
+  bool deferredExportFlag = false;
+  for (int columnNum : columnList) {
+    if (std::find(deferredColumnList->begin(), deferredColumnList->end(),
+                  columnNum) != deferredColumnList->end()) {
+      deferredExportFlag = true;
+      break;
+    }
+  }
+
+  // indexes without cached rows are read once
+  std::unordered_map<SqliteModelIndex *, SqliteRowBlock> fetchedDataMap;
+  for (ExportSegment &segment : segmentList) {
+    const SqliteRowBlock *rowDataPtr = nullptr;
+    if (segment.indexPtr->isLoaded() && !deferredExportFlag) {
+      rowDataPtr = &segment.indexPtr->getRowData();
+    } else {
+      auto findIt = fetchedDataMap.find(segment.indexPtr);
+      if (findIt == fetchedDataMap.end()) {
+        findIt = fetchedDataMap.insert({segment.indexPtr, SqliteRowBlock()})
+                     .first;
+        if (segment.indexPtr->fetchDataBackend(findIt->second, -1, false) <
+            0) {
+          writer.finish();
+          return -1;
+        }
+      }
+      rowDataPtr = &findIt->second;
+    }
+    int rowEnd = std::min(segment.rowEnd, rowDataPtr->getRowCount());
+    writer.writeRows(*rowDataPtr, segment.rowBegin, rowEnd, columnList);
+    exportCount += std::max(rowEnd - segment.rowBegin, 0);
+  }
+  writer.finish();
+  return exportCount;
+}
+
+QMimeData *SqliteModel::exportMimeData(const QItemSelection &selection,
+                                       SqliteRowWriter::Format format,
+                                       std::vector<int> columnList) {
+  QByteArray exportData;
+  exportSelection(
+      selection, format, false,
+      [&exportData](const char *chunkPtr, std::size_t chunkSize) {
+        exportData.append(chunkPtr, static_cast<int>(chunkSize));
+      },
+      columnList);
+  QMimeData *mimeDataPtr = new QMimeData();
+  mimeDataPtr->setData(SqliteRowWriter::getMimeType(format), exportData);
+  return mimeDataPtr;
+}
+
+int SqliteModel::exportFile(const QItemSelection &selection,
+                            SqliteRowWriter::Format format,
+                            const QString &filePath,
+                            std::vector<int> columnList) {
+  QFile file(filePath);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return -1;
+  }
+  bool errorFlag = false;
+  int rc = exportSelection(
+      selection, format, true,
+      [&file, &errorFlag](const char *chunkPtr, std::size_t chunkSize) {
+        if (!errorFlag) {
+          errorFlag = file.write(chunkPtr, static_cast<qint64>(chunkSize)) !=
+                      static_cast<qint64>(chunkSize);
+        }
+      },
+      columnList);
+  file.close();
+  return errorFlag ? -2 : rc;
+}
+
+std::string SqliteModel::getTreeCacheSignature() const {
+  // the filter values are bound, so they are not part of the SQL
+  SqliteModelIndexQuery query = rootIndex->getLoadQuery();
+  std::string signature = query.sql + "\n" + query.filterTreeSQL + "\n" +
+                          std::to_string(columnCount()) + "\n" +
+                          std::to_string(fetchBlockSize);
+  for (auto &filterTuple : *filterList) {
+    signature.append("\n" + std::get<0>(filterTuple) + "\n" +
+                     std::get<1>(filterTuple) + "\n" +
+                     std::get<2>(filterTuple));
+  }
+  return signature;
+}
+
+int SqliteModel::saveTreeCache(const std::string &filePath,
+                               const std::vector<std::string> &expandedIdList) {
+  if (flatTree) {
+    return -1;
+  }
+  // the fingerprint must describe the file with the edits written
+  int rc = commit();
+  if (rc != 0) {
+    return rc;
+  }
+  SqliteTreeCache treeCache;
+  rc = SqliteTreeCache::getFingerprint(database.get(), tableName,
+                                       getTreeCacheSignature(),
+                                       treeCache.fingerprint);
+  if (rc != 0) {
+    return rc;
+  }
+
+  /* Breadth first so every container is restored before the indexes of its
+   * rows. The subtree below an evicted or loading index is left out.
+   */
+  std::deque<SqliteModelIndex *> indexQueue;
+  indexQueue.push_back(rootIndex.get());
+  while (!indexQueue.empty()) {
+    SqliteModelIndex *indexPtr = indexQueue.front();
+    indexQueue.pop_front();
+    if (!indexPtr->isLoaded() || indexPtr->hasLoadingRow()) {
+      continue;
+    }
+    SqliteTreeCache::Node node;
+    if (indexPtr != rootIndex.get()) {
+      node.containerId = indexPtr->getParent()->getParentId();
+    }
+    node.parentId = indexPtr->getParentId();
+    node.rowNum = indexPtr->getRowNum();
+    node.fetchedAll = !indexPtr->canFetchMore();
+    node.rowData = indexPtr->getRowData();
+    node.childCountList.assign(indexPtr->getChildCountMap().begin(),
+                               indexPtr->getChildCountMap().end());
+    treeCache.nodeList.push_back(std::move(node));
+    for (SqliteModelIndex *childIndexPtr : indexPtr->getIndexList()) {
+      indexQueue.push_back(childIndexPtr);
+    }
+  }
+  treeCache.expandedIdList = expandedIdList;
+  return treeCache.save(filePath);
+}
+
+int SqliteModel::loadTreeCache(const std::string &filePath,
+                               std::vector<std::string> &expandedIdList,
+                               bool staleFlag) {
+  if (flatTree) {
+    return -1;
+  }
+  SqliteTreeCache treeCache;
+  int rc = treeCache.load(filePath);
+  if (rc != 0) {
+    return rc;
+  }
+  SqliteTreeCache::Fingerprint fingerprint;
+  rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+  rc = SqliteTreeCache::getFingerprint(database.get(), tableName,
+                                       getTreeCacheSignature(), fingerprint);
+  if (rc != 0) {
+    return rc;
+  }
+  // rows of another sort or filter would be shown in the wrong places
+  if (fingerprint.signature != treeCache.fingerprint.signature ||
+      treeCache.nodeList.empty() ||
+      !treeCache.nodeList.front().containerId.empty() ||
+      treeCache.nodeList.front().parentId != rootIndex->getParentId()) {
+    return -2;
+  }
+  bool staleCacheFlag = fingerprint != treeCache.fingerprint;
+  if (staleCacheFlag && !staleFlag) {
+    return -3;
+  }
+
+  cancelPrefetch();
+  cancelQueries(false);
+  staleIndexQueue.clear();
+  beginResetModel();
+  for (SqliteModelIndex *childIndexPtr : rootIndex->getIndexList()) {
+    pruneIndex(rootIndex.get(), childIndexPtr->getParentIdNum());
+  }
+  for (SqliteTreeCache::Node &node : treeCache.nodeList) {
+    SqliteModelIndex *indexPtr = rootIndex.get();
+    if (!node.containerId.empty()) {
+      // the container was restored before, unless its row was skipped
+      auto containerIdNumOpt = idInterner->find(node.containerId);
+      auto findIt = containerIdNumOpt ? indexRegistry.find(*containerIdNumOpt)
+                                      : indexRegistry.end();
+      if (findIt == indexRegistry.end() || !findIt->second->isLoaded()) {
+        continue;
+      }
+      SqliteModelIndex *containerPtr = findIt->second;
+      auto rowIdOpt = containerPtr->getRowIdNum(node.rowNum);
+      if (!rowIdOpt || idInterner->getId(*rowIdOpt) != node.parentId) {
+        continue;
+      }
+      indexPtr = createChildIndex(containerPtr, node.rowNum, *rowIdOpt);
+    }
+    if (node.rowData.getColumnCount() != columnCount()) {
+      continue;
+    }
+    indexPtr->setPendingTicket(0);
+    indexPtr->setLoadingRow(false);
+    indexPtr->replaceData(std::move(node.rowData), node.fetchedAll);
+    for (auto &childCountPair : node.childCountList) {
+      indexPtr->setChildCount(childCountPair.first, childCountPair.second);
+    }
+    if (staleCacheFlag) {
+      staleIndexQueue.push_back(indexPtr->getParentIdNum());
+    }
+  }
+  endResetModel();
+  expandedIdList = treeCache.expandedIdList;
+
+  if (staleCacheFlag) {
+    // the changed rows may enter or leave the tree filter match set
+    if (filter->isTreeMode()) {
+      filter->refresh();
+    }
+    QTimer::singleShot(0, this, [this]() { refreshStaleIndex(); });
+  }
+  return 0;
+}
+
+void SqliteModel::refreshStaleIndex() {
+  while (!staleIndexQueue.empty()) {
+    std::uint32_t parentIdNum = staleIndexQueue.front();
+    staleIndexQueue.pop_front();
+    // the index may have been pruned by the refresh of its container
+    auto findIt = indexRegistry.find(parentIdNum);
+    if (findIt == indexRegistry.end()) {
+      continue;
+    }
+    // every row may have changed, they all get dataChanged()
+    SqliteModelIndex *indexPtr = findIt->second;
+    const std::vector<std::uint32_t> &rowIdList = indexPtr->getRowIdNumList();
+    std::unordered_set<std::uint32_t> updatedIdSet(rowIdList.begin(),
+                                                   rowIdList.end());
+    refreshIndex(indexPtr, updatedIdSet, 0);
+    break;
+  }
+  if (!staleIndexQueue.empty()) {
+    QTimer::singleShot(0, this, [this]() { refreshStaleIndex(); });
+  }
+}
+
+std::string SqliteModel::getId(const QModelIndex &index) const {
+  SqliteModelIndex *indexPtr =
+      static_cast<SqliteModelIndex *>(index.internalPointer());
+  if (!index.isValid() || !indexPtr || flatTree || !indexPtr->isLoaded()) {
+    return std::string();
+  }
+  auto rowIdOpt = indexPtr->getRowId(index.row());
+  return rowIdOpt ? *rowIdOpt : std::string();
+}
+
+QModelIndex SqliteModel::getModelIndex(const std::string &id) const {
+  if (flatTree) {
+    return QModelIndex();
+  }
+  auto idNumOpt = idInterner->find(id);
+  auto locationOpt = idNumOpt ? nodeTable->find(*idNumOpt)
+                              : std::optional<std::pair<int, int>>();
+  if (!locationOpt) {
+    return QModelIndex();
+  }
+  SqliteModelIndex *indexPtr = nodeTable->get(locationOpt->first);
+  if (!indexPtr || !indexPtr->isLoaded()) {
+    return QModelIndex();
+  }
+  return createIndex(locationOpt->second, 0, indexPtr);
+}
+
+int SqliteModel::setCacheByteBudget(std::size_t byteBudget) {
+  indexLru->setByteBudget(byteBudget);
+  return 0;
+}
+
+int SqliteModel::setHiddenColumns(std::vector<int> columnNumList) {
+  hiddenColumnList = columnNumList;
+  updateDeferredColumns();
+  return 0;
+}
+
+int SqliteModel::setDeferByteSize(std::size_t byteSize) {
+  deferByteSize = byteSize;
+  updateDeferredColumns();
+  return 0;
+}
+
+int SqliteModel::sampleColumnByteSize() {
+  columnByteSizeList.assign(columnToNumMap->size(), 0.0);
+  if (columnToNumMap->empty()) {
+    return 0;
+  }
+  std::string sqlQuery = "SELECT ";
+  for (int columnNum = 0; columnNum < static_cast<int>(columnToNumMap->size());
+       columnNum++) {
+    auto columnNameIt = columnToNumMap->right.find(columnNum);
+    sqlQuery.append(columnNum == 0 ? "" : ", ");
+    sqlQuery.append(columnNameIt == columnToNumMap->right.end()
+                        ? "0"
+                        : "avg(length(`" + columnNameIt->second + "`))");
+  }
+  sqlQuery.append(" FROM (SELECT * FROM `" + tableName + "` LIMIT 64);");
+
+  sqlite3_stmt *stmt = nullptr;
+  int rc =
+      sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
+  if (rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+    for (int columnNum = 0;
+         columnNum < static_cast<int>(columnByteSizeList.size());
+         columnNum++) {
+      columnByteSizeList[columnNum] = sqlite3_column_double(stmt, columnNum);
+    }
+  }
+  sqlite3_finalize(stmt);
+  return rc;
+}
+
+void SqliteModel::updateDeferredColumns() {
+  int columnCount = static_cast<int>(columnToNumMap->size());
+  std::set<int> columnSet;
+  for (int columnNum : hiddenColumnList) {
+    if (columnNum >= 0 && columnNum < columnCount) {
+      columnSet.insert(columnNum);
+    }
+  }
+  if (deferByteSize > 0) {
+    for (int columnNum = 0;
+         columnNum < static_cast<int>(columnByteSizeList.size());
+         columnNum++) {
+      if (columnByteSizeList[columnNum] > static_cast<double>(deferByteSize)) {
+        columnSet.insert(columnNum);
+      }
+    }
+  }
+
+  // the keys of a row are read from the cached rows
+  auto keepColumn = [&](const std::string &columnName) {
+    auto columnMapIt = columnMap->left.find(columnName);
+    auto findIt = columnToNumMap->left.find(
+        columnMapIt != columnMap->left.end() ? columnMapIt->second
+                                             : columnName);
+    if (findIt != columnToNumMap->left.end()) {
+      columnSet.erase(findIt->second);
+    }
+  };
+  keepColumn("id");
+  keepColumn("parentId");
+  for (auto &sortElement : *sortOrder) {
+    keepColumn(sortElement.first);
+  }
+
+  std::vector<int> columnList(columnSet.begin(), columnSet.end());
+  if (columnList != *deferredColumnList) {
+    *deferredColumnList = columnList;
+    statementCache->invalidate();
+  }
+}
+
+int SqliteModel::setInstrumentation(bool enableFlag) {
+  instrumentation->setEnabled(enableFlag);
+  return 0;
+}
+
+SqliteInstrumentation::Snapshot
+SqliteModel::getInstrumentationSnapshot() const {
+  SqliteInstrumentation::Snapshot snapshot = instrumentation->getSnapshot();
+  snapshot.nodeCount = nodeTable->getNodeCount();
+  snapshot.loadedNodeCount = indexLru->size();
+  snapshot.cachedRowCount = nodeTable->size();
+  snapshot.cachedByteCount = indexLru->getByteTotal();
+  snapshot.internedIdCount = idInterner->size();
+  return snapshot;
+}
+
+void SqliteModel::resetInstrumentation() { instrumentation->reset(); }
+
+std::shared_ptr<SqliteModelIndex> SqliteModel::createIndexNode() const {
+  std::shared_ptr<SqliteModelIndex> indexPtr =
+      std::make_shared<SqliteModelIndex>(database, tableName, columnMap,
+                                         columnNumMap, columnToNumMap,
+                                         idInterner);
+  indexPtr->setStatementCache(statementCache);
+  indexPtr->setInstrumentation(instrumentation);
+  indexPtr->setIndexLru(indexLru);
+  indexPtr->setNodeTable(nodeTable);
+  indexPtr->setSortOrder(sortOrder);
+  indexPtr->setFilter(filter);
+  indexPtr->setDeferredColumnList(deferredColumnList);
+  indexPtr->setFetchBlockSize(fetchBlockSize);
+  return indexPtr;
+}
+
+SqliteModelIndex *SqliteModel::getChildIndex(const QModelIndex &parent) const {
+  if (!parent.isValid() || !parent.internalPointer()) {
+    return loadIndex(rootIndex.get());
+  }
+
+  /* The internal pointer is the index holding the parent row. The children of
+   * that row are held by an index keyed by the parent row id.
+   */
+  SqliteModelIndex *parentIndexPtr =
+      loadIndex(static_cast<SqliteModelIndex *>(parent.internalPointer()));
+  SqliteModelIndex *childIndexPtr = parentIndexPtr->getChildAt(parent.row());
+  if (childIndexPtr) {
+    return loadIndex(childIndexPtr);
+  }
+  auto rowIdOpt = parentIndexPtr->getRowIdNum(parent.row());
+  if (!rowIdOpt) {
+    return nullptr;
+  }
+
+  // Perform a fetch for data and cache
+  return loadIndex(createChildIndex(parentIndexPtr, parent.row(), *rowIdOpt));
+}
+
+SqliteModelIndex *
+SqliteModel::createChildIndex(SqliteModelIndex *parentIndexPtr, int rowNum,
+                              std::uint32_t rowIdNum) const {
+  // Find if index was already cached
+  std::shared_ptr<SqliteModelIndex> childIndexPtr =
+      parentIndexPtr->findIndex(rowIdNum);
+  if (!childIndexPtr) {
+    // Create new index
+    childIndexPtr = createIndexNode();
+
+    /* QAbstractItemModel overrided methods are const
+     * so we can not store indexes in a map in this object
+     * Instead indexes are stored as children
+     */
+    parentIndexPtr->insertIndex(rowIdNum, childIndexPtr);
+
+    childIndexPtr->setRowNum(rowNum);
+    childIndexPtr->setColNum(0);
+    childIndexPtr->setParentId(idInterner->getId(rowIdNum));
+    childIndexPtr->setParent(parentIndexPtr);
+    indexRegistry[rowIdNum] = childIndexPtr.get();
   }
+  return childIndexPtr.get();
+}
 
-  /* Fill out the column num map at the same size as actual columns
-   */
-  for (int i = 0; i < rowCount; i++) {
-    columnNumMap->insert({i, i});
+SqliteModelIndex *SqliteModel::loadIndex(SqliteModelIndex *indexPtr) const {
+  instrumentation->countCache(SqliteInstrumentation::Cache::Index,
+                              indexPtr->isLoaded());
+  if (!indexPtr->isLoaded()) {
+    // evicted rows may hold buffered edits
+    writeBack();
+    /* The view already knows the rows of evicted data, so it is reloaded
+     * synchronously
+     */
+    if (queryWorker && indexPtr->getEvictedRowCount() == 0) {
+      if (indexPtr->getPendingTicket() != 0 ||
+          postQuery(indexPtr, indexPtr->getLoadQuery(), false) == 0) {
+        return indexPtr;
+      }
+    }
+    indexPtr->getDataBackend();
+  } else {
+    indexLru->touch(indexPtr);
   }
-
-  return 0;
+  return indexPtr;
 }
 
-int SqliteModel::setRoot(std::string id) {
-  viewRootId = std::make_shared<std::string>(id);
-  rootIndex->setParentId(*viewRootId);
+int SqliteModel::setColumnNumMap(
+    std::vector<boost::bimap<int, int>::value_type> columnNumMap_) {
+  // update in place because every index shares this map
+  *columnNumMap =
+      boost::bimap<int, int>(columnNumMap_.begin(), columnNumMap_.end());
+  statementCache->invalidate();
   return 0;
 }
 
-int SqliteModel::setColumnNumMap(
-    std::vector<boost::bimap<int, int>::value_type> columnNumMap_) {
-  columnNumMap = std::make_shared<boost::bimap<int, int>>(columnNumMap_.begin(),
-                                                          columnNumMap_.end());
+int SqliteModel::connectWriteError(
+    std::function<void(std::string, std::string, std::string)> slot) {
+  writeErrorSignal.connect(slot);
   return 0;
 }
 
@@ -148,53 +2268,34 @@ int SqliteModel::connectUpdateIdHint(
  */
 
 int SqliteModel::columnCount(const QModelIndex &index) const {
-#if BOOKFILER_QMODEL_SQLITE_MODEL_COUNT
-  auto startTimePoint = std::chrono::system_clock::now();
-  std::time_t startTime = std::chrono::system_clock::to_time_t(startTimePoint);
-  std::cout << "["
-            << std::put_time(std::localtime(&startTime), "%Y-%m-%d %H:%M:%S %X")
-            << "] ";
-  std::cout << BOOST_CURRENT_FUNCTION << " row: " << index.row()
-            << ", col: " << index.column();
-  if (index.internalPointer()) {
-    SqliteModelIndex *parentIndexPtr =
-        static_cast<SqliteModelIndex *>(index.internalPointer());
-    std::cout << ", parentId: " << parentIndexPtr->getParentId();
-  }
-  std::cout << std::endl;
-#endif
   return columnNumMap->size();
 }
 
 QVariant SqliteModel::data(const QModelIndex &index, int role) const {
-#if BOOKFILER_QMODEL_SQLITE_MODEL_DATA
-  auto startTimePoint = std::chrono::system_clock::now();
-  std::time_t startTime = std::chrono::system_clock::to_time_t(startTimePoint);
-  std::cout << "["
-            << std::put_time(std::localtime(&startTime), "%Y-%m-%d %H:%M:%S %X")
-            << "] ";
-  std::cout << BOOST_CURRENT_FUNCTION << " index.row: " << index.row()
-            << ", index.col: " << index.column() << ", role: " << role;
-  if (index.internalPointer()) {
-    SqliteModelIndex *parentIndexPtr =
-        static_cast<SqliteModelIndex *>(index.internalPointer());
-    std::cout << ", parentId: " << parentIndexPtr->getParentId();
-  }
-  std::cout << std::endl;
-#endif
 
   if (!index.isValid())
     return QVariant();
 
+  if (flatTree) {
+    if (role != Qt::DisplayRole && role != Qt::EditRole) {
+      return QVariant();
+    }
+    return SqliteModelIndex::getCellVariant(flatTree->getRowData(),
+                                            index.row(), index.column());
+  }
+
   SqliteModelIndex *modelIndexPtr =
-      static_cast<SqliteModelIndex *>(index.internalPointer());
+      loadIndex(static_cast<SqliteModelIndex *>(index.internalPointer()));
 
-  QVariant value = modelIndexPtr->getDataCell(index.row(), index.column());
+  // placeholder row while the query worker loads the rows
+  if (!modelIndexPtr->isLoaded()) {
+    if (role == Qt::DisplayRole && index.column() == 0) {
+      return tr("Loading...");
+    }
+    return QVariant();
+  }
 
-#if BOOKFILER_QMODEL_SQLITE_MODEL_DATA
-  std::cout << BOOST_CURRENT_FUNCTION
-            << " value: " << value.toString().toStdString() << std::endl;
-#endif
+  QVariant value = modelIndexPtr->getDataCell(index.row(), index.column());
 
   // Normal data display
   if (role == Qt::DisplayRole) {
@@ -210,18 +2311,23 @@ QVariant SqliteModel::data(const QModelIndex &index, int role) const {
 }
 
 Qt::ItemFlags SqliteModel::flags(const QModelIndex &index) const {
-#if BOOKFILER_QMODEL_SQLITE_MODEL_FLAGS
-  std::cout << BOOST_CURRENT_FUNCTION << " row: " << index.row()
-            << ", col: " << index.column();
-  if (index.internalPointer()) {
-    SqliteModelIndex *parentIndexPtr =
-        static_cast<SqliteModelIndex *>(index.internalPointer());
-    std::cout << ", parentId: " << parentIndexPtr->getParentId();
-  }
-  std::cout << std::endl;
-#endif
+  // rows dropped on the viewport go under the view root
   if (!index.isValid())
-    return Qt::NoItemFlags;
+    return flatTree || snapshot ? Qt::NoItemFlags : Qt::ItemIsDropEnabled;
+
+  if (flatTree) {
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemNeverHasChildren;
+  }
+
+  // the loading row can not be selected or edited
+  if (!static_cast<SqliteModelIndex *>(index.internalPointer())->isLoaded()) {
+    return Qt::ItemIsEnabled | Qt::ItemNeverHasChildren;
+  }
+
+  // rows of a snapshot can still be dragged out as copies
+  if (snapshot) {
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled;
+  }
 
   return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsEditable |
          Qt::ItemIsDragEnabled | Qt::ItemIsDropEnabled;
@@ -238,103 +2344,31 @@ QVariant SqliteModel::headerData(int columnNum, Qt::Orientation orientation,
 
 QModelIndex SqliteModel::index(int rowNum, int colNum,
                                const QModelIndex &parent) const {
-  SqliteModelIndex *parentIndexPtr = nullptr;
-  if (parent.internalPointer()) {
-    parentIndexPtr = static_cast<SqliteModelIndex *>(parent.internalPointer());
-  }
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX
-  auto startTimePoint = std::chrono::system_clock::now();
-  std::time_t startTime = std::chrono::system_clock::to_time_t(startTimePoint);
-  std::cout << "["
-            << std::put_time(std::localtime(&startTime), "%Y-%m-%d %H:%M:%S %X")
-            << "] ";
-  std::cout << BOOST_CURRENT_FUNCTION << " parent.row: " << parent.row()
-            << ", parent.col: " << parent.column();
-  std::cout << ", row: " << rowNum << ", col: " << colNum;
-  if (parentIndexPtr) {
-    std::cout << ", parentId: " << parentIndexPtr->getParentId();
-  }
-  std::cout << std::endl;
-#endif
-
   if (!hasIndex(rowNum, colNum, parent))
     return QModelIndex();
 
-  if (!parentIndexPtr) {
-    return createIndex(rowNum, colNum, rootIndex.get());
-    //parentIndexPtr = rootIndex.get();
+  if (flatTree) {
+    return createIndex(rowNum, colNum);
   }
 
-  auto rowIdOpt = parentIndexPtr->getRowId(rowNum);
-  if (rowIdOpt) {
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX
-    std::cout << BOOST_CURRENT_FUNCTION << " rowIdOpt: " << *rowIdOpt
-              << std::endl;
-#endif
-    // Find if index was already cached
-    std::shared_ptr<SqliteModelIndex> childIndexPtr =
-        parentIndexPtr->findIndex(*rowIdOpt);
-    if (childIndexPtr) {
-      return createIndex(rowNum, colNum, childIndexPtr.get());
-    }
-
-    // Create new index
-    childIndexPtr = std::make_shared<SqliteModelIndex>(
-        database, tableName, columnMap, columnNumMap, columnToNumMap);
-
-    /* QAbstractItemModel overrided methods are const
-     * so we can not store indexes in a map in this object
-     * Instead indexes are stored as children
-     */
-    parentIndexPtr->insertIndex(*rowIdOpt, childIndexPtr);
-
-    childIndexPtr->setSortOrder(sortOrder);
-    childIndexPtr->setFilterList(filterList);
-    childIndexPtr->setRowNum(rowNum);
-    childIndexPtr->setColNum(colNum);
-    childIndexPtr->setParentId(*rowIdOpt);
-    childIndexPtr->setParent(parentIndexPtr);
-
-    // Perform a full fetch for data and cache
-    childIndexPtr->getDataBackend();
-
-    return createIndex(rowNum, colNum, childIndexPtr.get());
+  SqliteModelIndex *childIndexPtr = getChildIndex(parent);
+  if (!childIndexPtr) {
+    return QModelIndex();
   }
-  return QModelIndex();
+  return createIndex(rowNum, colNum, childIndexPtr);
 }
 
 QModelIndex SqliteModel::parent(const QModelIndex &index) const {
-  SqliteModelIndex *childIndexPtr;
+  SqliteModelIndex *childIndexPtr = nullptr;
   if (index.internalPointer()) {
     childIndexPtr = static_cast<SqliteModelIndex *>(index.internalPointer());
   }
-#if BOOKFILER_QMODEL_SQLITE_MODEL_PARENT
-  auto startTimePoint = std::chrono::system_clock::now();
-  std::time_t startTime = std::chrono::system_clock::to_time_t(startTimePoint);
-  std::cout << "["
-            << std::put_time(std::localtime(&startTime), "%Y-%m-%d %H:%M:%S %X")
-            << "] ";
-  std::cout << BOOST_CURRENT_FUNCTION << " parent.row: " << index.row()
-            << ", parent.col: " << index.column();
-  if (childIndexPtr) {
-    std::cout << ", parentId: " << childIndexPtr->getParentId();
-  }
-  std::cout << std::endl;
-#endif
 
   // never return a model index corresponding to the root item
-  if (!childIndexPtr)
+  if (!childIndexPtr || flatTree)
     return QModelIndex();
 
-  if (childIndexPtr->getParentId() == "*")
-    return QModelIndex();
-
-  SqliteModelIndex *parentIndexPtr = childIndexPtr->getParent();
-  if (!parentIndexPtr) {
-    return QModelIndex();
-  }
-
-  return createIndex(parentIndexPtr->getRowNum(), 0, parentIndexPtr);
+  return getParentModelIndex(childIndexPtr);
 }
 
 int SqliteModel::rowCount(const QModelIndex &parent) const {
@@ -343,47 +2377,129 @@ int SqliteModel::rowCount(const QModelIndex &parent) const {
   if (parent.internalPointer()) {
     parentIndexPtr = static_cast<SqliteModelIndex *>(parent.internalPointer());
   }
-#if BOOKFILER_QMODEL_SQLITE_MODEL_ROW_COUNT
-  auto startTimePoint = std::chrono::system_clock::now();
-  std::time_t startTime = std::chrono::system_clock::to_time_t(startTimePoint);
-  std::cout << "["
-            << std::put_time(std::localtime(&startTime), "%Y-%m-%d %H:%M:%S %X")
-            << "] ";
-  std::cout << BOOST_CURRENT_FUNCTION << " parent.row: " << parent.row()
-            << ", parent.col: " << parent.column();
-  if (parentIndexPtr) {
-    std::cout << ", parentId: " << parentIndexPtr->getParentId();
-  }
-  std::cout << std::endl;
-#endif
 
-  if (!parentIndexPtr) {
-    parentIndexPtr = rootIndex.get();
+  // only the first column has children
+  if (parent.column() > 0) {
+    return 0;
   }
 
-  rowCountRet = parentIndexPtr->rowCountBackend(parent.row());
-
-#if BOOKFILER_QMODEL_SQLITE_MODEL_ROW_COUNT
-  std::cout << BOOST_CURRENT_FUNCTION << " rowCountRet: " << rowCountRet
-            << std::endl;
-#endif
+  if (flatTree) {
+    rowCountRet = parent.isValid() ? 0 : flatTree->getRowCount();
+  } else if (queryWorker) {
+    /* Async mode reports the rows loaded so far, or a single loading row
+     * while the query worker loads them. Rows without children do not get
+     * an index.
+     */
+    if (parentIndexPtr) {
+      SqliteModelIndex *containerIndexPtr = loadIndex(parentIndexPtr);
+      if (parent.row() >= containerIndexPtr->getRowCount()) {
+        return 0;
+      }
+      if (!containerIndexPtr->getChildAt(parent.row()) &&
+          containerIndexPtr->getChildCount(parent.row()) == 0) {
+        return 0;
+      }
+    }
+    SqliteModelIndex *childIndexPtr = getChildIndex(parent);
+    if (!childIndexPtr) {
+      rowCountRet = 0;
+    } else if (childIndexPtr->isLoaded()) {
+      rowCountRet = childIndexPtr->getRowCount();
+    } else {
+      childIndexPtr->setLoadingRow(true);
+      rowCountRet = 1;
+    }
+  } else if (fetchBlockSize > 0) {
+    // windowed mode only reports the rows fetched so far
+    SqliteModelIndex *childIndexPtr = getChildIndex(parent);
+    rowCountRet = childIndexPtr ? childIndexPtr->getRowCount() : 0;
+  } else if (!parentIndexPtr) {
+    rowCountRet = getChildIndex(parent)->getRowCount();
+  } else {
+    rowCountRet = loadIndex(parentIndexPtr)->getChildCount(parent.row());
+  }
 
   return rowCountRet;
 }
 
+bool SqliteModel::hasChildren(const QModelIndex &parent) const {
+  if (flatTree) {
+    return !parent.isValid() && flatTree->getRowCount() > 0;
+  }
+  if (!parent.isValid()) {
+    SqliteModelIndex *rootIndexPtr = getChildIndex(parent);
+    return !rootIndexPtr->isLoaded() || rootIndexPtr->getRowCount() > 0;
+  }
+  if (parent.column() > 0 || !parent.internalPointer()) {
+    return false;
+  }
+  /* Answered from the child count cache without loading the children, so
+   * collapsed rows do not query sqlite3 on every repaint
+   */
+  SqliteModelIndex *parentIndexPtr =
+      loadIndex(static_cast<SqliteModelIndex *>(parent.internalPointer()));
+  if (!parentIndexPtr->isLoaded()) {
+    return false;
+  }
+  return parentIndexPtr->getChildCount(parent.row()) > 0;
+}
+
+bool SqliteModel::canFetchMore(const QModelIndex &parent) const {
+  if (fetchBlockSize <= 0 || parent.column() > 0 || flatTree) {
+    return false;
+  }
+  SqliteModelIndex *childIndexPtr = getChildIndex(parent);
+  return childIndexPtr && childIndexPtr->canFetchMore() &&
+         childIndexPtr->getPendingTicket() == 0;
+}
+
+void SqliteModel::fetchMore(const QModelIndex &parent) {
+  if (flatTree) {
+    return;
+  }
+  SqliteModelIndex *childIndexPtr = getChildIndex(parent);
+  if (!childIndexPtr) {
+    return;
+  }
+  if (queryWorker) {
+    if (childIndexPtr->getPendingTicket() == 0 &&
+        childIndexPtr->canFetchMore()) {
+      postQuery(childIndexPtr, childIndexPtr->getFetchMoreQuery(), true);
+    }
+    return;
+  }
+  int rowCountBefore = childIndexPtr->getRowCount();
+  int fetchedCount = childIndexPtr->fetchMoreBackend();
+  if (fetchedCount <= 0) {
+    return;
+  }
+  beginInsertRows(parent, rowCountBefore, rowCountBefore + fetchedCount - 1);
+  childIndexPtr->commitFetchMore();
+  endInsertRows();
+}
+
 bool SqliteModel::setData(const QModelIndex &index, const QVariant &value,
                           int role) {
   if (role == Qt::EditRole) {
-    if (!index.isValid())
+    if (!index.isValid() || flatTree || snapshot)
       return false;
 
     SqliteModelIndex *modelIndexPtr =
-        static_cast<SqliteModelIndex *>(index.internalPointer());
+        loadIndex(static_cast<SqliteModelIndex *>(index.internalPointer()));
 
     int rc = modelIndexPtr->setDataCell(index.row(), index.column(), value);
     if (rc != 0) {
       return false;
     }
+    rc = modelIndexPtr->bufferDataCell(index.row(), index.column(),
+                                       *writeBuffer);
+    if (rc != 0) {
+      return false;
+    }
+    emit dataChanged(index, index);
+    if (writeBackDelay >= 0 && !writeBackTimer->isActive()) {
+      writeBackTimer->start(writeBackDelay);
+    }
   }
   return true;
 }
@@ -392,8 +2508,207 @@ Qt::DropActions SqliteModel::supportedDropActions() const {
   return Qt::CopyAction | Qt::MoveAction;
 }
 
+QStringList SqliteModel::mimeTypes() const {
+  return QStringList(idListMimeType);
+}
+
+QMimeData *SqliteModel::mimeData(const QModelIndexList &indexes) const {
+  if (flatTree) {
+    return nullptr;
+  }
+  // every column of a row is selected, each row is listed once
+  std::vector<SqliteModelIndex *> indexPtrList;
+  std::vector<std::string> idList;
+  std::unordered_set<std::string> idSet;
+  for (const QModelIndex &index : indexes) {
+    SqliteModelIndex *indexPtr =
+        static_cast<SqliteModelIndex *>(index.internalPointer());
+    if (!index.isValid() || !indexPtr || !indexPtr->isLoaded()) {
+      continue;
+    }
+    auto rowIdOpt = indexPtr->getRowId(index.row());
+    if (rowIdOpt && idSet.insert(*rowIdOpt).second) {
+      indexPtrList.push_back(indexPtr);
+      idList.push_back(*rowIdOpt);
+    }
+  }
+
+  /* A row whose ancestor is also dragged moves with the ancestor instead of
+   * becoming its sibling
+   */
+  QByteArray encodedData;
+  QDataStream stream(&encodedData, QIODevice::WriteOnly);
+  QList<QByteArray> idByteList;
+  for (std::size_t listNum = 0; listNum < idList.size(); listNum++) {
+    bool nestedFlag = false;
+    for (SqliteModelIndex *ancestorPtr = indexPtrList[listNum];
+         ancestorPtr && ancestorPtr != rootIndex.get() && !nestedFlag;
+         ancestorPtr = ancestorPtr->getParent()) {
+      nestedFlag = idSet.count(ancestorPtr->getParentId()) > 0;
+    }
+    if (!nestedFlag) {
+      idByteList.append(QByteArray::fromStdString(idList[listNum]));
+    }
+  }
+  // only models of the same table accept the ids
+  stream << static_cast<quint64>(reinterpret_cast<quintptr>(database.get()))
+         << QByteArray::fromStdString(tableName) << idByteList;
+
+  QMimeData *mimeDataPtr = new QMimeData();
+  mimeDataPtr->setData(idListMimeType, encodedData);
+  return mimeDataPtr;
+}
+
+int SqliteModel::decodeIdList(const QMimeData *data,
+                              std::vector<std::string> &idList) const {
+  if (!data || !data->hasFormat(idListMimeType)) {
+    return -1;
+  }
+  QByteArray encodedData = data->data(idListMimeType);
+  QDataStream stream(&encodedData, QIODevice::ReadOnly);
+  quint64 databaseAddress = 0;
+  QByteArray tableNameBytes;
+  QList<QByteArray> idByteList;
+  stream >> databaseAddress >> tableNameBytes >> idByteList;
+  if (stream.status() != QDataStream::Ok ||
+      databaseAddress !=
+          static_cast<quint64>(reinterpret_cast<quintptr>(database.get())) ||
+      tableNameBytes.toStdString() != tableName) {
+    return -2;
+  }
+  idList.reserve(idList.size() + idByteList.size());
+  for (const QByteArray &idBytes : idByteList) {
+    idList.push_back(idBytes.toStdString());
+  }
+  return 0;
+}
+
+std::string SqliteModel::getDropKey() const {
+  return std::to_string(reinterpret_cast<quintptr>(database.get())) + ":" +
+         tableName;
+}
+
+bool SqliteModel::isDroppedRow(SqliteModelIndex *indexPtr, int rowNum) const {
+  auto findIt = droppedIdMap.find(getDropKey());
+  if (findIt == droppedIdMap.end()) {
+    return false;
+  }
+  // a row nested in a moved row moved with it
+  auto rowIdOpt = indexPtr->getRowId(rowNum);
+  if (rowIdOpt && findIt->second.count(*rowIdOpt)) {
+    return true;
+  }
+  for (SqliteModelIndex *ancestorPtr = indexPtr;
+       ancestorPtr && ancestorPtr != rootIndex.get();
+       ancestorPtr = ancestorPtr->getParent()) {
+    if (findIt->second.count(ancestorPtr->getParentId())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SqliteModel::canDropMimeData(const QMimeData *data, Qt::DropAction action,
+                                  int row, int column,
+                                  const QModelIndex &parent) const {
+  if (flatTree || snapshot || !data || !data->hasFormat(idListMimeType) ||
+      (action != Qt::MoveAction && action != Qt::CopyAction)) {
+    return false;
+  }
+  // the loading row can not hold children
+  return !parent.isValid() ||
+         static_cast<SqliteModelIndex *>(parent.internalPointer())->isLoaded();
+}
+
+bool SqliteModel::dropMimeData(const QMimeData *data, Qt::DropAction action,
+                               int row, int column, const QModelIndex &parent) {
+  if (action == Qt::IgnoreAction) {
+    return true;
+  }
+  std::vector<std::string> idList;
+  if (!canDropMimeData(data, action, row, column, parent) ||
+      decodeIdList(data, idList) != 0) {
+    return false;
+  }
+  std::string parentId = rootIndex->getParentId();
+  if (parent.isValid()) {
+    SqliteModelIndex *parentIndexPtr =
+        static_cast<SqliteModelIndex *>(parent.internalPointer());
+    auto rowIdOpt = parentIndexPtr->getRowId(parent.row());
+    if (!rowIdOpt) {
+      return false;
+    }
+    parentId = *rowIdOpt;
+  }
+  if (action == Qt::MoveAction) {
+    if (moveIdList(idList, parentId) != 0) {
+      return false;
+    }
+    // the drag deletes its mime data after the dragging view removed rows
+    std::string dropKey = getDropKey();
+    droppedIdMap[dropKey].insert(idList.begin(), idList.end());
+    QObject::connect(data, &QObject::destroyed,
+                     [dropKey]() { droppedIdMap.erase(dropKey); });
+    return true;
+  }
+  std::vector<std::string> newIdList;
+  return copyIdList(idList, parentId, newIdList) == 0;
+}
+
 bool SqliteModel::removeRows(int row, int count, const QModelIndex &parent) {
-  // TODO
+  if (flatTree || snapshot || row < 0 || count <= 0) {
+    return false;
+  }
+  SqliteModelIndex *indexPtr = getChildIndex(parent);
+  if (!indexPtr || !indexPtr->isLoaded() ||
+      row + count > indexPtr->getRowCount()) {
+    return false;
+  }
+  // rows moved by a drop are not deleted, a range mixing them is refused
+  int droppedCount = 0;
+  for (int rowNum = row; rowNum < row + count; rowNum++) {
+    droppedCount += isDroppedRow(indexPtr, rowNum) ? 1 : 0;
+  }
+  if (droppedCount > 0) {
+    return droppedCount == count;
+  }
+  if (writeBack() != 0) {
+    return false;
+  }
+  std::vector<std::uint32_t> removedIdNumList(
+      indexPtr->getRowIdNumList().begin() + row,
+      indexPtr->getRowIdNumList().begin() + row + count);
+  std::vector<std::string> idList;
+  idList.reserve(count);
+  for (std::uint32_t idNum : removedIdNumList) {
+    idList.push_back(idInterner->getId(idNum));
+  }
+
+  // the descendants are deleted by the same statement
+  std::vector<std::string> deletedIdList;
+  {
+    SqliteChangeCapture::IgnoreScope ignoreScope(changeCapture.get());
+    if (treeEditor->deleteRows(idList, deletedIdList) != 0) {
+      return false;
+    }
+  }
+  if (filter->isTreeMode()) {
+    filter->refresh();
+  }
+
+  /* Only the rows are removed from the view. The cached subtrees are pruned
+   * without being reloaded or emitting signals of their own.
+   */
+  beginRemoveRows(getParentModelIndex(indexPtr), row, row + count - 1);
+  indexPtr->removeRows(row, count);
+  endRemoveRows();
+  for (std::uint32_t idNum : removedIdNumList) {
+    pruneIndex(indexPtr, idNum);
+  }
+  invalidateChildCount(
+      std::unordered_set<std::string>{indexPtr->getParentId()});
+  updateSignal(std::vector<std::string>(), std::vector<std::string>(),
+               deletedIdList);
   return true;
 }
 
@@ -403,35 +2718,217 @@ int SqliteModel::setSort(
   for (auto sortField : sortOrderList) {
     for (std::list<std::pair<std::string, std::string>>::iterator it =
              sortOrder->begin();
-         it != sortOrder->end(); ++it) {
+         it != sortOrder->end();) {
       // delete pairs with the same column code name
       if (it->first == sortField.first) {
-        sortOrder->erase(it);
+        it = sortOrder->erase(it);
+      } else {
+        ++it;
       }
     }
     sortOrder->push_front(sortField);
   }
+  updateDeferredColumns();
+  statementCache->invalidate();
+  adviseIndexes();
   return 0;
 }
 
 int SqliteModel::setFilter(
     std::list<std::tuple<std::string, std::string, std::string>> filterList_) {
-  filterList = std::make_shared<
-      std::list<std::tuple<std::string, std::string, std::string>>>(
-      filterList_);
+  *filterList = filterList_;
+  return compileFilter();
+}
+
+int SqliteModel::setFilterTreeMode(bool treeFlag) {
+  filter->setTreeMode(treeFlag, columnMap->left.at("id"),
+                      columnMap->left.at("parentId"));
+  return compileFilter();
+}
+
+int SqliteModel::compileFilter() {
+  int rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+  // the conditions may use code column names
+  std::list<std::tuple<std::string, std::string, std::string>> realFilterList;
+  for (auto filterElement : *filterList) {
+    auto findIt = columnMap->left.find(std::get<0>(filterElement));
+    if (findIt != columnMap->left.end()) {
+      std::get<0>(filterElement) = findIt->second;
+    }
+    realFilterList.push_back(filterElement);
+  }
+  // update in place because every index shares the filter
+  filter->setIdColumnName(columnMap->left.at("id"));
+  rc = filter->compile(realFilterList);
+  statementCache->invalidate();
+  adviseIndexes();
+  // queries bound to the previous filter are obsolete
+  cancelQueries();
+  cancelPrefetch();
+  // the flat rows are one query, reading them again is cheap
+  if (flatTree) {
+    beginResetModel();
+    flatTree->load();
+    endResetModel();
+  }
+  return rc;
+}
+
+int SqliteModel::setIndexAdvisor(bool enableFlag,
+                                 SqliteIndexAdvisor::Callback callback) {
+  // the destructor drops the created indexes
+  indexAdvisor.reset();
+  if (!enableFlag) {
+    return 0;
+  }
+  // creating indexes writes to the database file
+  if (snapshot) {
+    return -1;
+  }
+  indexAdvisor = std::make_shared<SqliteIndexAdvisor>(database, tableName);
+  /* The indexes are built on the worker thread, the callback runs on the GUI
+   * thread. The queued call is dropped if the model is destroyed first.
+   */
+  if (callback) {
+    indexAdvisor->setCallback([this, callback](const std::string &action,
+                                               const std::string &indexName,
+                                               const std::string &detail) {
+      QMetaObject::invokeMethod(
+          this, [callback, action, indexName, detail]() {
+            callback(action, indexName, detail);
+          },
+          Qt::QueuedConnection);
+    });
+  }
+  return adviseIndexes();
+}
+
+int SqliteModel::adviseIndexes() {
+  if (!indexAdvisor || !rootIndex) {
+    return 0;
+  }
+  /* Expanded rows run the child level query. The root level only differs in
+   * comparing the parent with IS NULL, which uses the same index.
+   */
+  SqliteModelIndexQuery query = rootIndex->getLoadQuery(std::string());
+  int rc = query.setup(*statementCache);
+  if (rc != 0) {
+    return rc;
+  }
+
+  // equality columns first so the ORDER BY can be read from the index
+  std::vector<std::pair<std::string, std::string>> columnList;
+  std::unordered_set<std::string> columnSet;
+  auto addColumn = [&](const std::string &columnName,
+                       const std::string &direction) {
+    if (columnSet.insert(columnName).second) {
+      columnList.push_back({columnName, direction});
+    }
+  };
+  addColumn(columnMap->left.at("parentId"), "ASC");
+  for (auto &columnName : filter->getEqualityColumnList()) {
+    addColumn(columnName, "ASC");
+  }
+  for (auto &sortElement : *sortOrder) {
+    addColumn(sortElement.first, sortElement.second);
+  }
+  addColumn(columnMap->left.at("id"), "ASC");
+  // the worker connection fills its own tree filter match table
+  return indexAdvisor->advise(
+      query.sql, columnList,
+      [query](SqliteStatementCache &cache) { return query.setup(cache); });
+}
+
+int SqliteModel::setFlatMode(bool flatFlag) {
+  if (flatFlag == static_cast<bool>(flatTree)) {
+    return 0;
+  }
+  cancelQueries(false);
+  cancelPrefetch();
+  int rc = writeBack();
+  if (rc != 0) {
+    return rc;
+  }
+  beginResetModel();
+  if (flatFlag) {
+    flatTree = std::make_shared<SqliteModelFlatTree>(
+        database, tableName, columnMap, sortOrder, filter, statementCache);
+    flatTree->setRootId(rootIndex->getParentId());
+    rc = flatTree->load();
+  } else {
+    flatTree.reset();
+  }
+  endResetModel();
+  return rc;
+}
+
+bool SqliteModel::isFlatMode() const { return static_cast<bool>(flatTree); }
+
+int SqliteModel::expandFlatRow(int rowNum) {
+  if (!flatTree) {
+    return -1;
+  }
+  int insertCount = flatTree->expandBackend(rowNum);
+  if (insertCount < 0) {
+    return insertCount;
+  }
+  if (insertCount == 0) {
+    flatTree->commitExpand();
+    return 0;
+  }
+  beginInsertRows(QModelIndex(), rowNum + 1, rowNum + insertCount);
+  flatTree->commitExpand();
+  endInsertRows();
+  return 0;
+}
+
+int SqliteModel::collapseFlatRow(int rowNum) {
+  if (!flatTree || rowNum < 0 || rowNum >= flatTree->getRowCount()) {
+    return -1;
+  }
+  int rowEnd = flatTree->getSubtreeEnd(rowNum);
+  if (rowEnd == rowNum + 1) {
+    flatTree->collapse(rowNum);
+    return 0;
+  }
+  beginRemoveRows(QModelIndex(), rowNum + 1, rowEnd - 1);
+  flatTree->collapse(rowNum);
+  endRemoveRows();
   return 0;
 }
 
+int SqliteModel::getFlatRowDepth(int rowNum) const {
+  if (!flatTree || rowNum < 0 || rowNum >= flatTree->getRowCount()) {
+    return -1;
+  }
+  return flatTree->getRow(rowNum).depth;
+}
+
+int SqliteModel::getFlatParentRow(int rowNum) const {
+  if (!flatTree || rowNum < 0 || rowNum >= flatTree->getRowCount()) {
+    return -1;
+  }
+  return flatTree->getRow(rowNum).parentRow;
+}
+
+bool SqliteModel::isFlatRowExpanded(int rowNum) const {
+  if (!flatTree || rowNum < 0 || rowNum >= flatTree->getRowCount()) {
+    return false;
+  }
+  return flatTree->getRow(rowNum).expandedFlag;
+}
+
+bool SqliteModel::hasFlatRowChildren(int rowNum) const {
+  if (!flatTree || rowNum < 0 || rowNum >= flatTree->getRowCount()) {
+    return false;
+  }
+  return flatTree->getRow(rowNum).hasChildren;
+}
+
 void SqliteModel::sort(int columnActualNum, Qt::SortOrder order) {
-#if BOOKFILER_QMODEL_SQLITE_MODEL_SORT
-  auto startTimePoint = std::chrono::system_clock::now();
-  std::time_t startTime = std::chrono::system_clock::to_time_t(startTimePoint);
-  std::cout << "["
-            << std::put_time(std::localtime(&startTime), "%Y-%m-%d %H:%M:%S %X")
-            << "] ";
-  std::cout << BOOST_CURRENT_FUNCTION << " columnActualNum: " << columnActualNum
-            << ", Qt::SortOrder: " << order << std::endl;
-#endif
 
   std::pair<std::string, std::string> sortField;
   // get the default column num from the actual column num
@@ -455,16 +2952,80 @@ void SqliteModel::sort(int columnActualNum, Qt::SortOrder order) {
     sortField.second = "DESC";
     break;
   }
-#if BOOKFILER_QMODEL_SQLITE_MODEL_SORT
-  std::cout << BOOST_CURRENT_FUNCTION << " columnCodeName: " << columnCodeName
-            << ", Order: " << sortField.second << std::endl;
-#endif
   std::list<std::pair<std::string, std::string>> sortOrderList{sortField};
   setSort(sortOrderList);
 
+  // queries for the previous sort order are obsolete
+  cancelQueries();
+  cancelPrefetch();
+  if (flatTree) {
+    beginResetModel();
+    flatTree->load();
+    endResetModel();
+    return;
+  }
+  if (!rootIndex->isLoaded()) {
+    return;
+  }
+
   // Perform a full fetch for data and cache
-  rootIndex->getDataBackend();
+  if (queryWorker) {
+    for (auto &indexPair : indexRegistry) {
+      if (indexPair.second->isLoaded()) {
+        postQuery(indexPair.second, indexPair.second->getLoadQuery(), false);
+      }
+    }
+    return;
+  }
+  reloadLayout();
+}
+
+void SqliteModel::reloadLayout() {
+  writeBack();
+  emit layoutAboutToBeChanged();
+  // the id each persistent index points to before the rows move
+  QModelIndexList fromList = persistentIndexList();
+  std::vector<std::optional<std::uint32_t>> fromIdList;
+  fromIdList.reserve(fromList.size());
+  for (const QModelIndex &persistentIndex : fromList) {
+    SqliteModelIndex *indexPtr =
+        static_cast<SqliteModelIndex *>(persistentIndex.internalPointer());
+    fromIdList.push_back(indexPtr
+                             ? indexPtr->getRowIdNum(persistentIndex.row())
+                             : std::optional<std::uint32_t>());
+  }
+
+  for (auto &indexPair : indexRegistry) {
+    SqliteModelIndex *indexPtr = indexPair.second;
+    if (!indexPtr->isLoaded()) {
+      continue;
+    }
+    // keep the rows the view fetched so far
+    int limit = fetchBlockSize > 0
+                    ? std::max(fetchBlockSize, indexPtr->getRowCount())
+                    : -1;
+    SqliteRowBlock rowData;
+    int rc = indexPtr->fetchDataBackend(rowData, limit);
+    indexPtr->replaceData(std::move(rowData),
+                          rc < 0 || limit < 0 || rc < limit);
+  }
 
+  // the node table already holds the new row of every id
+  QModelIndexList toList;
+  for (int listNum = 0; listNum < fromList.size(); listNum++) {
+    const QModelIndex &persistentIndex = fromList[listNum];
+    SqliteModelIndex *indexPtr =
+        static_cast<SqliteModelIndex *>(persistentIndex.internalPointer());
+    std::optional<std::pair<int, int>> locationOpt;
+    if (fromIdList[listNum]) {
+      locationOpt = nodeTable->find(*fromIdList[listNum]);
+    }
+    toList.append(locationOpt && locationOpt->first == indexPtr->getHandle()
+                      ? createIndex(locationOpt->second,
+                                    persistentIndex.column(), indexPtr)
+                      : QModelIndex());
+  }
+  changePersistentIndexList(fromList, toList);
   emit layoutChanged();
 }
 
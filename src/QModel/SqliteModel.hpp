@@ -14,13 +14,16 @@
 #include "../core/config.hpp"
 
 // C++
-#include <chrono>  // chrono::system_clock
-#include <ctime>   // localtime
-#include <iomanip> // put_time
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <sstream> // stringstream
+#include <unordered_map>
+#include <unordered_set>
 
 /* boost 1.72.0
  * License: Boost Software License (similar to BSD and MIT)
@@ -33,10 +36,22 @@
  * License: LGPLv3
  */
 #include <QAbstractItemModel>
+#include <QItemSelection>
+#include <QMimeData>
 #include <QModelIndex>
+#include <QTimer>
 #include <QVariant>
 
 // Local Project
+#include "../core/SqliteChangeCapture.hpp"
+#include "../core/SqliteIndexAdvisor.hpp"
+#include "../core/SqliteQueryPool.hpp"
+#include "../core/SqliteQueryWorker.hpp"
+#include "../core/SqliteRowWriter.hpp"
+#include "../core/SqliteSnapshot.hpp"
+#include "../core/SqliteTreeCache.hpp"
+#include "../core/SqliteTreeEditor.hpp"
+#include "SqliteModelFlatTree.hpp"
 #include "SqliteModelIndex.hpp"
 
 /*
@@ -62,13 +77,119 @@ private:
                                std::vector<std::string>,
                                std::vector<std::string>)>
       updateSignal;
+  boost::signals2::signal<void(std::string, std::string, std::string)>
+      writeErrorSignal;
   /* map the default column position to the display column name
    */
   std::vector<QVariant> headerList;
   std::shared_ptr<std::list<std::pair<std::string, std::string>>> sortOrder;
   std::shared_ptr<std::list<std::tuple<std::string, std::string, std::string>>>
       filterList;
+  /* filterList compiled to SQL, shared by all indexes
+   */
+  std::shared_ptr<SqliteFilter> filter;
+  /* columns left out of the data queries, shared by all indexes. The hidden
+   * columns and the columns whose sampled cells are wider than
+   * deferByteSize.
+   */
+  std::shared_ptr<std::vector<int>> deferredColumnList;
+  std::vector<int> hiddenColumnList;
+  /* average bytes per cell of each column in the first rows
+   */
+  std::vector<double> columnByteSizeList;
+  std::size_t deferByteSize = 512;
+  /* creates indexes for the sort and filter combination when enabled
+   */
+  std::shared_ptr<SqliteIndexAdvisor> indexAdvisor;
+  /* visible rows in pre-order when the model is flat, nullptr otherwise
+   */
+  std::shared_ptr<SqliteModelFlatTree> flatTree;
   std::shared_ptr<SqliteModelIndex> rootIndex;
+  /* prepared statements shared by all indexes. Invalidated when the sort,
+   * filter, or column settings change the generated SQL.
+   */
+  std::shared_ptr<SqliteStatementCache> statementCache;
+  /* least recently used order of the indexes holding cached data
+   */
+  std::shared_ptr<SqliteModelIndexLru> indexLru;
+  /* handle of every index and the index and row every cached id is at
+   */
+  std::shared_ptr<SqliteModelNodeTable> nodeTable;
+  /* map interned parentId->index for every index created. Used to find the
+   * index affected by an id hint.
+   */
+  mutable std::unordered_map<std::uint32_t, SqliteModelIndex *>
+      indexRegistry;
+  /* interned row ids shared by all indexes
+   */
+  std::shared_ptr<SqliteIdInterner> idInterner;
+  /* query and cache counters, disabled until setInstrumentation(true)
+   */
+  std::shared_ptr<SqliteInstrumentation> instrumentation;
+  int fetchBlockSize = 0;
+  /* Edits made with setData() wait in the write buffer until commit(). The
+   * ids written before a query re-read the table wait in writtenIdList
+   * until commit() signals them.
+   */
+  std::shared_ptr<SqliteWriteBuffer> writeBuffer;
+  mutable std::vector<std::string> writtenIdList;
+  QTimer *writeBackTimer = nullptr;
+  int writeBackDelay = 0;
+  /* moves and copies the subtrees dropped on the view
+   */
+  std::shared_ptr<SqliteTreeEditor> treeEditor;
+  /* pragmas of the read only snapshot mode, nullptr otherwise
+   */
+  std::shared_ptr<SqliteSnapshot> snapshot;
+  /* runs data queries off the GUI thread in async mode. Every posted query
+   * gets a new ticket and its result is dropped if the index no longer
+   * waits for that ticket.
+   */
+  std::shared_ptr<SqliteQueryWorker> queryWorker;
+  mutable std::uint64_t queryTicket = 0;
+  /* interned parent ids of the indexes restored from a stale tree cache,
+   * parents first. One is re-queried per event loop turn.
+   */
+  std::deque<std::uint32_t> staleIndexQueue;
+  /* collects the rows changed by other writers when enabled, nullptr
+   * otherwise. changelogTimer polls the changelog of other connections.
+   */
+  std::shared_ptr<SqliteChangeCapture> changeCapture;
+  QTimer *changelogTimer = nullptr;
+
+  /* rows of one index loaded by prefetch()
+   */
+  struct PrefetchResult {
+    std::string parentId, containerId;
+    int depth = 0;
+    SqliteRowBlock rowData;
+    bool fetchedAll = true;
+  };
+  /* shared by the jobs of one prefetch() call
+   */
+  struct PrefetchState {
+    SqliteModel *modelPtr = nullptr;
+    SqliteQueryPool *queryPool = nullptr;
+    std::shared_ptr<SqliteInstrumentation> instrumentation;
+    /* the query of a child row, the parent id is set per job
+     */
+    SqliteModelIndexQuery childQuery;
+    int idColumnNum = 0;
+    int depth = -1;
+    std::function<void()> callback;
+    /* jobs queued or running, the last job to finish hands the results to
+     * the GUI thread
+     */
+    std::atomic<int> outstandingCount{0};
+    std::atomic<bool> cancelFlag{false};
+    std::mutex resultMutex;
+    std::vector<PrefetchResult> resultList;
+  };
+  /* connections loading subtrees in parallel for prefetch()
+   */
+  std::shared_ptr<SqliteQueryPool> queryPool;
+  std::shared_ptr<PrefetchState> prefetchState;
+  int prefetchThreadCount = 4;
 
   /* map the code column name to the sqlite3 column name
    */
@@ -84,6 +205,193 @@ private:
    * @return 0 on success, else error code
    */
   int reverse();
+  /* Measures the average cell size of every column in the first rows
+   * @return 0 on success, else error code
+   */
+  int sampleColumnByteSize();
+  /* Collects the hidden and wide columns into deferredColumnList, keeping
+   * the id, parent id, and sort columns. The statements are invalidated if
+   * the list changed.
+   */
+  void updateDeferredColumns();
+
+  /* Creates a new index sharing the model's sort, filter, and column settings
+   * @return the new index
+   */
+  std::shared_ptr<SqliteModelIndex> createIndexNode() const;
+  /* Finds or creates the index holding the children of parent and makes sure
+   * its cache is loaded.
+   * @param parent the parent model index, invalid for the root
+   * @return the index or nullptr if the parent row does not exist
+   */
+  SqliteModelIndex *getChildIndex(const QModelIndex &parent) const;
+  /* Finds or creates the index holding the children of a row without
+   * loading it
+   * @param parentIndexPtr the index holding the row
+   * @return the index
+   */
+  SqliteModelIndex *createChildIndex(SqliteModelIndex *parentIndexPtr,
+                                     int rowNum,
+                                     std::uint32_t rowIdNum) const;
+  /* Reloads the index data if it was evicted and marks it most recently used
+   * @return indexPtr
+   */
+  SqliteModelIndex *loadIndex(SqliteModelIndex *indexPtr) const;
+  /* @return the model index of the row whose children indexPtr holds
+   */
+  QModelIndex getParentModelIndex(SqliteModelIndex *indexPtr) const;
+  /* Removes the child index of a row and all of its descendants
+   */
+  void pruneIndex(SqliteModelIndex *indexPtr, std::uint32_t idNum);
+  void unregisterIndex(SqliteModelIndex *indexPtr);
+  /* Looks up the parent id of many ids with grouped queries
+   * @return map id->parentId, "*" for a NULL parent
+   */
+  std::unordered_map<std::string, std::string>
+  getParentIdBackend(const std::vector<std::string> &idList);
+  /* Finds where ids are cached
+   * @return map id->{index, rowNum}
+   */
+  std::unordered_map<std::string, std::pair<SqliteModelIndex *, int>>
+  findIdList(const std::unordered_set<std::string> &idSet);
+  /* Finds the evicted indexes that held ids when their data was freed. The
+   * view still counts those rows.
+   * @return map id->index
+   */
+  std::unordered_map<std::string, SqliteModelIndex *>
+  findEvictedIdList(const std::unordered_set<std::string> &idSet);
+  /* updateIdHint() with the parents already known
+   * @param parentIdMap map id->current parent id of the added and updated
+   * ids
+   * @param previousParentIdSet parents that lost rows which may not be
+   * cached, their indexes are refreshed and their child counts forgotten
+   * @return 0 on success, else error code
+   */
+  int
+  applyIdHint(const std::vector<std::string> &addedIdList,
+              const std::vector<std::string> &updatedIdList,
+              const std::vector<std::string> &deletedIdList,
+              const std::unordered_map<std::string, std::string> &parentIdMap,
+              const std::unordered_set<std::string> &previousParentIdSet);
+  /* Applies the changes committed on this connection by other writers,
+   * called from the event loop after the commit hook
+   */
+  void takeCapturedChanges();
+  /* Applies the changes other connections logged in the changelog
+   */
+  void pollChangelog();
+  /* Forgets the child count of the rows with these ids and repaints them so
+   * the expand indicator follows the child count
+   */
+  void invalidateChildCount(std::unordered_set<std::string> parentIdSet);
+  /* Patches the cached rows after the rows were moved under parentId. Runs
+   * of rows cached next to each other are moved to the destination index
+   * with one beginMoveRows() and keep their cached subtrees. Rows the
+   * destination does not show are removed.
+   * @param movedIdNumList interned ids of the moved rows cached before the
+   * move
+   * @param addedCount number of rows moved
+   * @return 0 on success, else error code
+   */
+  int commitMove(const std::vector<std::uint32_t> &movedIdNumList,
+                 const std::string &parentId, int addedCount);
+  /* Reads the ids of mime data made by mimeData()
+   * @return 0 on success, else error code. Fails for rows of another table.
+   */
+  int decodeIdList(const QMimeData *data,
+                   std::vector<std::string> &idList) const;
+  /* the database and table the dropped ids are kept under
+   */
+  std::string getDropKey() const;
+  /* @return true if the row or one of its ancestors was moved by a drop
+   * whose drag is not finished yet
+   */
+  bool isDroppedRow(SqliteModelIndex *indexPtr, int rowNum) const;
+  /* Re-reads every loaded index in one layout change and moves the
+   * persistent indexes to the new row of their id. Used when the sort order
+   * changed.
+   */
+  void reloadLayout();
+  /* Re-queries an index and emits the row removals, insertions, moves, and
+   * data changes that turn the cached rows into the current rows.
+   * @param updatedIdSet ids whose data changed
+   * @param addedCount number of rows expected to be added to the index
+   * @return 0 on success, else error code
+   */
+  int refreshIndex(SqliteModelIndex *indexPtr,
+                   const std::unordered_set<std::uint32_t> &updatedIdSet,
+                   int addedCount);
+  /* Runs a data query of an index on the query worker. The result is handed
+   * back to the GUI thread with a queued call to commitQuery().
+   * @param appendFlag true for a fetch more query
+   * @return 0 on success, else error code
+   */
+  int postQuery(SqliteModelIndex *indexPtr, SqliteModelIndexQuery query,
+                bool appendFlag) const;
+  void commitQuery(std::shared_ptr<SqliteModelIndexQuery> queryPtr,
+                   std::uint64_t ticket, bool appendFlag, int fetchedCount,
+                   std::shared_ptr<SqliteRowBlock> rowDataPtr);
+  /* Replaces the rows of an index, removing the loading row if it is shown.
+   * Rows of an index that was already loaded are replaced with a layout
+   * change that moves the persistent indexes to the new row of their id.
+   */
+  void commitLoad(SqliteModelIndex *indexPtr, SqliteRowBlock &&rowData,
+                  bool fetchedAll);
+  /* Drops the queued and running queries. Indexes showing a loading row are
+   * queried again.
+   * @param repostFlag false to only drop the queries
+   * @return 0 on success, else error code
+   */
+  int cancelQueries(bool repostFlag = true);
+  /* Loads an index synchronously, replacing the loading row if it is shown
+   */
+  void loadIndexNow(SqliteModelIndex *indexPtr);
+  /* Loads the rows of one index on a prefetch thread and queues a job for
+   * each of its rows
+   */
+  static void prefetchBackend(std::shared_ptr<PrefetchState> statePtr,
+                              SqliteModelIndexQuery query,
+                              std::string containerId, int depth,
+                              SqliteStatementCache &statementCache,
+                              int workerNum);
+  /* merges the prefetched rows into the indexes on the GUI thread
+   */
+  void commitPrefetch(std::shared_ptr<PrefetchState> statePtr);
+  /* loads the subtree one index at a time when no prefetch threads are open
+   */
+  int prefetchSerial(SqliteModelIndex *indexPtr, int depth);
+  int cancelPrefetch();
+  /* compiles filterList into the shared filter and drops the queries using
+   * the previous filter
+   * @return 0 on success, else error code
+   */
+  int compileFilter();
+  /* Writes the buffered edits so a query reading the table sees them. The
+   * update signal is sent by the next commit().
+   * @return 0 on success, else error code
+   */
+  int writeBack() const;
+  /* Re-reads the rows of the edits the database refused, so their cells
+   * show the stored values again, and signals the errors
+   */
+  void revertRejectedEdits(
+      std::vector<SqliteWriteBuffer::Rejected> rejectedList);
+  /* lets the index advisor check the data query of the active sort and
+   * filter combination
+   * @return 0 on success, else error code
+   */
+  int adviseIndexes();
+  /* @return the query settings a tree cache is only valid for: the root
+   * data query, the filter values, and the column count
+   */
+  std::string getTreeCacheSignature() const;
+  /* Re-queries the next index of staleIndexQueue and schedules the one after
+   */
+  void refreshStaleIndex();
+  /* Queues every index for refreshStaleIndex(), parents first, when the
+   * changed rows are not known
+   */
+  void refreshAllIndexes();
 
 public:
   SqliteModel(std::shared_ptr<sqlite3> database_, std::string tableName_,
@@ -120,6 +428,254 @@ public:
   int setColumnNumMap(
       std::vector<boost::bimap<int, int>::value_type> columnNumMap);
 
+  /* Enables windowed fetching. Children are loaded in blocks of this many
+   * rows as the view scrolls using canFetchMore() and fetchMore(). Blocks are
+   * keyed by the ORDER BY tuple of the last loaded row, so fetching a block
+   * costs the same no matter how deep into the children it is.
+   * Does not update the view. You should update the view after calling this.
+   * @param blockSize rows per block, 0 to load all children at once
+   * @return 0 on success, else error code
+   */
+  int setFetchBlockSize(int blockSize);
+
+  /* Limits the memory used by cached row data. When the limit is exceeded
+   * the data of the least recently used indexes, typically collapsed or
+   * scrolled out of view, is freed and reloaded when it is needed again.
+   * Indexes are never deleted so existing QModelIndex objects stay valid.
+   * @param byteBudget maximum bytes of cached data, 0 for unlimited
+   * @return 0 on success, else error code
+   */
+  int setCacheByteBudget(std::size_t byteBudget);
+  /* Leaves columns out of the data queries. Their cells are read one at a
+   * time with a bound SELECT when they are painted, so the cache holds
+   * only what is shown. TreeView passes the sections hidden in its header.
+   * The id, parent id, and sort columns are always read with the rows.
+   * @param columnNumList the hidden column positions
+   * @return 0 on success, else error code
+   */
+  int setHiddenColumns(std::vector<int> columnNumList);
+  /* Leaves the columns whose cells average more than byteSize bytes in the
+   * first rows out of the data queries, for example long text or blobs.
+   * Their cells are read when painted like hidden columns. Default 512.
+   * @param byteSize 0 to read every shown column with the rows
+   * @return 0 on success, else error code
+   */
+  int setDeferByteSize(std::size_t byteSize);
+
+  /* Counts every query by kind with a latency histogram, and the hits and
+   * misses of the index data, child count, and statement caches. Disabled
+   * by default, when disabled a query costs one relaxed atomic load.
+   * @param enableFlag true to start counting, false to stop. The counters
+   * are kept until resetInstrumentation().
+   * @return 0 on success, else error code
+   */
+  int setInstrumentation(bool enableFlag);
+  /* @return a copy of the counters with the current node, row, and byte
+   * counts of the cache
+   */
+  SqliteInstrumentation::Snapshot getInstrumentationSnapshot() const;
+  void resetInstrumentation();
+
+  /* Enables async mode. Data queries run on a worker thread with a second,
+   * read only connection to the database file, so a slow query does not
+   * block the GUI. Children being loaded are shown as a single "Loading..."
+   * row until the rows arrive. Sorting cancels the queries made obsolete
+   * with sqlite3_interrupt(). Row counts, edits, and reloads of evicted
+   * data stay synchronous.
+   * @param asyncFlag true to enable, false to go back to synchronous queries
+   * @return 0 on success, else error code. In-memory and temporary databases
+   * can not be opened by a second connection and stay synchronous.
+   */
+  int setAsync(bool asyncFlag);
+  /* Loads the subtree of a row before it is expanded, for example before
+   * expandAll() or when restoring saved expansion. Sibling subtrees are
+   * loaded in parallel on read only connections to the database file and
+   * merged into the model on the GUI thread. In-memory databases, or a
+   * thread count of 0, load the subtree serially before returning.
+   * Rows that are already loaded are kept.
+   * @param parent the row to load the subtree of, invalid for the root
+   * @param depth number of levels to load, -1 for all levels
+   * @param callback called on the GUI thread after the rows are merged
+   * @return 0 on success, else error code
+   */
+  int prefetch(const QModelIndex &parent, int depth = -1,
+               std::function<void()> callback = nullptr);
+  /* Sets the number of connections and threads prefetch() uses. Takes
+   * effect on the next prefetch().
+   * @param threadCount number of threads, 0 to always prefetch serially
+   * @return 0 on success, else error code
+   */
+  int setPrefetchThreadCount(int threadCount);
+  /* Enables read only snapshot mode for large database files that do not
+   * change while they are viewed. The connection memory maps the file with
+   * mmap_size, gets a larger cache_size, keeps temp b-trees in memory, and
+   * refuses writes with query_only. The query worker and prefetch
+   * connections are opened again with the same pragmas. The index on the
+   * parent column is read once up front so the first expands do not fault
+   * its pages in one by one.
+   * In snapshot mode edits, drops, removeRows(), and the index advisor are
+   * refused and the advisor's indexes are dropped. The temp tables of the
+   * tree filter and flat mode are still written.
+   * Enable the instrumentation first to record the warm up scan. The
+   * ExpandCold and ExpandWarm queries then time the first load of an
+   * index's rows and the reloads after eviction, to size mmapByteSize and
+   * cacheKibiByteSize.
+   * Enabling it again applies the new settings to the pragmas the model
+   * started with, if that fails snapshot mode is left off.
+   * @param snapshotFlag true to enable, false to restore the previous
+   * pragmas
+   * @return 0 on success, else error code
+   */
+  int setSnapshotMode(bool snapshotFlag, SqliteSnapshot::Settings settings =
+                                             SqliteSnapshot::Settings());
+  bool isSnapshotMode() const;
+  /* Sets when the edits made with setData() are written to the database.
+   * Edits are buffered, then written with one prepared UPDATE per column
+   * inside a single transaction, so pasting many cells costs one journal
+   * sync. Editing a cell again before the write keeps only the last value.
+   * Buffered edits are also written before any query re-reads the table.
+   * @param delayMsec write this many milliseconds after the first buffered
+   * edit. 0 writes once control returns to the event loop, -1 only writes
+   * on commit().
+   * @return 0 on success, else error code
+   */
+  int setWriteBackDelay(int delayMsec);
+  /* Writes the buffered edits in one transaction and signals the updated
+   * ids to the functions connected with connectUpdateIdHint()
+   * @return 0 on success, else error code. The edits are kept when the
+   * transaction fails. Edits the database refuses are dropped and signaled
+   * to the functions connected with connectWriteError().
+   */
+  int commit();
+  /* number of edits waiting to be written
+   */
+  std::size_t getPendingWriteCount() const;
+  /* Moves rows and their subtrees under another parent with one UPDATE per
+   * page of ids. Cached rows are moved between the indexes in place, so
+   * expansion and selection are kept and nothing is reloaded. The ids are
+   * signaled as updated to the functions connected with
+   * connectUpdateIdHint(). Used by dropMimeData() for move drops.
+   * @param idList the rows to move
+   * @param parentId the new parent, "*" for a NULL parent
+   * @return 0 on success, else error code. Fails in flat mode and when a row
+   * would be moved below itself.
+   */
+  int moveIdList(std::vector<std::string> idList, std::string parentId);
+  /* Copies rows and their subtrees under a parent with one recursive
+   * INSERT ... SELECT. Used by dropMimeData() for copy drops.
+   * @param idList the rows to copy
+   * @param parentId the parent of the copies, "*" for a NULL parent
+   * @param newIdList the id of every copied row is appended, these ids are
+   * also signaled as added
+   * @return 0 on success, else error code. Fails in flat mode.
+   */
+  int copyIdList(std::vector<std::string> idList, std::string parentId,
+                 std::vector<std::string> &newIdList);
+  /* Writes the selected rows in the order the view shows them, the columns
+   * of columnList of each row once. Cells are formatted straight from the
+   * cached rows without data() calls or QVariant conversions. An index
+   * whose data was evicted, is still loading in async mode, or lacks an
+   * exported deferred column, is read with one query.
+   * @param selection row ranges, for example
+   * QItemSelectionModel::selection()
+   * @param headerFlag true to write the column headers first
+   * @param sink called with each chunk of output
+   * @param columnList the columns to write in that order, for example the
+   * visible columns of the view. Empty writes every column.
+   * @return number of rows written, negative on error
+   */
+  int exportSelection(const QItemSelection &selection,
+                      SqliteRowWriter::Format format, bool headerFlag,
+                      SqliteRowWriter::Sink sink,
+                      std::vector<int> columnList = std::vector<int>());
+  /* Exports the selected rows for the clipboard. The output is streamed into
+   * the mime data, TSV as text/plain, CSV as text/csv, and HTML as
+   * text/html.
+   * @return the mime data, owned by the caller
+   */
+  QMimeData *exportMimeData(
+      const QItemSelection &selection,
+      SqliteRowWriter::Format format = SqliteRowWriter::Format::Tsv,
+      std::vector<int> columnList = std::vector<int>());
+  /* Exports the selected rows with headers to a file, for selections too
+   * large for the clipboard
+   * @return number of rows written, negative on error
+   */
+  int exportFile(const QItemSelection &selection,
+                 SqliteRowWriter::Format format, const QString &filePath,
+                 std::vector<int> columnList = std::vector<int>());
+  /* Saves the loaded rows, their child counts, and the expanded ids to a
+   * sidecar cache file, for example next to the database on exit. Only the
+   * indexes whose rows are loaded are saved.
+   * @param expandedIdList ids of the expanded rows, parents first
+   * @return 0 on success, else error code. Fails in flat mode and for
+   * in-memory databases.
+   */
+  int saveTreeCache(const std::string &filePath,
+                    const std::vector<std::string> &expandedIdList);
+  /* Restores the rows saved by saveTreeCache() in one model reset, without
+   * querying the table. The cache is checked against the size and
+   * modification time of the database and WAL files, the schema version,
+   * the largest rowid, and the sort and filter settings.
+   * @param expandedIdList set to the saved expanded ids
+   * @param staleFlag true to also show a cache whose database changed since
+   * it was saved. Its indexes are then re-queried one per event loop turn
+   * with precise row signals, so expansion and selection are kept.
+   * @return 0 on success, else error code. Fails if the sort, filter, or
+   * view root differ from the saved ones.
+   */
+  int loadTreeCache(const std::string &filePath,
+                    std::vector<std::string> &expandedIdList,
+                    bool staleFlag = true);
+  /* @return the id of the row, empty if the row is not cached
+   */
+  std::string getId(const QModelIndex &index) const;
+  /* @return the model index of a cached row, invalid if the id is not
+   * cached
+   */
+  QModelIndex getModelIndex(const std::string &id) const;
+  /* Updates the view after the database was changed by something other than
+   * this widget, using the same id lists connectUpdateIdHint() provides.
+   * Only the indexes holding the listed ids, or the children of their
+   * parents, are re-queried. Precise row insert, remove, and data change
+   * signals are emitted so expansion and selection are kept.
+   * @param addedIdList a list of id that were added
+   * @param updatedIdList a list of id that were updated
+   * @param deletedIdList a list of id that were deleted
+   * @return 0 on success, else error code
+   */
+  int updateIdHint(std::vector<std::string> addedIdList,
+                   std::vector<std::string> updatedIdList,
+                   std::vector<std::string> deletedIdList);
+  /* Captures the rows changed by other writers and updates the view like
+   * updateIdHint(), so TreeView::update() and its full reset are not
+   * needed.
+   * Writes on this connection, for example an ingest thread writing to the
+   * in-memory database the model views, are collected by the update and
+   * commit hooks. The changed rowids are coalesced per transaction and
+   * applied once control returns to the event loop, a burst of commits is
+   * applied together. The hooks replace any hooks registered on the
+   * connection. Writes made through the model are not captured.
+   * Writes of other connections to the database file are logged by
+   * triggers into a changelog table, which is read whenever PRAGMA
+   * data_version shows another connection committed. If more changes were
+   * made than the changelog keeps, every loaded index is re-queried.
+   * @param captureFlag true to enable, false to remove the hooks. The
+   * changelog is kept for other viewers.
+   * @param pollDelay milliseconds between changelog polls, -1 to only
+   * capture writes on this connection. Creating the changelog writes to the
+   * database file, so it fails in snapshot mode unless another viewer
+   * created it.
+   * @return 0 on success, else error code
+   */
+  int setChangeCapture(bool captureFlag, int pollDelay = -1);
+  /* Drops the changelog table and its triggers from the database file, for
+   * example once no viewer polls it anymore. This model stops polling, the
+   * hooks are kept. Other viewers polling it fail to read it.
+   * @return 0 on success, else error code. Fails in snapshot mode.
+   */
+  int dropChangelog();
+
   /* Connect a function that will be signaled when the database is updated by
    * this widget
    * @param addedIdList a list of id that were added. Only the
@@ -137,6 +693,19 @@ public:
       std::function<void(std::vector<std::string>, std::vector<std::string>,
                          std::vector<std::string>)>);
 
+  /* Connect a function that will be signaled when buffered edits could not
+   * be written
+   * @param id the row of an edit the database refused, its cell shows the
+   * stored value again. Empty when the whole write failed and the edits are
+   * kept to be written again.
+   * @param columnName the column of the refused edit, empty with the id
+   * @param message the sqlite3 error message
+   * @return 0 on success, else error code
+   */
+  int connectWriteError(std::function<void(std::string id,
+                                           std::string columnName,
+                                           std::string message)>);
+
   /* The vector representation of an SQL "ORDER BY" clause.
    * For example the initialized object:
    * {{"Country","ASC"},{"CustomerName","DESC"}}
@@ -151,18 +720,77 @@ public:
   /* The vector representation of an SQL "WHERE" clause.
    * For example the initialized object:
    * {{"name","Josephine","="},{"description","funny","match"}}
-   * is converted to the following internally
-   * WHERE `name`='Josephine' AND `description` MATCH 'funny'
+   * is converted to the following internally, with the values bound to the
+   * parameters so the statements are reused
+   * WHERE `name` = :f0 AND `table`.`id` IN (SELECT `bookfiler_id` FROM
+   * `table_bookfiler_fts` WHERE `table_bookfiler_fts` MATCH :f1)
    * the matching methid may be:
    * "=" exact match
-   * "match" full-text search
-   * "auto" exact match for integers and full text search for strings
+   * "match" full-text search. Each word of the value must start a word of
+   * the column. Uses a LIKE substring search if FTS5 is not available.
+   * "auto" exact match for numeric columns and full text search for strings
    * Does not update the view. You should update the view after calling this.
-   * @param sortOrderList A list of orders to sort by
+   * @param filterList {column name, value, condition}
    * @return 0 on success, else error code
    */
   int setFilter(
       std::list<std::tuple<std::string, std::string, std::string>> filterList);
+  /* Tree filter mode also keeps every ancestor of a matching row so matches
+   * deep in the tree stay reachable. The matches and their ancestors are
+   * collected once per filter change with a recursive query into a temp
+   * table instead of filtering each level separately.
+   * Does not update the view. You should update the view after calling this.
+   * @param treeFlag true to enable tree filter mode
+   * @return 0 on success, else error code
+   */
+  int setFilterTreeMode(bool treeFlag);
+  /* Enables the index advisor. Whenever the sort or filter changes, the
+   * plan of the generated data query is checked with EXPLAIN QUERY PLAN. If
+   * it scans the table or sorts with a temp b-tree, an index on the parent,
+   * "=" filter, and sort columns is created. The index is dropped when the
+   * combination changes or the advisor is disabled. Creating indexes writes
+   * to the database file. Indexes of a database file are built by a worker
+   * connection, only the indexes created by this model are dropped.
+   * @param enableFlag true to enable, false to drop the created indexes
+   * @param callback called on the GUI thread with the action ("create",
+   * "drop", "exists", or "fail"), the index name, and the query plan or
+   * error message
+   * @return 0 on success, else error code
+   */
+  int setIndexAdvisor(bool enableFlag,
+                      SqliteIndexAdvisor::Callback callback = nullptr);
+
+  /* Enables flat mode for table style views. The model has no parents and
+   * its rows are the visible rows of the tree in pre-order, read with one
+   * recursive query. index(), parent(), and rowCount() are array lookups.
+   * Use expandFlatRow() and collapseFlatRow() to show or hide the rows below
+   * a row and getFlatRowDepth() to indent it. Rows are read only in flat
+   * mode.
+   * @param flatFlag true to enable, false to go back to the tree
+   * @return 0 on success, else error code
+   */
+  int setFlatMode(bool flatFlag);
+  bool isFlatMode() const;
+  /* Inserts the visible rows below a flat row
+   * @param rowNum the flat row to expand
+   * @return 0 on success, else error code
+   */
+  int expandFlatRow(int rowNum);
+  /* Removes the rows below a flat row
+   * @param rowNum the flat row to collapse
+   * @return 0 on success, else error code
+   */
+  int collapseFlatRow(int rowNum);
+  /* @return the depth of a flat row, 0 for the top level, -1 if out of
+   * range
+   */
+  int getFlatRowDepth(int rowNum) const;
+  /* @return the flat row of the parent, -1 for the top level or if out of
+   * range
+   */
+  int getFlatParentRow(int rowNum) const;
+  bool isFlatRowExpanded(int rowNum) const;
+  bool hasFlatRowChildren(int rowNum) const;
 
   /* Essential QAbstractItemModel methods
    *
@@ -178,9 +806,30 @@ public:
   int rowCount(const QModelIndex &parent = QModelIndex()) const override;
   int columnCount(const QModelIndex &parent = QModelIndex()) const override;
   QVariant data(const QModelIndex &index, int role) const override;
+  /* Lazy population methods
+   */
+  bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+  bool canFetchMore(const QModelIndex &parent) const override;
+  void fetchMore(const QModelIndex &parent) override;
   /* Copy and move operations methods
+   *
+   * Dragged rows are encoded by id. Dropping them on a row moves or copies
+   * them and their subtrees under that row, dropping them on the viewport
+   * puts them under the view root. The drop position between rows is
+   * ignored because the rows are sorted.
+   *
+   * removeRows() deletes the rows and their whole subtrees from the
+   * database with one DELETE and signals every deleted id. After a move
+   * drop the dragging view removes the dragged rows, so rows moved by a
+   * drop are not deleted until the drag finished.
    */
   Qt::DropActions supportedDropActions() const override;
+  QStringList mimeTypes() const override;
+  QMimeData *mimeData(const QModelIndexList &indexes) const override;
+  bool canDropMimeData(const QMimeData *data, Qt::DropAction action, int row,
+                       int column, const QModelIndex &parent) const override;
+  bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row,
+                    int column, const QModelIndex &parent) override;
   bool removeRows(int row, int count,
                   const QModelIndex &parent = QModelIndex()) override;
   /* Other QAbstractItemModel methods
@@ -0,0 +1,342 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief QAbstractItemModel with a sqlite3 backend.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// C++
+#include <unordered_map>
+
+// Local Project
+#include "SqliteModelFlatTree.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/* columns after the table columns, counted from the last column
+ */
+static const int flatIdOffset = 4;
+static const int flatParentIdOffset = 3;
+static const int flatDepthOffset = 2;
+static const int flatChildOffset = 1;
+
+SqliteModelFlatTree::SqliteModelFlatTree(
+    std::shared_ptr<sqlite3> database_, std::string tableName_,
+    std::shared_ptr<boost::bimap<std::string, std::string>> columnMap_,
+    std::shared_ptr<std::list<std::pair<std::string, std::string>>>
+        sortOrder_,
+    std::shared_ptr<SqliteFilter> filter_,
+    std::shared_ptr<SqliteStatementCache> statementCache_)
+    : database(database_), tableName(tableName_), columnMap(columnMap_),
+      sortOrder(sortOrder_), filter(filter_),
+      statementCache(statementCache_) {}
+
+int SqliteModelFlatTree::setRootId(std::string rootId_) {
+  rootId = rootId_;
+  return 0;
+}
+
+int SqliteModelFlatTree::load() {
+  SqliteRowBlock blockData;
+  std::vector<FlatRow> blockList;
+  int rc = fetchBackend(rootId, -1, -1, blockData, blockList);
+  rowData = std::move(blockData);
+  rowList = std::move(blockList);
+  expandRowNum = -1;
+  return rc < 0 ? rc : 0;
+}
+
+int SqliteModelFlatTree::expandBackend(int rowNum) {
+  expandRowNum = -1;
+  if (rowNum < 0 || rowNum >= getRowCount() || rowList[rowNum].expandedFlag) {
+    return -1;
+  }
+  if (!rowList[rowNum].hasChildren) {
+    return 0;
+  }
+  expandedIdSet.insert(getRowId(rowNum));
+  expandData.clear();
+  expandList.clear();
+  int rc = fetchBackend(getRowId(rowNum), rowNum, rowList[rowNum].depth,
+                        expandData, expandList);
+  if (rc < 0) {
+    expandedIdSet.erase(getRowId(rowNum));
+    return rc;
+  }
+  expandRowNum = rowNum;
+  return rc;
+}
+
+void SqliteModelFlatTree::commitExpand() {
+  if (expandRowNum < 0) {
+    return;
+  }
+  int insertBegin = expandRowNum + 1;
+  int insertCount = static_cast<int>(expandList.size());
+  rowList[expandRowNum].expandedFlag = true;
+
+  // rows after the subtree move down, and so do their parents
+  for (int rowNum = insertBegin; rowNum < getRowCount(); rowNum++) {
+    if (rowList[rowNum].parentRow >= insertBegin) {
+      rowList[rowNum].parentRow += insertCount;
+    }
+  }
+  if (insertCount > 0) {
+    if (rowData.getColumnCount() != expandData.getColumnCount()) {
+      rowData.reset(expandData.getColumnCount());
+    }
+    rowData.insertRows(insertBegin, expandData, 0, insertCount);
+    rowList.insert(rowList.begin() + insertBegin, expandList.begin(),
+                   expandList.end());
+  }
+  expandData.clear();
+  expandList.clear();
+  expandRowNum = -1;
+}
+
+int SqliteModelFlatTree::getSubtreeEnd(int rowNum) const {
+  int rowEnd = rowNum + 1;
+  while (rowEnd < getRowCount() &&
+         rowList[rowEnd].depth > rowList[rowNum].depth) {
+    rowEnd++;
+  }
+  return rowEnd;
+}
+
+int SqliteModelFlatTree::collapse(int rowNum) {
+  if (rowNum < 0 || rowNum >= getRowCount() || !rowList[rowNum].expandedFlag) {
+    return 0;
+  }
+  int eraseBegin = rowNum + 1;
+  int eraseCount = getSubtreeEnd(rowNum) - eraseBegin;
+  rowList[rowNum].expandedFlag = false;
+  expandedIdSet.erase(getRowId(rowNum));
+  if (eraseCount <= 0) {
+    return 0;
+  }
+  rowData.eraseRows(eraseBegin, eraseCount);
+  rowList.erase(rowList.begin() + eraseBegin,
+                rowList.begin() + eraseBegin + eraseCount);
+  for (int rowNum_ = eraseBegin; rowNum_ < getRowCount(); rowNum_++) {
+    if (rowList[rowNum_].parentRow >= eraseBegin) {
+      rowList[rowNum_].parentRow -= eraseCount;
+    }
+  }
+  return eraseCount;
+}
+
+int SqliteModelFlatTree::getRowCount() const {
+  return static_cast<int>(rowList.size());
+}
+
+const SqliteModelFlatTree::FlatRow &
+SqliteModelFlatTree::getRow(int rowNum) const {
+  return rowList.at(rowNum);
+}
+
+const SqliteRowBlock &SqliteModelFlatTree::getRowData() const {
+  return rowData;
+}
+
+std::string SqliteModelFlatTree::getRowId(int rowNum) const {
+  return rowData.getString(rowNum, rowData.getColumnCount() - flatIdOffset);
+}
+
+std::string SqliteModelFlatTree::getExpandedTableName() const {
+  return tableName + "_bookfiler_expanded";
+}
+
+int SqliteModelFlatTree::setupExpanded() {
+  std::string expandedTableSQL = "temp.`" + getExpandedTableName() + "`";
+  std::string setupSQL = "CREATE TEMP TABLE IF NOT EXISTS `" +
+                         getExpandedTableName() +
+                         "`(id PRIMARY KEY) WITHOUT ROWID;"
+                         "DELETE FROM " +
+                         expandedTableSQL + ";";
+  // a snapshot connection only allows the temp table writes
+  SqliteSnapshot::TempWriteScope tempWriteScope(database.get());
+  int rc = sqlite3_exec(database.get(), setupSQL.c_str(), nullptr, nullptr,
+                        nullptr);
+  if (rc != SQLITE_OK || expandedIdSet.empty()) {
+    return rc;
+  }
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("flat:expanded", [&]() {
+        return "INSERT OR IGNORE INTO " + expandedTableSQL +
+               "(id) VALUES (?1);";
+      });
+  if (!stmt) {
+    return -1;
+  }
+  for (auto &id : expandedIdSet) {
+    sqlite3_bind_text(stmt.get(), 1, id.c_str(), static_cast<int>(id.size()),
+                      SQLITE_TRANSIENT);
+    rc = sqlite3_step(stmt.get());
+    sqlite3_reset(stmt.get());
+    if (rc != SQLITE_DONE) {
+      return rc;
+    }
+  }
+  return 0;
+}
+
+std::string SqliteModelFlatTree::getSQL(bool rootFlag) const {
+  std::string tableSQL = "`" + tableName + "`";
+  std::string idSQL = tableSQL + ".`" + columnMap->left.at("id") + "`";
+  std::string parentIdSQL =
+      tableSQL + ".`" + columnMap->left.at("parentId") + "`";
+  std::string filterSQL = filter ? filter->getSQL() : std::string();
+  filterSQL = filterSQL.empty() ? "" : " AND " + filterSQL;
+
+  /* Walks down from the parent through the expanded rows only. The walk
+   * columns have prefixed names so the filter columns are not ambiguous.
+   * The path holds the ids above each row, separated by char(31), so a
+   * parentId cycle among the expanded rows stops at the first revisit.
+   */
+  std::string startPathSQL =
+      rootFlag ? "char(31)" : "char(31) || :parentId || char(31)";
+  std::string sqlQuery =
+      "WITH RECURSIVE bookfilerWalk(bookfilerId, bookfilerDepth, "
+      "bookfilerPath) AS (SELECT " +
+      idSQL + ", 0, " + startPathSQL + " || " + idSQL + " || char(31) FROM " +
+      tableSQL + " WHERE " + parentIdSQL +
+      (rootFlag ? " IS NULL" : " = :parentId") + filterSQL +
+      " UNION ALL SELECT " + idSQL +
+      ", bookfilerWalk.bookfilerDepth + 1, bookfilerWalk.bookfilerPath || " +
+      idSQL + " || char(31) FROM " + tableSQL + " JOIN bookfilerWalk ON " +
+      parentIdSQL +
+      " = bookfilerWalk.bookfilerId WHERE bookfilerWalk.bookfilerId IN "
+      "(SELECT id FROM temp.`" +
+      getExpandedTableName() + "`) AND instr(bookfilerWalk.bookfilerPath, "
+      "char(31) || " +
+      idSQL + " || char(31)) = 0" + filterSQL + ")";
+
+  // the child flag subquery reads its own copy of the table
+  sqlQuery.append(" SELECT " + tableSQL +
+                  ".*, bookfilerWalk.bookfilerId, " + parentIdSQL +
+                  ", bookfilerWalk.bookfilerDepth, EXISTS(SELECT 1 FROM " +
+                  tableSQL + " WHERE " + parentIdSQL +
+                  " = bookfilerWalk.bookfilerId" + filterSQL + ") FROM " +
+                  tableSQL + " JOIN bookfilerWalk ON " + idSQL +
+                  " = bookfilerWalk.bookfilerId");
+
+  // siblings are grouped in sort order, the pre-order is built afterwards
+  sqlQuery.append(" ORDER BY bookfilerWalk.bookfilerDepth");
+  for (auto sortElement : *sortOrder) {
+    sqlQuery.append(", " + tableSQL + ".`" + sortElement.first + "` " +
+                    sortElement.second);
+  }
+  sqlQuery.append(", " + idSQL + " ASC;");
+  return sqlQuery;
+}
+
+int SqliteModelFlatTree::fetchBackend(const std::string &parentId,
+                                      int parentRow, int parentDepth,
+                                      SqliteRowBlock &blockData,
+                                      std::vector<FlatRow> &blockList) {
+  int rc = setupExpanded();
+  if (rc != 0) {
+    return -1;
+  }
+  if (filter) {
+    rc = SqliteFilter::setup(*statementCache, filter->getTreeSQL(),
+                             filter->getVersion(), filter->getParamData());
+    if (rc != 0) {
+      return -1;
+    }
+  }
+  bool rootFlag = parentId == "*";
+  std::shared_ptr<sqlite3_stmt> stmt = statementCache->get(
+      rootFlag ? "flat:root" : "flat", [&]() { return getSQL(rootFlag); });
+  if (!stmt) {
+    return -1;
+  }
+  if (!rootFlag) {
+    sqlite3_bind_text(stmt.get(),
+                      sqlite3_bind_parameter_index(stmt.get(), ":parentId"),
+                      parentId.c_str(), static_cast<int>(parentId.size()),
+                      SQLITE_TRANSIENT);
+  }
+  if (filter) {
+    SqliteFilter::bind(stmt.get(), filter->getParamData());
+  }
+
+  // rows arrive level by level in sort order
+  SqliteRowBlock levelData(sqlite3_column_count(stmt.get()));
+  while ((rc = sqlite3_step(stmt.get())) == SQLITE_ROW) {
+    levelData.appendRow(stmt.get());
+  }
+  if (rc != SQLITE_DONE) {
+    return -2;
+  }
+
+  /* Group the rows under their parent id, then lay them out depth first.
+   * The top level rows are grouped under an empty key.
+   */
+  int columnCount = levelData.getColumnCount();
+  std::unordered_map<std::string, std::vector<int>> childListMap;
+  for (int rowNum = 0; rowNum < levelData.getRowCount(); rowNum++) {
+    bool topFlag = levelData.getInt(rowNum, columnCount - flatDepthOffset) == 0;
+    childListMap[topFlag ? std::string()
+                         : levelData.getString(
+                               rowNum, columnCount - flatParentIdOffset)]
+        .push_back(rowNum);
+  }
+  blockData.reset(columnCount);
+  blockList.clear();
+  blockList.reserve(levelData.getRowCount());
+
+  // stack of {level row, flat parent row, child number}
+  struct StackElement {
+    int levelRow, parentRow, childNum;
+  };
+  std::vector<StackElement> stack;
+  auto pushChildren = [&](const std::string &key, int flatParentRow) {
+    auto findIt = childListMap.find(key);
+    if (findIt == childListMap.end()) {
+      return;
+    }
+    for (int childNum = static_cast<int>(findIt->second.size()) - 1;
+         childNum >= 0; childNum--) {
+      stack.push_back({findIt->second[childNum], flatParentRow, childNum});
+    }
+  };
+  pushChildren(std::string(), parentRow);
+  int flatBegin = parentRow + 1;
+  while (!stack.empty()) {
+    StackElement element = stack.back();
+    stack.pop_back();
+    FlatRow flatRow;
+    flatRow.depth =
+        parentDepth + 1 +
+        static_cast<int>(
+            levelData.getInt(element.levelRow, columnCount - flatDepthOffset));
+    flatRow.parentRow = element.parentRow;
+    flatRow.childNum = element.childNum;
+    flatRow.hasChildren =
+        levelData.getInt(element.levelRow, columnCount - flatChildOffset) != 0;
+    std::string id =
+        levelData.getString(element.levelRow, columnCount - flatIdOffset);
+    flatRow.expandedFlag = flatRow.hasChildren && expandedIdSet.count(id);
+    int flatRowNum = flatBegin + static_cast<int>(blockList.size());
+    blockList.push_back(flatRow);
+    blockData.insertRows(blockData.getRowCount(), levelData, element.levelRow,
+                         1);
+    if (flatRow.expandedFlag) {
+      pushChildren(id, flatRowNum);
+    }
+  }
+  return static_cast<int>(blockList.size());
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief QAbstractItemModel with a sqlite3 backend.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_QMODEL_SQLITE_MODEL_FLAT_TREE_H
+#define BOOKFILER_QMODEL_SQLITE_MODEL_FLAT_TREE_H
+
+// config
+#include "../core/config.hpp"
+
+// C++
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/* boost 1.72.0
+ * License: Boost Software License (similar to BSD and MIT)
+ */
+#include <boost/bimap.hpp>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "../core/SqliteFilter.hpp"
+#include "../core/SqliteRowBlock.hpp"
+#include "../core/SqliteSnapshot.hpp"
+#include "../core/SqliteStatementCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief The visible rows of the tree in pre-order, the order a fully laid
+ * out tree view shows them. The rows below every expanded row are read with
+ * one recursive query. Row lookups are array accesses, and expanding or
+ * collapsing a row inserts or erases the rows of its subtree in place.
+ */
+class SqliteModelFlatTree {
+public:
+  struct FlatRow {
+    /* 0 for the top level rows
+     */
+    int depth = 0;
+    /* position of the parent row in the flat list, -1 for top level rows
+     */
+    int parentRow = -1;
+    /* position among the siblings
+     */
+    int childNum = 0;
+    bool hasChildren = false, expandedFlag = false;
+  };
+
+private:
+  std::shared_ptr<sqlite3> database;
+  std::string tableName;
+  std::shared_ptr<boost::bimap<std::string, std::string>> columnMap;
+  std::shared_ptr<std::list<std::pair<std::string, std::string>>> sortOrder;
+  std::shared_ptr<SqliteFilter> filter;
+  std::shared_ptr<SqliteStatementCache> statementCache;
+  /* the parent id of the top level rows, "*" for rows without a parent
+   */
+  std::string rootId = "*";
+  /* one row per visible row. The columns after the table columns hold the
+   * id, parent id, depth, and child flag of the row.
+   */
+  SqliteRowBlock rowData;
+  std::vector<FlatRow> rowList;
+  /* ids of the expanded rows, kept while collapsed so the subtree opens as
+   * it was left
+   */
+  std::unordered_set<std::string> expandedIdSet;
+  /* subtree read by expandBackend() waiting for commitExpand()
+   */
+  int expandRowNum = -1;
+  SqliteRowBlock expandData;
+  std::vector<FlatRow> expandList;
+
+  /* Reads the visible rows below a parent in pre-order
+   * @param parentId the parent of the top level rows read
+   * @param parentRow the position of the parent, -1 for the root
+   * @param parentDepth the depth of the parent, -1 for the root
+   * @return number of rows read, negative on error
+   */
+  int fetchBackend(const std::string &parentId, int parentRow,
+                   int parentDepth, SqliteRowBlock &blockData,
+                   std::vector<FlatRow> &blockList);
+  std::string getSQL(bool rootFlag) const;
+  /* writes expandedIdSet to the temp table the query reads
+   * @return 0 on success, else error code
+   */
+  int setupExpanded();
+  std::string getExpandedTableName() const;
+
+public:
+  SqliteModelFlatTree(
+      std::shared_ptr<sqlite3> database_, std::string tableName_,
+      std::shared_ptr<boost::bimap<std::string, std::string>> columnMap_,
+      std::shared_ptr<std::list<std::pair<std::string, std::string>>>
+          sortOrder_,
+      std::shared_ptr<SqliteFilter> filter_,
+      std::shared_ptr<SqliteStatementCache> statementCache_);
+
+  int setRootId(std::string rootId);
+  /* Reads all visible rows again, for example after the sort order changed
+   * @return 0 on success, else error code
+   */
+  int load();
+  /* Reads the visible rows below a collapsed row
+   * @return number of rows that commitExpand() will insert, negative on
+   * error
+   */
+  int expandBackend(int rowNum);
+  /* Inserts the rows read by expandBackend() after the expanded row
+   */
+  void commitExpand();
+  /* @return the position after the last row of the subtree of a row
+   */
+  int getSubtreeEnd(int rowNum) const;
+  /* Erases the rows below an expanded row
+   * @return number of rows erased
+   */
+  int collapse(int rowNum);
+
+  int getRowCount() const;
+  const FlatRow &getRow(int rowNum) const;
+  const SqliteRowBlock &getRowData() const;
+  std::string getRowId(int rowNum) const;
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_QMODEL_SQLITE_MODEL_FLAT_TREE_H
+#endif
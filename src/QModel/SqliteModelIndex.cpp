@@ -9,8 +9,7 @@
 #if DEPENDENCY_SQLITE
 
 // C++
-#include <algorithm> // std::find
-#include <iostream>  // std::cout
+#include <algorithm> // std::find, std::binary_search, std::min
 #include <vector>    // std::vector
 
 // Local Project
@@ -22,18 +21,34 @@
 namespace bookfiler {
 namespace widget {
 
+/* decoded text cells kept per index, about the cells of a few screens
+ */
+static const std::size_t textCacheCellLimit = 4096;
+
 SqliteModelIndex::SqliteModelIndex(
     std::shared_ptr<sqlite3> database_, std::string tableName_,
     std::shared_ptr<boost::bimap<std::string, std::string>> columnMap_,
     std::shared_ptr<boost::bimap<int, int>> columnNumMap_,
-    std::shared_ptr<boost::bimap<std::string, int>> columnToNumMap_)
+    std::shared_ptr<boost::bimap<std::string, int>> columnToNumMap_,
+    std::shared_ptr<SqliteIdInterner> idInterner_)
     : database(database_), tableName(tableName_), columnMap(columnMap_),
       columnNumMap(columnNumMap_), columnToNumMap(columnToNumMap_) {
+  idInterner = idInterner_;
+  parentIdNum = idInterner->intern(parentId);
   // Don't cache data yet because sortOrder and filterList have not been set
   // yet. Let the sqliteModel decide when to do full cache.
 }
 
-SqliteModelIndex::~SqliteModelIndex() {}
+SqliteModelIndex::~SqliteModelIndex() {
+  if (indexLru) {
+    indexLru->remove(this);
+  }
+  if (nodeTable) {
+    nodeTable->removeRows(handle, indexedIdList);
+    nodeTable->removeEvictedRows(handle, evictedIdList);
+    nodeTable->remove(handle);
+  }
+}
 
 int SqliteModelIndex::setParent(SqliteModelIndex *parentIndex_) {
   parentIndex = parentIndex_;
@@ -49,11 +64,14 @@ int SqliteModelIndex::setSortOrder(
   return 0;
 }
 
-int SqliteModelIndex::setFilterList(
-    std::shared_ptr<
-        std::list<std::tuple<std::string, std::string, std::string>>>
-        filterList_) {
-  filterList = filterList_;
+int SqliteModelIndex::setDeferredColumnList(
+    std::shared_ptr<std::vector<int>> deferredColumnList_) {
+  deferredColumnList = deferredColumnList_;
+  return 0;
+}
+
+int SqliteModelIndex::setFilter(std::shared_ptr<SqliteFilter> filter_) {
+  filter = filter_;
   return 0;
 }
 
@@ -61,174 +79,242 @@ std::string SqliteModelIndex::getParentId() { return parentId; }
 
 int SqliteModelIndex::setParentId(std::string parentId_) {
   parentId = parentId_;
+  parentIdNum = idInterner->intern(parentId);
   return 0;
 }
 
+std::uint32_t SqliteModelIndex::getParentIdNum() { return parentIdNum; }
+
 std::optional<std::string> SqliteModelIndex::getParentIdBackend() {
-  std::string indexId = "";
-  std::string *parentId;
-  int rc = 0;
+  std::optional<std::string> parentIdOpt;
+  if (parentId == "*") {
+    return parentIdOpt;
+  }
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::ParentId);
 
   // Get the parentID from the SELECT of the id
-  std::string sqlQuery = "SELECT `" + columnMap->left.at("parentId") +
-                         "` FROM `" + tableName + "` WHERE `" +
-                         columnMap->left.at("id") + "`='" + indexId + "';";
-
-  /* sqlite3_prepare_v2, sqlite3_step, sqlite3_finalize is used
-   * instead of sqlite3_exec because it allows more control over the
-   * extracted data type. This method also allows progressive handling of the
-   * queried data rather and avoids sqlite3_exec callback that will fragment the
-   * logic too much.
-   */
-
-  // sqlite3 prepare statement
-  sqlite3_stmt *stmt = nullptr;
-  rc = sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
-  if (rc != SQLITE_OK)
-    return std::optional<std::string>();
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("parentId", [this]() {
+        return "SELECT `" + columnMap->left.at("parentId") + "` FROM `" +
+               tableName + "` WHERE `" + columnMap->left.at("id") + "`=:id;";
+      });
+  if (!stmt)
+    return parentIdOpt;
+  bindText(stmt.get(), ":id", parentId);
 
   // sqlite3 step loop
-  rc = sqlite3_step(stmt);
-  while (rc != SQLITE_DONE && rc != SQLITE_OK) {
-    int colCount = sqlite3_column_count(stmt);
-    for (int colIndex = 0; colIndex < colCount; colIndex++) {
-      int type = sqlite3_column_type(stmt, colIndex);
-      if (type == SQLITE_NULL) {
-        break;
-      }
-      const unsigned char *valChar = sqlite3_column_text(stmt, colIndex);
-      parentId = new std::string(reinterpret_cast<const char *>(valChar));
-    }
-    rc = sqlite3_step(stmt);
+  int rc = sqlite3_step(stmt.get());
+  if (rc == SQLITE_ROW && sqlite3_column_type(stmt.get(), 0) != SQLITE_NULL) {
+    const unsigned char *valChar = sqlite3_column_text(stmt.get(), 0);
+    parentIdOpt = std::string(reinterpret_cast<const char *>(valChar),
+                              sqlite3_column_bytes(stmt.get(), 0));
   }
 
-  // sqlite3 finalize
-  rc = sqlite3_finalize(stmt);
-  if (rc != 0) {
-    return std::optional<std::string>();
+  return parentIdOpt;
+}
+
+QVariant SqliteModelIndex::getDataCell(int rowNum, int columnNum) {
+  if (rowNum < 0 || rowNum >= data.getRowCount() || columnNum < 0 ||
+      columnNum >= data.getColumnCount()) {
+    return QVariant();
+  }
+  if (data.isDeferred(rowNum, columnNum)) {
+    getDataCellBackend(rowNum, columnNum);
+  }
+  if (data.getType(rowNum, columnNum) != SqliteRowBlock::CellType::Text) {
+    return getCellVariant(data, rowNum, columnNum);
   }
+  std::size_t cellNum =
+      static_cast<std::size_t>(rowNum) * data.getColumnCount() + columnNum;
+  auto textIt = textCache.find(cellNum);
+  if (textIt != textCache.end()) {
+    return QVariant(textIt->second);
+  }
+  QString text;
+  auto oldTextIt = textCacheOld.find(cellNum);
+  if (oldTextIt != textCacheOld.end()) {
+    text = oldTextIt->second;
+    textCacheOld.erase(oldTextIt);
+  } else {
+    std::string_view value = data.getText(rowNum, columnNum);
+    text = QString::fromUtf8(value.data(), static_cast<int>(value.size()));
+    textCacheByteSize += text.size() * sizeof(QChar);
+  }
+  // the cells not shown since the last rotation are dropped
+  if (textCache.size() >= textCacheCellLimit / 2) {
+    for (auto &textPair : textCacheOld) {
+      textCacheByteSize -= textPair.second.size() * sizeof(QChar);
+    }
+    textCacheOld.swap(textCache);
+    textCache.clear();
+  }
+  textCache.emplace(cellNum, text);
+  return QVariant(text);
+}
 
-  if (!parentId)
-    return std::optional<std::string>();
+void SqliteModelIndex::invalidateTextCell(int rowNum, int columnNum) {
+  std::size_t cellNum =
+      static_cast<std::size_t>(rowNum) * data.getColumnCount() + columnNum;
+  for (auto *cachePtr : {&textCache, &textCacheOld}) {
+    auto textIt = cachePtr->find(cellNum);
+    if (textIt != cachePtr->end()) {
+      textCacheByteSize -= textIt->second.size() * sizeof(QChar);
+      cachePtr->erase(textIt);
+    }
+  }
+}
 
-  return *parentId;
+void SqliteModelIndex::clearTextCache() {
+  std::unordered_map<std::size_t, QString>().swap(textCache);
+  std::unordered_map<std::size_t, QString>().swap(textCacheOld);
+  textCacheByteSize = 0;
 }
 
-QVariant SqliteModelIndex::getDataCell(int rowNum, int columnNum) {
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getDataCell
-  std::cout << BOOST_CURRENT_FUNCTION << " rowNum: " << rowNum
-            << ", columnNum: " << columnNum << std::endl;
-  std::cout << "id: " << id << ", parentId: " << parentId
-            << ", RowNum: " << getRowNum() << ", ColNum: " << getColNum()
-            << std::endl;
-#endif
-  return data.at(rowNum).at(columnNum);
+QVariant SqliteModelIndex::getCellVariant(const SqliteRowBlock &block,
+                                          int rowNum, int columnNum) {
+  switch (block.getType(rowNum, columnNum)) {
+  case SqliteRowBlock::CellType::Integer:
+    return QVariant(static_cast<qlonglong>(block.getInt(rowNum, columnNum)));
+  case SqliteRowBlock::CellType::Float:
+    return QVariant(block.getFloat(rowNum, columnNum));
+  case SqliteRowBlock::CellType::Text: {
+    std::string_view value = block.getText(rowNum, columnNum);
+    return QVariant(
+        QString::fromUtf8(value.data(), static_cast<int>(value.size())));
+  }
+  case SqliteRowBlock::CellType::Blob: {
+    std::string_view value = block.getText(rowNum, columnNum);
+    return QVariant(QByteArray(value.data(), static_cast<int>(value.size())));
+  }
+  default:
+    return QVariant();
+  }
 }
 
 int SqliteModelIndex::setDataCell(int rowNum, int columnNum, QVariant value) {
-  data[rowNum][columnNum] = value;
+  if (rowNum < 0 || rowNum >= data.getRowCount() || columnNum < 0 ||
+      columnNum >= data.getColumnCount()) {
+    return -1;
+  }
+  invalidateTextCell(rowNum, columnNum);
+  // keep the storage class of the value
+  switch (value.type()) {
+  case QVariant::Invalid:
+    data.setNull(rowNum, columnNum);
+    break;
+  case QVariant::Bool:
+  case QVariant::Int:
+  case QVariant::UInt:
+  case QVariant::LongLong:
+  case QVariant::ULongLong:
+    data.setInt(rowNum, columnNum, value.toLongLong());
+    break;
+  case QVariant::Double:
+    data.setFloat(rowNum, columnNum, value.toDouble());
+    break;
+  case QVariant::ByteArray: {
+    QByteArray valueBytes = value.toByteArray();
+    data.setBlob(rowNum, columnNum,
+                 std::string_view(valueBytes.constData(), valueBytes.size()));
+    break;
+  }
+  default: {
+    QByteArray valueBytes = value.toString().toUtf8();
+    data.setText(rowNum, columnNum,
+                 std::string_view(valueBytes.constData(), valueBytes.size()));
+    break;
+  }
+  }
   return 0;
 }
 
 int SqliteModelIndex::getDataCellBackend(int rowNum, int columnNum) {
-  QVariant value;
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::CellLoad);
+  const std::string *childId = getRowIdText(rowNum);
+  if (!childId) {
+    return -1;
+  }
 
-  std::string columnCodeName = columnToNumMap->right.at(columnNum);
-  std::string columnActualName = columnMap->left.at(columnCodeName);
+  // columnToNumMap holds the sqlite3 column names
+  auto columnNameIt = columnToNumMap->right.find(columnNum);
+  if (columnNameIt == columnToNumMap->right.end()) {
+    return -1;
+  }
+  std::string columnActualName = columnNameIt->second;
   // Get the fieldValue from the SELECT of the id
-  std::string sqlQuery = "SELECT `" + columnActualName + "` FROM `" +
-                         tableName + "` LIMIT " + std::to_string(rowNum) +
-                         ",1;";
-
-  /* sqlite3_prepare_v2, sqlite3_step, sqlite3_finalize is used
-   * instead of sqlite3_exec because it allows more control over the
-   * extracted data type. This method also allows progressive handling of the
-   * queried data rather and avoids sqlite3_exec callback that will fragment the
-   * logic too much.
-   */
-
-  // sqlite3 prepare statement
-  sqlite3_stmt *stmt = nullptr;
-  int rc =
-      sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("cell:" + columnActualName, [&]() {
+        return "SELECT `" + columnActualName + "` FROM `" + tableName +
+               "` WHERE `" + columnMap->left.at("id") + "`=:id;";
+      });
+  if (!stmt) {
     return -1;
   }
+  bindText(stmt.get(), ":id", *childId);
 
   // sqlite3 step loop
-  rc = sqlite3_step(stmt);
-  while (rc != SQLITE_DONE && rc != SQLITE_OK) {
-    int colCount = sqlite3_column_count(stmt);
-    for (int colIndex = 0; colIndex < colCount; colIndex++) {
-      /* Should the underying value data type be checked?
-       * Does treating all value types as text save time?
-       */
-      const unsigned char *valChar = sqlite3_column_text(stmt, colIndex);
-      if (valChar) {
-        value = QVariant(QString().fromStdString(
-            std::string(reinterpret_cast<const char *>(valChar))));
-      }
-    }
-    rc = sqlite3_step(stmt);
-  }
-
-  // sqlite3 finalize
-  rc = sqlite3_finalize(stmt);
-  if (rc != 0) {
+  int rc = sqlite3_step(stmt.get());
+  if (rc == SQLITE_ROW) {
+    // cache
+    invalidateTextCell(rowNum, columnNum);
+    data.setFromStatement(rowNum, columnNum, stmt.get(), 0);
+    timer.setResult(1);
+  } else if (rc != SQLITE_DONE) {
     return -1;
+  } else if (data.isDeferred(rowNum, columnNum)) {
+    // the row was deleted, do not query it again on every paint
+    data.setNull(rowNum, columnNum);
   }
 
-  // cache
-  data[rowNum][columnNum] = value;
-
   return 0;
 }
 
+int SqliteModelIndex::bufferDataCell(int rowNum, int columnNum,
+                                     SqliteWriteBuffer &writeBuffer) {
+  auto columnCodeIt = columnToNumMap->right.find(columnNum);
+  if (columnCodeIt == columnToNumMap->right.end()) {
+    return -1;
+  }
+  auto columnActualIt = columnMap->left.find(columnCodeIt->second);
+  if (columnActualIt == columnMap->left.end()) {
+    return -1;
+  }
+  const std::string *childId = getRowIdText(rowNum);
+  if (!childId) {
+    return -1;
+  }
+  return writeBuffer.add(*childId, columnActualIt->second, data, rowNum,
+                         columnNum);
+}
+
 int SqliteModelIndex::setDataCellBackend(int rowNum, int columnNum) {
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::CellUpdate);
   std::string columnCodeName = columnToNumMap->right.at(columnNum);
   std::string columnActualName = columnMap->left.at(columnCodeName);
-  QVariant value = data.at(rowNum).at(columnNum);
-  int rc = 0;
-
-  auto childId = getRowId(rowNum);
+  const std::string *childId = getRowIdText(rowNum);
   if (!childId) {
     return -1;
   }
 
-  // Get the fieldValue from the SELECT of the id
-  std::string sqlQuery = "UPDATE`" + tableName + "` SET `" + columnActualName +
-                         "` = '" + value.toString().toStdString() +
-                         "' WHERE `" + columnMap->left.at("id") + "` = '" +
-                         *childId + "';";
-
-  /* sqlite3_prepare_v2, sqlite3_step, sqlite3_finalize is used
-   * instead of sqlite3_exec because it allows more control over the
-   * extracted data type. This method also allows progressive handling of the
-   * queried data rather and avoids sqlite3_exec callback that will fragment the
-   * logic too much.
-   */
-
-  // sqlite3 prepare statement
-  sqlite3_stmt *stmt = nullptr;
-  rc = sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
+  // Update the field value of the id
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("update:" + columnActualName, [&]() {
+        return "UPDATE `" + tableName + "` SET `" + columnActualName +
+               "`=:value WHERE `" + columnMap->left.at("id") + "`=:id;";
+      });
+  if (!stmt) {
     return -1;
   }
+  data.bindCell(stmt.get(), sqlite3_bind_parameter_index(stmt.get(), ":value"),
+                rowNum, columnNum);
+  bindText(stmt.get(), ":id", *childId);
 
-  // sqlite3 step loop
-  rc = sqlite3_step(stmt);
-  while (rc != SQLITE_DONE && rc != SQLITE_OK) {
-    int colCount = sqlite3_column_count(stmt);
-    for (int colIndex = 0; colIndex < colCount; colIndex++) {
-      // TODO
-      // nothing for updates?
-    }
-    rc = sqlite3_step(stmt);
-  }
-
-  // sqlite3 finalize
-  rc = sqlite3_finalize(stmt);
-  if (rc != 0) {
+  int rc = sqlite3_step(stmt.get());
+  if (rc != SQLITE_DONE) {
+    timer.setResult(-2);
     return -2;
   }
 
@@ -236,148 +322,363 @@ int SqliteModelIndex::setDataCellBackend(int rowNum, int columnNum) {
 }
 
 int SqliteModelIndex::getDataBackend() {
-  int rc = 0;
-  // Get the parentID from the SELECT of the id
-  std::string sqlQuery = "SELECT * FROM `" + tableName + "`";
-  sqlQuery.append(getWhereSQL(getParentId()));
-  sqlQuery.append(getOrderBySQL());
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::DataLoad);
+  SqliteInstrumentation::Timer expandTimer(
+      instrumentation.get(), warmFlag
+                                 ? SqliteInstrumentation::Query::ExpandWarm
+                                 : SqliteInstrumentation::Query::ExpandCold);
+  loadedFlag = true;
+  warmFlag = true;
+  fetchData.clear();
+  childCountMap.clear();
+
+  // wipe current data cache
+  data.clear();
 
-  /* sqlite3_prepare_v2, sqlite3_step, sqlite3_finalize is used
-   * instead of sqlite3_exec because it allows more control over the
-   * extracted data type. This method also allows progressive handling of the
-   * queried data rather and avoids sqlite3_exec callback that will fragment the
-   * logic too much.
+  // reload as many rows as the view saw before the data was evicted
+  int limit =
+      fetchBlockSize > 0 ? std::max(fetchBlockSize, evictedRowCount) : -1;
+  evictedRowCount = 0;
+  int rc = fetchRowsBackend(limit, false, data);
+  timer.setResult(rc);
+  expandTimer.setResult(rc);
+  if (indexLru) {
+    indexLru->update(this, byteSize());
+  }
+  updateChildRowNums();
+  if (rc < 0) {
+    fetchedAllFlag = true;
+    return rc;
+  }
+  fetchedAllFlag = limit < 0 || rc < limit;
+
+  return 0;
+}
+
+SqliteModelIndexQuery SqliteModelIndex::getDataQuery(int limit, bool afterKey,
+                                                     bool deferFlag) {
+  SqliteModelIndexQuery query;
+  int keyRowNum = data.getRowCount() - 1;
+  bool keysetFlag = afterKey && keyRowNum >= 0;
+  query.signature = "data";
+  query.signature.append(parentId == "*" ? ":root" : "");
+  query.signature.append(keysetFlag ? ":keyset" : "");
+  query.signature.append(limit >= 0 ? ":limit" : "");
+  if (deferFlag && deferredColumnList) {
+    query.deferredColumnList = *deferredColumnList;
+  }
+  query.signature.append(deferFlag ? "" : ":all");
+  query.parentId = parentId;
+  query.limit = limit;
+
+  /* copy the ORDER BY tuple of the last cached row. The id column is always
+   * the last element to break ties.
    */
+  if (keysetFlag) {
+    for (auto sortElement : *sortOrder) {
+      auto findIt = columnToNumMap->left.find(sortElement.first);
+      query.keyColumnList.push_back(
+          findIt == columnToNumMap->left.end() ? -1 : findIt->second);
+    }
+    query.keyColumnList.push_back(
+        columnToNumMap->left.at(columnMap->left.at("id")));
+    query.keyData.reset(data.getColumnCount());
+    query.keyData.insertRows(0, data, keyRowNum, 1);
+  }
+  if (filter) {
+    query.filterData = filter->getParamData();
+    query.filterTreeSQL = filter->getTreeSQL();
+    query.filterVersion = filter->getVersion();
+  }
+  return query;
+}
+
+std::string
+SqliteModelIndex::getDataSQL(const SqliteModelIndexQuery &query) const {
+  std::string whereSQL = getWhereSQL(query.parentId);
+  if (!query.keyColumnList.empty()) {
+    whereSQL.append((whereSQL.empty() ? " WHERE (" : " AND (") +
+                    getKeysetSQL() + ")");
+  }
+  std::string sqlQuery = getSelectSQL(query.deferredColumnList);
+  sqlQuery.append(" FROM `" + tableName + "`");
+  sqlQuery.append(whereSQL);
+  sqlQuery.append(getOrderBySQL());
+  if (query.limit >= 0) {
+    sqlQuery.append(" LIMIT :limit");
+  }
+  return sqlQuery;
+}
 
-  // sqlite3 prepare statement
-  sqlite3_stmt *stmt = nullptr;
-  rc = sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
+std::string SqliteModelIndex::getSelectSQL(
+    const std::vector<int> &queryDeferredList) const {
+  if (queryDeferredList.empty()) {
+    return "SELECT *";
+  }
+  // deferred columns keep their position so the cache layout is the same
+  std::string sqlQuery = "SELECT ";
+  for (int columnNum = 0; columnNum < static_cast<int>(columnToNumMap->size());
+       columnNum++) {
+    sqlQuery.append(columnNum == 0 ? "" : ", ");
+    auto columnNameIt = columnToNumMap->right.find(columnNum);
+    if (std::binary_search(queryDeferredList.begin(), queryDeferredList.end(),
+                           columnNum) ||
+        columnNameIt == columnToNumMap->right.end()) {
+      sqlQuery.append("NULL");
+    } else {
+      sqlQuery.append("`" + columnNameIt->second + "`");
+    }
+  }
+  return sqlQuery;
+}
+
+/* @return true if two cells hold the same value with the same storage class
+ */
+static bool isSameCell(const SqliteRowBlock &block, int rowNum, int columnNum,
+                       const SqliteRowBlock &other, int otherRowNum) {
+  SqliteRowBlock::CellType cellType = block.getType(rowNum, columnNum);
+  if (cellType != other.getType(otherRowNum, columnNum)) {
+    return false;
+  }
+  switch (cellType) {
+  case SqliteRowBlock::CellType::Integer:
+    return block.getInt(rowNum, columnNum) ==
+           other.getInt(otherRowNum, columnNum);
+  case SqliteRowBlock::CellType::Float:
+    return block.getFloat(rowNum, columnNum) ==
+           other.getFloat(otherRowNum, columnNum);
+  case SqliteRowBlock::CellType::Text:
+  case SqliteRowBlock::CellType::Blob:
+    return block.getText(rowNum, columnNum) ==
+           other.getText(otherRowNum, columnNum);
+  default:
+    return true;
+  }
+}
+
+int SqliteModelIndex::refreshRowsBackend(const std::vector<int> &rowNumList) {
+  if (!loadedFlag || rowNumList.empty()) {
+    return 0;
+  }
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::RowLoad);
+  std::vector<int> queryDeferredList;
+  if (deferredColumnList) {
+    queryDeferredList = *deferredColumnList;
+  }
+  if (setupFilter() != 0) {
+    return -1;
+  }
+  std::shared_ptr<sqlite3_stmt> stmt = statementCache->get("dataRow", [&]() {
+    std::string sqlQuery = getSelectSQL(queryDeferredList);
+    sqlQuery.append(" FROM `" + tableName + "` WHERE `" +
+                    columnMap->left.at("id") + "`=:id");
+    std::string filterStrings = getFilterSQL();
+    if (!filterStrings.empty()) {
+      sqlQuery.append(" AND " + filterStrings);
+    }
+    sqlQuery.append(";");
+    return sqlQuery;
+  });
+  if (!stmt) {
     return -1;
   }
 
-  // wipe current data cache
-  data.clear();
+  // every row is read before any is changed, a fallback leaves all as is
+  SqliteRowBlock freshData(data.getColumnCount());
+  for (int rowNum : rowNumList) {
+    const std::string *rowId = getRowIdText(rowNum);
+    if (!rowId) {
+      return 1;
+    }
+    sqlite3_reset(stmt.get());
+    bindText(stmt.get(), ":id", *rowId);
+    bindFilter(stmt.get());
+    int rc = sqlite3_step(stmt.get());
+    if (rc == SQLITE_DONE) {
+      // deleted or filtered out
+      return 1;
+    }
+    if (rc != SQLITE_ROW || sqlite3_column_count(stmt.get()) !=
+                                freshData.getColumnCount()) {
+      return -2;
+    }
+    int freshRowNum = freshData.appendRow(stmt.get());
+    for (int columnNum : queryDeferredList) {
+      freshData.setDeferred(freshRowNum, columnNum);
+    }
+  }
+  sqlite3_reset(stmt.get());
+  timer.setResult(freshData.getRowCount());
+
+  // a row with another parent or sort position must move
+  std::vector<int> keyColumnList;
+  for (auto &sortElement : *sortOrder) {
+    auto findIt = columnToNumMap->left.find(sortElement.first);
+    if (findIt != columnToNumMap->left.end()) {
+      keyColumnList.push_back(findIt->second);
+    }
+  }
+  auto parentColumnIt =
+      columnToNumMap->left.find(columnMap->left.at("parentId"));
+  if (parentColumnIt != columnToNumMap->left.end()) {
+    keyColumnList.push_back(parentColumnIt->second);
+  }
+  for (int listNum = 0; listNum < static_cast<int>(rowNumList.size());
+       listNum++) {
+    for (int columnNum : keyColumnList) {
+      if (!isSameCell(data, rowNumList[listNum], columnNum, freshData,
+                      listNum)) {
+        return 1;
+      }
+    }
+  }
+
+  for (int listNum = 0; listNum < static_cast<int>(rowNumList.size());
+       listNum++) {
+    for (int columnNum = 0; columnNum < data.getColumnCount(); columnNum++) {
+      invalidateTextCell(rowNumList[listNum], columnNum);
+      data.setFromBlock(rowNumList[listNum], columnNum, freshData, listNum,
+                        columnNum);
+    }
+  }
+  if (indexLru) {
+    indexLru->update(this, byteSize());
+  }
+  return 0;
+}
+
+int SqliteModelIndex::fetchRowsBackend(int limit, bool afterKey,
+                                       SqliteRowBlock &rowData,
+                                       bool deferFlag) {
+  SqliteModelIndexQuery query = getDataQuery(limit, afterKey, deferFlag);
+  if (query.setup(*statementCache) != 0) {
+    return -1;
+  }
+  std::shared_ptr<sqlite3_stmt> stmtPtr = statementCache->get(
+      query.signature, [&]() { return getDataSQL(query); });
+  if (!stmtPtr) {
+    return -1;
+  }
+  return query.run(stmtPtr.get(), rowData);
+}
+
+int SqliteModelIndexQuery::setup(SqliteStatementCache &statementCache) const {
+  return SqliteFilter::setup(statementCache, filterTreeSQL, filterVersion,
+                             filterData);
+}
+
+int SqliteModelIndexQuery::run(sqlite3_stmt *stmt,
+                               SqliteRowBlock &rowData) const {
+  int rc = 0;
+  int paramIndex = sqlite3_bind_parameter_index(stmt, ":parentId");
+  if (paramIndex > 0) {
+    sqlite3_bind_text(stmt, paramIndex, parentId.c_str(),
+                      static_cast<int>(parentId.size()), SQLITE_TRANSIENT);
+  }
+  if (limit >= 0) {
+    sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":limit"),
+                     limit);
+  }
+  for (size_t keyNum = 0; keyNum < keyColumnList.size(); keyNum++) {
+    std::string paramName = ":k" + std::to_string(keyNum);
+    paramIndex = sqlite3_bind_parameter_index(stmt, paramName.c_str());
+    if (paramIndex > 0) {
+      keyData.bindCell(stmt, paramIndex, 0, keyColumnList[keyNum]);
+    }
+  }
+  SqliteFilter::bind(stmt, filterData);
+
+  if (rowData.getColumnCount() != sqlite3_column_count(stmt)) {
+    rowData.reset(sqlite3_column_count(stmt));
+  }
 
   // step through the SQL query and insert data into the data cache
   rc = sqlite3_step(stmt);
   int rowNum = 0;
-  while (rc != SQLITE_DONE && rc != SQLITE_OK) {
-    int colCount = sqlite3_column_count(stmt);
-    std::unordered_map<int, QVariant> rowData;
-    for (int colIndex = 0; colIndex < colCount; colIndex++) {
-      const unsigned char *valChar = sqlite3_column_text(stmt, colIndex);
-      rowData.insert({colIndex, reinterpret_cast<const char *>(valChar)});
+  while (rc == SQLITE_ROW) {
+    int blockRowNum = rowData.appendRow(stmt);
+    for (int columnNum : deferredColumnList) {
+      rowData.setDeferred(blockRowNum, columnNum);
     }
-    data.insert({rowNum, rowData});
     rowNum++;
     rc = sqlite3_step(stmt);
   }
 
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getDataBackend
-  std::cout << BOOST_CURRENT_FUNCTION << " data: " << std::endl;
-  std::cout << "id: " << id << ", parentId: " << parentId
-            << ", RowNum: " << getRowNum() << ", ColNum: " << getColNum()
-            << std::endl;
-  for (auto data1 : data) {
-    std::cout << data1.first << ": ";
-    for (auto data2 : data1.second) {
-      if (data2.first == 0) {
-        std::cout << data2.second.toString().toStdString();
-      }
-    }
-    std::cout << std::endl;
-  }
-#endif
-
-  // sqlite3 finalize
-  rc = sqlite3_finalize(stmt);
-  if (rc != 0) {
+  if (rc != SQLITE_DONE) {
     return -2;
   }
-  return 0;
+  return rowNum;
 }
 
 std::optional<std::string> SqliteModelIndex::getRowId(int rowNum) {
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getRowId
-  std::cout << BOOST_CURRENT_FUNCTION << " rowNum: " << rowNum
-            << " columnToNumMap:" << std::endl;
-  for (auto it : columnToNumMap->left) {
-    std::cout << it.first << ": " << it.second << std::endl;
-  }
-#endif
-  std::string columnRealName = columnMap->left.at("id");
-  int columnCodeNum = columnToNumMap->left.at(columnRealName);
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getRowId
-  std::cout << BOOST_CURRENT_FUNCTION << " columnCodeNum: " << columnCodeNum
-            << " columnNumMap:" << std::endl;
-  for (auto it : columnNumMap->left) {
-    std::cout << it.first << ": " << it.second << std::endl;
-  }
-#endif
-  int columnRealNum = columnNumMap->left.at(columnCodeNum);
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getRowId
-  std::cout << BOOST_CURRENT_FUNCTION << " columnRealNum: " << columnRealNum
-            << std::endl;
-#endif
-  auto rowFindIt = data.find(rowNum);
-  if (rowFindIt == data.end()) {
+  const std::string *rowIdText = getRowIdText(rowNum);
+  if (!rowIdText) {
     return std::optional<std::string>();
   }
-  QVariant childIdVariant = rowFindIt->second.at(columnRealNum);
-  if (!childIdVariant.isValid()) {
-    return std::optional<std::string>();
+  return *rowIdText;
+}
+
+const std::string *SqliteModelIndex::getRowIdText(int rowNum) {
+  // the text was interned when the row was cached
+  if (rowNum < 0 || rowNum >= static_cast<int>(indexedIdList.size()) ||
+      data.isNull(rowNum, getIdColumnNum())) {
+    return nullptr;
   }
-  std::string returnId = childIdVariant.toString().toStdString();
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getRowId
-  std::cout << BOOST_CURRENT_FUNCTION << " returnId: " << returnId << std::endl;
-#endif
-  return returnId;
+  return &idInterner->getId(indexedIdList[rowNum]);
+}
+
+std::optional<std::uint32_t> SqliteModelIndex::getRowIdNum(int rowNum) {
+  if (rowNum < 0 || rowNum >= static_cast<int>(indexedIdList.size())) {
+    return std::optional<std::uint32_t>();
+  }
+  return indexedIdList[rowNum];
+}
+
+int SqliteModelIndex::getIdColumnNum() const {
+  std::string columnRealName = columnMap->left.at("id");
+  int columnCodeNum = columnToNumMap->left.at(columnRealName);
+  return columnNumMap->left.at(columnCodeNum);
 }
 
 std::optional<std::string> SqliteModelIndex::getRowIdBackend(int rowNum) {
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::RowId);
   std::string childId;
   // Get the fieldValue from the SELECT of the id
-  std::string sqlQuery =
-      "SELECT `" + columnMap->left.at("id") + "` FROM `" + tableName + "`";
-  sqlQuery.append(getWhereSQL(getParentId()));
-  sqlQuery.append(getOrderBySQL());
-  sqlQuery.append(" LIMIT " + std::to_string(rowNum) + ",1;");
-
-  /* sqlite3_prepare_v2, sqlite3_step, sqlite3_finalize is used
-   * instead of sqlite3_exec because it allows more control over the
-   * extracted data type. This method also allows progressive handling of the
-   * queried data rather and avoids sqlite3_exec callback that will fragment the
-   * logic too much.
-   */
-
-  // sqlite3 prepare statement
-  sqlite3_stmt *stmt = nullptr;
-  int rc =
-      sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
-  if (rc != SQLITE_OK) {
+  std::string signature = parentId == "*" ? "rowId:root" : "rowId";
+  if (setupFilter() != 0) {
+    return std::optional<std::string>();
+  }
+  std::shared_ptr<sqlite3_stmt> stmt = statementCache->get(signature, [this]() {
+    std::string sqlQuery =
+        "SELECT `" + columnMap->left.at("id") + "` FROM `" + tableName + "`";
+    sqlQuery.append(getWhereSQL(getParentId()));
+    sqlQuery.append(getOrderBySQL());
+    sqlQuery.append(" LIMIT :offset,1;");
+    return sqlQuery;
+  });
+  if (!stmt) {
     return std::optional<std::string>();
   }
+  bindText(stmt.get(), ":parentId", parentId);
+  bindFilter(stmt.get());
+  sqlite3_bind_int(stmt.get(),
+                   sqlite3_bind_parameter_index(stmt.get(), ":offset"), rowNum);
 
   // sqlite3 step loop
-  rc = sqlite3_step(stmt);
-  while (rc != SQLITE_DONE && rc != SQLITE_OK) {
-    int colCount = sqlite3_column_count(stmt);
-    for (int colIndex = 0; colIndex < colCount; colIndex++) {
-      /* Should the underying value data type be checked?
-       * Does treating all value types as text save time?
-       */
-      const unsigned char *valChar = sqlite3_column_text(stmt, colIndex);
-      if (valChar) {
-        childId = std::string(reinterpret_cast<const char *>(valChar));
-      }
+  int rc = sqlite3_step(stmt.get());
+  if (rc == SQLITE_ROW) {
+    /* Should the underying value data type be checked?
+     * Does treating all value types as text save time?
+     */
+    const unsigned char *valChar = sqlite3_column_text(stmt.get(), 0);
+    if (valChar) {
+      childId = std::string(reinterpret_cast<const char *>(valChar),
+                            sqlite3_column_bytes(stmt.get(), 0));
     }
-    rc = sqlite3_step(stmt);
-  }
-
-  // sqlite3 finalize
-  rc = sqlite3_finalize(stmt);
-  if (rc != 0) {
+  } else if (rc != SQLITE_DONE) {
     return std::optional<std::string>();
   }
 
@@ -385,14 +686,11 @@ std::optional<std::string> SqliteModelIndex::getRowIdBackend(int rowNum) {
 }
 
 int SqliteModelIndex::rowCountBackend(int rowNum) {
-  int rc = 0;
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::RowCount);
   int rowCountRet = 0;
   std::string whereParentId;
 
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_rowCountBackend
-  std::cout << BOOST_CURRENT_FUNCTION << " rowNum: " << rowNum << std::endl;
-#endif
-
   // get the parent ID for the where clause
   if (rowNum < 0) {
     whereParentId = parentId;
@@ -405,104 +703,645 @@ int SqliteModelIndex::rowCountBackend(int rowNum) {
   }
 
   // Count the selected rows
-  std::string sqlQuery = "SELECT COUNT(1) FROM `" + tableName + "`";
-  sqlQuery.append(getWhereSQL(whereParentId));
-  sqlQuery.append(";");
-
-#if BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_rowCountBackend
-  std::cout << BOOST_CURRENT_FUNCTION << " sqlQuery: " << sqlQuery << std::endl;
-#endif
-
-  /* sqlite3_prepare_v2, sqlite3_step, sqlite3_finalize is used
-   * instead of sqlite3_exec because it allows more control over the
-   * extracted data type. This method also allows progressive handling of the
-   * queried data rather and avoids sqlite3_exec callback that will fragment the
-   * logic too much.
-   */
-
-  // sqlite3 prepare statement
-  sqlite3_stmt *stmt = nullptr;
-  rc = sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
-  if (rc != SQLITE_OK)
+  std::string signature = whereParentId == "*" ? "rowCount:root" : "rowCount";
+  if (setupFilter() != 0) {
     return 0;
-
-  // sqlite3 step loop
-  rc = sqlite3_step(stmt);
-  while (rc != SQLITE_DONE && rc != SQLITE_OK) {
-    int colCount = sqlite3_column_count(stmt);
-    for (int colIndex = 0; colIndex < colCount; colIndex++) {
-      rowCountRet = sqlite3_column_int(stmt, colIndex);
-    }
-    rc = sqlite3_step(stmt);
   }
-
-  // sqlite3 finalize
-  rc = sqlite3_finalize(stmt);
-  if (rc != 0) {
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get(signature, [&]() {
+        std::string sqlQuery = "SELECT COUNT(1) FROM `" + tableName + "`";
+        sqlQuery.append(getWhereSQL(whereParentId));
+        sqlQuery.append(";");
+        return sqlQuery;
+      });
+  if (!stmt)
     return 0;
+  bindText(stmt.get(), ":parentId", whereParentId);
+  bindFilter(stmt.get());
+
+  // sqlite3 step loop
+  int rc = sqlite3_step(stmt.get());
+  if (rc == SQLITE_ROW) {
+    rowCountRet = sqlite3_column_int(stmt.get(), 0);
   }
 
   return rowCountRet;
 }
 
 std::string SqliteModelIndex::getWhereSQL(const std::string &parentId) const {
+  // the parent id is bound to :parentId so statements can be reused
   std::string whereClause;
   if (parentId == "*") {
     whereClause.append("`" + columnMap->left.at("parentId") + "` IS NULL ");
   } else {
-    whereClause.append("`" + columnMap->left.at("parentId") + "`='" + parentId +
-                       "'");
-  }
-
-  std::string filterStrings;
-  for (auto filterElement : *filterList) {
-    auto fieldName = std::get<0>(filterElement);
-    auto value = std::get<1>(filterElement);
-    auto condition = std::get<2>(filterElement);
-    std::string filterString;
-    if (condition == "=") {
-      filterString = "`" + fieldName + "` = '" + value + "'";
-    } else if (condition == "match") {
-      filterString = "`" + fieldName + "` like '%" + value + "%'";
-    } else if (condition == "auto") {
-    }
-    filterStrings.append((filterString.empty() ? "" : " AND ") + filterString);
+    whereClause.append("`" + columnMap->left.at("parentId") + "`=:parentId");
   }
 
-  if (!whereClause.empty()) {
-    if (!filterStrings.empty()) {
-      whereClause = " AND ";
-    }
+  std::string filterStrings = getFilterSQL();
+  if (!filterStrings.empty()) {
+    whereClause.append(" AND " + filterStrings);
   }
-  whereClause += filterStrings;
   whereClause = whereClause.empty() ? "" : " WHERE " + whereClause;
   return whereClause;
 }
 
+std::string SqliteModelIndex::getFilterSQL() const {
+  return filter ? filter->getSQL() : std::string();
+}
+
+int SqliteModelIndex::bindFilter(sqlite3_stmt *stmt) {
+  return filter ? SqliteFilter::bind(stmt, filter->getParamData()) : 0;
+}
+
+int SqliteModelIndex::setupFilter() {
+  if (!filter) {
+    return 0;
+  }
+  return SqliteFilter::setup(*statementCache, filter->getTreeSQL(),
+                             filter->getVersion(), filter->getParamData());
+}
+
 std::string SqliteModelIndex::getOrderBySQL() const {
   std::string sortSQLClause;
   for (auto sortElement : *sortOrder) {
     std::string sortField = "`" + sortElement.first + "` " + sortElement.second;
     sortSQLClause.append((sortSQLClause.empty() ? "" : " , ") + sortField);
   }
+  // the id breaks ties so the order is total, required for windowed fetching
+  sortSQLClause.append((sortSQLClause.empty() ? "" : " , ") + std::string("`") +
+                       columnMap->left.at("id") + "` ASC");
 
   sortSQLClause = (sortSQLClause.empty() ? "" : " ORDER BY ") + sortSQLClause;
   return sortSQLClause;
 }
 
+std::string SqliteModelIndex::getKeysetSQL() const {
+  std::vector<std::pair<std::string, std::string>> keyList(sortOrder->begin(),
+                                                           sortOrder->end());
+  keyList.push_back({columnMap->left.at("id"), "ASC"});
+
+  /* Row comparison expanded term by term so that mixed ASC/DESC directions
+   * work. sqlite3 sorts NULL first for ASC and last for DESC.
+   * (k0 after :k0) OR (k0 IS :k0 AND k1 after :k1) OR ...
+   */
+  std::string keysetClause;
+  std::string equalPrefix;
+  for (size_t keyNum = 0; keyNum < keyList.size(); keyNum++) {
+    std::string columnName = "`" + keyList[keyNum].first + "`";
+    std::string paramName = ":k" + std::to_string(keyNum);
+    bool isDescending = keyList[keyNum].second == "DESC" ||
+                        keyList[keyNum].second == "desc";
+    std::string afterTerm =
+        isDescending ? "(" + columnName + " < " + paramName + " OR (" +
+                           columnName + " IS NULL AND " + paramName +
+                           " IS NOT NULL))"
+                     : "(" + columnName + " > " + paramName + " OR (" +
+                           columnName + " IS NOT NULL AND " + paramName +
+                           " IS NULL))";
+    keysetClause.append((keysetClause.empty() ? "(" : " OR (") + equalPrefix +
+                        afterTerm + ")");
+    equalPrefix.append(columnName + " IS " + paramName + " AND ");
+  }
+  return keysetClause;
+}
+
+void SqliteModelIndex::setFetchBlockSize(int fetchBlockSize_) {
+  fetchBlockSize = fetchBlockSize_;
+}
+
+int SqliteModelIndex::getFetchBlockSize() { return fetchBlockSize; }
+
+bool SqliteModelIndex::isLoaded() { return loadedFlag; }
+
+bool SqliteModelIndex::isWarm() { return warmFlag; }
+
+bool SqliteModelIndex::canFetchMore() {
+  return loadedFlag && !fetchedAllFlag;
+}
+
+int SqliteModelIndex::fetchMoreBackend() {
+  fetchData.clear();
+  if (!canFetchMore()) {
+    return 0;
+  }
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::FetchMore);
+  int rc = fetchRowsBackend(fetchBlockSize, true, fetchData);
+  timer.setResult(rc);
+  if (rc < 0) {
+    fetchedAllFlag = true;
+    return rc;
+  }
+  fetchedAllFlag = rc < fetchBlockSize;
+  return rc;
+}
+
+int SqliteModelIndex::commitFetchMore() {
+  int rowBegin = data.getRowCount();
+  data.append(std::move(fetchData));
+  updateChildRowNums(rowBegin);
+  if (indexLru) {
+    indexLru->update(this, byteSize());
+  }
+  return 0;
+}
+
+SqliteModelIndexQuery SqliteModelIndex::getLoadQuery() {
+  int limit =
+      fetchBlockSize > 0 ? std::max(fetchBlockSize, evictedRowCount) : -1;
+  SqliteModelIndexQuery query = getDataQuery(limit, false);
+  query.sql = getDataSQL(query);
+  return query;
+}
+
+SqliteModelIndexQuery
+SqliteModelIndex::getLoadQuery(const std::string &queryParentId) {
+  SqliteModelIndexQuery query =
+      getDataQuery(fetchBlockSize > 0 ? fetchBlockSize : -1, false);
+  query.signature.clear();
+  query.parentId = queryParentId;
+  query.sql = getDataSQL(query);
+  return query;
+}
+
+SqliteModelIndexQuery SqliteModelIndex::getFetchMoreQuery() {
+  SqliteModelIndexQuery query = getDataQuery(fetchBlockSize, true);
+  query.sql = getDataSQL(query);
+  return query;
+}
+
+int SqliteModelIndex::appendData(SqliteRowBlock &&rowData, bool fetchedAll) {
+  if (data.getColumnCount() != rowData.getColumnCount()) {
+    data.reset(rowData.getColumnCount());
+  }
+  int rowBegin = data.getRowCount();
+  data.append(std::move(rowData));
+  updateChildRowNums(rowBegin);
+  fetchedAllFlag = fetchedAll;
+  if (indexLru) {
+    indexLru->update(this, byteSize());
+  }
+  return 0;
+}
+
+std::uint64_t SqliteModelIndex::getPendingTicket() { return pendingTicket; }
+
+void SqliteModelIndex::setPendingTicket(std::uint64_t ticket) {
+  pendingTicket = ticket;
+}
+
+bool SqliteModelIndex::hasLoadingRow() { return loadingRowFlag; }
+
+void SqliteModelIndex::setLoadingRow(bool loadingRowFlag_) {
+  loadingRowFlag = loadingRowFlag_;
+}
+
+int SqliteModelIndex::getRowCount() { return data.getRowCount(); }
+
+const SqliteRowBlock &SqliteModelIndex::getRowData() { return data; }
+
+int SqliteModelIndex::getEvictedRowCount() { return evictedRowCount; }
+
+const std::vector<std::uint32_t> &SqliteModelIndex::getEvictedIdNumList() {
+  return evictedIdList;
+}
+
+int SqliteModelIndex::fetchDataBackend(SqliteRowBlock &rowData, int limit,
+                                       bool deferFlag) {
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::DataLoad);
+  int rc = fetchRowsBackend(limit, false, rowData, deferFlag);
+  timer.setResult(rc);
+  return rc;
+}
+
+const std::vector<std::uint32_t> &SqliteModelIndex::getRowIdNumList() {
+  return indexedIdList;
+}
+
+std::vector<std::uint32_t>
+SqliteModelIndex::getRowIdNumList(const SqliteRowBlock &rowData) {
+  std::vector<std::uint32_t> rowIdList;
+  int idColumnNum = getIdColumnNum();
+  rowIdList.reserve(rowData.getRowCount());
+  for (int rowNum = 0; rowNum < rowData.getRowCount(); rowNum++) {
+    rowIdList.push_back(internRowId(rowData, rowNum, idColumnNum));
+  }
+  return rowIdList;
+}
+
+std::uint32_t SqliteModelIndex::internRowId(const SqliteRowBlock &rowData,
+                                            int rowNum, int idColumnNum) {
+  if (rowData.getType(rowNum, idColumnNum) == SqliteRowBlock::CellType::Text) {
+    return idInterner->intern(rowData.getText(rowNum, idColumnNum));
+  }
+  return idInterner->intern(rowData.getString(rowNum, idColumnNum));
+}
+
+int SqliteModelIndex::insertRows(int rowNum, const SqliteRowBlock &rowData,
+                                 int srcRowNum, int count) {
+  bool resetFlag = data.getColumnCount() != rowData.getColumnCount();
+  if (resetFlag) {
+    data.reset(rowData.getColumnCount());
+  }
+  data.insertRows(rowNum, rowData, srcRowNum, count);
+  if (resetFlag) {
+    childCountMap.clear();
+    return updateChildRowNums();
+  }
+  // counts are cached by row number
+  shiftChildCounts(rowNum, count);
+  return insertChildRowNums(rowNum, count);
+}
+
+int SqliteModelIndex::insertChildRowNums(int rowNum, int count) {
+  // an empty node may still list the ids of its evicted rows
+  if (indexedIdList.empty() || rowNum < 0 ||
+      rowNum > static_cast<int>(indexedIdList.size()) || count <= 0) {
+    return updateChildRowNums();
+  }
+  int idColumnNum = getIdColumnNum();
+  std::vector<std::uint32_t> insertedIdList;
+  insertedIdList.reserve(count);
+  for (int rowOffset = 0; rowOffset < count; rowOffset++) {
+    insertedIdList.push_back(
+        internRowId(data, rowNum + rowOffset, idColumnNum));
+  }
+  indexedIdList.insert(indexedIdList.begin() + rowNum, insertedIdList.begin(),
+                       insertedIdList.end());
+  // the rows below the insertion point are registered at their new number
+  if (nodeTable) {
+    nodeTable->insertRows(handle, indexedIdList, rowNum);
+  }
+
+  // the cached texts are keyed by cell number, the visible cells decode again
+  clearTextCache();
+
+  int rowCount = data.getRowCount();
+  childRowList.resize(rowCount - count, nullptr);
+  childRowList.insert(childRowList.begin() + rowNum, count, nullptr);
+  for (int rowOffset = 0; rowOffset < count; rowOffset++) {
+    auto findIt = indexMap.find(insertedIdList[rowOffset]);
+    if (findIt != indexMap.end()) {
+      findIt->second->setRowNum(rowNum + rowOffset);
+      childRowList[rowNum + rowOffset] = findIt->second.get();
+    }
+  }
+  for (int childRowNum = rowNum + count; childRowNum < rowCount;
+       childRowNum++) {
+    if (childRowList[childRowNum]) {
+      childRowList[childRowNum]->setRowNum(childRowNum);
+    }
+  }
+  return 0;
+}
+
+int SqliteModelIndex::removeRows(int rowNum, int count) {
+  int rowCount = data.getRowCount();
+  if (rowNum < 0 || count <= 0 || rowNum + count > rowCount) {
+    return -1;
+  }
+  data.eraseRows(rowNum, count);
+  shiftChildCounts(rowNum, -count);
+  return removeChildRowNums(rowNum, count);
+}
+
+int SqliteModelIndex::removeChildRowNums(int rowNum, int count) {
+  if (static_cast<int>(indexedIdList.size()) !=
+      data.getRowCount() + count) {
+    return updateChildRowNums();
+  }
+  std::vector<std::uint32_t> removedIdList(
+      indexedIdList.begin() + rowNum, indexedIdList.begin() + rowNum + count);
+  indexedIdList.erase(indexedIdList.begin() + rowNum,
+                      indexedIdList.begin() + rowNum + count);
+  // the rows below the removed ones are registered at their new number
+  if (nodeTable) {
+    nodeTable->removeRows(handle, removedIdList);
+    nodeTable->insertRows(handle, indexedIdList, rowNum);
+  }
+
+  // the cached texts are keyed by cell number, the visible cells decode again
+  clearTextCache();
+
+  // a child index keeps its last row number if its row is gone
+  if (static_cast<int>(childRowList.size()) >= rowNum + count) {
+    childRowList.erase(childRowList.begin() + rowNum,
+                       childRowList.begin() + rowNum + count);
+  }
+  int rowCount = data.getRowCount();
+  childRowList.resize(rowCount, nullptr);
+  for (int childRowNum = rowNum; childRowNum < rowCount; childRowNum++) {
+    if (childRowList[childRowNum]) {
+      childRowList[childRowNum]->setRowNum(childRowNum);
+    }
+  }
+  return 0;
+}
+
+void SqliteModelIndex::shiftChildCounts(int rowNum, int shift) {
+  std::unordered_map<int, int> shiftedMap;
+  for (auto it = childCountMap.begin(); it != childCountMap.end();) {
+    if (it->first < rowNum) {
+      ++it;
+      continue;
+    }
+    // counts of removed rows are dropped
+    if (it->first + shift >= rowNum) {
+      shiftedMap.emplace(it->first + shift, it->second);
+    }
+    it = childCountMap.erase(it);
+  }
+  childCountMap.insert(shiftedMap.begin(), shiftedMap.end());
+}
+
+int SqliteModelIndex::replaceData(SqliteRowBlock &&rowData, bool fetchedAll) {
+  data = std::move(rowData);
+  loadedFlag = true;
+  warmFlag = true;
+  fetchedAllFlag = fetchedAll;
+  evictedRowCount = 0;
+  childCountMap.clear();
+  updateChildRowNums();
+  if (indexLru) {
+    indexLru->update(this, byteSize());
+  }
+  return 0;
+}
+
+void SqliteModelIndex::invalidateChildCount(int rowNum) {
+  childCountMap.erase(rowNum);
+}
+
+const std::unordered_map<int, int> &SqliteModelIndex::getChildCountMap() {
+  return childCountMap;
+}
+
+void SqliteModelIndex::setChildCount(int rowNum, int count) {
+  if (rowNum >= 0 && rowNum < getRowCount()) {
+    childCountMap[rowNum] = count;
+  }
+}
+
+int SqliteModelIndex::updateChildRowNums(int rowBegin) {
+  int rowCount = data.getRowCount();
+  if (rowBegin <= 0 || rowBegin > static_cast<int>(indexedIdList.size())) {
+    rowBegin = 0;
+    if (nodeTable) {
+      nodeTable->removeRows(handle, indexedIdList);
+      nodeTable->removeEvictedRows(handle, evictedIdList);
+    }
+    indexedIdList.clear();
+    std::vector<std::uint32_t>().swap(evictedIdList);
+    childRowList.clear();
+    clearTextCache();
+  }
+  if (rowCount == 0) {
+    return 0;
+  }
+  int idColumnNum = getIdColumnNum();
+  indexedIdList.resize(rowBegin);
+  indexedIdList.reserve(rowCount);
+  for (int rowNum = rowBegin; rowNum < rowCount; rowNum++) {
+    indexedIdList.push_back(internRowId(data, rowNum, idColumnNum));
+  }
+  if (nodeTable) {
+    nodeTable->insertRows(handle, indexedIdList, rowBegin);
+  }
+
+  // a child index keeps its last row number if its row is gone
+  childRowList.resize(rowCount, nullptr);
+  if (indexMap.empty()) {
+    return 0;
+  }
+  for (int rowNum = rowBegin; rowNum < rowCount; rowNum++) {
+    auto findIt = indexMap.find(indexedIdList[rowNum]);
+    if (findIt != indexMap.end()) {
+      findIt->second->setRowNum(rowNum);
+      childRowList[rowNum] = findIt->second.get();
+    }
+  }
+  return 0;
+}
+
+int SqliteModelIndex::evictData() {
+  if (!loadedFlag) {
+    return 0;
+  }
+  evictedRowCount = data.getRowCount();
+  loadedFlag = false;
+  fetchedAllFlag = true;
+  data.reset(0);
+  fetchData.reset(0);
+  std::unordered_map<int, int>().swap(childCountMap);
+  // the node table remembers this index held the rows
+  if (nodeTable) {
+    nodeTable->evictRows(handle, indexedIdList);
+  }
+  evictedIdList.swap(indexedIdList);
+  std::vector<std::uint32_t>().swap(indexedIdList);
+  std::vector<SqliteModelIndex *>().swap(childRowList);
+  clearTextCache();
+  return 0;
+}
+
+std::size_t SqliteModelIndex::byteSize() {
+  return data.byteSize() + fetchData.byteSize() +
+         childCountMap.size() * (sizeof(int) * 2 + sizeof(void *)) +
+         (textCache.size() + textCacheOld.size()) *
+             (sizeof(std::size_t) + sizeof(QString) + sizeof(void *) * 2) +
+         textCacheByteSize;
+}
+
+int SqliteModelIndex::setInstrumentation(
+    std::shared_ptr<SqliteInstrumentation> instrumentation_) {
+  instrumentation = instrumentation_;
+  return 0;
+}
+
+int SqliteModelIndex::setIndexLru(
+    std::shared_ptr<SqliteModelIndexLru> indexLru_) {
+  indexLru = indexLru_;
+  return 0;
+}
+
+int SqliteModelIndex::setNodeTable(
+    std::shared_ptr<SqliteModelNodeTable> nodeTable_) {
+  if (nodeTable) {
+    nodeTable->removeRows(handle, indexedIdList);
+    nodeTable->removeEvictedRows(handle, evictedIdList);
+    nodeTable->remove(handle);
+  }
+  nodeTable = nodeTable_;
+  handle = nodeTable ? nodeTable->insert(this) : -1;
+  if (nodeTable) {
+    nodeTable->insertRows(handle, indexedIdList);
+  }
+  return 0;
+}
+
+int SqliteModelIndex::getHandle() { return handle; }
+
+int SqliteModelIndex::getChildCount(int rowNum) {
+  auto findIt = childCountMap.find(rowNum);
+  if (instrumentation) {
+    instrumentation->countCache(SqliteInstrumentation::Cache::ChildCount,
+                                findIt != childCountMap.end());
+  }
+  if (findIt == childCountMap.end()) {
+    childCountBackend(rowNum / childCountPageSize);
+    findIt = childCountMap.find(rowNum);
+    if (findIt == childCountMap.end()) {
+      return 0;
+    }
+  }
+  return findIt->second;
+}
+
+int SqliteModelIndex::childCountBackend(int pageNum) {
+  int rowBegin = pageNum * childCountPageSize;
+  int rowEnd = std::min(rowBegin + childCountPageSize, getRowCount());
+  if (rowBegin >= rowEnd) {
+    return 0;
+  }
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::ChildCount);
+
+  /* Count the children of every row in the page with one grouped query. The
+   * IN list always has childCountPageSize parameters so a single statement is
+   * cached. Unused parameters stay NULL and match nothing.
+   */
+  if (setupFilter() != 0) {
+    return -1;
+  }
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("childCount", [this]() {
+        std::string parentColumn = "`" + columnMap->left.at("parentId") + "`";
+        std::string sqlQuery = "SELECT " + parentColumn + ", COUNT(1) FROM `" +
+                               tableName + "` WHERE " + parentColumn + " IN (";
+        for (int paramNum = 1; paramNum <= childCountPageSize; paramNum++) {
+          sqlQuery.append((paramNum == 1 ? "?" : ",?") +
+                          std::to_string(paramNum));
+        }
+        sqlQuery.append(")");
+        std::string filterStrings = getFilterSQL();
+        if (!filterStrings.empty()) {
+          sqlQuery.append(" AND " + filterStrings);
+        }
+        sqlQuery.append(" GROUP BY " + parentColumn + ";");
+        return sqlQuery;
+      });
+  if (!stmt) {
+    return -1;
+  }
+
+  bindFilter(stmt.get());
+
+  /* map each row id to its row number to place the counts. Interned ids are
+   * never freed, so their text is bound without a copy.
+   */
+  std::unordered_map<std::uint32_t, int> idToRowMap;
+  for (int rowNum = rowBegin; rowNum < rowEnd; rowNum++) {
+    childCountMap[rowNum] = 0;
+    auto rowIdOpt = getRowIdNum(rowNum);
+    if (!rowIdOpt) {
+      continue;
+    }
+    const std::string &rowId = idInterner->getId(*rowIdOpt);
+    sqlite3_bind_text(stmt.get(), rowNum - rowBegin + 1, rowId.c_str(),
+                      static_cast<int>(rowId.size()), SQLITE_STATIC);
+    idToRowMap.insert({*rowIdOpt, rowNum});
+  }
+
+  // sqlite3 step loop
+  int rc = sqlite3_step(stmt.get());
+  while (rc == SQLITE_ROW) {
+    const unsigned char *valChar = sqlite3_column_text(stmt.get(), 0);
+    if (valChar) {
+      auto idNumOpt = idInterner->find(
+          std::string_view(reinterpret_cast<const char *>(valChar),
+                           sqlite3_column_bytes(stmt.get(), 0)));
+      auto findIt = idNumOpt ? idToRowMap.find(*idNumOpt) : idToRowMap.end();
+      if (findIt != idToRowMap.end()) {
+        childCountMap[findIt->second] = sqlite3_column_int(stmt.get(), 1);
+      }
+    }
+    rc = sqlite3_step(stmt.get());
+  }
+  if (rc != SQLITE_DONE) {
+    return -2;
+  }
+  return 0;
+}
+
+int SqliteModelIndex::setStatementCache(
+    std::shared_ptr<SqliteStatementCache> statementCache_) {
+  statementCache = statementCache_;
+  return 0;
+}
+
+int SqliteModelIndex::bindText(sqlite3_stmt *stmt, const char *paramName,
+                               const std::string &value) {
+  int paramIndex = sqlite3_bind_parameter_index(stmt, paramName);
+  if (paramIndex <= 0) {
+    return 0;
+  }
+  return sqlite3_bind_text(stmt, paramIndex, value.c_str(),
+                           static_cast<int>(value.size()), SQLITE_TRANSIENT);
+}
+
 int SqliteModelIndex::getRowNum() { return rowIndexNum; }
 void SqliteModelIndex::setRowNum(int rowNum_) { rowIndexNum = rowNum_; }
 int SqliteModelIndex::getColNum() { return colIndexNum; }
 void SqliteModelIndex::setColNum(int colNum_) { colIndexNum = colNum_; }
 
-int SqliteModelIndex::insertIndex(std::string id_,
-                                  std::shared_ptr<SqliteModelIndex> indexPtr_) {
-  indexMap.insert({id_, indexPtr_});
+int SqliteModelIndex::insertIndex(
+    std::uint32_t idNum_, std::shared_ptr<SqliteModelIndex> indexPtr_) {
+  indexMap.insert({idNum_, indexPtr_});
+  if (nodeTable) {
+    auto locationOpt = nodeTable->find(idNum_);
+    if (locationOpt && locationOpt->first == handle &&
+        locationOpt->second < static_cast<int>(childRowList.size())) {
+      childRowList[locationOpt->second] = indexPtr_.get();
+    }
+  }
   return 0;
 }
 
-std::shared_ptr<SqliteModelIndex> SqliteModelIndex::findIndex(std::string id_) {
-  auto findIt = indexMap.find(id_);
+std::shared_ptr<SqliteModelIndex>
+SqliteModelIndex::removeIndex(std::uint32_t idNum_) {
+  std::shared_ptr<SqliteModelIndex> indexPtr;
+  auto findIt = indexMap.find(idNum_);
+  if (findIt != indexMap.end()) {
+    indexPtr = findIt->second;
+    indexMap.erase(findIt);
+    SqliteModelIndex *childPtr = getChildAt(indexPtr->getRowNum());
+    if (childPtr == indexPtr.get()) {
+      childRowList[indexPtr->getRowNum()] = nullptr;
+    }
+  }
+  return indexPtr;
+}
+
+std::vector<SqliteModelIndex *> SqliteModelIndex::getIndexList() {
+  std::vector<SqliteModelIndex *> indexList;
+  indexList.reserve(indexMap.size());
+  for (auto &indexPair : indexMap) {
+    indexList.push_back(indexPair.second.get());
+  }
+  return indexList;
+}
+
+SqliteModelIndex *SqliteModelIndex::getChildAt(int rowNum) {
+  if (rowNum < 0 || rowNum >= static_cast<int>(childRowList.size())) {
+    return nullptr;
+  }
+  return childRowList[rowNum];
+}
+
+std::shared_ptr<SqliteModelIndex>
+SqliteModelIndex::findIndex(std::uint32_t idNum_) {
+  auto findIt = indexMap.find(idNum_);
   if (findIt != indexMap.end()) {
     return findIt->second;
   }
@@ -14,10 +14,12 @@
 #include "../core/config.hpp"
 
 // C++
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <unordered_map>
+#include <vector>
 
 /* boost 1.72.0
  * License: Boost Software License (similar to BSD and MIT)
@@ -37,12 +39,60 @@
 #include <QVariant>
 #include <QVector>
 
+// Local Project
+#include "../core/SqliteFilter.hpp"
+#include "../core/SqliteIdInterner.hpp"
+#include "../core/SqliteRowBlock.hpp"
+#include "../core/SqliteStatementCache.hpp"
+#include "../core/SqliteWriteBuffer.hpp"
+#include "SqliteModelIndexLru.hpp"
+#include "SqliteModelNodeTable.hpp"
+
 /*
  * bookfiler - widget
  */
 namespace bookfiler {
 namespace widget {
 
+/*
+ * @brief A data query of an index. The bound values are copied so the query
+ * can run on another connection and thread than the index.
+ */
+struct SqliteModelIndexQuery {
+  /* statement cache key, the SQL is only built when sql is set
+   */
+  std::string signature, sql;
+  std::string parentId;
+  /* maximum rows to fetch, -1 for all rows
+   */
+  int limit = -1;
+  /* the last cached row and the positions of its ORDER BY tuple when only
+   * rows after it are fetched
+   */
+  SqliteRowBlock keyData;
+  std::vector<int> keyColumnList;
+  /* values of the filter parameters, and in tree filter mode the statements
+   * filling the match table with the version they were compiled for
+   */
+  SqliteRowBlock filterData;
+  std::string filterTreeSQL;
+  std::uint64_t filterVersion = 0;
+  /* columns selected as NULL and marked deferred in the result rows
+   */
+  std::vector<int> deferredColumnList;
+
+  /* Fills the tree filter match table of the connection if needed. Call
+   * before the statement is prepared.
+   * @return 0 on success, else error code
+   */
+  int setup(SqliteStatementCache &statementCache) const;
+  /* Binds the values and appends the result rows to rowData
+   * @param stmt the statement prepared from the query SQL
+   * @return number of rows fetched, negative on error
+   */
+  int run(sqlite3_stmt *stmt, SqliteRowBlock &rowData) const;
+};
+
 /*
  * @brief An index meant to be used with SqliteModel. Implements some caching
  * for queries to be used for the virtual data() function  from
@@ -53,19 +103,134 @@ private:
   std::shared_ptr<sqlite3> database;
   SqliteModelIndex *parentIndex = nullptr;
   std::string parentId, tableName;
+  /* parentId interned in the id table shared by all indexes of the model
+   */
+  std::uint32_t parentIdNum = 0;
+  std::shared_ptr<SqliteIdInterner> idInterner;
   int rowIndexNum, colIndexNum;
-  std::unordered_map<int, std::unordered_map<int, QVariant>> data;
-  /* A list of updated ID
-   * This updated data is temporary and must be committed to the database
+  /* cached rows of this index, one column per table column
    */
-  std::vector<std::string> updateIdList;
+  SqliteRowBlock data;
 
+  /* prepared statements shared by all indexes of the model
+   */
+  std::shared_ptr<SqliteStatementCache> statementCache;
   std::shared_ptr<std::list<std::pair<std::string, std::string>>> sortOrder;
-  std::shared_ptr<std::list<std::tuple<std::string, std::string, std::string>>>
-      filterList;
+  /* compiled filter shared by all indexes of the model
+   */
+  std::shared_ptr<SqliteFilter> filter;
+  /* columns left out of the data queries and read per cell when shown,
+   * shared by all indexes of the model
+   */
+  std::shared_ptr<std::vector<int>> deferredColumnList;
+  /* query and cache counters shared by all indexes of the model
+   */
+  std::shared_ptr<SqliteInstrumentation> instrumentation;
 
+  /* Windowed fetching. When fetchBlockSize is above zero rows are paged in
+   * blocks of that size. Each block starts after the ORDER BY tuple of the
+   * last cached row (keyset pagination) so no OFFSET scan is needed.
+   */
+  int fetchBlockSize = 0;
+  bool loadedFlag = false, fetchedAllFlag = true;
+  /* set by the first load, later loads read pages that were read before
+   */
+  bool warmFlag = false;
+  SqliteRowBlock fetchData;
+  /* least recently used tracking shared by all indexes of the model. The row
+   * count before eviction is restored when the data is reloaded.
+   */
+  std::shared_ptr<SqliteModelIndexLru> indexLru;
+  int evictedRowCount = 0;
+  /* Handle of this index in the node table shared by all indexes of the
+   * model, and the interned id of every cached row. childRowList maps
+   * rowNum->child index so index() does not look up ids.
+   */
+  std::shared_ptr<SqliteModelNodeTable> nodeTable;
+  int handle = -1;
+  std::vector<std::uint32_t> indexedIdList;
+  /* the interned id of every row before evictData(), so the rows that
+   * changed since can be told apart when the index is refreshed
+   */
+  std::vector<std::uint32_t> evictedIdList;
+  std::vector<SqliteModelIndex *> childRowList;
+  /* Async loading. The ticket of the query running for this index, 0 when
+   * none is. loadingRowFlag is set while the view is shown a placeholder
+   * row in place of the rows being loaded.
+   */
+  std::uint64_t pendingTicket = 0;
+  bool loadingRowFlag = false;
+  /* Child count cache. Maps rowNum->number of children of that row. Counts
+   * are fetched for a page of rows at a time with one grouped query.
+   */
+  std::unordered_map<int, int> childCountMap;
+  /* Text cells decoded on display, keyed rowNum * columnCount + columnNum.
+   * QString is shared on copy, so repaints reuse the decoded text instead of
+   * allocating a new string per data() call. Only the recently shown cells
+   * are kept: once textCache holds half the limit it becomes textCacheOld,
+   * and cells found there move back. Cleared whenever the cached rows are
+   * replaced or reordered.
+   */
+  std::unordered_map<std::size_t, QString> textCache, textCacheOld;
+  std::size_t textCacheByteSize = 0;
+
+  /* binds a text value to a named parameter if the statement uses it
+   * @return sqlite3 result code
+   */
+  int bindText(sqlite3_stmt *stmt, const char *paramName,
+               const std::string &value);
+  /* interns the id of a row without copying text ids
+   */
+  std::uint32_t internRowId(const SqliteRowBlock &rowData, int rowNum,
+                            int idColumnNum);
+  /* the interned text of a row id, nullptr for a NULL id or a row out of
+   * range
+   */
+  const std::string *getRowIdText(int rowNum);
+  /* forgets the decoded text of a cell after it was changed
+   */
+  void invalidateTextCell(int rowNum, int columnNum);
+  void clearTextCache();
   std::string getWhereSQL(const std::string &parentId) const;
+  /* @return the filter predicate with named parameters :f0, :f1, ... or
+   * empty string
+   */
+  std::string getFilterSQL() const;
+  /* binds the filter parameter values if the statement uses them
+   * @return 0 on success, else error code
+   */
+  int bindFilter(sqlite3_stmt *stmt);
+  /* fills the tree filter match table before filtered statements are
+   * prepared
+   * @return 0 on success, else error code
+   */
+  int setupFilter();
   std::string getOrderBySQL() const;
+  /* Builds the predicate selecting rows after the last cached row in ORDER BY
+   * order
+   * @return predicate with named parameters :k0, :k1, ...
+   */
+  std::string getKeysetSQL() const;
+  /* Copies the values a data query binds
+   * @param limit maximum rows to fetch, -1 for all rows
+   * @param afterKey only fetch rows after the last cached row
+   * @param deferFlag false to select the deferred columns too
+   */
+  SqliteModelIndexQuery getDataQuery(int limit, bool afterKey,
+                                     bool deferFlag = true);
+  std::string getDataSQL(const SqliteModelIndexQuery &query) const;
+  /* @return the column list of the data queries, the deferred columns are
+   * selected as NULL
+   */
+  std::string getSelectSQL(const std::vector<int> &queryDeferredList) const;
+  /* Runs the data query and appends the rows to rowData
+   * @param limit maximum rows to fetch, -1 for all rows
+   * @param afterKey only fetch rows after the last cached row
+   * @param deferFlag false to select the deferred columns too
+   * @return number of rows fetched, negative on error
+   */
+  int fetchRowsBackend(int limit, bool afterKey, SqliteRowBlock &rowData,
+                       bool deferFlag = true);
 
   /* map the code column name to the sqlite3 column name
    */
@@ -77,31 +242,38 @@ private:
    */
   std::shared_ptr<boost::bimap<std::string, int>> columnToNumMap;
 
-  /* index map maps parentId->index
-   */
-  std::unordered_map<std::string, std::shared_ptr<SqliteModelIndex>> indexMap;
-  /* index child map maps id->rowNum->childId
-   * column is not used for indexes
+  /* index map maps interned parentId->index
    */
-  std::map<std::string, std::map<int, std::string>> indexChildMap;
+  std::unordered_map<std::uint32_t, std::shared_ptr<SqliteModelIndex>>
+      indexMap;
 
 public:
   SqliteModelIndex(
       std::shared_ptr<sqlite3> database_, std::string tableName_,
       std::shared_ptr<boost::bimap<std::string, std::string>> columnMap_,
       std::shared_ptr<boost::bimap<int, int>> columnNumMap_,
-      std::shared_ptr<boost::bimap<std::string, int>> columnToNumMap_);
+      std::shared_ptr<boost::bimap<std::string, int>> columnToNumMap_,
+      std::shared_ptr<SqliteIdInterner> idInterner_);
   ~SqliteModelIndex();
 
   int setParent(SqliteModelIndex *parentIndex);
   SqliteModelIndex *getParent();
+  int setStatementCache(
+      std::shared_ptr<SqliteStatementCache> statementCache);
+  int setIndexLru(std::shared_ptr<SqliteModelIndexLru> indexLru);
+  int setInstrumentation(
+      std::shared_ptr<SqliteInstrumentation> instrumentation);
+  /* registers the index in the node table
+   * @return 0 on success, else error code
+   */
+  int setNodeTable(std::shared_ptr<SqliteModelNodeTable> nodeTable);
+  int getHandle();
   int setSortOrder(
       std::shared_ptr<std::list<std::pair<std::string, std::string>>>
           sortOrder);
-  int setFilterList(
-      std::shared_ptr<
-          std::list<std::tuple<std::string, std::string, std::string>>>
-          filterList);
+  int setFilter(std::shared_ptr<SqliteFilter> filter);
+  int setDeferredColumnList(
+      std::shared_ptr<std::vector<int>> deferredColumnList);
   /* returns the parent ID
    * @return parentId
    */
@@ -110,13 +282,22 @@ public:
    * @return 0 on sucess, else error code
    */
   int setParentId(std::string parentId);
+  /* @return the interned parent ID
+   */
+  std::uint32_t getParentIdNum();
   /* returns the parent ID
    * @return parentId
    */
   std::optional<std::string> getParentIdBackend();
-  /* get data from the cache
+  /* get data from the cache. Numbers are built from the columnar cache on
+   * each call, text is decoded once and then shared. Deferred cells are read
+   * with getDataCellBackend() first.
    */
   QVariant getDataCell(int rowNum, int columnNum);
+  /* converts a cell of a row block keeping its storage class
+   */
+  static QVariant getCellVariant(const SqliteRowBlock &block, int rowNum,
+                                 int columnNum);
   /* set data to the cache
    * @return 0 on sucess, else error code
    */
@@ -129,14 +310,159 @@ public:
    * @return 0 on sucess, else error code
    */
   int setDataCellBackend(int rowNum, int columnNum);
+  /* add the cached value of a cell to a write buffer
+   * @return 0 on sucess, else error code
+   */
+  int bufferDataCell(int rowNum, int columnNum, SqliteWriteBuffer &writeBuffer);
   /* get all data from the backend and update cache
    * wipes all temporary data
    * @return 0 on sucess, else error code
    */
   int getDataBackend();
+  /* Sets the windowed fetch block size. 0 fetches all rows at once.
+   * Takes effect on the next getDataBackend().
+   */
+  void setFetchBlockSize(int fetchBlockSize);
+  int getFetchBlockSize();
+  /* @return true if getDataBackend() was called since the cache was wiped
+   */
+  bool isLoaded();
+  /* @return true if the rows were loaded before, even if they were evicted
+   * since
+   */
+  bool isWarm();
+  /* @return true if more rows can be fetched in windowed mode
+   */
+  bool canFetchMore();
+  /* fetch the next block of rows after the last cached row into a staging
+   * area. Call commitFetchMore() to append them to the cache.
+   * @return number of rows fetched, negative on error
+   */
+  int fetchMoreBackend();
+  /* append the rows staged by fetchMoreBackend() to the cache
+   * @return 0 on sucess, else error code
+   */
+  int commitFetchMore();
+  /* The query getDataBackend() runs, with its SQL built so it can run on
+   * another connection. Apply the result with replaceData().
+   */
+  SqliteModelIndexQuery getLoadQuery();
+  /* The query loading the rows of another parent with the settings of this
+   * index, with its SQL built so it can run on another connection
+   * @param queryParentId the parent of the rows, "*" for a NULL parent
+   */
+  SqliteModelIndexQuery getLoadQuery(const std::string &queryParentId);
+  /* position of the id column in the cached rows
+   */
+  int getIdColumnNum() const;
+  /* The query fetchMoreBackend() runs, with its SQL built so it can run on
+   * another connection. Apply the result with appendData().
+   */
+  SqliteModelIndexQuery getFetchMoreQuery();
+  /* append rows fetched with getFetchMoreQuery() to the cache
+   * @param fetchedAll false if more rows can be fetched in windowed mode
+   * @return 0 on sucess, else error code
+   */
+  int appendData(SqliteRowBlock &&rowData, bool fetchedAll);
+  /* getters and setters for the async query state
+   */
+  std::uint64_t getPendingTicket();
+  void setPendingTicket(std::uint64_t ticket);
+  bool hasLoadingRow();
+  void setLoadingRow(bool loadingRowFlag_);
+  /* number of rows in the cache
+   */
+  int getRowCount();
+  /* the cached rows, only valid until the cache is modified
+   */
+  const SqliteRowBlock &getRowData();
+  /* number of rows the cache held before evictData(), 0 if not evicted
+   */
+  int getEvictedRowCount();
+  /* the interned id of every row before evictData(), empty if not evicted
+   */
+  const std::vector<std::uint32_t> &getEvictedIdNumList();
+  /* fetch the current rows from sqlite3 without touching the cache
+   * @param rowData the block to append the rows to
+   * @param limit maximum rows to fetch, -1 for all rows
+   * @param deferFlag false to read the deferred columns too
+   * @return number of rows fetched, negative on error
+   */
+  int fetchDataBackend(SqliteRowBlock &rowData, int limit,
+                       bool deferFlag = true);
+  /* Re-reads cached rows by id and replaces their cells. Rows whose parent
+   * or sort keys changed, or that no longer match the filter, are left for
+   * a refresh of the whole index.
+   * @param rowNumList the cached rows to read
+   * @return 0 on success, 1 if the index must be refreshed instead,
+   * negative on error
+   */
+  int refreshRowsBackend(const std::vector<int> &rowNumList);
+  /* the interned id of every cached row in row order
+   */
+  const std::vector<std::uint32_t> &getRowIdNumList();
+  /* interns the id of every row of a block fetched with fetchDataBackend()
+   */
+  std::vector<std::uint32_t> getRowIdNumList(const SqliteRowBlock &rowData);
+  /* copy rows from a block fetched with fetchDataBackend() into the cache
+   * @return 0 on sucess, else error code
+   */
+  int insertRows(int rowNum, const SqliteRowBlock &rowData, int srcRowNum,
+                 int count);
+  /* remove rows from the cache
+   * @return 0 on sucess, else error code
+   */
+  int removeRows(int rowNum, int count);
+  /* replace the cache with a block fetched with fetchDataBackend()
+   * @param fetchedAll false if more rows can be fetched in windowed mode
+   * @return 0 on sucess, else error code
+   */
+  int replaceData(SqliteRowBlock &&rowData, bool fetchedAll);
+  /* forget the cached child count of a row
+   */
+  void invalidateChildCount(int rowNum);
+  /* the cached child counts, rowNum->number of children
+   */
+  const std::unordered_map<int, int> &getChildCountMap();
+  /* caches the child count of a row, for counts restored from a tree cache
+   */
+  void setChildCount(int rowNum, int count);
+  /* Registers the ids of the cached rows in the node table and sets the row
+   * number of every child index to the row its id is cached at. Called by
+   * every function changing the cached rows.
+   * @param rowBegin first row to register when rows were only appended, 0
+   * registers all rows again
+   * @return 0 on sucess, else error code
+   */
+  int updateChildRowNums(int rowBegin = 0);
+  /* Registers rows inserted at rowNum and renumbers the rows after them,
+   * the rows before the insertion point keep their registration
+   * @return 0 on sucess, else error code
+   */
+  int insertChildRowNums(int rowNum, int count);
+  /* Unregisters count rows removed at rowNum and renumbers the rows after
+   * them, the rows before keep their registration
+   * @return 0 on sucess, else error code
+   */
+  int removeChildRowNums(int rowNum, int count);
+  /* moves the cached child counts at or after rowNum by shift rows, the
+   * counts of rows shifted before rowNum are dropped
+   */
+  void shiftChildCounts(int rowNum, int shift);
+  /* Frees the cached data. Child indexes are kept. The data is reloaded
+   * with the same number of rows by the next getDataBackend().
+   * @return 0 on sucess, else error code
+   */
+  int evictData();
+  /* approximate heap memory used by the cached data
+   */
+  std::size_t byteSize();
   /* row number to ID using cache
    */
   std::optional<std::string> getRowId(int rowNum);
+  /* row number to interned ID using cache
+   */
+  std::optional<std::uint32_t> getRowIdNum(int rowNum);
   /* row number to ID using sqlite3
    */
   std::optional<std::string> getRowIdBackend(int rowNum);
@@ -144,6 +470,19 @@ public:
    * @return 0 on sucess, else error code
    */
   int rowCountBackend(int rowNum = -1);
+  /* get the number of children of a row using the child count cache. On a
+   * cache miss the counts for the whole page of rows are fetched at once.
+   * @return the number of children
+   */
+  int getChildCount(int rowNum);
+  /* fetch the child counts for a page of rows with one grouped query
+   * @param pageNum the page number, rows pageNum * childCountPageSize onward
+   * @return 0 on sucess, else error code
+   */
+  int childCountBackend(int pageNum);
+  /* number of rows counted per grouped child count query
+   */
+  static const int childCountPageSize = 256;
   /* getters and setters for the row and column number that the index exists at
    */
   int getRowNum();
@@ -152,10 +491,22 @@ public:
   void setColNum(int colNum_);
   /* insert the index into the index cache
    */
-  int insertIndex(std::string id_, std::shared_ptr<SqliteModelIndex> indexPtr_);
+  int insertIndex(std::uint32_t idNum_,
+                  std::shared_ptr<SqliteModelIndex> indexPtr_);
   /* find index in the index cache
    */
-  std::shared_ptr<SqliteModelIndex> findIndex(std::string id_);
+  std::shared_ptr<SqliteModelIndex> findIndex(std::uint32_t idNum_);
+  /* remove index from the index cache
+   * @return the removed index
+   */
+  std::shared_ptr<SqliteModelIndex> removeIndex(std::uint32_t idNum_);
+  /* all indexes in the index cache
+   */
+  std::vector<SqliteModelIndex *> getIndexList();
+  /* @return the index holding the children of a row, nullptr if none was
+   * created yet
+   */
+  SqliteModelIndex *getChildAt(int rowNum);
 };
 
 } // namespace widget
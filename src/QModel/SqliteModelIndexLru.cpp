@@ -0,0 +1,88 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief QAbstractItemModel with a sqlite3 backend.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteModelIndexLru.hpp"
+#include "SqliteModelIndex.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteModelIndexLru::SqliteModelIndexLru() {}
+
+SqliteModelIndexLru::~SqliteModelIndexLru() {}
+
+void SqliteModelIndexLru::setByteBudget(std::size_t byteBudget_) {
+  byteBudget = byteBudget_;
+  evict();
+}
+
+std::size_t SqliteModelIndexLru::getByteBudget() { return byteBudget; }
+
+std::size_t SqliteModelIndexLru::getByteTotal() { return byteTotal; }
+
+std::size_t SqliteModelIndexLru::size() { return entryMap.size(); }
+
+void SqliteModelIndexLru::update(SqliteModelIndex *indexPtr,
+                                 std::size_t byteSize) {
+  auto findIt = entryMap.find(indexPtr);
+  if (findIt == entryMap.end()) {
+    lruList.push_front(indexPtr);
+    entryMap.insert({indexPtr, {lruList.begin(), byteSize}});
+  } else {
+    lruList.splice(lruList.begin(), lruList, findIt->second.first);
+    byteTotal -= findIt->second.second;
+    findIt->second.second = byteSize;
+  }
+  byteTotal += byteSize;
+  evict(indexPtr);
+}
+
+void SqliteModelIndexLru::touch(SqliteModelIndex *indexPtr) {
+  auto findIt = entryMap.find(indexPtr);
+  if (findIt != entryMap.end() && findIt->second.first != lruList.begin()) {
+    lruList.splice(lruList.begin(), lruList, findIt->second.first);
+  }
+}
+
+void SqliteModelIndexLru::remove(SqliteModelIndex *indexPtr) {
+  auto findIt = entryMap.find(indexPtr);
+  if (findIt == entryMap.end()) {
+    return;
+  }
+  byteTotal -= findIt->second.second;
+  lruList.erase(findIt->second.first);
+  entryMap.erase(findIt);
+}
+
+int SqliteModelIndexLru::evict(SqliteModelIndex *keepPtr) {
+  int evictCount = 0;
+  if (byteBudget == 0) {
+    return evictCount;
+  }
+  while (byteTotal > byteBudget && !lruList.empty()) {
+    SqliteModelIndex *indexPtr = lruList.back();
+    if (indexPtr == keepPtr) {
+      break;
+    }
+    remove(indexPtr);
+    indexPtr->evictData();
+    evictCount++;
+  }
+  return evictCount;
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief QAbstractItemModel with a sqlite3 backend.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_LRU_H
+#define BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_LRU_H
+
+// config
+#include "../core/config.hpp"
+
+// C++
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+class SqliteModelIndex;
+
+/*
+ * @brief Tracks the cached data size of every SqliteModelIndex in least
+ * recently used order. When the total exceeds the byte budget the data of the
+ * least recently used indexes is evicted. Indexes themselves are never
+ * deleted, so QModelIndex::internalPointer() targets stay valid and evicted
+ * indexes reload their data the next time they are used.
+ */
+class SqliteModelIndexLru {
+private:
+  /* 0 means unlimited
+   */
+  std::size_t byteBudget = 0;
+  std::size_t byteTotal = 0;
+  /* front is the most recently used index
+   */
+  std::list<SqliteModelIndex *> lruList;
+  std::unordered_map<SqliteModelIndex *,
+                     std::pair<std::list<SqliteModelIndex *>::iterator,
+                               std::size_t>>
+      entryMap;
+
+public:
+  SqliteModelIndexLru();
+  ~SqliteModelIndexLru();
+
+  /* Sets the byte budget and evicts data until the total is under it
+   * @param byteBudget maximum bytes of cached data, 0 for unlimited
+   */
+  void setByteBudget(std::size_t byteBudget);
+  std::size_t getByteBudget();
+  std::size_t getByteTotal();
+  /* number of indexes holding cached data
+   */
+  std::size_t size();
+  /* Records the cached data size of an index after it loaded data and marks
+   * it most recently used. Evicts other indexes if over budget.
+   */
+  void update(SqliteModelIndex *indexPtr, std::size_t byteSize);
+  /* marks an index most recently used
+   */
+  void touch(SqliteModelIndex *indexPtr);
+  /* stops tracking an index, for example when it is destroyed
+   */
+  void remove(SqliteModelIndex *indexPtr);
+  /* Evicts least recently used data until the total is under budget
+   * @param keepPtr an index that must not be evicted
+   * @return number of indexes evicted
+   */
+  int evict(SqliteModelIndex *keepPtr = nullptr);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_LRU_H
+#endif
@@ -0,0 +1,124 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief QAbstractItemModel with a sqlite3 backend.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteModelNodeTable.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteModelNodeTable::SqliteModelNodeTable() {}
+
+SqliteModelNodeTable::~SqliteModelNodeTable() {}
+
+int SqliteModelNodeTable::insert(SqliteModelIndex *indexPtr) {
+  if (!freeHandleList.empty()) {
+    int handle = freeHandleList.back();
+    freeHandleList.pop_back();
+    nodeList[handle] = indexPtr;
+    return handle;
+  }
+  nodeList.push_back(indexPtr);
+  return static_cast<int>(nodeList.size()) - 1;
+}
+
+void SqliteModelNodeTable::remove(int handle) {
+  if (handle < 0 || handle >= static_cast<int>(nodeList.size()) ||
+      !nodeList[handle]) {
+    return;
+  }
+  nodeList[handle] = nullptr;
+  freeHandleList.push_back(handle);
+}
+
+SqliteModelIndex *SqliteModelNodeTable::get(int handle) const {
+  if (handle < 0 || handle >= static_cast<int>(nodeList.size())) {
+    return nullptr;
+  }
+  return nodeList[handle];
+}
+
+void SqliteModelNodeTable::insertRows(
+    int handle, const std::vector<std::uint32_t> &rowIdList, int rowBegin) {
+  for (int rowNum = rowBegin; rowNum < static_cast<int>(rowIdList.size());
+       rowNum++) {
+    std::uint32_t idNum = rowIdList[rowNum];
+    if (idNum >= rowLocationList.size()) {
+      rowLocationList.resize(idNum + 1, {-1, -1});
+    }
+    if (rowLocationList[idNum].first < 0) {
+      rowLocationCount++;
+    }
+    rowLocationList[idNum] = {handle, rowNum};
+  }
+}
+
+void SqliteModelNodeTable::removeRows(
+    int handle, const std::vector<std::uint32_t> &rowIdList) {
+  for (std::uint32_t idNum : rowIdList) {
+    // the row may have moved to another index since
+    if (idNum < rowLocationList.size() &&
+        rowLocationList[idNum].first == handle) {
+      rowLocationList[idNum] = {-1, -1};
+      rowLocationCount--;
+    }
+  }
+}
+
+void SqliteModelNodeTable::evictRows(
+    int handle, const std::vector<std::uint32_t> &rowIdList) {
+  removeRows(handle, rowIdList);
+  for (std::uint32_t idNum : rowIdList) {
+    if (idNum >= evictedHandleList.size()) {
+      evictedHandleList.resize(idNum + 1, -1);
+    }
+    evictedHandleList[idNum] = handle;
+  }
+}
+
+void SqliteModelNodeTable::removeEvictedRows(
+    int handle, const std::vector<std::uint32_t> &rowIdList) {
+  for (std::uint32_t idNum : rowIdList) {
+    if (idNum < evictedHandleList.size() &&
+        evictedHandleList[idNum] == handle) {
+      evictedHandleList[idNum] = -1;
+    }
+  }
+}
+
+std::optional<std::pair<int, int>>
+SqliteModelNodeTable::find(std::uint32_t idNum) const {
+  if (idNum >= rowLocationList.size() || rowLocationList[idNum].first < 0) {
+    return std::optional<std::pair<int, int>>();
+  }
+  return rowLocationList[idNum];
+}
+
+std::optional<int>
+SqliteModelNodeTable::findEvicted(std::uint32_t idNum) const {
+  if (idNum >= evictedHandleList.size() || evictedHandleList[idNum] < 0) {
+    return std::optional<int>();
+  }
+  return evictedHandleList[idNum];
+}
+
+std::size_t SqliteModelNodeTable::size() const { return rowLocationCount; }
+
+std::size_t SqliteModelNodeTable::getNodeCount() const {
+  return nodeList.size() - freeHandleList.size();
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief QAbstractItemModel with a sqlite3 backend.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_QMODEL_SQLITE_MODEL_NODE_TABLE_H
+#define BOOKFILER_QMODEL_SQLITE_MODEL_NODE_TABLE_H
+
+// config
+#include "../core/config.hpp"
+
+// C++
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+class SqliteModelIndex;
+
+/*
+ * @brief Gives every SqliteModelIndex of a model an integer handle and maps
+ * the interned id of every cached row to the handle of the index holding it
+ * and its row number. Indexes update their rows whenever their data is
+ * replaced, reordered, or evicted, so finding where an id is shown never scans
+ * the cached rows.
+ */
+class SqliteModelNodeTable {
+private:
+  /* map handle->index, nullptr for free handles
+   */
+  std::vector<SqliteModelIndex *> nodeList;
+  std::vector<int> freeHandleList;
+  /* map idNum->{handle, rowNum}, handle -1 for rows not cached. Interned ids
+   * are dense so the ids index the vector directly.
+   */
+  std::vector<std::pair<int, int>> rowLocationList;
+  std::size_t rowLocationCount = 0;
+  /* map idNum->handle of the evicted index that held the row, -1 for none.
+   * A change to an evicted row still finds the index whose rows the view
+   * counts.
+   */
+  std::vector<int> evictedHandleList;
+
+public:
+  SqliteModelNodeTable();
+  ~SqliteModelNodeTable();
+
+  /* @return the handle of the index
+   */
+  int insert(SqliteModelIndex *indexPtr);
+  /* frees the handle, the rows of the index must be removed first
+   */
+  void remove(int handle);
+  /* @return the index or nullptr if the handle is free
+   */
+  SqliteModelIndex *get(int handle) const;
+  /* Sets the location of rows held by an index
+   * @param rowIdList the id of each row of the index
+   * @param rowBegin the first row to set, earlier rows are kept
+   */
+  void insertRows(int handle, const std::vector<std::uint32_t> &rowIdList,
+                  int rowBegin = 0);
+  /* Removes the locations of rows that still point to the index
+   */
+  void removeRows(int handle, const std::vector<std::uint32_t> &rowIdList);
+  /* Removes the locations of the rows of an evicted index and remembers
+   * the index held them
+   */
+  void evictRows(int handle, const std::vector<std::uint32_t> &rowIdList);
+  /* Forgets the evicted rows that still point to the index
+   */
+  void removeEvictedRows(int handle,
+                         const std::vector<std::uint32_t> &rowIdList);
+  /* @return {handle, rowNum} of a cached row
+   */
+  std::optional<std::pair<int, int>> find(std::uint32_t idNum) const;
+  /* @return the handle of the evicted index that held a row
+   */
+  std::optional<int> findEvicted(std::uint32_t idNum) const;
+  /* number of cached rows with a location
+   */
+  std::size_t size() const;
+  /* number of registered indexes
+   */
+  std::size_t getNodeCount() const;
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_QMODEL_SQLITE_MODEL_NODE_TABLE_H
+#endif
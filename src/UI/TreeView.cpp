@@ -10,11 +10,19 @@
  * piwebapi-ucdavis 1.0
  */
 #include "TreeView.hpp"
+#if DEPENDENCY_SQLITE
+#include "../QModel/SqliteModel.hpp"
+#endif
 #include <QKeyEvent>
+#include <QPointer>
 //#include <QMimeData>
 #include <QApplication>
 #include <QClipboard>
 #include <QDebug>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QTimer>
 /*
  * bookfiler - widget
  */
@@ -25,9 +33,29 @@ TreeView::TreeView() {
   setObjectName("BookFiler Tree Widget");
   setSelectionMode(MultiSelection);
   setSelectionBehavior(SelectRows);
+  setDragDropMode(DragDrop);
+  setDefaultDropAction(Qt::MoveAction);
+  setDropIndicatorShown(true);
+#if DEPENDENCY_SQLITE
+  /* Hiding or showing a section resizes the sections, a section that
+   * resizes to its contents is not resized itself
+   */
+  connect(header(), &QHeaderView::sectionResized, this,
+          [this]() { queueHiddenColumns(); });
+  connect(header(), &QHeaderView::geometriesChanged, this,
+          [this]() { queueHiddenColumns(); });
+#endif
 };
 TreeView::~TreeView(){};
 
+void TreeView::setModel(QAbstractItemModel *model) {
+  QTreeView::setModel(model);
+#if DEPENDENCY_SQLITE
+  // the header keeps its hidden sections for the new model
+  updateHiddenColumns();
+#endif
+}
+
 int TreeView::update() {
   QAbstractItemModel *m = this->model();
   setModel(nullptr);
@@ -48,8 +76,162 @@ void TreeView::expand(const QModelIndex &index) {
   QTreeView::expand(index);
 }
 
+void TreeView::expandAll() {
+#if DEPENDENCY_SQLITE
+  SqliteModel *sqliteModelPtr = dynamic_cast<SqliteModel *>(model());
+  if (sqliteModelPtr) {
+    // the view may be destroyed before the prefetch finishes
+    QPointer<TreeView> viewPtr(this);
+    sqliteModelPtr->prefetch(QModelIndex(), -1, [viewPtr]() {
+      if (viewPtr) {
+        viewPtr->QTreeView::expandAll();
+      }
+    });
+    return;
+  }
+#endif
+  QTreeView::expandAll();
+}
+
+int TreeView::setClipboardCellLimit(long long cellLimit) {
+  clipboardCellLimit = cellLimit;
+  return 0;
+}
+
+int TreeView::saveState(const std::string &filePath) {
+#if DEPENDENCY_SQLITE
+  SqliteModel *sqliteModelPtr = dynamic_cast<SqliteModel *>(model());
+  if (sqliteModelPtr) {
+    std::vector<std::string> expandedIdList;
+    getExpandedIdList(sqliteModelPtr, QModelIndex(), expandedIdList);
+    return sqliteModelPtr->saveTreeCache(filePath, expandedIdList);
+  }
+#endif
+  return -1;
+}
+
+int TreeView::restoreState(const std::string &filePath) {
+#if DEPENDENCY_SQLITE
+  SqliteModel *sqliteModelPtr = dynamic_cast<SqliteModel *>(model());
+  if (sqliteModelPtr) {
+    std::vector<std::string> expandedIdList;
+    int rc = sqliteModelPtr->loadTreeCache(filePath, expandedIdList);
+    if (rc != 0) {
+      return rc;
+    }
+    // the rows of every expanded id were restored with the cache
+    for (auto &id : expandedIdList) {
+      QModelIndex index = sqliteModelPtr->getModelIndex(id);
+      if (index.isValid()) {
+        setExpanded(index, true);
+      }
+    }
+    return 0;
+  }
+#endif
+  return -1;
+}
+
+#if DEPENDENCY_SQLITE
+void TreeView::queueHiddenColumns() {
+  if (hiddenColumnsQueuedFlag) {
+    return;
+  }
+  hiddenColumnsQueuedFlag = true;
+  QTimer::singleShot(0, this, [this]() {
+    hiddenColumnsQueuedFlag = false;
+    updateHiddenColumns();
+  });
+}
+
+int TreeView::updateHiddenColumns() {
+  SqliteModel *sqliteModelPtr = dynamic_cast<SqliteModel *>(model());
+  if (!sqliteModelPtr) {
+    return 0;
+  }
+  std::vector<int> columnNumList;
+  for (int sectionNum = 0; sectionNum < header()->count(); sectionNum++) {
+    if (header()->isSectionHidden(sectionNum)) {
+      columnNumList.push_back(sectionNum);
+    }
+  }
+  return sqliteModelPtr->setHiddenColumns(columnNumList);
+}
+
+void TreeView::getExpandedIdList(SqliteModel *sqliteModelPtr,
+                                 const QModelIndex &parent,
+                                 std::vector<std::string> &idList) {
+  // collapsed rows are not entered, so their children are not loaded
+  int rowCount = sqliteModelPtr->rowCount(parent);
+  for (int rowNum = 0; rowNum < rowCount; rowNum++) {
+    QModelIndex index = sqliteModelPtr->index(rowNum, 0, parent);
+    if (!isExpanded(index)) {
+      continue;
+    }
+    std::string id = sqliteModelPtr->getId(index);
+    if (!id.empty()) {
+      idList.push_back(id);
+      getExpandedIdList(sqliteModelPtr, index, idList);
+    }
+  }
+}
+
+int TreeView::copySelection(SqliteModel *sqliteModelPtr) {
+  QItemSelection selection = selectionModel()->selection();
+  // the visible columns in the order the header shows them
+  std::vector<int> columnList;
+  for (int visualNum = 0; visualNum < header()->count(); visualNum++) {
+    int columnNum = header()->logicalIndex(visualNum);
+    if (!header()->isSectionHidden(columnNum)) {
+      columnList.push_back(columnNum);
+    }
+  }
+  long long cellCount = 0;
+  for (const QItemSelectionRange &range : selection) {
+    cellCount += static_cast<long long>(range.height()) * columnList.size();
+  }
+  if (cellCount == 0) {
+    return 0;
+  }
+  if (clipboardCellLimit < 0 || cellCount <= clipboardCellLimit) {
+    QApplication::clipboard()->setMimeData(sqliteModelPtr->exportMimeData(
+        selection, SqliteRowWriter::Format::Tsv, columnList));
+    return 0;
+  }
+
+  // too large for the clipboard, the rows are written to a file instead
+  QString tsvFilter = tr("Tab separated values (*.tsv)");
+  QString csvFilter = tr("Comma separated values (*.csv)");
+  QString htmlFilter = tr("HTML table (*.html)");
+  QString selectedFilter = tsvFilter;
+  QString filePath = QFileDialog::getSaveFileName(
+      this, tr("Export Selection"), QString(),
+      tsvFilter + ";;" + csvFilter + ";;" + htmlFilter, &selectedFilter);
+  if (filePath.isEmpty()) {
+    return 0;
+  }
+  QString suffix = QFileInfo(filePath).suffix().toLower();
+  SqliteRowWriter::Format format = SqliteRowWriter::Format::Tsv;
+  if (suffix == "csv" || (suffix != "tsv" && selectedFilter == csvFilter)) {
+    format = SqliteRowWriter::Format::Csv;
+  } else if (suffix == "html" || suffix == "htm" ||
+             (suffix != "tsv" && selectedFilter == htmlFilter)) {
+    format = SqliteRowWriter::Format::Html;
+  }
+  int rc = sqliteModelPtr->exportFile(selection, format, filePath, columnList);
+  return rc < 0 ? rc : 0;
+}
+#endif
+
 void TreeView::keyPressEvent(QKeyEvent *event) {
   if (event->matches(QKeySequence::Copy)) {
+#if DEPENDENCY_SQLITE
+    SqliteModel *sqliteModelPtr = dynamic_cast<SqliteModel *>(model());
+    if (sqliteModelPtr) {
+      copySelection(sqliteModelPtr);
+      return;
+    }
+#endif
     QItemSelectionModel *selection = selectionModel();
     QModelIndexList indexes = selection->selectedIndexes();
 
@@ -76,7 +258,7 @@ void TreeView::keyPressEvent(QKeyEvent *event) {
     }
 
     // add last element
-    // selected_text.append(model()->data(current).toString());
+    selected_text.append(model()->data(previous).toString());
 
     selected_text.append(QLatin1Char('\n'));
     QApplication::clipboard()->setText(selected_text);
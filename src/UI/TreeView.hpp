@@ -53,20 +53,56 @@
 namespace bookfiler {
 namespace widget {
 
+#if DEPENDENCY_SQLITE
+class SqliteModel;
+#endif
+
 class TreeView : public QTreeView {
   Q_OBJECT
 private:
   std::shared_ptr<TreeItemDelegate> treeItemDelegatePtr;
+  long long clipboardCellLimit = 4000000;
+
+#if DEPENDENCY_SQLITE
+  /* Copies the visible columns of the selected rows as TSV with
+   * SqliteModel::exportMimeData(), or asks for a file to export them to
+   * when the selection has more cells than the clipboard limit
+   * @return 0 on success, else error code
+   */
+  int copySelection(SqliteModel *sqliteModelPtr);
+  /* Passes the sections hidden in the header to
+   * SqliteModel::setHiddenColumns() so hidden columns are not queried
+   * @return 0 on success, else error code
+   */
+  int updateHiddenColumns();
+  /* Calls updateHiddenColumns() once control returns to the event loop.
+   * QHeaderView resizes a section before it marks it hidden, and resizing
+   * a section to 0 by hand does not hide it.
+   */
+  void queueHiddenColumns();
+  bool hiddenColumnsQueuedFlag = false;
+  /* Appends the ids of the expanded rows below parent, parents first
+   */
+  void getExpandedIdList(SqliteModel *sqliteModelPtr, const QModelIndex &parent,
+                         std::vector<std::string> &idList);
+#endif
 
 public:
   TreeView();
   ~TreeView();
 
+  /* Passes the hidden sections of the header to a SqliteModel
+   */
+  void setModel(QAbstractItemModel *model) override;
+
   /* Called when the sqlite3 database is updated by another widget, thread, or
    * process. Need to rebuild the entire internal representation of the tree
    * because no hint at which rows were added, updated, or deleted is provided.
    * Internally update(const QModelIndex &index) is called to update the root
-   * index and all child indexes
+   * index and all child indexes. When the added, updated, and deleted ids are
+   * known, SqliteModel::updateIdHint() updates only the affected rows and
+   * keeps the expansion and selection. SqliteModel::setChangeCapture() finds
+   * the changed rows itself, so this call is not needed.
    * @return 0 on success, else error code
    */
   int update();
@@ -81,9 +117,33 @@ public:
       int columnNum,
       std::function<std::shared_ptr<QWidget>()> editorWidgetCreator);
 
+  /* Copying a selection with more cells than this writes the rows to a file
+   * chosen by the user instead of the clipboard
+   * @param cellLimit rows times columns, -1 to always use the clipboard
+   * @return 0 on success, else error code
+   */
+  int setClipboardCellLimit(long long cellLimit);
+
+  /* Saves the rows loaded by a SqliteModel and the expanded rows to a
+   * sidecar cache file, see SqliteModel::saveTreeCache()
+   * @return 0 on success, else error code
+   */
+  int saveState(const std::string &filePath);
+  /* Restores the rows and expanded rows saved by saveState() without
+   * querying the table. If the database changed since, the saved rows are
+   * shown first and refreshed one index at a time.
+   * @return 0 on success, else error code
+   */
+  int restoreState(const std::string &filePath);
+
 
   public slots:
       void expand(const QModelIndex &index);
+      /* Expands every row. With a SqliteModel the whole tree is prefetched
+       * first so the rows are loaded in parallel instead of one expanded row
+       * at a time.
+       */
+      void expandAll();
       void keyPressEvent(QKeyEvent *event);
 };
 
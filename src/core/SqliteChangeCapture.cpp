@@ -0,0 +1,554 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Collects the ids changed by committed transactions of this and
+ * other connections.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteChangeCapture.hpp"
+#include "SqliteSnapshot.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+bool SqliteChangeCapture::ChangeSet::empty() const {
+  return addedIdList.empty() && updatedIdList.empty() &&
+         deletedIdList.empty() && previousParentIdSet.empty();
+}
+
+SqliteChangeCapture::IgnoreScope::IgnoreScope(
+    SqliteChangeCapture *capturePtr_)
+    : capturePtr(capturePtr_) {
+  if (!capturePtr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(capturePtr->hookMutex);
+    previousThreadId = capturePtr->ignoredThreadId;
+    capturePtr->ignoredThreadId = std::this_thread::get_id();
+  }
+  if (capturePtr->hookFlag) {
+    tempRowIdMark = capturePtr->getInt("SELECT ifnull(max(rowid), 0) FROM "
+                                       "temp.`" +
+                                       capturePtr->getTempTableName() + "`;");
+  }
+}
+
+SqliteChangeCapture::IgnoreScope::~IgnoreScope() {
+  if (!capturePtr) {
+    return;
+  }
+  /* The TEMP triggers also fire for the ignored writes. Their rows are
+   * deleted while the thread is still ignored, the hooks lock hookMutex.
+   */
+  if (capturePtr->hookFlag) {
+    std::string tempTableName = "temp.`" + capturePtr->getTempTableName() + "`";
+    if (capturePtr->getInt("SELECT ifnull(max(rowid), 0) FROM " +
+                           tempTableName + ";") > tempRowIdMark) {
+      SqliteSnapshot::TempWriteScope tempWriteScope(
+          capturePtr->database.get());
+      capturePtr->exec("DELETE FROM " + tempTableName + " WHERE rowid > " +
+                       std::to_string(tempRowIdMark) + ";");
+    }
+  }
+  std::lock_guard<std::mutex> lock(capturePtr->hookMutex);
+  capturePtr->ignoredThreadId = previousThreadId;
+}
+
+SqliteChangeCapture::SqliteChangeCapture(
+    std::shared_ptr<sqlite3> database_,
+    std::shared_ptr<SqliteStatementCache> statementCache_,
+    std::string tableName_, std::string idColumnName_,
+    std::string parentIdColumnName_)
+    : database(database_), statementCache(statementCache_),
+      tableName(tableName_), idColumnName(idColumnName_),
+      parentIdColumnName(parentIdColumnName_) {}
+
+SqliteChangeCapture::~SqliteChangeCapture() { close(); }
+
+std::string SqliteChangeCapture::getTempTableName() const {
+  return tableName + "_bookfiler_capture";
+}
+
+std::string SqliteChangeCapture::getChangelogTableName() const {
+  return tableName + "_bookfiler_changelog";
+}
+
+int SqliteChangeCapture::exec(const std::string &sqlQuery) {
+  return sqlite3_exec(database.get(), sqlQuery.c_str(), nullptr, nullptr,
+                      nullptr);
+}
+
+std::int64_t SqliteChangeCapture::getInt(const std::string &sqlQuery) {
+  sqlite3_stmt *stmt = nullptr;
+  std::int64_t value = 0;
+  if (sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt,
+                         nullptr) == SQLITE_OK &&
+      sqlite3_step(stmt) == SQLITE_ROW) {
+    value = sqlite3_column_int64(stmt, 0);
+  }
+  sqlite3_finalize(stmt);
+  return value;
+}
+
+void SqliteChangeCapture::updateHook(void *capturePtr, int op,
+                                     const char *databaseName,
+                                     const char *changedTableName,
+                                     sqlite3_int64 rowId) {
+  SqliteChangeCapture *self = static_cast<SqliteChangeCapture *>(capturePtr);
+  std::lock_guard<std::mutex> lock(self->hookMutex);
+  if (self->ignoredThreadId == std::this_thread::get_id()) {
+    return;
+  }
+  // the TEMP trigger writes its rows to the temp schema
+  if (sqlite3_stricmp(databaseName, "temp") == 0) {
+    if (sqlite3_stricmp(changedTableName, self->getTempTableName().c_str()) ==
+        0) {
+      self->pendingTempFlag = true;
+    }
+    return;
+  }
+  if (sqlite3_stricmp(databaseName, "main") != 0 ||
+      sqlite3_stricmp(changedTableName, self->tableName.c_str()) != 0) {
+    return;
+  }
+  switch (op) {
+  case SQLITE_INSERT:
+    self->pendingRowMap[rowId] = true;
+    break;
+  case SQLITE_UPDATE:
+    // an added row stays added
+    self->pendingRowMap.insert({rowId, false});
+    break;
+  case SQLITE_DELETE:
+    self->pendingRowMap.erase(rowId);
+    self->pendingDeletedSet.insert(rowId);
+    break;
+  }
+}
+
+int SqliteChangeCapture::commitHook(void *capturePtr) {
+  SqliteChangeCapture *self = static_cast<SqliteChangeCapture *>(capturePtr);
+  std::function<void()> notifyCopy;
+  {
+    std::lock_guard<std::mutex> lock(self->hookMutex);
+    // rows deleted by this transaction replace what earlier commits did
+    for (sqlite3_int64 rowId : self->pendingDeletedSet) {
+      self->committedRowMap.erase(rowId);
+    }
+    for (auto &rowPair : self->pendingRowMap) {
+      auto insertPair = self->committedRowMap.insert(rowPair);
+      if (!insertPair.second) {
+        insertPair.first->second = insertPair.first->second || rowPair.second;
+      }
+    }
+    self->committedTempFlag = self->committedTempFlag || self->pendingTempFlag;
+    bool changedFlag =
+        !self->pendingRowMap.empty() || !self->pendingDeletedSet.empty() ||
+        self->pendingTempFlag;
+    self->pendingRowMap.clear();
+    self->pendingDeletedSet.clear();
+    self->pendingTempFlag = false;
+    if (changedFlag && !self->notifyFlag) {
+      self->notifyFlag = true;
+      notifyCopy = self->notify;
+    }
+  }
+  if (notifyCopy) {
+    notifyCopy();
+  }
+  // 0 lets the commit proceed
+  return 0;
+}
+
+void SqliteChangeCapture::rollbackHook(void *capturePtr) {
+  SqliteChangeCapture *self = static_cast<SqliteChangeCapture *>(capturePtr);
+  std::lock_guard<std::mutex> lock(self->hookMutex);
+  self->pendingRowMap.clear();
+  self->pendingDeletedSet.clear();
+  self->pendingTempFlag = false;
+}
+
+int SqliteChangeCapture::openHooks(std::function<void()> notify_) {
+  if (hookFlag) {
+    close();
+  }
+
+  /* Deleted rows and the previous parent of moved rows can not be read after
+   * the commit. 'd' rows hold the deleted id and its parent, 'm' rows the
+   * previous parent of a moved row.
+   */
+  std::string tempTableName = getTempTableName();
+  std::string idColumn = "`" + idColumnName + "`";
+  std::string parentIdColumn = "`" + parentIdColumnName + "`";
+  int rc = 0;
+  {
+    SqliteSnapshot::TempWriteScope tempWriteScope(database.get());
+    rc = exec(
+        "CREATE TEMP TABLE IF NOT EXISTS `" + tempTableName +
+        "`(op TEXT, id, parentId);"
+        "CREATE TEMP TRIGGER IF NOT EXISTS `" +
+        tempTableName + "_delete` AFTER DELETE ON main.`" + tableName +
+        "` BEGIN INSERT INTO `" + tempTableName +
+        "` VALUES ('d', old." + idColumn + ", old." + parentIdColumn +
+        "); END;"
+        "CREATE TEMP TRIGGER IF NOT EXISTS `" +
+        tempTableName + "_move` AFTER UPDATE OF " + parentIdColumn +
+        " ON main.`" + tableName + "` WHEN old." + parentIdColumn +
+        " IS NOT new." + parentIdColumn + " BEGIN INSERT INTO `" +
+        tempTableName + "` VALUES ('m', old." + idColumn + ", old." +
+        parentIdColumn + "); END;");
+  }
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(hookMutex);
+    notify = notify_;
+    pendingRowMap.clear();
+    committedRowMap.clear();
+    pendingDeletedSet.clear();
+    pendingTempFlag = committedTempFlag = notifyFlag = false;
+  }
+  sqlite3_update_hook(database.get(), updateHook, this);
+  sqlite3_commit_hook(database.get(), commitHook, this);
+  sqlite3_rollback_hook(database.get(), rollbackHook, this);
+  hookFlag = true;
+  return 0;
+}
+
+int SqliteChangeCapture::openChangelog() {
+  std::string changelogTableName = getChangelogTableName();
+  std::string idColumn = "`" + idColumnName + "`";
+  std::string parentIdColumn = "`" + parentIdColumnName + "`";
+
+  // the changelog may exist from an earlier session or another viewer
+  std::int64_t triggerCount =
+      getInt("SELECT count(1) FROM sqlite_master WHERE type = 'trigger' AND "
+             "name IN ('" +
+             changelogTableName + "_insert', '" + changelogTableName +
+             "_update', '" + changelogTableName + "_delete', '" +
+             changelogTableName + "_trim');");
+  if (triggerCount < 4) {
+    /* AUTOINCREMENT never reuses a changeId, so a reader can tell when the
+     * changes after its last changeId were trimmed
+     */
+    std::string insertSQL = "INSERT INTO `" + changelogTableName +
+                            "`(op, id, parentId, previousParentId) ";
+    std::string triggerName = "`" + changelogTableName;
+    int rc = exec(
+        "SAVEPOINT bookfiler_changelog;"
+        "CREATE TABLE IF NOT EXISTS `" +
+        changelogTableName +
+        "`(changeId INTEGER PRIMARY KEY AUTOINCREMENT, op TEXT, id, "
+        "parentId, previousParentId);"
+        "CREATE TRIGGER IF NOT EXISTS " +
+        triggerName + "_insert` AFTER INSERT ON `" + tableName + "` BEGIN " +
+        insertSQL + "VALUES ('i', new." + idColumn + ", new." +
+        parentIdColumn + ", NULL); END;" + "CREATE TRIGGER IF NOT EXISTS " +
+        triggerName + "_update` AFTER UPDATE ON `" + tableName + "` BEGIN " +
+        insertSQL + "VALUES ('u', new." + idColumn + ", new." +
+        parentIdColumn + ", old." + parentIdColumn + "); " + insertSQL +
+        "SELECT 'd', old." + idColumn + ", old." + parentIdColumn +
+        ", NULL WHERE old." + idColumn + " IS NOT new." + idColumn +
+        "; END;" + "CREATE TRIGGER IF NOT EXISTS " + triggerName +
+        "_delete` AFTER DELETE ON `" + tableName + "` BEGIN " + insertSQL +
+        "VALUES ('d', old." + idColumn + ", old." + parentIdColumn +
+        ", NULL); END;" + "CREATE TRIGGER IF NOT EXISTS " + triggerName +
+        "_trim` AFTER INSERT ON `" + changelogTableName +
+        "` WHEN new.changeId % 1024 = 0 BEGIN DELETE FROM `" +
+        changelogTableName + "` WHERE changeId <= new.changeId - " +
+        std::to_string(changelogRetainCount) +
+        "; END;"
+        "RELEASE bookfiler_changelog;");
+    if (rc != SQLITE_OK) {
+      // the database is read only or in query_only mode
+      exec("ROLLBACK TO bookfiler_changelog; RELEASE bookfiler_changelog;");
+      return rc;
+    }
+  }
+
+  dataVersion = getInt("PRAGMA data_version;");
+  lastChangeId = getInt("SELECT seq FROM sqlite_sequence WHERE name = '" +
+                        changelogTableName + "';");
+  changelogFlag = true;
+  return 0;
+}
+
+int SqliteChangeCapture::close() {
+  changelogFlag = false;
+  if (!hookFlag) {
+    return 0;
+  }
+  hookFlag = false;
+  sqlite3_update_hook(database.get(), nullptr, nullptr);
+  sqlite3_commit_hook(database.get(), nullptr, nullptr);
+  sqlite3_rollback_hook(database.get(), nullptr, nullptr);
+  {
+    std::lock_guard<std::mutex> lock(hookMutex);
+    notify = nullptr;
+  }
+  std::string tempTableName = getTempTableName();
+  SqliteSnapshot::TempWriteScope tempWriteScope(database.get());
+  return exec("DROP TRIGGER IF EXISTS temp.`" + tempTableName +
+              "_delete`; DROP TRIGGER IF EXISTS temp.`" + tempTableName +
+              "_move`; DROP TABLE IF EXISTS temp.`" + tempTableName + "`;");
+}
+
+int SqliteChangeCapture::dropChangelog() {
+  changelogFlag = false;
+  std::string triggerName = "`" + getChangelogTableName();
+  int rc = exec("SAVEPOINT bookfiler_changelog;"
+                "DROP TRIGGER IF EXISTS " +
+                triggerName + "_insert`; DROP TRIGGER IF EXISTS " +
+                triggerName + "_update`; DROP TRIGGER IF EXISTS " +
+                triggerName + "_delete`; DROP TRIGGER IF EXISTS " +
+                triggerName + "_trim`; DROP TABLE IF EXISTS " + triggerName +
+                "`; RELEASE bookfiler_changelog;");
+  if (rc != SQLITE_OK) {
+    // the database is read only or in query_only mode
+    exec("ROLLBACK TO bookfiler_changelog; RELEASE bookfiler_changelog;");
+    return rc;
+  }
+  return 0;
+}
+
+bool SqliteChangeCapture::isHookOpen() const { return hookFlag; }
+
+bool SqliteChangeCapture::isChangelogOpen() const { return changelogFlag; }
+
+int SqliteChangeCapture::readRowIdList(
+    const std::unordered_map<sqlite3_int64, bool> &rowMap,
+    ChangeSet &changeSet) {
+  std::vector<std::pair<sqlite3_int64, bool>> rowList(rowMap.begin(),
+                                                      rowMap.end());
+  for (std::size_t pageBegin = 0; pageBegin < rowList.size();
+       pageBegin += rowIdPageSize) {
+    /* The IN list always has rowIdPageSize parameters so a single statement
+     * is cached. Unused parameters stay NULL and match nothing.
+     */
+    std::shared_ptr<sqlite3_stmt> stmt =
+        statementCache->get("captureRowIdList", [this]() {
+          std::string sqlQuery = "SELECT rowid, `" + idColumnName + "`, `" +
+                                 parentIdColumnName + "` FROM `" + tableName +
+                                 "` WHERE rowid IN (";
+          for (int paramNum = 1; paramNum <= rowIdPageSize; paramNum++) {
+            sqlQuery.append((paramNum == 1 ? "?" : ",?") +
+                            std::to_string(paramNum));
+          }
+          sqlQuery.append(");");
+          return sqlQuery;
+        });
+    if (!stmt) {
+      return -1;
+    }
+    std::unordered_map<sqlite3_int64, bool> pageMap;
+    for (std::size_t rowNum = pageBegin;
+         rowNum < rowList.size() && rowNum < pageBegin + rowIdPageSize;
+         rowNum++) {
+      sqlite3_bind_int64(stmt.get(), static_cast<int>(rowNum - pageBegin + 1),
+                         rowList[rowNum].first);
+      pageMap.insert(rowList[rowNum]);
+    }
+    // rows deleted after the commit are not found
+    int rc = sqlite3_step(stmt.get());
+    while (rc == SQLITE_ROW) {
+      const unsigned char *idChar = sqlite3_column_text(stmt.get(), 1);
+      const unsigned char *parentChar = sqlite3_column_text(stmt.get(), 2);
+      if (idChar) {
+        std::string id = reinterpret_cast<const char *>(idChar);
+        (pageMap[sqlite3_column_int64(stmt.get(), 0)]
+             ? changeSet.addedIdList
+             : changeSet.updatedIdList)
+            .push_back(id);
+        changeSet.parentIdMap[id] =
+            parentChar ? reinterpret_cast<const char *>(parentChar) : "*";
+      }
+      rc = sqlite3_step(stmt.get());
+    }
+    if (rc != SQLITE_DONE) {
+      return -2;
+    }
+  }
+  return 0;
+}
+
+int SqliteChangeCapture::readTempTable(ChangeSet &changeSet) {
+  std::string tempTableName = getTempTableName();
+  std::string sqlQuery = "SELECT op, id, parentId FROM temp.`" +
+                         tempTableName + "` ORDER BY rowid;";
+  sqlite3_stmt *stmt = nullptr;
+  int rc =
+      sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    sqlite3_finalize(stmt);
+    return rc;
+  }
+  std::unordered_set<std::string> deletedIdSet;
+  rc = sqlite3_step(stmt);
+  while (rc == SQLITE_ROW) {
+    const unsigned char *opChar = sqlite3_column_text(stmt, 0);
+    const unsigned char *idChar = sqlite3_column_text(stmt, 1);
+    const unsigned char *parentChar = sqlite3_column_text(stmt, 2);
+    changeSet.previousParentIdSet.insert(
+        parentChar ? reinterpret_cast<const char *>(parentChar) : "*");
+    if (opChar && opChar[0] == 'd' && idChar) {
+      deletedIdSet.insert(reinterpret_cast<const char *>(idChar));
+    }
+    rc = sqlite3_step(stmt);
+  }
+  sqlite3_finalize(stmt);
+  if (rc != SQLITE_DONE) {
+    return rc;
+  }
+  mergeDeleted(deletedIdSet, changeSet);
+
+  // the delete is filtered out by the update hook through the temp schema
+  SqliteSnapshot::TempWriteScope tempWriteScope(database.get());
+  return exec("DELETE FROM temp.`" + tempTableName + "`;");
+}
+
+void SqliteChangeCapture::mergeDeleted(
+    std::unordered_set<std::string> &deletedIdSet, ChangeSet &changeSet) {
+  // an id deleted and inserted again replaces the row it had
+  for (auto &id : changeSet.updatedIdList) {
+    deletedIdSet.erase(id);
+  }
+  std::vector<std::string> addedIdList;
+  for (auto &id : changeSet.addedIdList) {
+    if (deletedIdSet.erase(id)) {
+      changeSet.updatedIdList.push_back(id);
+    } else {
+      addedIdList.push_back(id);
+    }
+  }
+  changeSet.addedIdList.swap(addedIdList);
+  changeSet.deletedIdList.insert(changeSet.deletedIdList.end(),
+                                 deletedIdSet.begin(), deletedIdSet.end());
+}
+
+int SqliteChangeCapture::takeChangeSet(ChangeSet &changeSet) {
+  std::unordered_map<sqlite3_int64, bool> rowMap;
+  bool tempFlag = false;
+  {
+    std::lock_guard<std::mutex> lock(hookMutex);
+    rowMap.swap(committedRowMap);
+    tempFlag = committedTempFlag;
+    committedTempFlag = false;
+    notifyFlag = false;
+  }
+  int rc = readRowIdList(rowMap, changeSet);
+  if (rc == 0 && tempFlag) {
+    rc = readTempTable(changeSet);
+  }
+  return rc;
+}
+
+int SqliteChangeCapture::pollChangelog(ChangeSet &changeSet) {
+  if (!changelogFlag) {
+    return -1;
+  }
+  // data_version only changes when another connection commits
+  std::int64_t dataVersionNew = getInt("PRAGMA data_version;");
+  if (dataVersionNew == dataVersion) {
+    return 0;
+  }
+  dataVersion = dataVersionNew;
+
+  std::string sqlQuery =
+      "SELECT changeId, op, id, parentId, previousParentId FROM `" +
+      getChangelogTableName() + "` WHERE changeId > ?1 ORDER BY changeId;";
+  sqlite3_stmt *stmt = nullptr;
+  int rc =
+      sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    sqlite3_finalize(stmt);
+    return -rc;
+  }
+  sqlite3_bind_int64(stmt, 1, lastChangeId);
+
+  /* Coalesce the operations on each id to the first and the last one. The
+   * order of first appearance is kept.
+   */
+  struct IdChange {
+    char firstOp = 0, lastOp = 0;
+  };
+  std::unordered_map<std::string, IdChange> idChangeMap;
+  std::vector<std::string> idList;
+  bool trimmedFlag = false;
+  rc = sqlite3_step(stmt);
+  while (rc == SQLITE_ROW) {
+    std::int64_t changeId = sqlite3_column_int64(stmt, 0);
+    // AUTOINCREMENT leaves no gaps, a gap was trimmed
+    if (changeId > lastChangeId + 1 && idChangeMap.empty()) {
+      trimmedFlag = true;
+    }
+    lastChangeId = changeId;
+    const unsigned char *opChar = sqlite3_column_text(stmt, 1);
+    const unsigned char *idChar = sqlite3_column_text(stmt, 2);
+    const unsigned char *parentChar = sqlite3_column_text(stmt, 3);
+    const unsigned char *previousParentChar = sqlite3_column_text(stmt, 4);
+    if (!opChar || !idChar) {
+      rc = sqlite3_step(stmt);
+      continue;
+    }
+    std::string id = reinterpret_cast<const char *>(idChar);
+    std::string parentId =
+        parentChar ? reinterpret_cast<const char *>(parentChar) : "*";
+    auto insertPair = idChangeMap.insert({id, IdChange()});
+    if (insertPair.second) {
+      insertPair.first->second.firstOp = opChar[0];
+      idList.push_back(id);
+    }
+    insertPair.first->second.lastOp = opChar[0];
+    if (opChar[0] == 'd') {
+      changeSet.previousParentIdSet.insert(parentId);
+      changeSet.parentIdMap.erase(id);
+    } else {
+      changeSet.parentIdMap[id] = parentId;
+      if (opChar[0] == 'u') {
+        changeSet.previousParentIdSet.insert(
+            previousParentChar
+                ? reinterpret_cast<const char *>(previousParentChar)
+                : "*");
+      }
+    }
+    rc = sqlite3_step(stmt);
+  }
+  sqlite3_finalize(stmt);
+  if (rc != SQLITE_DONE) {
+    return -rc;
+  }
+
+  std::unordered_set<std::string> deletedIdSet;
+  for (auto &id : idList) {
+    IdChange &idChange = idChangeMap.at(id);
+    if (idChange.lastOp == 'd') {
+      // an id added and deleted since the last poll was never shown
+      if (idChange.firstOp != 'i') {
+        deletedIdSet.insert(id);
+      }
+    } else if (idChange.firstOp == 'i') {
+      changeSet.addedIdList.push_back(id);
+    } else {
+      changeSet.updatedIdList.push_back(id);
+    }
+  }
+  changeSet.deletedIdList.insert(changeSet.deletedIdList.end(),
+                                 deletedIdSet.begin(), deletedIdSet.end());
+  return trimmedFlag ? 1 : 0;
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
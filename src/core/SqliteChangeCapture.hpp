@@ -0,0 +1,208 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Collects the ids changed by committed transactions of this and
+ * other connections.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_CHANGE_CAPTURE_H
+#define BOOKFILER_CORE_SQLITE_CHANGE_CAPTURE_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteStatementCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Captures the rows of a table changed by committed transactions.
+ *
+ * Writes on the viewed connection, for example an ingest thread sharing an
+ * in-memory database, are seen by sqlite3_update_hook(). The changed rowids
+ * are coalesced per transaction and handed over by the commit hook, a
+ * rollback drops them. The ids are read for the rowids when the changes are
+ * taken. A deleted row can not be read anymore, so a TEMP trigger records
+ * the id and parent of deleted rows, and the previous parent of moved rows.
+ * TEMP triggers only fire for this connection.
+ *
+ * Writes of other connections are recorded by triggers into a changelog
+ * table in the database file. PRAGMA data_version tells when another
+ * connection committed, so polling reads the changelog only after a change.
+ * The changelog keeps the last changelogRetainCount changes.
+ */
+class SqliteChangeCapture {
+public:
+  /* The changed ids, each listed once. An id added and then updated is
+   * listed as added, an id added and then deleted is not listed.
+   */
+  struct ChangeSet {
+    std::vector<std::string> addedIdList, updatedIdList, deletedIdList;
+    /* map id->current parent id of the added and updated ids, "*" for a
+     * NULL parent
+     */
+    std::unordered_map<std::string, std::string> parentIdMap;
+    /* the parents the deleted and moved rows were removed from
+     */
+    std::unordered_set<std::string> previousParentIdSet;
+    bool empty() const;
+  };
+  /* Ignores the writes of the calling thread to the table while it exists,
+   * for writes whose changes the caller applies itself. The rows the TEMP
+   * triggers recorded meanwhile are deleted when it ends.
+   */
+  class IgnoreScope {
+  private:
+    SqliteChangeCapture *capturePtr = nullptr;
+    std::thread::id previousThreadId;
+    /* largest rowid of the TEMP table when the scope began
+     */
+    std::int64_t tempRowIdMark = 0;
+
+  public:
+    IgnoreScope(SqliteChangeCapture *capturePtr_);
+    ~IgnoreScope();
+    IgnoreScope(const IgnoreScope &) = delete;
+    IgnoreScope &operator=(const IgnoreScope &) = delete;
+  };
+  /* rowids read per query when the changes are taken
+   */
+  static const int rowIdPageSize = 256;
+  static const int changelogRetainCount = 65536;
+
+private:
+  std::shared_ptr<sqlite3> database;
+  std::shared_ptr<SqliteStatementCache> statementCache;
+  std::string tableName, idColumnName, parentIdColumnName;
+
+  /* Hook state, written by the thread running the statement. The maps are
+   * rowid->true if the row was added. pendingRowMap belongs to the open
+   * transaction and committedRowMap to the committed ones not taken yet.
+   */
+  std::mutex hookMutex;
+  bool hookFlag = false;
+  std::unordered_map<sqlite3_int64, bool> pendingRowMap, committedRowMap;
+  std::unordered_set<sqlite3_int64> pendingDeletedSet;
+  /* set when the TEMP trigger recorded a row
+   */
+  bool pendingTempFlag = false, committedTempFlag = false;
+  /* set from the commit that found changes until they are taken, so a
+   * burst of commits notifies once
+   */
+  bool notifyFlag = false;
+  std::function<void()> notify;
+  std::thread::id ignoredThreadId;
+
+  /* changelog state
+   */
+  bool changelogFlag = false;
+  std::int64_t lastChangeId = 0, dataVersion = 0;
+
+  static void updateHook(void *capturePtr, int op, const char *databaseName,
+                         const char *changedTableName, sqlite3_int64 rowId);
+  static int commitHook(void *capturePtr);
+  static void rollbackHook(void *capturePtr);
+  std::string getTempTableName() const;
+  std::string getChangelogTableName() const;
+  /* @return sqlite3 result code
+   */
+  int exec(const std::string &sqlQuery);
+  /* @return the value of a pragma or query returning one integer, 0 if it
+   * can not be read
+   */
+  std::int64_t getInt(const std::string &sqlQuery);
+  /* reads the ids and parents of the committed rowids
+   * @return 0 on success, else error code
+   */
+  int readRowIdList(const std::unordered_map<sqlite3_int64, bool> &rowMap,
+                    ChangeSet &changeSet);
+  /* reads and clears the rows recorded by the TEMP trigger
+   * @return 0 on success, else error code
+   */
+  int readTempTable(ChangeSet &changeSet);
+  /* moves the ids of deleted rows that exist again to the updated ids
+   */
+  static void mergeDeleted(std::unordered_set<std::string> &deletedIdSet,
+                           ChangeSet &changeSet);
+
+public:
+  SqliteChangeCapture(std::shared_ptr<sqlite3> database_,
+                      std::shared_ptr<SqliteStatementCache> statementCache_,
+                      std::string tableName_, std::string idColumnName_,
+                      std::string parentIdColumnName_);
+  /* calls close()
+   */
+  ~SqliteChangeCapture();
+
+  /* Registers the update, commit, and rollback hooks and creates the TEMP
+   * trigger. The hooks replace any hooks registered on the connection. The
+   * trigger also turns off the truncate optimization, which would delete
+   * every row without calling the update hook. Tables declared WITHOUT
+   * ROWID do not call the update hook.
+   * @param notify_ called by the thread that committed changes to the
+   * table, once until takeChangeSet(). It must not use the connection.
+   * @return 0 on success, else error code
+   */
+  int openHooks(std::function<void()> notify_);
+  /* Creates the changelog table and its triggers if they do not exist, and
+   * starts reading after the last change. Creating them writes to the
+   * database file.
+   * @return 0 on success, else error code
+   */
+  int openChangelog();
+  /* Unregisters the hooks and drops the TEMP trigger. The changelog is kept
+   * for other viewers.
+   * @return 0 on success, else error code
+   */
+  int close();
+  /* Drops the changelog table and its triggers, for a database no viewer
+   * polls anymore. Viewers still polling it fail to read it. Dropping them
+   * writes to the database file.
+   * @return 0 on success, else error code
+   */
+  int dropChangelog();
+  bool isHookOpen() const;
+  bool isChangelogOpen() const;
+  /* Takes the changes committed on this connection since the last call
+   * @return 0 on success, else error code
+   */
+  int takeChangeSet(ChangeSet &changeSet);
+  /* Reads the changelog if another connection committed since the last
+   * call. Changes of this connection are read too when they are logged in
+   * the same span, applying them twice is harmless.
+   * @return 0 on success, 1 if changes were trimmed from the changelog
+   * before they were read and everything must be read again, negative on
+   * error
+   */
+  int pollChangelog(ChangeSet &changeSet);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_CHANGE_CAPTURE_H
+#endif
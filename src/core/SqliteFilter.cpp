@@ -0,0 +1,453 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Compiles filter conditions into parameterized sqlite3 SQL.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// C++
+#include <algorithm> // std::transform
+#include <cctype>    // std::toupper
+#include <cstdlib>   // std::strtoll
+#include <sstream>   // std::istringstream
+
+// Local Project
+#include "SqliteFilter.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/* column of the FTS5 shadow table holding the id of the row
+ */
+static const std::string ftsIdColumnName = "bookfiler_id";
+
+SqliteFilter::SqliteFilter(std::shared_ptr<sqlite3> database_,
+                           std::string tableName_)
+    : database(database_), tableName(tableName_) {}
+
+int SqliteFilter::loadColumns() {
+  affinityMap.clear();
+  std::string sqlQuery =
+      "SELECT name, type FROM pragma_table_info('" + tableName + "');";
+  sqlite3_stmt *stmt = nullptr;
+  int rc =
+      sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    sqlite3_finalize(stmt);
+    return rc;
+  }
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const unsigned char *nameChar = sqlite3_column_text(stmt, 0);
+    const unsigned char *typeChar = sqlite3_column_text(stmt, 1);
+    if (!nameChar) {
+      continue;
+    }
+    affinityMap.insert(
+        {reinterpret_cast<const char *>(nameChar),
+         getAffinity(typeChar ? reinterpret_cast<const char *>(typeChar)
+                              : "")});
+  }
+  sqlite3_finalize(stmt);
+  return rc == SQLITE_DONE ? 0 : rc;
+}
+
+int SqliteFilter::compile(
+    const std::list<std::tuple<std::string, std::string, std::string>>
+        &filterList) {
+  if (affinityMap.empty()) {
+    int rc = loadColumns();
+    if (rc != 0) {
+      return rc;
+    }
+  }
+
+  // the value of each parameter, typed by the column affinity
+  struct ParamValue {
+    SqliteRowBlock::CellType type;
+    std::int64_t intValue;
+    double floatValue;
+    std::string textValue;
+  };
+  std::vector<ParamValue> paramList;
+  filterSQL.clear();
+  equalityColumnList.clear();
+  for (auto &filterElement : filterList) {
+    const std::string &columnName = std::get<0>(filterElement);
+    const std::string &value = std::get<1>(filterElement);
+    std::string condition = std::get<2>(filterElement);
+    auto affinityIt = affinityMap.find(columnName);
+    if (affinityIt == affinityMap.end()) {
+      continue;
+    }
+    Affinity affinity = affinityIt->second;
+    if (condition == "auto") {
+      condition = affinity == Affinity::Integer ||
+                          affinity == Affinity::Real ||
+                          affinity == Affinity::Numeric
+                      ? "="
+                      : "match";
+    }
+
+    std::string paramName = ":f" + std::to_string(paramList.size());
+    std::string columnSQL = "`" + columnName + "`";
+    std::string conditionSQL;
+    ParamValue param{SqliteRowBlock::CellType::Text, 0, 0.0, value};
+    if (condition == "=") {
+      /* Bind numbers as numbers so the comparison can use an index on the
+       * column. Text that does not parse stays text, like sqlite3 would
+       * store it.
+       */
+      if (affinity != Affinity::Text && affinity != Affinity::Blob &&
+          !value.empty()) {
+        char *endPtr = nullptr;
+        long long intValue = std::strtoll(value.c_str(), &endPtr, 10);
+        if (*endPtr == '\0') {
+          param.type = SqliteRowBlock::CellType::Integer;
+          param.intValue = intValue;
+        } else {
+          double floatValue = std::strtod(value.c_str(), &endPtr);
+          if (*endPtr == '\0') {
+            param.type = SqliteRowBlock::CellType::Float;
+            param.floatValue = floatValue;
+          }
+        }
+      }
+      conditionSQL = columnSQL + " = " + paramName;
+      equalityColumnList.push_back(columnName);
+    } else if (condition == "match") {
+      // split the value into tokens, an empty search matches every row
+      std::vector<std::string> tokenList;
+      std::istringstream valueStream(value);
+      std::string token;
+      while (valueStream >> token) {
+        tokenList.push_back(token);
+      }
+      if (tokenList.empty()) {
+        continue;
+      }
+      if (createFts() == 0 && ftsColumnSet.count(columnName)) {
+        /* Every token must start a word of the column. Tokens are quoted so
+         * FTS5 operators in the value are searched for literally.
+         */
+        std::string columnFilter = "\"" + columnName + "\" : ";
+        param.textValue.clear();
+        for (auto &tokenElement : tokenList) {
+          std::string quotedToken;
+          for (char tokenChar : tokenElement) {
+            quotedToken.append(tokenChar == '"' ? "\"\""
+                                                : std::string(1, tokenChar));
+          }
+          param.textValue.append((param.textValue.empty() ? "" : " AND ") +
+                                 columnFilter + "\"" + quotedToken + "\" *");
+        }
+        std::string ftsTableName = getFtsTableName();
+        conditionSQL = "`" + tableName + "`.`" + idColumnName +
+                       "` IN (SELECT `" + ftsIdColumnName + "` FROM `" +
+                       ftsTableName + "` WHERE `" + ftsTableName +
+                       "` MATCH " + paramName + ")";
+      } else {
+        // substring search with the LIKE wildcards in the value escaped
+        param.textValue = "%";
+        for (char valueChar : value) {
+          if (valueChar == '%' || valueChar == '_' || valueChar == '\\') {
+            param.textValue.push_back('\\');
+          }
+          param.textValue.push_back(valueChar);
+        }
+        param.textValue.push_back('%');
+        conditionSQL = columnSQL + " LIKE " + paramName + " ESCAPE '\\'";
+      }
+    } else {
+      continue;
+    }
+    paramList.push_back(param);
+    filterSQL.append((filterSQL.empty() ? "" : " AND ") + conditionSQL);
+  }
+
+  /* In tree mode the conditions are only used to fill the match table. The
+   * recursive part walks up from every matching row, UNION drops the
+   * ancestors already collected.
+   */
+  treeSQL.clear();
+  version++;
+  if (treeFlag && !filterSQL.empty()) {
+    std::string idSQL = "`" + idColumnName + "`";
+    std::string parentIdSQL = "`" + parentIdColumnName + "`";
+    std::string tableSQL = "`" + tableName + "`";
+    std::string matchTableSQL = "temp.`" + getMatchTableName() + "`";
+    treeSQL = "CREATE TEMP TABLE IF NOT EXISTS `" + getMatchTableName() +
+              "`(id PRIMARY KEY) WITHOUT ROWID;"
+              "DELETE FROM " +
+              matchTableSQL +
+              ";"
+              "WITH RECURSIVE treeMatch(id, parentId) AS (SELECT " +
+              idSQL + ", " + parentIdSQL + " FROM " + tableSQL + " WHERE " +
+              filterSQL + " UNION SELECT " + tableSQL + "." + idSQL + ", " +
+              tableSQL + "." + parentIdSQL + " FROM " + tableSQL +
+              " JOIN treeMatch ON " + tableSQL + "." + idSQL +
+              " = treeMatch.parentId) INSERT OR IGNORE INTO " + matchTableSQL +
+              "(id) SELECT id FROM treeMatch WHERE id IS NOT NULL;";
+    filterSQL = idSQL + " IN (SELECT id FROM " + matchTableSQL + ")";
+    equalityColumnList.clear();
+  }
+
+  paramData.reset(static_cast<int>(paramList.size()));
+  if (!paramList.empty()) {
+    paramData.appendNullRow();
+  }
+  for (int paramNum = 0; paramNum < static_cast<int>(paramList.size());
+       paramNum++) {
+    ParamValue &param = paramList[paramNum];
+    switch (param.type) {
+    case SqliteRowBlock::CellType::Integer:
+      paramData.setInt(0, paramNum, param.intValue);
+      break;
+    case SqliteRowBlock::CellType::Float:
+      paramData.setFloat(0, paramNum, param.floatValue);
+      break;
+    default:
+      paramData.setText(0, paramNum, param.textValue);
+      break;
+    }
+  }
+  return 0;
+}
+
+int SqliteFilter::setTreeMode(bool treeFlag_, std::string idColumnName_,
+                              std::string parentIdColumnName_) {
+  treeFlag = treeFlag_;
+  idColumnName = idColumnName_;
+  parentIdColumnName = parentIdColumnName_;
+  return 0;
+}
+
+bool SqliteFilter::isTreeMode() const { return treeFlag; }
+
+int SqliteFilter::setIdColumnName(std::string idColumnName_) {
+  idColumnName = idColumnName_;
+  return 0;
+}
+
+int SqliteFilter::refresh() {
+  version++;
+  return 0;
+}
+
+const std::string &SqliteFilter::getSQL() const { return filterSQL; }
+
+const std::vector<std::string> &SqliteFilter::getEqualityColumnList() const {
+  return equalityColumnList;
+}
+
+const std::string &SqliteFilter::getTreeSQL() const { return treeSQL; }
+
+std::uint64_t SqliteFilter::getVersion() const { return version; }
+
+int SqliteFilter::setup(SqliteStatementCache &statementCache,
+                        const std::string &treeSQL, std::uint64_t version,
+                        const SqliteRowBlock &paramData) {
+  if (treeSQL.empty()) {
+    return 0;
+  }
+  return statementCache.setup(
+      "treeMatch", std::to_string(version), [&](sqlite3 *database) {
+        /* temp tables can be written on read only connections too, a
+         * snapshot connection lifts query_only meanwhile
+         */
+        SqliteSnapshot::TempWriteScope tempWriteScope(database);
+        const char *sqlTail = treeSQL.c_str();
+        int rc = SQLITE_OK;
+        while (rc == SQLITE_OK && *sqlTail) {
+          sqlite3_stmt *stmt = nullptr;
+          rc = sqlite3_prepare_v2(database, sqlTail, -1, &stmt, &sqlTail);
+          if (rc != SQLITE_OK || !stmt) {
+            sqlite3_finalize(stmt);
+            break;
+          }
+          rc = bind(stmt, paramData);
+          if (rc == SQLITE_OK) {
+            rc = sqlite3_step(stmt);
+            rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+          }
+          sqlite3_finalize(stmt);
+        }
+        return rc;
+      });
+}
+
+const SqliteRowBlock &SqliteFilter::getParamData() const { return paramData; }
+
+int SqliteFilter::bind(sqlite3_stmt *stmt, const SqliteRowBlock &paramData) {
+  if (paramData.getRowCount() == 0) {
+    return 0;
+  }
+  for (int paramNum = 0; paramNum < paramData.getColumnCount(); paramNum++) {
+    std::string paramName = ":f" + std::to_string(paramNum);
+    int paramIndex = sqlite3_bind_parameter_index(stmt, paramName.c_str());
+    if (paramIndex > 0) {
+      int rc = paramData.bindCell(stmt, paramIndex, 0, paramNum);
+      if (rc != SQLITE_OK) {
+        return rc;
+      }
+    }
+  }
+  return 0;
+}
+
+SqliteFilter::Affinity
+SqliteFilter::getAffinity(const std::string &declaredType) {
+  std::string typeUpper(declaredType);
+  std::transform(typeUpper.begin(), typeUpper.end(), typeUpper.begin(),
+                 [](unsigned char typeChar) { return std::toupper(typeChar); });
+  if (typeUpper.find("INT") != std::string::npos) {
+    return Affinity::Integer;
+  }
+  if (typeUpper.find("CHAR") != std::string::npos ||
+      typeUpper.find("CLOB") != std::string::npos ||
+      typeUpper.find("TEXT") != std::string::npos) {
+    return Affinity::Text;
+  }
+  if (typeUpper.empty() || typeUpper.find("BLOB") != std::string::npos) {
+    return Affinity::Blob;
+  }
+  if (typeUpper.find("REAL") != std::string::npos ||
+      typeUpper.find("FLOA") != std::string::npos ||
+      typeUpper.find("DOUB") != std::string::npos) {
+    return Affinity::Real;
+  }
+  return Affinity::Numeric;
+}
+
+std::string SqliteFilter::getFtsTableName() const {
+  return tableName + "_bookfiler_fts";
+}
+
+std::string SqliteFilter::getFtsKeyTableName() const {
+  return tableName + "_bookfiler_fts_key";
+}
+
+std::string SqliteFilter::getMatchTableName() const {
+  return tableName + "_bookfiler_match";
+}
+
+int SqliteFilter::execute(const std::string &sqlQuery) {
+  return sqlite3_exec(database.get(), sqlQuery.c_str(), nullptr, nullptr,
+                      nullptr);
+}
+
+int SqliteFilter::createFts() {
+  if (ftsState != 0) {
+    return ftsState > 0 ? 0 : -1;
+  }
+  // the rows are matched by id, try again once it is set
+  if (idColumnName.empty()) {
+    return -1;
+  }
+  ftsState = -1;
+  std::string ftsTableName = getFtsTableName();
+  std::string ftsKeyTableName = getFtsKeyTableName();
+
+  // the shadow table may exist from an earlier session
+  std::unordered_set<std::string> existingColumnSet;
+  std::string sqlQuery =
+      "SELECT name FROM pragma_table_info('" + ftsTableName + "');";
+  sqlite3_stmt *stmt = nullptr;
+  int rc =
+      sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    sqlite3_finalize(stmt);
+    return rc;
+  }
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const unsigned char *nameChar = sqlite3_column_text(stmt, 0);
+    if (nameChar) {
+      existingColumnSet.insert(reinterpret_cast<const char *>(nameChar));
+    }
+  }
+  sqlite3_finalize(stmt);
+  if (existingColumnSet.erase(ftsIdColumnName)) {
+    ftsColumnSet = existingColumnSet;
+    ftsState = 1;
+    return 0;
+  }
+
+  // index every text column
+  std::vector<std::string> columnList;
+  for (auto &affinityPair : affinityMap) {
+    if (affinityPair.second == Affinity::Text) {
+      columnList.push_back(affinityPair.first);
+    }
+  }
+  if (columnList.empty()) {
+    return -1;
+  }
+  std::sort(columnList.begin(), columnList.end());
+  std::string columnSQL, newSQL;
+  for (auto &columnName : columnList) {
+    columnSQL.append(", `" + columnName + "`");
+    newSQL.append(", new.`" + columnName + "`");
+  }
+
+  /* The shadow table keeps the id of each row, rowids of a table without an
+   * INTEGER PRIMARY KEY are renumbered by VACUUM. The key table finds the
+   * shadow row of an id without scanning. The triggers keep both in sync
+   * with changes from any connection.
+   */
+  std::string idSQL = "`" + idColumnName + "`";
+  std::string triggerName = "`" + ftsTableName;
+  std::string insertSQL =
+      "INSERT INTO `" + ftsTableName + "`(`" + ftsIdColumnName + "`" +
+      columnSQL + ") VALUES (new." + idSQL + newSQL +
+      "); INSERT OR REPLACE INTO `" + ftsKeyTableName + "` VALUES (new." +
+      idSQL + ", last_insert_rowid());";
+  std::string deleteSQL = "DELETE FROM `" + ftsTableName +
+                          "` WHERE rowid IN (SELECT ftsRowid FROM `" +
+                          ftsKeyTableName + "` WHERE `" + ftsIdColumnName +
+                          "` = old." + idSQL + "); DELETE FROM `" +
+                          ftsKeyTableName + "` WHERE `" + ftsIdColumnName +
+                          "` = old." + idSQL + ";";
+  std::string createSQL =
+      "SAVEPOINT bookfiler_fts;"
+      // an earlier version matched external content by rowid
+      "DROP TRIGGER IF EXISTS " +
+      triggerName + "_insert`; DROP TRIGGER IF EXISTS " + triggerName +
+      "_delete`; DROP TRIGGER IF EXISTS " + triggerName +
+      "_update`; DROP TABLE IF EXISTS `" + ftsTableName +
+      "`; DROP TABLE IF EXISTS `" + ftsKeyTableName +
+      "`;"
+      "CREATE VIRTUAL TABLE `" +
+      ftsTableName + "` USING fts5(`" + ftsIdColumnName + "` UNINDEXED" +
+      columnSQL + ");" + "CREATE TABLE `" + ftsKeyTableName + "`(`" +
+      ftsIdColumnName + "` PRIMARY KEY, ftsRowid INTEGER);" +
+      "CREATE TRIGGER " + triggerName + "_insert` AFTER INSERT ON `" +
+      tableName + "` BEGIN " + insertSQL + " END;" + "CREATE TRIGGER " +
+      triggerName + "_delete` AFTER DELETE ON `" + tableName + "` BEGIN " +
+      deleteSQL + " END;" + "CREATE TRIGGER " + triggerName +
+      "_update` AFTER UPDATE ON `" + tableName + "` BEGIN " + deleteSQL +
+      " " + insertSQL + " END;" + "INSERT INTO `" + ftsTableName + "`(`" +
+      ftsIdColumnName + "`" + columnSQL + ") SELECT " + idSQL + columnSQL +
+      " FROM `" + tableName + "`;" + "INSERT INTO `" + ftsKeyTableName +
+      "` SELECT `" + ftsIdColumnName + "`, rowid FROM `" + ftsTableName +
+      "`;"
+      "RELEASE bookfiler_fts;";
+  rc = execute(createSQL);
+  if (rc != SQLITE_OK) {
+    // FTS5 is not compiled in or the database is read only
+    execute("ROLLBACK TO bookfiler_fts; RELEASE bookfiler_fts;");
+    return rc;
+  }
+  ftsColumnSet.insert(columnList.begin(), columnList.end());
+  ftsState = 1;
+  return 0;
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
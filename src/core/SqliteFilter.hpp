@@ -0,0 +1,180 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Compiles filter conditions into parameterized sqlite3 SQL.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_FILTER_H
+#define BOOKFILER_CORE_SQLITE_FILTER_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <list>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteRowBlock.hpp"
+#include "SqliteSnapshot.hpp"
+#include "SqliteStatementCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Turns a list of {column, value, condition} filter conditions into a
+ * SQL predicate with named parameters :f0, :f1, ... and the values to bind to
+ * them. The predicate only changes when compile() is called, so statements
+ * using it can be cached.
+ *
+ * Conditions:
+ * "=" exact match, the value is bound with the type of the column affinity
+ * "match" full-text search through an FTS5 shadow table of the text columns
+ * and the row id. The shadow table is created on first use and kept in sync
+ * with triggers.
+ * Falls back to a bound LIKE when FTS5 is not available.
+ * "auto" "=" for INTEGER, REAL, and NUMERIC affinity columns, "match" for
+ * the others
+ *
+ * In tree mode the matching rows and all of their ancestors are collected
+ * with one recursive query into a temp table, and the predicate selects the
+ * rows in that table. A child that matches stays reachable when its parent
+ * does not match, and each level reads the temp table instead of scanning
+ * the table again. Temp tables belong to one connection, so every connection
+ * fills its own with setup() before running the filtered statements.
+ */
+class SqliteFilter {
+public:
+  enum class Affinity { Integer, Real, Numeric, Text, Blob };
+
+private:
+  std::shared_ptr<sqlite3> database;
+  std::string tableName;
+  /* map column name->affinity for every column of the table
+   */
+  std::unordered_map<std::string, Affinity> affinityMap;
+  std::string filterSQL;
+  /* columns compared with "=" by the predicate
+   */
+  std::vector<std::string> equalityColumnList;
+  /* one row holding the value of each parameter, column n is :fn
+   */
+  SqliteRowBlock paramData;
+  /* FTS5 shadow table. ftsState is 0 before the first "match", 1 if the
+   * table is usable, and -1 if it could not be created.
+   */
+  int ftsState = 0;
+  std::unordered_set<std::string> ftsColumnSet;
+  /* Tree mode. treeSQL fills the match table, version changes whenever the
+   * match table must be filled again.
+   */
+  bool treeFlag = false;
+  std::string idColumnName, parentIdColumnName;
+  std::string treeSQL;
+  std::uint64_t version = 0;
+
+  std::string getFtsTableName() const;
+  std::string getFtsKeyTableName() const;
+  std::string getMatchTableName() const;
+  /* creates the shadow table, its triggers, and fills it if needed
+   * @return 0 on success, else error code
+   */
+  int createFts();
+  /* runs SQL without results
+   * @return sqlite3 result code
+   */
+  int execute(const std::string &sqlQuery);
+
+public:
+  SqliteFilter(std::shared_ptr<sqlite3> database_, std::string tableName_);
+
+  /* Reads the column names and declared types of the table
+   * @return 0 on success, else error code
+   */
+  int loadColumns();
+  /* Compiles the filter conditions. Conditions on unknown columns are
+   * skipped.
+   * @param filterList {column name, value, condition}
+   * @return 0 on success, else error code
+   */
+  int compile(
+      const std::list<std::tuple<std::string, std::string, std::string>>
+          &filterList);
+  /* Enables tree mode. Call compile() afterwards.
+   * @param treeFlag keep the ancestors of matching rows
+   * @param idColumnName column holding the row id
+   * @param parentIdColumnName column holding the id of the parent row
+   * @return 0 on success, else error code
+   */
+  int setTreeMode(bool treeFlag, std::string idColumnName,
+                  std::string parentIdColumnName);
+  bool isTreeMode() const;
+  /* Sets the column holding the row id, "match" conditions select the rows
+   * by id
+   * @return 0 on success, else error code
+   */
+  int setIdColumnName(std::string idColumnName);
+  /* Marks the match table as stale after the table data changed. Each
+   * connection fills it again on the next setup().
+   * @return 0 on success, else error code
+   */
+  int refresh();
+  /* @return the predicate, empty if there are no conditions
+   */
+  const std::string &getSQL() const;
+  /* @return the columns the predicate compares with "=", for choosing
+   * indexes
+   */
+  const std::vector<std::string> &getEqualityColumnList() const;
+  /* @return the values of the parameters
+   */
+  const SqliteRowBlock &getParamData() const;
+  /* @return the statements filling the match table, empty when not in tree
+   * mode or without conditions
+   */
+  const std::string &getTreeSQL() const;
+  std::uint64_t getVersion() const;
+  /* Fills the match table of the connection if it is missing or stale
+   * @param statementCache the statement cache of the connection
+   * @param treeSQL the value of getTreeSQL()
+   * @param version the value of getVersion()
+   * @param paramData the value of getParamData()
+   * @return 0 on success, else error code
+   */
+  static int setup(SqliteStatementCache &statementCache,
+                   const std::string &treeSQL, std::uint64_t version,
+                   const SqliteRowBlock &paramData);
+  /* Binds the parameter values of a compiled filter to a statement
+   * @param paramData the values returned by getParamData()
+   * @return 0 on success, else error code
+   */
+  static int bind(sqlite3_stmt *stmt, const SqliteRowBlock &paramData);
+  /* The sqlite3 type affinity of a declared column type
+   * https://www.sqlite.org/datatype3.html#determination_of_column_affinity
+   */
+  static Affinity getAffinity(const std::string &declaredType);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_FILTER_H
+#endif
@@ -0,0 +1,53 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Maps row id text to dense integers.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteIdInterner.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteIdInterner::SqliteIdInterner() {}
+
+SqliteIdInterner::~SqliteIdInterner() {}
+
+std::uint32_t SqliteIdInterner::intern(std::string_view id) {
+  auto findIt = idMap.find(id);
+  if (findIt != idMap.end()) {
+    return findIt->second;
+  }
+  std::uint32_t idNum = static_cast<std::uint32_t>(idList.size());
+  idList.emplace_back(id);
+  idMap.insert({std::string_view(idList.back()), idNum});
+  return idNum;
+}
+
+std::optional<std::uint32_t>
+SqliteIdInterner::find(std::string_view id) const {
+  auto findIt = idMap.find(id);
+  if (findIt == idMap.end()) {
+    return std::optional<std::uint32_t>();
+  }
+  return findIt->second;
+}
+
+const std::string &SqliteIdInterner::getId(std::uint32_t idNum) const {
+  return idList.at(idNum);
+}
+
+std::size_t SqliteIdInterner::size() const { return idList.size(); }
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Maps row id text to dense integers.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_ID_INTERNER_H
+#define BOOKFILER_CORE_SQLITE_ID_INTERNER_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Gives every distinct id text a dense integer, counting up from 0.
+ * The text of an id is stored once and looked up without allocating, so
+ * containers keyed by ids hash and compare integers instead of strings. Ids
+ * are never removed, the table grows with the number of distinct ids seen.
+ */
+class SqliteIdInterner {
+private:
+  /* map idNum->id text. A deque keeps the text at a fixed address for the
+   * views in idMap.
+   */
+  std::deque<std::string> idList;
+  /* map id text->idNum
+   */
+  std::unordered_map<std::string_view, std::uint32_t> idMap;
+
+public:
+  SqliteIdInterner();
+  ~SqliteIdInterner();
+
+  /* @return the number of the id, a new one if the id was not seen yet
+   */
+  std::uint32_t intern(std::string_view id);
+  /* @return the number of the id if it was interned
+   */
+  std::optional<std::uint32_t> find(std::string_view id) const;
+  /* @return the text of an interned id
+   */
+  const std::string &getId(std::uint32_t idNum) const;
+  /* number of interned ids
+   */
+  std::size_t size() const;
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_ID_INTERNER_H
+#endif
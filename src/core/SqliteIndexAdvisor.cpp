@@ -0,0 +1,233 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Creates indexes for the generated queries when their plan scans the
+ * table or sorts with a temp b-tree.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// C++
+#include <sstream> // std::ostringstream
+
+// Local Project
+#include "SqliteIndexAdvisor.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteIndexAdvisor::SqliteIndexAdvisor(std::shared_ptr<sqlite3> database_,
+                                       std::string tableName_)
+    : database(database_), tableName(tableName_) {
+  // in-memory and temporary databases have no file name
+  const char *fileName = sqlite3_db_filename(database.get(), "main");
+  if (fileName && fileName[0] != '\0') {
+    buildWorker = std::make_shared<SqliteQueryWorker>();
+    if (buildWorker->open(fileName, std::string(), false) != 0) {
+      buildWorker.reset();
+    }
+  }
+}
+
+SqliteIndexAdvisor::~SqliteIndexAdvisor() {
+  // a build interrupted by close() is rolled back
+  if (buildWorker) {
+    buildWorker->close();
+  }
+  dropCreated(database.get());
+}
+
+int SqliteIndexAdvisor::setCallback(Callback callback_) {
+  callback = callback_;
+  return 0;
+}
+
+int SqliteIndexAdvisor::advise(
+    const std::string &sqlQuery,
+    const std::vector<std::pair<std::string, std::string>> &columnList,
+    Setup setup) {
+  std::string key;
+  std::string columnSQL;
+  for (auto &columnPair : columnList) {
+    key.append(columnPair.first + " " + columnPair.second + ",");
+    columnSQL.append((columnSQL.empty() ? "`" : ", `") + columnPair.first +
+                     "` " + columnPair.second);
+  }
+  if (key == activeKey) {
+    return 0;
+  }
+
+  // the indexes of the previous combination would skew the plan
+  int rc = dropAll();
+  if (rc != 0) {
+    return rc;
+  }
+  activeKey = key;
+  if (columnList.empty()) {
+    return 0;
+  }
+
+  // the same combination always gets the same name
+  std::ostringstream nameStream;
+  nameStream << tableName << "_bookfiler_idx_" << std::hex
+             << std::hash<std::string>()(key);
+  std::string indexName = nameStream.str();
+  // explained after the queued drop so the old indexes are gone
+  if (buildWorker) {
+    return buildWorker->post([this, indexName, columnSQL, sqlQuery,
+                              setup](SqliteStatementCache &cache) {
+      if (setup) {
+        int rc = setup(cache);
+        if (rc != 0) {
+          report("fail", indexName, sqlite3_errmsg(cache.getDatabase()));
+          return;
+        }
+      }
+      adviseIndex(cache.getDatabase(), indexName, columnSQL, sqlQuery);
+    });
+  }
+  return adviseIndex(database.get(), indexName, columnSQL, sqlQuery);
+}
+
+int SqliteIndexAdvisor::adviseIndex(sqlite3 *connection,
+                                    const std::string &indexName,
+                                    const std::string &columnSQL,
+                                    const std::string &sqlQuery) {
+  std::vector<std::string> detailList;
+  int rc = explain(connection, sqlQuery, detailList);
+  if (rc != 0) {
+    report("fail", indexName, sqlite3_errmsg(connection));
+    return rc;
+  }
+  if (!isSlowPlan(detailList)) {
+    return 0;
+  }
+  return createIndex(connection, indexName, columnSQL, sqlQuery);
+}
+
+int SqliteIndexAdvisor::createIndex(sqlite3 *connection,
+                                    const std::string &indexName,
+                                    const std::string &columnSQL,
+                                    const std::string &sqlQuery) {
+  // an index of another viewer is used but not dropped
+  std::string existsSQL =
+      "SELECT 1 FROM sqlite_master WHERE type = 'index' AND name = '" +
+      indexName + "';";
+  sqlite3_stmt *stmt = nullptr;
+  int rc = sqlite3_prepare_v2(connection, existsSQL.c_str(), -1, &stmt,
+                              nullptr);
+  bool existsFlag = rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW;
+  sqlite3_finalize(stmt);
+  if (existsFlag) {
+    report("exists", indexName, "");
+    return 0;
+  }
+
+  // without IF NOT EXISTS an index created meanwhile is not taken as ours
+  std::string createSQL = "CREATE INDEX `" + indexName + "` ON `" +
+                          tableName + "`(" + columnSQL + ");";
+  rc = sqlite3_exec(connection, createSQL.c_str(), nullptr, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    // for example a read only database
+    report("fail", indexName, sqlite3_errmsg(connection));
+    return rc;
+  }
+  createdIndexList.push_back(indexName);
+
+  std::string planDetail;
+  std::vector<std::string> detailList;
+  if (explain(connection, sqlQuery, detailList) == 0) {
+    for (auto &detail : detailList) {
+      planDetail.append((planDetail.empty() ? "" : "; ") + detail);
+    }
+  }
+  report("create", indexName, planDetail);
+  return 0;
+}
+
+int SqliteIndexAdvisor::dropAll() {
+  activeKey.clear();
+  if (buildWorker) {
+    return buildWorker->post([this](SqliteStatementCache &cache) {
+      dropCreated(cache.getDatabase());
+    });
+  }
+  return dropCreated(database.get());
+}
+
+int SqliteIndexAdvisor::dropCreated(sqlite3 *connection) {
+  int rcRet = 0;
+  for (auto &indexName : createdIndexList) {
+    std::string dropSQL = "DROP INDEX IF EXISTS `" + indexName + "`;";
+    int rc =
+        sqlite3_exec(connection, dropSQL.c_str(), nullptr, nullptr, nullptr);
+    if (rc != SQLITE_OK) {
+      report("fail", indexName, sqlite3_errmsg(connection));
+      rcRet = rc;
+      continue;
+    }
+    report("drop", indexName, "");
+  }
+  createdIndexList.clear();
+  return rcRet;
+}
+
+int SqliteIndexAdvisor::explain(sqlite3 *connection,
+                                const std::string &sqlQuery,
+                                std::vector<std::string> &detailList) {
+  std::string explainSQL = "EXPLAIN QUERY PLAN " + sqlQuery;
+  sqlite3_stmt *stmt = nullptr;
+  int rc = sqlite3_prepare_v2(connection, explainSQL.c_str(), -1, &stmt,
+                              nullptr);
+  if (rc != SQLITE_OK) {
+    sqlite3_finalize(stmt);
+    return rc;
+  }
+  // the columns are id, parent, notused, detail
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const unsigned char *detailChar = sqlite3_column_text(stmt, 3);
+    if (detailChar) {
+      detailList.push_back(reinterpret_cast<const char *>(detailChar));
+    }
+  }
+  sqlite3_finalize(stmt);
+  return rc == SQLITE_DONE ? 0 : rc;
+}
+
+bool SqliteIndexAdvisor::isSlowPlan(
+    const std::vector<std::string> &detailList) const {
+  /* Scans of the FTS and temp match tables are expected. Only a scan of
+   * the table itself is slow. sqlite3 before 3.36 writes "SCAN TABLE".
+   */
+  for (auto &detail : detailList) {
+    if (detail.find("USE TEMP B-TREE FOR ORDER BY") != std::string::npos) {
+      return true;
+    }
+    for (std::string scanPrefix : {"SCAN ", "SCAN TABLE "}) {
+      std::string scanSQL = scanPrefix + tableName;
+      if (detail.compare(0, scanSQL.size(), scanSQL) == 0 &&
+          (detail.size() == scanSQL.size() || detail[scanSQL.size()] == ' ')) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void SqliteIndexAdvisor::report(const std::string &action,
+                                const std::string &indexName,
+                                const std::string &detail) {
+  if (callback) {
+    callback(action, indexName, detail);
+  }
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
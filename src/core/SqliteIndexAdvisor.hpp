@@ -0,0 +1,144 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Creates indexes for the generated queries when their plan scans the
+ * table or sorts with a temp b-tree.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_INDEX_ADVISOR_H
+#define BOOKFILER_CORE_SQLITE_INDEX_ADVISOR_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteQueryWorker.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Checks the plan of a query with EXPLAIN QUERY PLAN. When sqlite3
+ * scans the table or needs a temp b-tree for ORDER BY, an index on the
+ * equality columns followed by the ORDER BY columns is created. The indexes
+ * are kept for one column combination at a time and dropped when the
+ * combination changes or the advisor is destroyed.
+ *
+ * The indexes of a database file are built and dropped by a worker thread on
+ * its own connection, in the order they were advised, so a long CREATE INDEX
+ * does not block the caller. The statements of the caller's connection are
+ * prepared again by sqlite3 once the schema changed. In-memory databases
+ * have no second connection and build on the caller's connection.
+ */
+class SqliteIndexAdvisor {
+public:
+  /* Called by the thread that built or dropped the index
+   * @param action "create", "drop", "exists", or "fail". "exists" means an
+   * index of that name was there before, it is used but never dropped.
+   * @param indexName the index created or dropped
+   * @param detail the query plan or the sqlite3 error message
+   */
+  typedef std::function<void(const std::string &action,
+                             const std::string &indexName,
+                             const std::string &detail)>
+      Callback;
+  /* Prepares a worker connection for the query, for example fills the temp
+   * tables it reads
+   * @return 0 on success, else error code
+   */
+  typedef std::function<int(SqliteStatementCache &cache)> Setup;
+
+private:
+  std::shared_ptr<sqlite3> database;
+  std::string tableName;
+  Callback callback;
+  /* columns of the active combination
+   */
+  std::string activeKey;
+  /* Indexes this advisor created and did not drop yet, only used by the
+   * thread building the indexes. Indexes that existed before are never
+   * listed, they may belong to another viewer.
+   */
+  std::vector<std::string> createdIndexList;
+  /* builds and drops the indexes of a database file, nullptr for in-memory
+   * databases
+   */
+  std::shared_ptr<SqliteQueryWorker> buildWorker;
+
+  /* Runs EXPLAIN QUERY PLAN on the query
+   * @param detailList the detail column of each plan row
+   * @return 0 on success, else error code
+   */
+  int explain(sqlite3 *connection, const std::string &sqlQuery,
+              std::vector<std::string> &detailList);
+  /* Explains the query and creates the index if the plan is slow
+   * @return 0 on success, else error code
+   */
+  int adviseIndex(sqlite3 *connection, const std::string &indexName,
+                  const std::string &columnSQL, const std::string &sqlQuery);
+  /* Creates the index unless an index of that name exists
+   * @return 0 on success, else error code
+   */
+  int createIndex(sqlite3 *connection, const std::string &indexName,
+                  const std::string &columnSQL, const std::string &sqlQuery);
+  /* Drops the indexes in createdIndexList
+   * @return 0 on success, else error code
+   */
+  int dropCreated(sqlite3 *connection);
+  /* @return true if the plan scans the table or sorts with a temp b-tree
+   */
+  bool isSlowPlan(const std::vector<std::string> &detailList) const;
+  void report(const std::string &action, const std::string &indexName,
+              const std::string &detail);
+
+public:
+  SqliteIndexAdvisor(std::shared_ptr<sqlite3> database_,
+                     std::string tableName_);
+  ~SqliteIndexAdvisor();
+
+  int setCallback(Callback callback);
+  /* Creates an index for the query if its plan is slow. Does nothing while
+   * the column combination is the active one. The plan of a database file
+   * is explained and its index built after the call returns, once the
+   * indexes of the previous combination are dropped.
+   * @param sqlQuery the query to explain, parameters may be unbound
+   * @param columnList {column name, "ASC" or "DESC"} equality columns first,
+   * then the ORDER BY columns
+   * @param setup run on the worker connection before explaining, the
+   * caller's connection must already be set up
+   * @return 0 on success, else error code
+   */
+  int advise(const std::string &sqlQuery,
+             const std::vector<std::pair<std::string, std::string>>
+                 &columnList,
+             Setup setup = Setup());
+  /* Drops the indexes created for the active combination, after the
+   * builds queued before
+   * @return 0 on success, else error code
+   */
+  int dropAll();
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_INDEX_ADVISOR_H
+#endif
@@ -0,0 +1,141 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Query latency and cache counters of a sqlite3 model.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteInstrumentation.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+double SqliteInstrumentation::QueryStats::getMeanNanoseconds() const {
+  return count == 0 ? 0.0
+                    : static_cast<double>(totalNanoseconds) /
+                          static_cast<double>(count);
+}
+
+std::uint64_t
+SqliteInstrumentation::QueryStats::getQuantileMicroseconds(
+    double quantile) const {
+  std::uint64_t targetCount = static_cast<std::uint64_t>(quantile * count);
+  std::uint64_t bucketSum = 0;
+  for (int bucketNum = 0; bucketNum < latencyBucketCount; bucketNum++) {
+    bucketSum += latencyHistogram[bucketNum];
+    if (bucketSum > targetCount || bucketSum == count) {
+      return std::uint64_t(1) << bucketNum;
+    }
+  }
+  return std::uint64_t(1) << (latencyBucketCount - 1);
+}
+
+double SqliteInstrumentation::CacheStats::getHitRate() const {
+  std::uint64_t lookupCount = hitCount + missCount;
+  return lookupCount == 0 ? 0.0
+                          : static_cast<double>(hitCount) /
+                                static_cast<double>(lookupCount);
+}
+
+const SqliteInstrumentation::QueryStats &
+SqliteInstrumentation::Snapshot::getQuery(Query query) const {
+  return queryList[static_cast<int>(query)];
+}
+
+const SqliteInstrumentation::CacheStats &
+SqliteInstrumentation::Snapshot::getCache(Cache cache) const {
+  return cacheList[static_cast<int>(cache)];
+}
+
+SqliteInstrumentation::SqliteInstrumentation() {}
+
+SqliteInstrumentation::~SqliteInstrumentation() {}
+
+void SqliteInstrumentation::setEnabled(bool enabledFlag_) {
+  enabledFlag.store(enabledFlag_, std::memory_order_relaxed);
+}
+
+void SqliteInstrumentation::record(Query query,
+                                   std::chrono::steady_clock::duration latency,
+                                   int result) {
+  QueryCounter &counter = queryCounterList[static_cast<int>(query)];
+  std::uint64_t nanoseconds = static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+  counter.count.fetch_add(1, std::memory_order_relaxed);
+  if (result < 0) {
+    counter.errorCount.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    counter.rowCount.fetch_add(result, std::memory_order_relaxed);
+  }
+  counter.totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+  std::uint64_t maxNanoseconds =
+      counter.maxNanoseconds.load(std::memory_order_relaxed);
+  while (nanoseconds > maxNanoseconds &&
+         !counter.maxNanoseconds.compare_exchange_weak(
+             maxNanoseconds, nanoseconds, std::memory_order_relaxed)) {
+  }
+
+  // the first power of two above the latency in microseconds
+  std::uint64_t microseconds = nanoseconds / 1000;
+  int bucketNum = 0;
+  while (bucketNum < latencyBucketCount - 1 &&
+         (std::uint64_t(1) << bucketNum) <= microseconds) {
+    bucketNum++;
+  }
+  counter.latencyHistogram[bucketNum].fetch_add(1, std::memory_order_relaxed);
+}
+
+SqliteInstrumentation::Snapshot SqliteInstrumentation::getSnapshot() const {
+  Snapshot snapshot;
+  for (int queryNum = 0; queryNum < queryCount; queryNum++) {
+    const QueryCounter &counter = queryCounterList[queryNum];
+    QueryStats &stats = snapshot.queryList[queryNum];
+    stats.count = counter.count.load(std::memory_order_relaxed);
+    stats.errorCount = counter.errorCount.load(std::memory_order_relaxed);
+    stats.rowCount = counter.rowCount.load(std::memory_order_relaxed);
+    stats.totalNanoseconds =
+        counter.totalNanoseconds.load(std::memory_order_relaxed);
+    stats.maxNanoseconds =
+        counter.maxNanoseconds.load(std::memory_order_relaxed);
+    for (int bucketNum = 0; bucketNum < latencyBucketCount; bucketNum++) {
+      stats.latencyHistogram[bucketNum] =
+          counter.latencyHistogram[bucketNum].load(std::memory_order_relaxed);
+    }
+  }
+  for (int cacheNum = 0; cacheNum < cacheCount; cacheNum++) {
+    snapshot.cacheList[cacheNum].hitCount =
+        cacheCounterList[cacheNum].hitCount.load(std::memory_order_relaxed);
+    snapshot.cacheList[cacheNum].missCount =
+        cacheCounterList[cacheNum].missCount.load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+void SqliteInstrumentation::reset() {
+  for (QueryCounter &counter : queryCounterList) {
+    counter.count.store(0, std::memory_order_relaxed);
+    counter.errorCount.store(0, std::memory_order_relaxed);
+    counter.rowCount.store(0, std::memory_order_relaxed);
+    counter.totalNanoseconds.store(0, std::memory_order_relaxed);
+    counter.maxNanoseconds.store(0, std::memory_order_relaxed);
+    for (auto &bucket : counter.latencyHistogram) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+  for (CacheCounter &counter : cacheCounterList) {
+    counter.hitCount.store(0, std::memory_order_relaxed);
+    counter.missCount.store(0, std::memory_order_relaxed);
+  }
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Query latency and cache counters of a sqlite3 model.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_INSTRUMENTATION_H
+#define BOOKFILER_CORE_SQLITE_INSTRUMENTATION_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Counts queries by kind with a latency histogram, and cache hits and
+ * misses. Disabled by default. While disabled a timer or a cache count is one
+ * relaxed atomic load, no clock is read. Counters are atomic so queries on
+ * worker threads can be recorded. Read the counters with getSnapshot().
+ */
+class SqliteInstrumentation {
+public:
+  enum class Query : int {
+    DataLoad,
+    FetchMore,
+    RowCount,
+    RowId,
+    ParentId,
+    ChildCount,
+    CellLoad,
+    CellUpdate,
+    /* single rows re-read after an id hint updated them
+     */
+    RowLoad,
+    /* data loads of an index loaded for the first time, and of an index
+     * loaded before whose pages were read already
+     */
+    ExpandCold,
+    ExpandWarm,
+    /* the parent index scan of a read only snapshot
+     */
+    Warmup,
+    Count
+  };
+  enum class Cache : int { Index, ChildCount, Statement, Count };
+  static const int queryCount = static_cast<int>(Query::Count);
+  static const int cacheCount = static_cast<int>(Cache::Count);
+  /* bucket n counts the latencies below 2^n microseconds, the last bucket
+   * counts all slower queries
+   */
+  static const int latencyBucketCount = 24;
+
+  struct QueryStats {
+    std::uint64_t count = 0, errorCount = 0, rowCount = 0;
+    std::uint64_t totalNanoseconds = 0, maxNanoseconds = 0;
+    std::array<std::uint64_t, latencyBucketCount> latencyHistogram{};
+    /* @return the average latency in nanoseconds, 0 if there was no query
+     */
+    double getMeanNanoseconds() const;
+    /* @return the upper bound in microseconds of the bucket holding the
+     * quantile, for example 0.99
+     */
+    std::uint64_t getQuantileMicroseconds(double quantile) const;
+  };
+  struct CacheStats {
+    std::uint64_t hitCount = 0, missCount = 0;
+    /* @return hits divided by lookups, 0 if there was no lookup
+     */
+    double getHitRate() const;
+  };
+  /* A copy of the counters. The node and row counts are filled in by the
+   * model.
+   */
+  struct Snapshot {
+    std::array<QueryStats, queryCount> queryList;
+    std::array<CacheStats, cacheCount> cacheList;
+    /* indexes created, and the ones holding cached data
+     */
+    std::size_t nodeCount = 0, loadedNodeCount = 0;
+    std::size_t cachedRowCount = 0, cachedByteCount = 0;
+    std::size_t internedIdCount = 0;
+    const QueryStats &getQuery(Query query) const;
+    const CacheStats &getCache(Cache cache) const;
+  };
+
+  /* Measures one query from construction to destruction. Does nothing if
+   * the instrumentation is null or disabled.
+   */
+  class Timer {
+  private:
+    SqliteInstrumentation *instrumentation = nullptr;
+    Query query;
+    std::chrono::steady_clock::time_point startTime;
+    int result = 0;
+
+  public:
+    Timer(SqliteInstrumentation *instrumentation_, Query query_)
+        : query(query_) {
+      if (instrumentation_ && instrumentation_->isEnabled()) {
+        instrumentation = instrumentation_;
+        startTime = std::chrono::steady_clock::now();
+      }
+    }
+    ~Timer() {
+      if (instrumentation) {
+        instrumentation->record(query, std::chrono::steady_clock::now() -
+                                           startTime,
+                                result);
+      }
+    }
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+    /* @param result_ rows read, or negative on error
+     */
+    void setResult(int result_) { result = result_; }
+  };
+
+private:
+  struct QueryCounter {
+    std::atomic<std::uint64_t> count{0}, errorCount{0}, rowCount{0};
+    std::atomic<std::uint64_t> totalNanoseconds{0}, maxNanoseconds{0};
+    std::array<std::atomic<std::uint64_t>, latencyBucketCount>
+        latencyHistogram{};
+  };
+  struct CacheCounter {
+    std::atomic<std::uint64_t> hitCount{0}, missCount{0};
+  };
+  std::atomic<bool> enabledFlag{false};
+  std::array<QueryCounter, queryCount> queryCounterList;
+  std::array<CacheCounter, cacheCount> cacheCounterList;
+
+public:
+  SqliteInstrumentation();
+  ~SqliteInstrumentation();
+
+  void setEnabled(bool enabledFlag_);
+  bool isEnabled() const {
+    return enabledFlag.load(std::memory_order_relaxed);
+  }
+  /* Records a finished query
+   * @param result rows read, or negative on error
+   */
+  void record(Query query, std::chrono::steady_clock::duration latency,
+              int result);
+  void countCache(Cache cache, bool hitFlag) {
+    if (isEnabled()) {
+      CacheCounter &counter = cacheCounterList[static_cast<int>(cache)];
+      (hitFlag ? counter.hitCount : counter.missCount)
+          .fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  Snapshot getSnapshot() const;
+  /* sets all counters to zero
+   */
+  void reset();
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_INSTRUMENTATION_H
+#endif
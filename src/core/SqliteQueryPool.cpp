@@ -0,0 +1,188 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Work stealing thread pool running read queries on several sqlite3
+ * connections.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteQueryPool.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteQueryPool::SqliteQueryPool() {}
+
+SqliteQueryPool::~SqliteQueryPool() { close(); }
+
+int SqliteQueryPool::open(const std::string &fileName, int threadCount,
+                          const std::string &setupSQL) {
+  close();
+  if (fileName.empty() || fileName == ":memory:" || threadCount <= 0) {
+    return -1;
+  }
+
+  // open every connection before starting any thread
+  for (int workerNum = 0; workerNum < threadCount; workerNum++) {
+    sqlite3 *databaseRaw = nullptr;
+    int rc = sqlite3_open_v2(fileName.c_str(), &databaseRaw,
+                             SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                             nullptr);
+    if (rc != SQLITE_OK) {
+      sqlite3_close(databaseRaw);
+      workerList.clear();
+      return rc;
+    }
+    sqlite3_busy_timeout(databaseRaw, 1000);
+    if (!setupSQL.empty()) {
+      rc = sqlite3_exec(databaseRaw, setupSQL.c_str(), nullptr, nullptr,
+                        nullptr);
+      if (rc != SQLITE_OK) {
+        sqlite3_close(databaseRaw);
+        workerList.clear();
+        return rc;
+      }
+    }
+    std::unique_ptr<Worker> workerPtr = std::make_unique<Worker>();
+    workerPtr->database = std::shared_ptr<sqlite3>(databaseRaw, sqlite3_close);
+    workerPtr->statementCache =
+        std::make_shared<SqliteStatementCache>(workerPtr->database);
+    workerList.push_back(std::move(workerPtr));
+  }
+
+  stopFlag = false;
+  for (int workerNum = 0; workerNum < threadCount; workerNum++) {
+    workerList[workerNum]->workerThread =
+        std::thread(&SqliteQueryPool::run, this, workerNum);
+  }
+  return 0;
+}
+
+int SqliteQueryPool::close() {
+  if (workerList.empty()) {
+    return 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(idleMutex);
+    stopFlag = true;
+  }
+  cancel();
+  idleCondition.notify_all();
+  for (auto &workerPtr : workerList) {
+    if (workerPtr->workerThread.joinable()) {
+      workerPtr->workerThread.join();
+    }
+  }
+
+  // statements are finalized before their connection is closed
+  workerList.clear();
+  return 0;
+}
+
+bool SqliteQueryPool::isOpen() { return !workerList.empty(); }
+
+int SqliteQueryPool::getThreadCount() {
+  return static_cast<int>(workerList.size());
+}
+
+int SqliteQueryPool::post(Job job, int workerNum) {
+  if (workerList.empty()) {
+    return -1;
+  }
+  if (workerNum < 0 || workerNum >= static_cast<int>(workerList.size())) {
+    workerNum = static_cast<int>(postCount++ % workerList.size());
+  }
+  Worker &worker = *workerList[workerNum];
+  {
+    std::lock_guard<std::mutex> lock(worker.jobMutex);
+    worker.jobDeque.emplace_back(generation.load(), std::move(job));
+  }
+  {
+    // raised under the idle lock so a waiting thread can not miss it
+    std::lock_guard<std::mutex> lock(idleMutex);
+    queuedCount++;
+  }
+  idleCondition.notify_one();
+  return 0;
+}
+
+int SqliteQueryPool::cancel() {
+  generation++;
+  for (auto &workerPtr : workerList) {
+    std::lock_guard<std::mutex> lock(workerPtr->jobMutex);
+    queuedCount -= static_cast<int>(workerPtr->jobDeque.size());
+    workerPtr->jobDeque.clear();
+  }
+  /* Only affects statements running right now. Statements started after
+   * the call are not interrupted.
+   */
+  for (auto &workerPtr : workerList) {
+    sqlite3_interrupt(workerPtr->database.get());
+  }
+  return 0;
+}
+
+bool SqliteQueryPool::takeJob(int workerNum,
+                              std::pair<std::uint64_t, Job> &job) {
+  // newest job of the own deque first
+  {
+    Worker &worker = *workerList[workerNum];
+    std::lock_guard<std::mutex> lock(worker.jobMutex);
+    if (!worker.jobDeque.empty()) {
+      job = std::move(worker.jobDeque.back());
+      worker.jobDeque.pop_back();
+      queuedCount--;
+      return true;
+    }
+  }
+  // then the oldest job of another thread, which is the largest subtree
+  int workerCount = static_cast<int>(workerList.size());
+  for (int stealNum = 1; stealNum < workerCount; stealNum++) {
+    Worker &victim = *workerList[(workerNum + stealNum) % workerCount];
+    std::lock_guard<std::mutex> lock(victim.jobMutex);
+    if (!victim.jobDeque.empty()) {
+      job = std::move(victim.jobDeque.front());
+      victim.jobDeque.pop_front();
+      queuedCount--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void SqliteQueryPool::run(int workerNum) {
+  Worker &worker = *workerList[workerNum];
+  std::uint64_t statementGeneration = 0;
+  while (true) {
+    std::pair<std::uint64_t, Job> job;
+    if (stopFlag) {
+      return;
+    }
+    if (!takeJob(workerNum, job)) {
+      std::unique_lock<std::mutex> lock(idleMutex);
+      idleCondition.wait(lock,
+                         [this]() { return stopFlag || queuedCount > 0; });
+      if (stopFlag) {
+        return;
+      }
+      continue;
+    }
+    if (job.first != statementGeneration) {
+      worker.statementCache->invalidate();
+      statementGeneration = job.first;
+    }
+    job.second(*worker.statementCache, workerNum);
+  }
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
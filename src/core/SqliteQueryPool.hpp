@@ -0,0 +1,129 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Work stealing thread pool running read queries on several sqlite3
+ * connections.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_QUERY_POOL_H
+#define BOOKFILER_CORE_SQLITE_QUERY_POOL_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteStatementCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Runs jobs on several threads, each with its own read only connection
+ * to the same database file. Every thread has a job deque. A thread takes the
+ * newest job from its own deque and, when that is empty, steals the oldest job
+ * from another thread. Jobs that post follow up jobs to their own thread, for
+ * example the children of a tree node, keep related work on one connection
+ * while idle threads take over whole pending subtrees.
+ */
+class SqliteQueryPool {
+public:
+  /* @param statementCache the statement cache of the thread running the job
+   * @param workerNum the thread running the job, pass it to post() to queue
+   * follow up jobs on the same thread
+   */
+  typedef std::function<void(SqliteStatementCache &statementCache,
+                             int workerNum)>
+      Job;
+
+private:
+  struct Worker {
+    std::thread workerThread;
+    /* read only connection used by this thread only
+     */
+    std::shared_ptr<sqlite3> database;
+    std::shared_ptr<SqliteStatementCache> statementCache;
+    std::mutex jobMutex;
+    std::deque<std::pair<std::uint64_t, Job>> jobDeque;
+  };
+  std::vector<std::unique_ptr<Worker>> workerList;
+  /* idle threads wait on this until jobs are queued
+   */
+  std::mutex idleMutex;
+  std::condition_variable idleCondition;
+  std::atomic<int> queuedCount{0};
+  std::atomic<unsigned int> postCount{0};
+  /* bumped by cancel(), statements are re-prepared when it changes
+   */
+  std::atomic<std::uint64_t> generation{0};
+  std::atomic<bool> stopFlag{false};
+
+  void run(int workerNum);
+  /* takes a job from the own deque or steals one from another thread
+   * @return true if a job was taken
+   */
+  bool takeJob(int workerNum, std::pair<std::uint64_t, Job> &job);
+
+public:
+  SqliteQueryPool();
+  ~SqliteQueryPool();
+
+  /* Opens the connections and starts the threads. The database should use
+   * WAL journaling so the readers do not wait on writes from other
+   * connections.
+   * @param fileName the database file. In-memory databases can not be shared
+   * with other connections and are rejected.
+   * @param threadCount number of threads and connections
+   * @param setupSQL statements run on every new connection, for example
+   * pragmas
+   * @return 0 on success, else error code
+   */
+  int open(const std::string &fileName, int threadCount,
+           const std::string &setupSQL = std::string());
+  /* Drops the queued jobs, waits for the running jobs, and closes the
+   * connections.
+   * @return 0 on success, else error code
+   */
+  int close();
+  bool isOpen();
+  int getThreadCount();
+  /* Queues a job
+   * @param workerNum the thread to queue the job on, -1 to spread jobs over
+   * the threads
+   * @return 0 on success, else error code
+   */
+  int post(Job job, int workerNum = -1);
+  /* Drops the queued jobs and interrupts the running queries with
+   * sqlite3_interrupt()
+   * @return 0 on success, else error code
+   */
+  int cancel();
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_QUERY_POOL_H
+#endif
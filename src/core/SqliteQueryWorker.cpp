@@ -0,0 +1,135 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Background thread running read queries on its own sqlite3
+ * connection.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteQueryWorker.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteQueryWorker::SqliteQueryWorker() {}
+
+SqliteQueryWorker::~SqliteQueryWorker() { close(); }
+
+int SqliteQueryWorker::open(const std::string &fileName,
+                            const std::string &setupSQL, bool readOnlyFlag) {
+  close();
+  if (fileName.empty() || fileName == ":memory:") {
+    return -1;
+  }
+
+  /* The connection is only used by the worker thread, so the connection
+   * mutex is not needed
+   */
+  sqlite3 *databaseRaw = nullptr;
+  int rc = sqlite3_open_v2(
+      fileName.c_str(), &databaseRaw,
+      (readOnlyFlag ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE) |
+          SQLITE_OPEN_NOMUTEX,
+      nullptr);
+  if (rc != SQLITE_OK) {
+    sqlite3_close(databaseRaw);
+    return rc;
+  }
+  sqlite3_busy_timeout(databaseRaw, 1000);
+  if (!setupSQL.empty()) {
+    rc = sqlite3_exec(databaseRaw, setupSQL.c_str(), nullptr, nullptr,
+                      nullptr);
+    if (rc != SQLITE_OK) {
+      sqlite3_close(databaseRaw);
+      return rc;
+    }
+  }
+  database = std::shared_ptr<sqlite3>(databaseRaw, sqlite3_close);
+  statementCache = std::make_shared<SqliteStatementCache>(database);
+
+  stopFlag = false;
+  workerThread = std::thread(&SqliteQueryWorker::run, this);
+  return 0;
+}
+
+int SqliteQueryWorker::close() {
+  if (!workerThread.joinable()) {
+    return 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    stopFlag = true;
+    jobQueue.clear();
+  }
+  sqlite3_interrupt(database.get());
+  jobCondition.notify_all();
+  workerThread.join();
+
+  // statements must be finalized before the connection is closed
+  statementCache.reset();
+  database.reset();
+  return 0;
+}
+
+bool SqliteQueryWorker::isOpen() { return workerThread.joinable(); }
+
+int SqliteQueryWorker::post(std::function<void(SqliteStatementCache &)> job) {
+  if (!workerThread.joinable()) {
+    return -1;
+  }
+  {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    jobQueue.emplace_back(generation, std::move(job));
+  }
+  jobCondition.notify_one();
+  return 0;
+}
+
+int SqliteQueryWorker::cancel() {
+  if (!workerThread.joinable()) {
+    return 0;
+  }
+  {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    jobQueue.clear();
+    generation++;
+  }
+  /* Only affects statements running right now. Statements started after
+   * the call are not interrupted.
+   */
+  sqlite3_interrupt(database.get());
+  return 0;
+}
+
+void SqliteQueryWorker::run() {
+  std::uint64_t statementGeneration = 0;
+  while (true) {
+    std::pair<std::uint64_t, std::function<void(SqliteStatementCache &)>> job;
+    {
+      std::unique_lock<std::mutex> lock(jobMutex);
+      jobCondition.wait(lock, [this]() { return stopFlag || !jobQueue.empty(); });
+      if (stopFlag) {
+        return;
+      }
+      job = std::move(jobQueue.front());
+      jobQueue.pop_front();
+    }
+    if (job.first != statementGeneration) {
+      statementCache->invalidate();
+      statementGeneration = job.first;
+    }
+    job.second(*statementCache);
+  }
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Background thread running read queries on its own sqlite3
+ * connection.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_QUERY_WORKER_H
+#define BOOKFILER_CORE_SQLITE_QUERY_WORKER_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteStatementCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Runs jobs one at a time on a worker thread. Each job gets the
+ * statement cache of a read only connection that is only used by the worker
+ * thread, so a slow query never blocks the thread that posted it. Jobs are
+ * responsible for handing their results back to the posting thread.
+ */
+class SqliteQueryWorker {
+private:
+  /* connection used by the worker thread, read only unless opened for
+   * writing
+   */
+  std::shared_ptr<sqlite3> database;
+  std::shared_ptr<SqliteStatementCache> statementCache;
+  std::thread workerThread;
+  std::mutex jobMutex;
+  std::condition_variable jobCondition;
+  /* queued jobs with the generation they were posted in
+   */
+  std::deque<std::pair<std::uint64_t,
+                       std::function<void(SqliteStatementCache &)>>>
+      jobQueue;
+  /* bumped by cancel(). Statements are re-prepared when the generation
+   * changes because the SQL the jobs use usually changed too.
+   */
+  std::uint64_t generation = 0;
+  bool stopFlag = false;
+
+  void run();
+
+public:
+  SqliteQueryWorker();
+  ~SqliteQueryWorker();
+
+  /* Opens a read only connection to a database file and starts the worker
+   * thread. The database should use WAL journaling so reads do not wait on
+   * writes from other connections.
+   * @param fileName the database file. In-memory databases can not be shared
+   * with a second connection and are rejected.
+   * @param setupSQL statements run on the new connection, for example
+   * pragmas
+   * @param readOnlyFlag false to open the connection for writing, for jobs
+   * changing the schema
+   * @return 0 on success, else error code
+   */
+  int open(const std::string &fileName,
+           const std::string &setupSQL = std::string(),
+           bool readOnlyFlag = true);
+  /* Drops the queued jobs, waits for the running job, and closes the
+   * connection.
+   * @return 0 on success, else error code
+   */
+  int close();
+  bool isOpen();
+  /* Queues a job. The job runs on the worker thread.
+   * @param job called with the statement cache of the worker connection
+   * @return 0 on success, else error code
+   */
+  int post(std::function<void(SqliteStatementCache &)> job);
+  /* Drops the queued jobs and interrupts the running query with
+   * sqlite3_interrupt(). An interrupted query fails with SQLITE_INTERRUPT.
+   * @return 0 on success, else error code
+   */
+  int cancel();
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_QUERY_WORKER_H
+#endif
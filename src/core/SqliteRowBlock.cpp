@@ -0,0 +1,531 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Columnar cache for rows queried from sqlite3.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// C++
+#include <cstdio>  // std::snprintf
+#include <cstdlib> // std::strtoll
+#include <cstring> // std::memcpy
+
+// Local Project
+#include "SqliteRowBlock.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/* the most columns read() accepts, sqlite3 allows at most 32767 in a table
+ */
+static const std::int32_t rowBlockColumnLimit = 32767;
+/* slots hold a 32 bit arena offset so the arena can not grow past 4 GiB
+ */
+static const std::uint64_t arenaSizeLimit = 0xFFFFFFFFu;
+
+SqliteRowBlock::SqliteRowBlock(int columnCount) { reset(columnCount); }
+
+void SqliteRowBlock::reset(int columnCount) {
+  // swap with empty containers so the memory is released
+  rowCount = 0;
+  std::vector<Column>(columnCount).swap(columnList);
+  std::vector<char>().swap(arena);
+  arenaWasted = 0;
+}
+
+void SqliteRowBlock::clear() { reset(getColumnCount()); }
+
+int SqliteRowBlock::getRowCount() const { return rowCount; }
+
+int SqliteRowBlock::getColumnCount() const {
+  return static_cast<int>(columnList.size());
+}
+
+/* Text and blob slots pack the arena offset in the high 32 bits and the size
+ * in the low 32 bits
+ */
+std::int64_t SqliteRowBlock::arenaAppend(const char *valuePtr,
+                                         std::size_t valueSize) {
+  std::uint64_t offset = arena.size();
+  arena.insert(arena.end(), valuePtr, valuePtr + valueSize);
+  return static_cast<std::int64_t>((offset << 32) |
+                                   static_cast<std::uint32_t>(valueSize));
+}
+
+bool SqliteRowBlock::arenaReserve(std::size_t valueSize) {
+  if (arena.size() + std::uint64_t(valueSize) <= arenaSizeLimit) {
+    return true;
+  }
+  compact();
+  return arena.size() + std::uint64_t(valueSize) <= arenaSizeLimit;
+}
+
+std::string_view SqliteRowBlock::arenaView(std::int64_t slot) const {
+  std::uint64_t slotBits = static_cast<std::uint64_t>(slot);
+  std::size_t offset = static_cast<std::size_t>(slotBits >> 32);
+  std::size_t valueSize = static_cast<std::size_t>(slotBits & 0xFFFFFFFFu);
+  return std::string_view(arena.data() + offset, valueSize);
+}
+
+int SqliteRowBlock::appendRow(sqlite3_stmt *stmt) {
+  int rowNum = appendNullRow();
+  int stmtColumnCount = sqlite3_column_count(stmt);
+  for (int columnNum = 0;
+       columnNum < getColumnCount() && columnNum < stmtColumnCount;
+       columnNum++) {
+    setFromStatement(rowNum, columnNum, stmt, columnNum);
+  }
+  return rowNum;
+}
+
+int SqliteRowBlock::appendNullRow() {
+  for (auto &column : columnList) {
+    column.typeList.push_back(CellType::Null);
+    column.valueList.push_back(0);
+  }
+  return rowCount++;
+}
+
+void SqliteRowBlock::append(SqliteRowBlock &&other) {
+  if (other.getColumnCount() != getColumnCount()) {
+    return;
+  }
+  compact();
+  other.compact();
+  if (!arenaReserve(other.arena.size())) {
+    // the arenas do not fit in one, copy cell by cell so the text that does
+    // not fit is left deferred
+    for (int rowNum = 0; rowNum < other.rowCount; rowNum++) {
+      int newRowNum = appendNullRow();
+      for (int columnNum = 0; columnNum < getColumnCount(); columnNum++) {
+        setFromBlock(newRowNum, columnNum, other, rowNum, columnNum);
+      }
+    }
+    other.clear();
+    return;
+  }
+  std::uint64_t arenaShift = arena.size();
+  arena.insert(arena.end(), other.arena.begin(), other.arena.end());
+  arenaWasted += other.arenaWasted;
+  for (std::size_t columnNum = 0; columnNum < columnList.size(); columnNum++) {
+    Column &column = columnList[columnNum];
+    Column &otherColumn = other.columnList[columnNum];
+    for (std::size_t rowNum = 0; rowNum < otherColumn.typeList.size();
+         rowNum++) {
+      CellType type = otherColumn.typeList[rowNum];
+      std::int64_t slot = otherColumn.valueList[rowNum];
+      if (type == CellType::Text || type == CellType::Blob) {
+        slot = static_cast<std::int64_t>(static_cast<std::uint64_t>(slot) +
+                                         (arenaShift << 32));
+      }
+      column.typeList.push_back(type);
+      column.valueList.push_back(slot);
+    }
+  }
+  rowCount += other.rowCount;
+  other.clear();
+}
+
+void SqliteRowBlock::insertRows(int rowBegin, const SqliteRowBlock &src,
+                                int srcBegin, int count) {
+  if (&src == this || src.getColumnCount() != getColumnCount() ||
+      rowBegin < 0 || rowBegin > rowCount || srcBegin < 0 || count <= 0 ||
+      srcBegin + count > src.rowCount) {
+    return;
+  }
+  for (auto &column : columnList) {
+    column.typeList.insert(column.typeList.begin() + rowBegin, count,
+                           CellType::Null);
+    column.valueList.insert(column.valueList.begin() + rowBegin, count, 0);
+  }
+  rowCount += count;
+  for (int columnNum = 0; columnNum < getColumnCount(); columnNum++) {
+    for (int rowNum = 0; rowNum < count; rowNum++) {
+      setFromBlock(rowBegin + rowNum, columnNum, src, srcBegin + rowNum,
+                   columnNum);
+    }
+  }
+}
+
+void SqliteRowBlock::eraseRows(int rowBegin, int count) {
+  if (rowBegin < 0 || count <= 0 || rowBegin + count > rowCount) {
+    return;
+  }
+  for (int columnNum = 0; columnNum < getColumnCount(); columnNum++) {
+    for (int rowNum = rowBegin; rowNum < rowBegin + count; rowNum++) {
+      releaseCell(rowNum, columnNum);
+    }
+    Column &column = columnList[columnNum];
+    column.typeList.erase(column.typeList.begin() + rowBegin,
+                          column.typeList.begin() + rowBegin + count);
+    column.valueList.erase(column.valueList.begin() + rowBegin,
+                           column.valueList.begin() + rowBegin + count);
+  }
+  rowCount -= count;
+  if (arenaWasted > 4096 && arenaWasted > arena.size() / 2) {
+    compact();
+  }
+}
+
+SqliteRowBlock::CellType SqliteRowBlock::getType(int rowNum,
+                                                 int columnNum) const {
+  if (rowNum < 0 || rowNum >= rowCount || columnNum < 0 ||
+      columnNum >= getColumnCount()) {
+    return CellType::Null;
+  }
+  return columnList[columnNum].typeList[rowNum];
+}
+
+bool SqliteRowBlock::isNull(int rowNum, int columnNum) const {
+  return getType(rowNum, columnNum) == CellType::Null;
+}
+
+bool SqliteRowBlock::isDeferred(int rowNum, int columnNum) const {
+  return getType(rowNum, columnNum) == CellType::Deferred;
+}
+
+std::int64_t SqliteRowBlock::getInt(int rowNum, int columnNum) const {
+  switch (getType(rowNum, columnNum)) {
+  case CellType::Integer:
+    return columnList[columnNum].valueList[rowNum];
+  case CellType::Float:
+    return static_cast<std::int64_t>(getFloat(rowNum, columnNum));
+  case CellType::Text:
+    return std::strtoll(std::string(getText(rowNum, columnNum)).c_str(),
+                        nullptr, 10);
+  default:
+    return 0;
+  }
+}
+
+double SqliteRowBlock::getFloat(int rowNum, int columnNum) const {
+  switch (getType(rowNum, columnNum)) {
+  case CellType::Integer:
+    return static_cast<double>(columnList[columnNum].valueList[rowNum]);
+  case CellType::Float: {
+    double value;
+    std::memcpy(&value, &columnList[columnNum].valueList[rowNum],
+                sizeof(value));
+    return value;
+  }
+  case CellType::Text:
+    return std::strtod(std::string(getText(rowNum, columnNum)).c_str(),
+                       nullptr);
+  default:
+    return 0.0;
+  }
+}
+
+std::string_view SqliteRowBlock::getText(int rowNum, int columnNum) const {
+  CellType type = getType(rowNum, columnNum);
+  if (type != CellType::Text && type != CellType::Blob) {
+    return std::string_view();
+  }
+  return arenaView(columnList[columnNum].valueList[rowNum]);
+}
+
+std::string SqliteRowBlock::getString(int rowNum, int columnNum) const {
+  switch (getType(rowNum, columnNum)) {
+  case CellType::Integer:
+    return std::to_string(getInt(rowNum, columnNum));
+  case CellType::Float: {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.15g", getFloat(rowNum, columnNum));
+    return buffer;
+  }
+  case CellType::Text:
+  case CellType::Blob:
+    return std::string(getText(rowNum, columnNum));
+  default:
+    return std::string();
+  }
+}
+
+void SqliteRowBlock::releaseCell(int rowNum, int columnNum) {
+  CellType type = columnList[columnNum].typeList[rowNum];
+  if (type == CellType::Text || type == CellType::Blob) {
+    arenaWasted += arenaView(columnList[columnNum].valueList[rowNum]).size();
+  }
+}
+
+void SqliteRowBlock::setNull(int rowNum, int columnNum) {
+  if (getType(rowNum, columnNum) == CellType::Null) {
+    return;
+  }
+  releaseCell(rowNum, columnNum);
+  columnList[columnNum].typeList[rowNum] = CellType::Null;
+  columnList[columnNum].valueList[rowNum] = 0;
+}
+
+void SqliteRowBlock::setDeferred(int rowNum, int columnNum) {
+  if (rowNum < 0 || rowNum >= rowCount || columnNum < 0 ||
+      columnNum >= getColumnCount()) {
+    return;
+  }
+  releaseCell(rowNum, columnNum);
+  columnList[columnNum].typeList[rowNum] = CellType::Deferred;
+  columnList[columnNum].valueList[rowNum] = 0;
+}
+
+void SqliteRowBlock::setInt(int rowNum, int columnNum, std::int64_t value) {
+  if (rowNum < 0 || rowNum >= rowCount || columnNum < 0 ||
+      columnNum >= getColumnCount()) {
+    return;
+  }
+  releaseCell(rowNum, columnNum);
+  columnList[columnNum].typeList[rowNum] = CellType::Integer;
+  columnList[columnNum].valueList[rowNum] = value;
+}
+
+void SqliteRowBlock::setFloat(int rowNum, int columnNum, double value) {
+  if (rowNum < 0 || rowNum >= rowCount || columnNum < 0 ||
+      columnNum >= getColumnCount()) {
+    return;
+  }
+  releaseCell(rowNum, columnNum);
+  columnList[columnNum].typeList[rowNum] = CellType::Float;
+  std::memcpy(&columnList[columnNum].valueList[rowNum], &value, sizeof(value));
+}
+
+void SqliteRowBlock::setText(int rowNum, int columnNum,
+                             std::string_view value) {
+  if (rowNum < 0 || rowNum >= rowCount || columnNum < 0 ||
+      columnNum >= getColumnCount()) {
+    return;
+  }
+  // the value may point into the arena which can move when appended to
+  if (value.data() >= arena.data() &&
+      value.data() < arena.data() + arena.size()) {
+    std::string valueCopy(value);
+    setText(rowNum, columnNum, valueCopy);
+    return;
+  }
+  releaseCell(rowNum, columnNum);
+  if (!arenaReserve(value.size())) {
+    // leave the value in sqlite3 rather than overflow the slot offset
+    columnList[columnNum].typeList[rowNum] = CellType::Deferred;
+    columnList[columnNum].valueList[rowNum] = 0;
+    return;
+  }
+  columnList[columnNum].typeList[rowNum] = CellType::Text;
+  columnList[columnNum].valueList[rowNum] =
+      arenaAppend(value.data(), value.size());
+  if (arenaWasted > 4096 && arenaWasted > arena.size() / 2) {
+    compact();
+  }
+}
+
+void SqliteRowBlock::setBlob(int rowNum, int columnNum,
+                             std::string_view value) {
+  setText(rowNum, columnNum, value);
+  if (getType(rowNum, columnNum) == CellType::Text) {
+    columnList[columnNum].typeList[rowNum] = CellType::Blob;
+  }
+}
+
+void SqliteRowBlock::setFromBlock(int rowNum, int columnNum,
+                                  const SqliteRowBlock &src, int srcRowNum,
+                                  int srcColumnNum) {
+  switch (src.getType(srcRowNum, srcColumnNum)) {
+  case CellType::Integer:
+    setInt(rowNum, columnNum, src.getInt(srcRowNum, srcColumnNum));
+    break;
+  case CellType::Float:
+    setFloat(rowNum, columnNum, src.getFloat(srcRowNum, srcColumnNum));
+    break;
+  case CellType::Text:
+    setText(rowNum, columnNum, src.getText(srcRowNum, srcColumnNum));
+    break;
+  case CellType::Blob:
+    setBlob(rowNum, columnNum, src.getText(srcRowNum, srcColumnNum));
+    break;
+  case CellType::Deferred:
+    setDeferred(rowNum, columnNum);
+    break;
+  default:
+    setNull(rowNum, columnNum);
+    break;
+  }
+}
+
+void SqliteRowBlock::setFromStatement(int rowNum, int columnNum,
+                                      sqlite3_stmt *stmt, int stmtColumnNum) {
+  switch (sqlite3_column_type(stmt, stmtColumnNum)) {
+  case SQLITE_INTEGER:
+    setInt(rowNum, columnNum, sqlite3_column_int64(stmt, stmtColumnNum));
+    break;
+  case SQLITE_FLOAT:
+    setFloat(rowNum, columnNum, sqlite3_column_double(stmt, stmtColumnNum));
+    break;
+  case SQLITE_TEXT: {
+    const char *valChar = reinterpret_cast<const char *>(
+        sqlite3_column_text(stmt, stmtColumnNum));
+    int valSize = sqlite3_column_bytes(stmt, stmtColumnNum);
+    setText(rowNum, columnNum, std::string_view(valChar, valSize));
+    break;
+  }
+  case SQLITE_BLOB: {
+    const char *valChar = reinterpret_cast<const char *>(
+        sqlite3_column_blob(stmt, stmtColumnNum));
+    int valSize = sqlite3_column_bytes(stmt, stmtColumnNum);
+    setBlob(rowNum, columnNum,
+            valChar ? std::string_view(valChar, valSize) : std::string_view());
+    break;
+  }
+  default:
+    setNull(rowNum, columnNum);
+    break;
+  }
+}
+
+int SqliteRowBlock::bindCell(sqlite3_stmt *stmt, int paramIndex, int rowNum,
+                             int columnNum) const {
+  switch (getType(rowNum, columnNum)) {
+  case CellType::Integer:
+    return sqlite3_bind_int64(stmt, paramIndex, getInt(rowNum, columnNum));
+  case CellType::Float:
+    return sqlite3_bind_double(stmt, paramIndex, getFloat(rowNum, columnNum));
+  case CellType::Text: {
+    std::string_view value = getText(rowNum, columnNum);
+    return sqlite3_bind_text(stmt, paramIndex, value.data(),
+                             static_cast<int>(value.size()), SQLITE_TRANSIENT);
+  }
+  case CellType::Blob: {
+    std::string_view value = getText(rowNum, columnNum);
+    return sqlite3_bind_blob(stmt, paramIndex, value.data(),
+                             static_cast<int>(value.size()), SQLITE_TRANSIENT);
+  }
+  default:
+    return sqlite3_bind_null(stmt, paramIndex);
+  }
+}
+
+void SqliteRowBlock::compact() {
+  if (arenaWasted == 0) {
+    return;
+  }
+  std::vector<char> newArena;
+  newArena.reserve(arena.size() - arenaWasted);
+  for (auto &column : columnList) {
+    for (std::size_t rowNum = 0; rowNum < column.typeList.size(); rowNum++) {
+      CellType type = column.typeList[rowNum];
+      if (type != CellType::Text && type != CellType::Blob) {
+        continue;
+      }
+      std::string_view value = arenaView(column.valueList[rowNum]);
+      std::uint64_t offset = newArena.size();
+      newArena.insert(newArena.end(), value.begin(), value.end());
+      column.valueList[rowNum] = static_cast<std::int64_t>(
+          (offset << 32) | static_cast<std::uint32_t>(value.size()));
+    }
+  }
+  arena.swap(newArena);
+  arenaWasted = 0;
+}
+
+void SqliteRowBlock::write(std::ostream &stream) const {
+  std::int32_t header[2] = {getColumnCount(), rowCount};
+  std::uint64_t arenaSize = arena.size();
+  stream.write(reinterpret_cast<const char *>(header), sizeof(header));
+  stream.write(reinterpret_cast<const char *>(&arenaSize), sizeof(arenaSize));
+  for (auto &column : columnList) {
+    stream.write(reinterpret_cast<const char *>(column.typeList.data()),
+                 column.typeList.size() * sizeof(CellType));
+    stream.write(reinterpret_cast<const char *>(column.valueList.data()),
+                 column.valueList.size() * sizeof(std::int64_t));
+  }
+  stream.write(arena.data(), arena.size());
+}
+
+int SqliteRowBlock::read(std::istream &stream) {
+  std::int32_t header[2] = {0, 0};
+  std::uint64_t arenaSize = 0;
+  stream.read(reinterpret_cast<char *>(header), sizeof(header));
+  stream.read(reinterpret_cast<char *>(&arenaSize), sizeof(arenaSize));
+  if (!stream || header[0] < 0 || header[1] < 0 ||
+      header[0] > rowBlockColumnLimit ||
+      arenaSize > std::uint64_t(0xFFFFFFFFu)) {
+    reset(0);
+    return -1;
+  }
+
+  /* A damaged count must not allocate more than the stream holds, the cells
+   * and the arena must fit in the rest of the stream
+   */
+  std::istream::pos_type position = stream.tellg();
+  stream.seekg(0, std::ios::end);
+  std::istream::pos_type endPosition = stream.tellg();
+  stream.seekg(position);
+  std::uint64_t cellByteSize =
+      static_cast<std::uint64_t>(header[0]) * header[1] *
+      (sizeof(CellType) + sizeof(std::int64_t));
+  if (!stream || position < 0 || endPosition < position ||
+      cellByteSize + arenaSize >
+          static_cast<std::uint64_t>(endPosition - position)) {
+    stream.setstate(std::ios::failbit);
+    reset(0);
+    return -1;
+  }
+  reset(header[0]);
+  for (auto &column : columnList) {
+    column.typeList.resize(header[1]);
+    column.valueList.resize(header[1]);
+    stream.read(reinterpret_cast<char *>(column.typeList.data()),
+                column.typeList.size() * sizeof(CellType));
+    stream.read(reinterpret_cast<char *>(column.valueList.data()),
+                column.valueList.size() * sizeof(std::int64_t));
+  }
+  arena.resize(static_cast<std::size_t>(arenaSize));
+  stream.read(arena.data(), arena.size());
+  rowCount = header[1];
+  if (!stream) {
+    reset(0);
+    return -1;
+  }
+
+  // a damaged file must not make a cell read outside the arena
+  std::uint64_t referencedSize = 0;
+  for (auto &column : columnList) {
+    for (int rowNum = 0; rowNum < rowCount; rowNum++) {
+      CellType type = column.typeList[rowNum];
+      if (type > CellType::Deferred) {
+        reset(0);
+        return -1;
+      }
+      if (type != CellType::Text && type != CellType::Blob) {
+        continue;
+      }
+      std::uint64_t slotBits =
+          static_cast<std::uint64_t>(column.valueList[rowNum]);
+      if ((slotBits >> 32) + (slotBits & 0xFFFFFFFFu) > arenaSize) {
+        reset(0);
+        return -1;
+      }
+      referencedSize += slotBits & 0xFFFFFFFFu;
+    }
+  }
+  arenaWasted = referencedSize < arenaSize
+                    ? static_cast<std::size_t>(arenaSize - referencedSize)
+                    : 0;
+  return 0;
+}
+
+std::size_t SqliteRowBlock::byteSize() const {
+  std::size_t byteCount = sizeof(SqliteRowBlock) + arena.capacity();
+  for (auto &column : columnList) {
+    byteCount += sizeof(Column) + column.typeList.capacity() * sizeof(CellType) +
+                 column.valueList.capacity() * sizeof(std::int64_t);
+  }
+  return byteCount;
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
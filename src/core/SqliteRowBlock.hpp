@@ -0,0 +1,162 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Columnar cache for rows queried from sqlite3.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_ROW_BLOCK_H
+#define BOOKFILER_CORE_SQLITE_ROW_BLOCK_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Stores query results column by column. Each column keeps one type tag
+ * and one 8 byte value slot per row. Integers and floats are stored in the
+ * slot directly, text and blobs store an offset and size into one arena buffer
+ * shared by all columns. Values keep the sqlite3 storage class they were read
+ * with, so no text conversion happens for numbers.
+ */
+class SqliteRowBlock {
+public:
+  /* Deferred cells were left out of the query and are read on demand, they
+   * read as NULL until then
+   */
+  enum class CellType : std::uint8_t {
+    Null,
+    Integer,
+    Float,
+    Text,
+    Blob,
+    Deferred
+  };
+
+private:
+  struct Column {
+    std::vector<CellType> typeList;
+    std::vector<std::int64_t> valueList;
+  };
+  int rowCount = 0;
+  std::vector<Column> columnList;
+  std::vector<char> arena;
+  /* bytes in the arena no longer referenced by a cell
+   */
+  std::size_t arenaWasted = 0;
+
+  std::int64_t arenaAppend(const char *valuePtr, std::size_t valueSize);
+  /* true when valueSize more bytes fit under the 4 GiB slot offset limit,
+   * compacting the arena first if needed
+   */
+  bool arenaReserve(std::size_t valueSize);
+  std::string_view arenaView(std::int64_t slot) const;
+  void releaseCell(int rowNum, int columnNum);
+  /* rewrite the arena without the unreferenced bytes
+   */
+  void compact();
+
+public:
+  SqliteRowBlock(int columnCount = 0);
+
+  /* clears all rows and sets the number of columns
+   */
+  void reset(int columnCount);
+  void clear();
+  int getRowCount() const;
+  int getColumnCount() const;
+  /* append the current row of a stepped statement
+   * @return the new row number
+   */
+  int appendRow(sqlite3_stmt *stmt);
+  /* append an empty row of NULL cells
+   * @return the new row number
+   */
+  int appendNullRow();
+  /* move all rows of another block with the same columns to the end of this
+   * block
+   */
+  void append(SqliteRowBlock &&other);
+  /* copy rows of another block with the same columns into this block
+   * @param rowBegin the row number the first copied row will have
+   * @param src the block to copy from
+   * @param srcBegin the first row to copy
+   * @param count number of rows to copy
+   */
+  void insertRows(int rowBegin, const SqliteRowBlock &src, int srcBegin,
+                  int count);
+  /* remove rows from the block
+   */
+  void eraseRows(int rowBegin, int count);
+
+  CellType getType(int rowNum, int columnNum) const;
+  bool isNull(int rowNum, int columnNum) const;
+  bool isDeferred(int rowNum, int columnNum) const;
+  std::int64_t getInt(int rowNum, int columnNum) const;
+  double getFloat(int rowNum, int columnNum) const;
+  /* text or blob bytes. Only valid until the block is modified.
+   */
+  std::string_view getText(int rowNum, int columnNum) const;
+  /* any cell converted to text the same way sqlite3 would
+   */
+  std::string getString(int rowNum, int columnNum) const;
+
+  void setNull(int rowNum, int columnNum);
+  void setDeferred(int rowNum, int columnNum);
+  void setInt(int rowNum, int columnNum, std::int64_t value);
+  void setFloat(int rowNum, int columnNum, double value);
+  void setText(int rowNum, int columnNum, std::string_view value);
+  void setBlob(int rowNum, int columnNum, std::string_view value);
+  /* set a cell from a cell of another block
+   */
+  void setFromBlock(int rowNum, int columnNum, const SqliteRowBlock &src,
+                    int srcRowNum, int srcColumnNum);
+  /* set a cell from a column of a stepped statement
+   */
+  void setFromStatement(int rowNum, int columnNum, sqlite3_stmt *stmt,
+                        int stmtColumnNum);
+  /* bind a cell to a statement parameter keeping its storage class
+   * @return sqlite3 result code
+   */
+  int bindCell(sqlite3_stmt *stmt, int paramIndex, int rowNum,
+               int columnNum) const;
+
+  /* approximate heap memory used by the block
+   */
+  std::size_t byteSize() const;
+  /* Writes the block in its in-memory layout, the column type and value
+   * arrays followed by the arena, in host byte order
+   */
+  void write(std::ostream &stream) const;
+  /* Replaces the rows with a block written by write(). The counts are
+   * checked against the rest of the stream before anything is allocated, the
+   * text and blob slots against the arena. The stream must be seekable.
+   * @return 0 on success, else error code. The block is empty on error.
+   */
+  int read(std::istream &stream);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_ROW_BLOCK_H
+#endif
@@ -0,0 +1,188 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Writes cached rows as TSV, CSV, or an HTML table in chunks.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteRowWriter.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteRowWriter::SqliteRowWriter(Format format_, Sink sink_,
+                                 std::size_t chunkSize_)
+    : format(format_), sink(sink_), chunkSize(chunkSize_) {
+  buffer.reserve(chunkSize + 1024);
+}
+
+SqliteRowWriter::~SqliteRowWriter() { finish(); }
+
+const char *SqliteRowWriter::getMimeType(Format format) {
+  switch (format) {
+  case Format::Csv:
+    return "text/csv";
+  case Format::Html:
+    return "text/html";
+  default:
+    return "text/plain";
+  }
+}
+
+void SqliteRowWriter::begin() {
+  if (beginFlag) {
+    return;
+  }
+  beginFlag = true;
+  if (format == Format::Html) {
+    buffer.append("<table>\n");
+  }
+}
+
+void SqliteRowWriter::writeCell(std::string_view value, bool firstFlag,
+                                bool headerFlag) {
+  if (format == Format::Html) {
+    buffer.append(firstFlag ? "<tr>" : "");
+    buffer.append(headerFlag ? "<th>" : "<td>");
+    for (char valueCh : value) {
+      switch (valueCh) {
+      case '&':
+        buffer.append("&amp;");
+        break;
+      case '<':
+        buffer.append("&lt;");
+        break;
+      case '>':
+        buffer.append("&gt;");
+        break;
+      case '"':
+        buffer.append("&quot;");
+        break;
+      case '\n':
+        buffer.append("<br>");
+        break;
+      default:
+        buffer.push_back(valueCh);
+      }
+    }
+    buffer.append(headerFlag ? "</th>" : "</td>");
+    return;
+  }
+
+  // TSV quotes cells the way spreadsheets do when they hold a separator
+  char separator = format == Format::Csv ? ',' : '\t';
+  if (!firstFlag) {
+    buffer.push_back(separator);
+  }
+  bool quoteFlag = false;
+  for (char valueCh : value) {
+    if (valueCh == separator || valueCh == '"' || valueCh == '\n' ||
+        valueCh == '\r') {
+      quoteFlag = true;
+      break;
+    }
+  }
+  if (!quoteFlag) {
+    buffer.append(value.data(), value.size());
+    return;
+  }
+  buffer.push_back('"');
+  for (char valueCh : value) {
+    if (valueCh == '"') {
+      buffer.push_back('"');
+    }
+    buffer.push_back(valueCh);
+  }
+  buffer.push_back('"');
+}
+
+void SqliteRowWriter::endRow() {
+  switch (format) {
+  case Format::Csv:
+    buffer.append("\r\n");
+    break;
+  case Format::Html:
+    buffer.append("</tr>\n");
+    break;
+  default:
+    buffer.push_back('\n');
+  }
+  flushFull();
+}
+
+void SqliteRowWriter::flushFull() {
+  if (buffer.size() < chunkSize) {
+    return;
+  }
+  byteCount += buffer.size();
+  if (sink) {
+    sink(buffer.data(), buffer.size());
+  }
+  buffer.clear();
+}
+
+void SqliteRowWriter::writeHeader(const std::vector<std::string> &nameList) {
+  begin();
+  for (std::size_t columnNum = 0; columnNum < nameList.size(); columnNum++) {
+    writeCell(nameList[columnNum], columnNum == 0, true);
+  }
+  endRow();
+}
+
+void SqliteRowWriter::writeRows(const SqliteRowBlock &block, int rowBegin,
+                                int rowEnd,
+                                const std::vector<int> &columnList) {
+  begin();
+  if (rowEnd > block.getRowCount()) {
+    rowEnd = block.getRowCount();
+  }
+  for (int rowNum = rowBegin < 0 ? 0 : rowBegin; rowNum < rowEnd; rowNum++) {
+    bool firstFlag = true;
+    for (int columnNum : columnList) {
+      switch (block.getType(rowNum, columnNum)) {
+      case SqliteRowBlock::CellType::Null:
+        writeCell(std::string_view(), firstFlag, false);
+        break;
+      case SqliteRowBlock::CellType::Text:
+      case SqliteRowBlock::CellType::Blob:
+        writeCell(block.getText(rowNum, columnNum), firstFlag, false);
+        break;
+      default:
+        writeCell(block.getString(rowNum, columnNum), firstFlag, false);
+      }
+      firstFlag = false;
+    }
+    endRow();
+  }
+}
+
+void SqliteRowWriter::finish() {
+  if (finishFlag) {
+    return;
+  }
+  finishFlag = true;
+  if (beginFlag && format == Format::Html) {
+    buffer.append("</table>\n");
+  }
+  byteCount += buffer.size();
+  if (sink && !buffer.empty()) {
+    sink(buffer.data(), buffer.size());
+  }
+  buffer.clear();
+}
+
+std::size_t SqliteRowWriter::getByteCount() const {
+  return byteCount + buffer.size();
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Writes cached rows as TSV, CSV, or an HTML table in chunks.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_ROW_WRITER_H
+#define BOOKFILER_CORE_SQLITE_ROW_WRITER_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Local Project
+#include "SqliteRowBlock.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Formats the cells of row blocks straight from their storage, text
+ * cells are escaped without being copied first. The output is collected in a
+ * buffer of chunkSize bytes that is handed to the sink whenever it is full,
+ * so the whole export never has to be held twice.
+ */
+class SqliteRowWriter {
+public:
+  enum class Format { Tsv, Csv, Html };
+  /* called with each chunk of output
+   */
+  using Sink = std::function<void(const char *, std::size_t)>;
+
+private:
+  Format format;
+  Sink sink;
+  std::string buffer;
+  std::size_t chunkSize;
+  std::size_t byteCount = 0;
+  bool beginFlag = false, finishFlag = false;
+
+  /* writes the start of the HTML table before the first row
+   */
+  void begin();
+  void writeCell(std::string_view value, bool firstFlag, bool headerFlag);
+  void endRow();
+  void flushFull();
+
+public:
+  SqliteRowWriter(Format format_, Sink sink_,
+                  std::size_t chunkSize_ = 64 * 1024);
+  /* calls finish() if it was not called
+   */
+  ~SqliteRowWriter();
+
+  void writeHeader(const std::vector<std::string> &nameList);
+  /* writes rows [rowBegin, rowEnd) with the columns of columnList in that
+   * order, columns the block lacks are written empty
+   */
+  void writeRows(const SqliteRowBlock &block, int rowBegin, int rowEnd,
+                 const std::vector<int> &columnList);
+  /* writes the end of the HTML table and hands the rest of the buffer to the
+   * sink
+   */
+  void finish();
+  /* bytes written so far, including the buffered bytes
+   */
+  std::size_t getByteCount() const;
+  static const char *getMimeType(Format format);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_ROW_WRITER_H
+#endif
@@ -0,0 +1,182 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Tunes a connection for reading a large database file that does not
+ * change.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteSnapshot.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteSnapshot::TempWriteScope::TempWriteScope(sqlite3 *database_) {
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v2(database_, "PRAGMA query_only;", -1, &stmt,
+                         nullptr) == SQLITE_OK &&
+      sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) != 0) {
+    database = database_;
+  }
+  sqlite3_finalize(stmt);
+  if (database) {
+    sqlite3_exec(database, "PRAGMA query_only = 0;", nullptr, nullptr,
+                 nullptr);
+  }
+}
+
+SqliteSnapshot::TempWriteScope::~TempWriteScope() {
+  if (database) {
+    sqlite3_exec(database, "PRAGMA query_only = 1;", nullptr, nullptr,
+                 nullptr);
+  }
+}
+
+SqliteSnapshot::SqliteSnapshot(std::shared_ptr<sqlite3> database_,
+                               std::string tableName_,
+                               std::string parentIdColumnName_)
+    : database(database_), tableName(tableName_),
+      parentIdColumnName(parentIdColumnName_) {}
+
+SqliteSnapshot::~SqliteSnapshot() { close(); }
+
+std::int64_t SqliteSnapshot::getPragma(const char *pragmaName) const {
+  std::string sqlQuery = std::string("PRAGMA ") + pragmaName + ";";
+  sqlite3_stmt *stmt = nullptr;
+  std::int64_t value = 0;
+  if (sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt,
+                         nullptr) == SQLITE_OK &&
+      sqlite3_step(stmt) == SQLITE_ROW) {
+    value = sqlite3_column_int64(stmt, 0);
+  }
+  sqlite3_finalize(stmt);
+  return value;
+}
+
+int SqliteSnapshot::setPragma(const char *pragmaName, std::int64_t value) {
+  std::string sqlQuery =
+      std::string("PRAGMA ") + pragmaName + " = " + std::to_string(value) + ";";
+  return sqlite3_exec(database.get(), sqlQuery.c_str(), nullptr, nullptr,
+                      nullptr);
+}
+
+int SqliteSnapshot::open(const Settings &settings_) {
+  if (openFlag) {
+    close();
+  }
+  previousMmapSize = getPragma("mmap_size");
+  previousCacheSize = getPragma("cache_size");
+  previousTempStore = getPragma("temp_store");
+  previousQueryOnly = getPragma("query_only");
+
+  // query_only goes last, the other pragmas do not write the file
+  int rc = setPragma("mmap_size", settings_.mmapByteSize);
+  if (rc == SQLITE_OK) {
+    rc = setPragma("cache_size", -std::int64_t(settings_.cacheKibiByteSize));
+  }
+  if (rc == SQLITE_OK) {
+    // 2 is MEMORY
+    rc = setPragma("temp_store", 2);
+  }
+  if (rc == SQLITE_OK) {
+    rc = setPragma("query_only", 1);
+  }
+  settings = settings_;
+  openFlag = true;
+  if (rc != SQLITE_OK) {
+    close();
+    return rc;
+  }
+  return 0;
+}
+
+int SqliteSnapshot::close() {
+  if (!openFlag) {
+    return 0;
+  }
+  openFlag = false;
+  int rc = setPragma("query_only", previousQueryOnly);
+  setPragma("temp_store", previousTempStore);
+  setPragma("cache_size", previousCacheSize);
+  setPragma("mmap_size", previousMmapSize);
+  return rc;
+}
+
+bool SqliteSnapshot::isOpen() const { return openFlag; }
+
+const SqliteSnapshot::Settings &SqliteSnapshot::getSettings() const {
+  return settings;
+}
+
+std::string SqliteSnapshot::getConnectionSQL() const {
+  if (!openFlag) {
+    return std::string();
+  }
+  return "PRAGMA mmap_size = " + std::to_string(settings.mmapByteSize) +
+         "; PRAGMA cache_size = " +
+         std::to_string(-std::int64_t(settings.cacheKibiByteSize)) +
+         "; PRAGMA temp_store = 2;";
+}
+
+std::string SqliteSnapshot::getParentIndexName() const {
+  // a partial index does not hold every row
+  sqlite3_stmt *stmt = nullptr;
+  int rc = sqlite3_prepare_v2(
+      database.get(),
+      "SELECT indexList.name FROM pragma_index_list(?1) AS indexList JOIN "
+      "pragma_index_info(indexList.name) AS indexInfo WHERE indexInfo.seqno "
+      "= 0 AND indexInfo.name = ?2 AND indexList.partial = 0 ORDER BY "
+      "(SELECT count(*) FROM pragma_index_info(indexList.name)) LIMIT 1;",
+      -1, &stmt, nullptr);
+  std::string indexName;
+  if (rc == SQLITE_OK) {
+    sqlite3_bind_text(stmt, 1, tableName.c_str(),
+                      static_cast<int>(tableName.size()), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, parentIdColumnName.c_str(),
+                      static_cast<int>(parentIdColumnName.size()),
+                      SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      indexName = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    }
+  }
+  sqlite3_finalize(stmt);
+  return indexName;
+}
+
+int SqliteSnapshot::warm(SqliteInstrumentation *instrumentation) {
+  SqliteInstrumentation::Timer timer(instrumentation,
+                                     SqliteInstrumentation::Query::Warmup);
+  std::string indexName = getParentIndexName();
+  if (indexName.empty()) {
+    return 0;
+  }
+
+  /* count() of the first index column is answered from the index alone, so
+   * only its pages are read. count(*) would ignore INDEXED BY and scan the
+   * smallest index.
+   */
+  std::string sqlQuery = "SELECT count(`" + parentIdColumnName + "`) FROM `" +
+                         tableName + "` INDEXED BY `" + indexName + "`;";
+  sqlite3_stmt *stmt = nullptr;
+  int rc =
+      sqlite3_prepare_v2(database.get(), sqlQuery.c_str(), -1, &stmt, nullptr);
+  int entryCount = -1;
+  if (rc == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+    entryCount = sqlite3_column_int(stmt, 0);
+  }
+  sqlite3_finalize(stmt);
+  timer.setResult(entryCount);
+  return entryCount;
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Tunes a connection for reading a large database file that does not
+ * change.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_SNAPSHOT_H
+#define BOOKFILER_CORE_SQLITE_SNAPSHOT_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteInstrumentation.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Applies the pragmas of a read only snapshot to a connection: the
+ * file is memory mapped, the page cache is enlarged, temp b-trees stay in
+ * memory, and query_only refuses writes to the database. The previous values
+ * are restored by close(). warm() reads the index on the parent column once
+ * so the first expands do not fault its pages in one by one.
+ */
+class SqliteSnapshot {
+public:
+  struct Settings {
+    /* bytes of the file to memory map, capped by SQLITE_MAX_MMAP_SIZE
+     */
+    std::int64_t mmapByteSize = std::int64_t(1) << 32;
+    /* page cache size in KiB per connection
+     */
+    int cacheKibiByteSize = 256 * 1024;
+    /* read the pages of the parent index when the snapshot is opened
+     */
+    bool warmFlag = true;
+  };
+
+  /* Lifts query_only while temp tables are written and puts it back on
+   * destruction. Does nothing on a connection without query_only.
+   */
+  class TempWriteScope {
+  private:
+    sqlite3 *database = nullptr;
+
+  public:
+    TempWriteScope(sqlite3 *database_);
+    ~TempWriteScope();
+    TempWriteScope(const TempWriteScope &) = delete;
+    TempWriteScope &operator=(const TempWriteScope &) = delete;
+  };
+
+private:
+  std::shared_ptr<sqlite3> database;
+  std::string tableName, parentIdColumnName;
+  Settings settings;
+  bool openFlag = false;
+  /* pragma values before open()
+   */
+  std::int64_t previousMmapSize = 0, previousCacheSize = 0;
+  std::int64_t previousTempStore = 0, previousQueryOnly = 0;
+
+  /* @return the value of a pragma, 0 if it can not be read
+   */
+  std::int64_t getPragma(const char *pragmaName) const;
+  int setPragma(const char *pragmaName, std::int64_t value);
+
+public:
+  SqliteSnapshot(std::shared_ptr<sqlite3> database_, std::string tableName_,
+                 std::string parentIdColumnName_);
+  /* calls close()
+   */
+  ~SqliteSnapshot();
+
+  /* Applies the pragmas to the connection
+   * @return 0 on success, else error code. Nothing is changed on error.
+   */
+  int open(const Settings &settings_);
+  /* Restores the pragma values from before open()
+   * @return 0 on success, else error code
+   */
+  int close();
+  bool isOpen() const;
+  const Settings &getSettings() const;
+  /* @return the pragmas to run on the read only connections of the query
+   * worker and the prefetch threads, empty if the snapshot is not open.
+   * query_only is left out because those connections are opened read only
+   * and still fill temp tables for the tree filter.
+   */
+  std::string getConnectionSQL() const;
+  /* @return the name of the smallest index whose first column is the parent
+   * column, empty if there is none
+   */
+  std::string getParentIndexName() const;
+  /* Reads every page of the parent index with a covering scan. The scan is
+   * recorded as a warm up query.
+   * @return number of rows with a parent, negative on error. 0 if the table
+   * has no index on the parent column.
+   */
+  int warm(SqliteInstrumentation *instrumentation);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_SNAPSHOT_H
+#endif
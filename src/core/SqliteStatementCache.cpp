@@ -0,0 +1,122 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Prepared statement cache for a sqlite3 database.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// Local Project
+#include "SqliteStatementCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteStatementCache::SqliteStatementCache(std::shared_ptr<sqlite3> database_)
+    : database(database_) {}
+
+SqliteStatementCache::~SqliteStatementCache() {
+  invalidate();
+  for (sqlite3_stmt *stmt : orphanSet) {
+    sqlite3_finalize(stmt);
+  }
+}
+
+std::shared_ptr<sqlite3_stmt>
+SqliteStatementCache::get(const std::string &signature,
+                          const std::function<std::string()> &sqlBuilder) {
+  sqlite3_stmt *stmt = nullptr;
+  auto findIt = statementMap.find(signature);
+  if (instrumentation) {
+    instrumentation->countCache(SqliteInstrumentation::Cache::Statement,
+                                findIt != statementMap.end());
+  }
+  if (findIt != statementMap.end()) {
+    stmt = findIt->second;
+    /* The same signature is already borrowed, for example by a nested query.
+     * Hand out a statement that is not cached.
+     */
+    if (borrowedSet.count(stmt)) {
+      int rc = sqlite3_prepare_v2(database.get(), sqlBuilder().c_str(), -1,
+                                  &stmt, nullptr);
+      if (rc != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return std::shared_ptr<sqlite3_stmt>();
+      }
+      return std::shared_ptr<sqlite3_stmt>(stmt, sqlite3_finalize);
+    }
+  } else {
+    /* sqlite3_prepare_v3 with SQLITE_PREPARE_PERSISTENT tells sqlite3 the
+     * statement will be reused many times
+     */
+    int rc = sqlite3_prepare_v3(database.get(), sqlBuilder().c_str(), -1,
+                                SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    if (rc != SQLITE_OK) {
+      sqlite3_finalize(stmt);
+      return std::shared_ptr<sqlite3_stmt>();
+    }
+    statementMap.insert({signature, stmt});
+  }
+
+  borrowedSet.insert(stmt);
+  return std::shared_ptr<sqlite3_stmt>(
+      stmt, [this](sqlite3_stmt *stmt_) { release(stmt_); });
+}
+
+void SqliteStatementCache::release(sqlite3_stmt *stmt) {
+  borrowedSet.erase(stmt);
+  if (orphanSet.erase(stmt)) {
+    sqlite3_finalize(stmt);
+    return;
+  }
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+}
+
+int SqliteStatementCache::setup(
+    const std::string &name, const std::string &key,
+    const std::function<int(sqlite3 *)> &setupFunc) {
+  auto findIt = setupMap.find(name);
+  if (findIt != setupMap.end() && findIt->second == key) {
+    return 0;
+  }
+  setupMap.erase(name);
+  int rc = setupFunc(database.get());
+  if (rc != 0) {
+    return rc;
+  }
+  setupMap.insert({name, key});
+  return 0;
+}
+
+int SqliteStatementCache::invalidate() {
+  for (auto &statementPair : statementMap) {
+    if (borrowedSet.count(statementPair.second)) {
+      orphanSet.insert(statementPair.second);
+    } else {
+      sqlite3_finalize(statementPair.second);
+    }
+  }
+  statementMap.clear();
+  setupMap.clear();
+  return 0;
+}
+
+std::size_t SqliteStatementCache::size() { return statementMap.size(); }
+
+void SqliteStatementCache::setInstrumentation(
+    std::shared_ptr<SqliteInstrumentation> instrumentation_) {
+  instrumentation = instrumentation_;
+}
+
+sqlite3 *SqliteStatementCache::getDatabase() { return database.get(); }
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Prepared statement cache for a sqlite3 database.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_STATEMENT_CACHE_H
+#define BOOKFILER_CORE_SQLITE_STATEMENT_CACHE_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteInstrumentation.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Holds one prepared statement per query signature so that the SQL is
+ * only parsed once. Statements are borrowed with get() and automatically reset
+ * and unbound when the returned pointer is released. The owner must call
+ * invalidate() whenever the generated SQL for a signature changes, for example
+ * when the sort order or filters change.
+ */
+class SqliteStatementCache {
+private:
+  std::shared_ptr<sqlite3> database;
+  /* map the query signature to the prepared statement
+   */
+  std::unordered_map<std::string, sqlite3_stmt *> statementMap;
+  /* statements currently borrowed
+   */
+  std::unordered_set<sqlite3_stmt *> borrowedSet;
+  /* statements that were invalidated while borrowed. They are finalized when
+   * returned.
+   */
+  std::unordered_set<sqlite3_stmt *> orphanSet;
+  /* map setup name->key of the setup that ran on this connection
+   */
+  std::unordered_map<std::string, std::string> setupMap;
+  /* counts statement cache hits and misses, may be null
+   */
+  std::shared_ptr<SqliteInstrumentation> instrumentation;
+
+  void release(sqlite3_stmt *stmt);
+
+public:
+  SqliteStatementCache(std::shared_ptr<sqlite3> database_);
+  ~SqliteStatementCache();
+
+  /* Borrow the prepared statement for a query signature
+   * @param signature unique key for the query shape
+   * @param sqlBuilder called to build the SQL only when the statement is not
+   * cached yet
+   * @return the statement or nullptr if it failed to prepare. The statement is
+   * reset when the last copy of the pointer is destroyed.
+   */
+  std::shared_ptr<sqlite3_stmt>
+  get(const std::string &signature,
+      const std::function<std::string()> &sqlBuilder);
+  /* Runs a setup step once per connection, for example filling a temp table
+   * that cached statements read. Runs again when the key changes or after
+   * invalidate().
+   * @param name identifies the setup step
+   * @param key the step is skipped while the key matches the last success
+   * @param setupFunc called with the connection, returns 0 on success
+   * @return 0 on success, else error code
+   */
+  int setup(const std::string &name, const std::string &key,
+            const std::function<int(sqlite3 *)> &setupFunc);
+  /* Finalize all cached statements. Borrowed statements are finalized when
+   * they are returned.
+   * @return 0 on success, else error code
+   */
+  int invalidate();
+  /* number of cached statements
+   */
+  std::size_t size();
+  /* the connection of the statements, for statements that run once
+   */
+  sqlite3 *getDatabase();
+  void setInstrumentation(
+      std::shared_ptr<SqliteInstrumentation> instrumentation);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_STATEMENT_CACHE_H
+#endif
@@ -0,0 +1,320 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Sidecar file holding the loaded tree of a model between sessions.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// C++
+#include <cstdio> // std::remove
+#include <filesystem>
+#include <fstream>
+
+// Local Project
+#include "SqliteTreeCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/* "BFTC", the format version, and a value showing the byte order
+ */
+static const std::uint32_t treeCacheMagic = 0x43544642u;
+static const std::uint32_t treeCacheVersion = 2;
+static const std::uint32_t treeCacheByteOrder = 0x01020304u;
+/* longest string read, a damaged length must not allocate gigabytes
+ */
+static const std::uint32_t treeCacheStringLimit = 1u << 24;
+
+template <typename T> static void writeValue(std::ostream &stream, T value) {
+  stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> static bool readValue(std::istream &stream, T &value) {
+  stream.read(reinterpret_cast<char *>(&value), sizeof(value));
+  return static_cast<bool>(stream);
+}
+
+static void writeString(std::ostream &stream, const std::string &value) {
+  writeValue<std::uint32_t>(stream, static_cast<std::uint32_t>(value.size()));
+  stream.write(value.data(), value.size());
+}
+
+static bool readString(std::istream &stream, std::string &value) {
+  std::uint32_t valueSize = 0;
+  if (!readValue(stream, valueSize) || valueSize > treeCacheStringLimit) {
+    return false;
+  }
+  value.resize(valueSize);
+  stream.read(&value[0], valueSize);
+  return static_cast<bool>(stream);
+}
+
+/* the sqlite3 file headers are big-endian
+ */
+static std::uint32_t readBigEndian(const unsigned char *bytes) {
+  return (static_cast<std::uint32_t>(bytes[0]) << 24) |
+         (static_cast<std::uint32_t>(bytes[1]) << 16) |
+         (static_cast<std::uint32_t>(bytes[2]) << 8) |
+         static_cast<std::uint32_t>(bytes[3]);
+}
+
+/* Reads the file change counter and the page count at bytes 24..31 of the
+ * database header
+ * @return 0 on success, else error code
+ */
+static int readDatabaseHeader(const std::string &filePath,
+                              std::int64_t &changeCounter,
+                              std::int64_t &pageCount) {
+  std::ifstream stream(filePath, std::ios::binary);
+  unsigned char header[32];
+  if (!stream ||
+      !stream.read(reinterpret_cast<char *>(header), sizeof(header))) {
+    return -1;
+  }
+  changeCounter = readBigEndian(header + 24);
+  pageCount = readBigEndian(header + 28);
+  return 0;
+}
+
+/* Reads the salts of the WAL header and counts the frames up to the last
+ * commit frame of the current salts. A checkpoint that restarts the WAL
+ * changes the salts, frames of an older WAL keep the older salts.
+ * @return 0 on success or if there is no WAL, else error code
+ */
+static int readWalHeader(const std::string &filePath, std::int64_t &walSalt,
+                         std::int64_t &walFrameCount) {
+  walSalt = 0;
+  walFrameCount = 0;
+  std::ifstream stream(filePath, std::ios::binary);
+  unsigned char header[32];
+  if (!stream ||
+      !stream.read(reinterpret_cast<char *>(header), sizeof(header))) {
+    // no WAL, or one that was never written
+    return 0;
+  }
+  std::uint32_t magic = readBigEndian(header);
+  std::uint32_t pageSize = readBigEndian(header + 8);
+  if ((magic & 0xFFFFFFFEu) != 0x377F0682u || pageSize < 512) {
+    return -1;
+  }
+  std::uint32_t salt1 = readBigEndian(header + 16);
+  std::uint32_t salt2 = readBigEndian(header + 20);
+  walSalt = (static_cast<std::int64_t>(salt1) << 32) | salt2;
+
+  unsigned char frameHeader[24];
+  for (std::int64_t frameNum = 1;; frameNum++) {
+    stream.seekg(32 + (frameNum - 1) * (24 + std::int64_t(pageSize)));
+    if (!stream.read(reinterpret_cast<char *>(frameHeader),
+                     sizeof(frameHeader)) ||
+        readBigEndian(frameHeader + 8) != salt1 ||
+        readBigEndian(frameHeader + 12) != salt2) {
+      break;
+    }
+    // a commit frame holds the database size after the commit
+    if (readBigEndian(frameHeader + 4) != 0) {
+      walFrameCount = frameNum;
+    }
+  }
+  return 0;
+}
+
+bool SqliteTreeCache::Fingerprint::operator==(const Fingerprint &other) const {
+  return signature == other.signature &&
+         schemaVersion == other.schemaVersion && maxRowId == other.maxRowId &&
+         changeCounter == other.changeCounter &&
+         pageCount == other.pageCount && walSalt == other.walSalt &&
+         walFrameCount == other.walFrameCount;
+}
+
+bool SqliteTreeCache::Fingerprint::operator!=(const Fingerprint &other) const {
+  return !(*this == other);
+}
+
+SqliteTreeCache::SqliteTreeCache() {}
+
+SqliteTreeCache::~SqliteTreeCache() {}
+
+int SqliteTreeCache::getFingerprint(sqlite3 *database,
+                                    const std::string &tableName,
+                                    const std::string &signature,
+                                    Fingerprint &fingerprint) {
+  const char *fileName = sqlite3_db_filename(database, "main");
+  if (!fileName || fileName[0] == '\0') {
+    return -1;
+  }
+  fingerprint = Fingerprint();
+  fingerprint.signature = signature;
+
+  // both are read from the b-tree headers without a scan
+  std::string sqlQuery =
+      "SELECT (SELECT schema_version FROM pragma_schema_version), "
+      "(SELECT max(rowid) FROM `" +
+      tableName + "`);";
+  sqlite3_stmt *stmt = nullptr;
+  int rc = sqlite3_prepare_v2(database, sqlQuery.c_str(), -1, &stmt, nullptr);
+  if (rc == SQLITE_OK) {
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+      fingerprint.schemaVersion = sqlite3_column_int64(stmt, 0);
+      fingerprint.maxRowId = sqlite3_column_int64(stmt, 1);
+      rc = SQLITE_OK;
+    }
+  }
+  sqlite3_finalize(stmt);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
+  /* Commits in rollback journal mode increment the change counter. Commits
+   * in WAL mode only append frames to the WAL until a checkpoint.
+   */
+  rc = readDatabaseHeader(fileName, fingerprint.changeCounter,
+                          fingerprint.pageCount);
+  if (rc != 0) {
+    return rc;
+  }
+  return readWalHeader(std::string(fileName) + "-wal", fingerprint.walSalt,
+                       fingerprint.walFrameCount);
+}
+
+int SqliteTreeCache::save(const std::string &filePath) const {
+  std::string tempPath = filePath + ".tmp";
+  {
+    std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+    if (!stream) {
+      return -1;
+    }
+    writeValue(stream, treeCacheMagic);
+    writeValue(stream, treeCacheVersion);
+    writeValue(stream, treeCacheByteOrder);
+
+    writeString(stream, fingerprint.signature);
+    writeValue(stream, fingerprint.schemaVersion);
+    writeValue(stream, fingerprint.maxRowId);
+    writeValue(stream, fingerprint.changeCounter);
+    writeValue(stream, fingerprint.pageCount);
+    writeValue(stream, fingerprint.walSalt);
+    writeValue(stream, fingerprint.walFrameCount);
+
+    writeValue<std::uint32_t>(stream,
+                              static_cast<std::uint32_t>(nodeList.size()));
+    for (auto &node : nodeList) {
+      writeString(stream, node.containerId);
+      writeString(stream, node.parentId);
+      writeValue<std::int32_t>(stream, node.rowNum);
+      writeValue<std::uint8_t>(stream, node.fetchedAll ? 1 : 0);
+      node.rowData.write(stream);
+      writeValue<std::uint32_t>(
+          stream, static_cast<std::uint32_t>(node.childCountList.size()));
+      for (auto &childCountPair : node.childCountList) {
+        writeValue<std::int32_t>(stream, childCountPair.first);
+        writeValue<std::int32_t>(stream, childCountPair.second);
+      }
+    }
+
+    writeValue<std::uint32_t>(
+        stream, static_cast<std::uint32_t>(expandedIdList.size()));
+    for (auto &id : expandedIdList) {
+      writeString(stream, id);
+    }
+    stream.flush();
+    if (!stream) {
+      stream.close();
+      std::remove(tempPath.c_str());
+      return -1;
+    }
+  }
+
+  std::error_code errorCode;
+  std::filesystem::rename(tempPath, filePath, errorCode);
+  if (errorCode) {
+    std::remove(tempPath.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int SqliteTreeCache::load(const std::string &filePath) {
+  nodeList.clear();
+  expandedIdList.clear();
+  std::ifstream stream(filePath, std::ios::binary);
+  if (!stream) {
+    return -1;
+  }
+  std::uint32_t magic = 0, version = 0, byteOrder = 0;
+  if (!readValue(stream, magic) || !readValue(stream, version) ||
+      !readValue(stream, byteOrder) || magic != treeCacheMagic ||
+      version != treeCacheVersion || byteOrder != treeCacheByteOrder) {
+    return -1;
+  }
+
+  if (!readString(stream, fingerprint.signature) ||
+      !readValue(stream, fingerprint.schemaVersion) ||
+      !readValue(stream, fingerprint.maxRowId) ||
+      !readValue(stream, fingerprint.changeCounter) ||
+      !readValue(stream, fingerprint.pageCount) ||
+      !readValue(stream, fingerprint.walSalt) ||
+      !readValue(stream, fingerprint.walFrameCount)) {
+    return -1;
+  }
+
+  std::uint32_t nodeCount = 0;
+  if (!readValue(stream, nodeCount)) {
+    return -1;
+  }
+  for (std::uint32_t nodeNum = 0; nodeNum < nodeCount; nodeNum++) {
+    Node node;
+    std::int32_t rowNum = 0;
+    std::uint8_t fetchedAll = 0;
+    std::uint32_t childCountSize = 0;
+    if (!readString(stream, node.containerId) ||
+        !readString(stream, node.parentId) || !readValue(stream, rowNum) ||
+        !readValue(stream, fetchedAll) || node.rowData.read(stream) != 0 ||
+        !readValue(stream, childCountSize) ||
+        childCountSize > static_cast<std::uint32_t>(
+                             node.rowData.getRowCount())) {
+      nodeList.clear();
+      return -1;
+    }
+    node.rowNum = rowNum;
+    node.fetchedAll = fetchedAll != 0;
+    node.childCountList.resize(childCountSize);
+    for (auto &childCountPair : node.childCountList) {
+      std::int32_t childRowNum = 0, childCount = 0;
+      if (!readValue(stream, childRowNum) || !readValue(stream, childCount)) {
+        nodeList.clear();
+        return -1;
+      }
+      childCountPair = {childRowNum, childCount};
+    }
+    nodeList.push_back(std::move(node));
+  }
+
+  std::uint32_t expandedCount = 0;
+  if (!readValue(stream, expandedCount)) {
+    nodeList.clear();
+    return -1;
+  }
+  for (std::uint32_t expandedNum = 0; expandedNum < expandedCount;
+       expandedNum++) {
+    std::string id;
+    if (!readString(stream, id)) {
+      nodeList.clear();
+      expandedIdList.clear();
+      return -1;
+    }
+    expandedIdList.push_back(std::move(id));
+  }
+  return 0;
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Sidecar file holding the loaded tree of a model between sessions.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_TREE_CACHE_H
+#define BOOKFILER_CORE_SQLITE_TREE_CACHE_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteRowBlock.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief The cached rows, child counts, and expanded ids of a tree saved to a
+ * binary file next to the database. The file records a fingerprint of the
+ * database file and the query settings. A cache whose fingerprint differs
+ * from the current one describes rows that may have changed since.
+ */
+class SqliteTreeCache {
+public:
+  /* The database file is compared by the change counter and page count of
+   * its header, its WAL file by the salts of its header and the number of
+   * frames up to the last commit. The table is compared by schema version
+   * and largest rowid. The signature describes the sort, filter, and
+   * columns of the data queries.
+   */
+  struct Fingerprint {
+    std::string signature;
+    std::int64_t schemaVersion = 0, maxRowId = 0;
+    std::int64_t changeCounter = 0, pageCount = 0, walSalt = 0,
+                 walFrameCount = 0;
+    bool operator==(const Fingerprint &other) const;
+    bool operator!=(const Fingerprint &other) const;
+  };
+  /* the rows of one index. Parents come before their children.
+   */
+  struct Node {
+    /* the index holding the row this node holds the children of, and the
+     * row. The root has an empty containerId.
+     */
+    std::string containerId, parentId;
+    int rowNum = 0;
+    bool fetchedAll = true;
+    SqliteRowBlock rowData;
+    /* {rowNum, number of children}
+     */
+    std::vector<std::pair<int, int>> childCountList;
+  };
+
+  Fingerprint fingerprint;
+  std::vector<Node> nodeList;
+  std::vector<std::string> expandedIdList;
+
+  SqliteTreeCache();
+  ~SqliteTreeCache();
+
+  /* Reads the fingerprint of a table
+   * @param signature copied into the fingerprint
+   * @return 0 on success, else error code. In-memory databases have no file
+   * to compare and fail.
+   */
+  static int getFingerprint(sqlite3 *database, const std::string &tableName,
+                            const std::string &signature,
+                            Fingerprint &fingerprint);
+  /* Writes the cache to a temporary file and renames it over filePath, so a
+   * crash never leaves half a cache
+   * @return 0 on success, else error code
+   */
+  int save(const std::string &filePath) const;
+  /* @return 0 on success, else error code. Fails for files of another
+   * format version or byte order.
+   */
+  int load(const std::string &filePath);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_TREE_CACHE_H
+#endif
@@ -0,0 +1,342 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Moves, copies, and deletes subtrees of the tree table with set
+ * based SQL.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// C++
+#include <cctype> // std::toupper
+
+// Local Project
+#include "SqliteTreeEditor.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteTreeEditor::SqliteTreeEditor(
+    std::shared_ptr<sqlite3> database_,
+    std::shared_ptr<SqliteStatementCache> statementCache_,
+    std::string tableName_, std::string idColumnName_,
+    std::string parentIdColumnName_, std::vector<std::string> columnNameList_)
+    : database(database_), statementCache(statementCache_),
+      tableName(tableName_), idColumnName(idColumnName_),
+      parentIdColumnName(parentIdColumnName_),
+      columnNameList(columnNameList_) {}
+
+std::string SqliteTreeEditor::getInListSQL() {
+  std::string inListSQL;
+  for (int paramNum = 1; paramNum <= pageSize; paramNum++) {
+    inListSQL.append((paramNum == 1 ? "?" : ",?") + std::to_string(paramNum));
+  }
+  return inListSQL;
+}
+
+void SqliteTreeEditor::bindPage(sqlite3_stmt *stmt,
+                                const std::vector<std::string> &idList,
+                                std::size_t pageBegin) {
+  // unused parameters stay NULL and match nothing
+  for (std::size_t idNum = pageBegin;
+       idNum < idList.size() && idNum < pageBegin + pageSize; idNum++) {
+    sqlite3_bind_text(stmt, static_cast<int>(idNum - pageBegin + 1),
+                      idList[idNum].c_str(),
+                      static_cast<int>(idList[idNum].size()), SQLITE_STATIC);
+  }
+}
+
+std::string SqliteTreeEditor::getSubtreeTableName() const {
+  return tableName + "_bookfiler_subtree";
+}
+
+bool SqliteTreeEditor::isIntegerId() {
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("treeIdType", [this]() {
+        return "SELECT type FROM pragma_table_info('" + tableName +
+               "') WHERE name=?1;";
+      });
+  if (!stmt) {
+    return false;
+  }
+  sqlite3_bind_text(stmt.get(), 1, idColumnName.c_str(),
+                    static_cast<int>(idColumnName.size()), SQLITE_STATIC);
+  if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+    return false;
+  }
+  const unsigned char *typeChar = sqlite3_column_text(stmt.get(), 0);
+  std::string typeName = typeChar ? reinterpret_cast<const char *>(typeChar)
+                                  : std::string();
+  for (char &typeCh : typeName) {
+    typeCh = static_cast<char>(std::toupper(static_cast<unsigned char>(typeCh)));
+  }
+  // the sqlite3 rule for integer affinity
+  return typeName.find("INT") != std::string::npos;
+}
+
+int SqliteTreeEditor::exec(const std::string &sqlQuery) {
+  return sqlite3_exec(database.get(), sqlQuery.c_str(), nullptr, nullptr,
+                      nullptr);
+}
+
+int SqliteTreeEditor::rollback() {
+  exec("ROLLBACK TO bookfiler_tree_editor;");
+  exec("RELEASE bookfiler_tree_editor;");
+  return 0;
+}
+
+int SqliteTreeEditor::moveRows(const std::vector<std::string> &idList,
+                               const std::string &parentId) {
+  if (idList.empty()) {
+    return 0;
+  }
+  if (exec("SAVEPOINT bookfiler_tree_editor;") != SQLITE_OK) {
+    return -1;
+  }
+  for (std::size_t pageBegin = 0; pageBegin < idList.size();
+       pageBegin += pageSize) {
+    std::shared_ptr<sqlite3_stmt> stmt =
+        statementCache->get("treeMove", [this]() {
+          return "UPDATE `" + tableName + "` SET `" + parentIdColumnName +
+                 "`=?" + std::to_string(pageSize + 1) + " WHERE `" +
+                 idColumnName + "` IN (" + getInListSQL() + ");";
+        });
+    if (!stmt) {
+      rollback();
+      return -1;
+    }
+    bindPage(stmt.get(), idList, pageBegin);
+    if (parentId != "*") {
+      sqlite3_bind_text(stmt.get(), pageSize + 1, parentId.c_str(),
+                        static_cast<int>(parentId.size()), SQLITE_STATIC);
+    }
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+      stmt.reset();
+      rollback();
+      return -2;
+    }
+  }
+  if (exec("RELEASE bookfiler_tree_editor;") != SQLITE_OK) {
+    rollback();
+    return -3;
+  }
+  return 0;
+}
+
+int SqliteTreeEditor::copyRows(const std::vector<std::string> &idList,
+                               const std::string &parentId,
+                               std::vector<std::string> &newIdList) {
+  if (idList.empty()) {
+    return 0;
+  }
+  if (exec("SAVEPOINT bookfiler_tree_editor;") != SQLITE_OK) {
+    return -1;
+  }
+  // maps every copied row to the id of its copy
+  std::string subtreeTableName = getSubtreeTableName();
+  bool integerFlag = isIntegerId();
+  int rc = collectSubtree(idList, integerFlag ? "treeSubtree" : "treeCopyMap",
+                          integerFlag ? "NULL" : "lower(hex(randomblob(16)))");
+  if (rc != 0) {
+    rollback();
+    return rc;
+  }
+  if (integerFlag &&
+      exec("UPDATE temp.`" + subtreeTableName +
+           "` SET newId=rowNum+(SELECT ifnull(max(`" + idColumnName +
+           "`),0) FROM `" + tableName + "`);") != SQLITE_OK) {
+    rollback();
+    return -2;
+  }
+
+  /* The copy of a row is the child of the copy of its parent, or of parentId
+   * for the top rows
+   */
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("treeCopy", [this, &subtreeTableName]() {
+        std::string columnSQL, selectSQL;
+        for (auto &columnName : columnNameList) {
+          columnSQL.append((columnSQL.empty() ? "`" : ", `") + columnName +
+                           "`");
+          selectSQL.append(selectSQL.empty() ? "" : ", ");
+          if (columnName == idColumnName) {
+            selectSQL.append("copyRow.newId");
+          } else if (columnName == parentIdColumnName) {
+            selectSQL.append("ifnull(parentRow.newId, ?1)");
+          } else {
+            selectSQL.append("`" + tableName + "`.`" + columnName + "`");
+          }
+        }
+        return "INSERT INTO `" + tableName + "`(" + columnSQL + ") SELECT " +
+               selectSQL + " FROM temp.`" + subtreeTableName +
+               "` AS copyRow JOIN `" + tableName + "` ON `" + tableName +
+               "`.`" + idColumnName + "`=copyRow.oldId LEFT JOIN temp.`" +
+               subtreeTableName + "` AS parentRow ON parentRow.oldId=`" +
+               tableName + "`.`" + parentIdColumnName +
+               "` ORDER BY copyRow.rowNum;";
+      });
+  if (!stmt) {
+    rollback();
+    return -1;
+  }
+  if (parentId != "*") {
+    sqlite3_bind_text(stmt.get(), 1, parentId.c_str(),
+                      static_cast<int>(parentId.size()), SQLITE_STATIC);
+  }
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    stmt.reset();
+    rollback();
+    return -2;
+  }
+  stmt.reset();
+
+  std::vector<std::string> copyIdList;
+  stmt = statementCache->get("treeCopyIdList", [&subtreeTableName]() {
+    return "SELECT newId FROM temp.`" + subtreeTableName +
+           "` ORDER BY rowNum;";
+  });
+  while (stmt && sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    const unsigned char *idChar = sqlite3_column_text(stmt.get(), 0);
+    if (idChar) {
+      copyIdList.push_back(reinterpret_cast<const char *>(idChar));
+    }
+  }
+  stmt.reset();
+  if (exec("DELETE FROM temp.`" + subtreeTableName + "`;") != SQLITE_OK ||
+      exec("RELEASE bookfiler_tree_editor;") != SQLITE_OK) {
+    rollback();
+    return -3;
+  }
+  newIdList.insert(newIdList.end(), copyIdList.begin(), copyIdList.end());
+  return 0;
+}
+
+int SqliteTreeEditor::collectSubtree(const std::vector<std::string> &idList,
+                                     const std::string &signature,
+                                     const std::string &newIdSQL) {
+  std::string subtreeTableName = getSubtreeTableName();
+  if (exec("CREATE TEMP TABLE IF NOT EXISTS `" + subtreeTableName +
+           "`(rowNum INTEGER PRIMARY KEY, oldId UNIQUE, newId);") !=
+          SQLITE_OK ||
+      exec("DELETE FROM temp.`" + subtreeTableName + "`;") != SQLITE_OK) {
+    return -1;
+  }
+
+  /* Every listed row and its subtree in one recursive query per page. UNION
+   * keeps a row reached twice, or a cycle, from being listed twice.
+   */
+  for (std::size_t pageBegin = 0; pageBegin < idList.size();
+       pageBegin += pageSize) {
+    std::shared_ptr<sqlite3_stmt> stmt = statementCache->get(signature, [&]() {
+      std::string tableSQL = "`" + tableName + "`";
+      return "INSERT OR IGNORE INTO temp.`" + subtreeTableName +
+             "`(oldId, newId) WITH RECURSIVE subtree(id) AS (SELECT `" +
+             idColumnName + "` FROM " + tableSQL + " WHERE `" + idColumnName +
+             "` IN (" + getInListSQL() + ") UNION SELECT " + tableSQL + ".`" +
+             idColumnName + "` FROM " + tableSQL + " JOIN subtree ON " +
+             tableSQL + ".`" + parentIdColumnName +
+             "`=subtree.id) SELECT id, " + newIdSQL + " FROM subtree;";
+    });
+    if (!stmt) {
+      return -1;
+    }
+    bindPage(stmt.get(), idList, pageBegin);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+      return -2;
+    }
+  }
+  return 0;
+}
+
+int SqliteTreeEditor::deleteRows(const std::vector<std::string> &idList,
+                                 std::vector<std::string> &deletedIdList) {
+  if (idList.empty()) {
+    return 0;
+  }
+  if (exec("SAVEPOINT bookfiler_tree_editor;") != SQLITE_OK) {
+    return -1;
+  }
+  std::string subtreeTableName = getSubtreeTableName();
+  int rc = collectSubtree(idList, "treeSubtree", "NULL");
+  if (rc != 0) {
+    rollback();
+    return rc;
+  }
+
+  // the ids are read before the rows are gone
+  std::vector<std::string> subtreeIdList;
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("treeSubtreeIdList", [&subtreeTableName]() {
+        return "SELECT oldId FROM temp.`" + subtreeTableName +
+               "` ORDER BY rowNum;";
+      });
+  while (stmt && sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    const unsigned char *idChar = sqlite3_column_text(stmt.get(), 0);
+    if (idChar) {
+      subtreeIdList.push_back(reinterpret_cast<const char *>(idChar));
+    }
+  }
+  stmt.reset();
+
+  stmt = statementCache->get("treeDelete", [this, &subtreeTableName]() {
+    return "DELETE FROM `" + tableName + "` WHERE `" + idColumnName +
+           "` IN (SELECT oldId FROM temp.`" + subtreeTableName + "`);";
+  });
+  if (!stmt) {
+    rollback();
+    return -1;
+  }
+  if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+    stmt.reset();
+    rollback();
+    return -2;
+  }
+  stmt.reset();
+  if (exec("DELETE FROM temp.`" + subtreeTableName + "`;") != SQLITE_OK ||
+      exec("RELEASE bookfiler_tree_editor;") != SQLITE_OK) {
+    rollback();
+    return -3;
+  }
+  deletedIdList.insert(deletedIdList.end(), subtreeIdList.begin(),
+                       subtreeIdList.end());
+  return 0;
+}
+
+std::unordered_set<std::string>
+SqliteTreeEditor::getAncestorIdSet(const std::string &id) {
+  std::unordered_set<std::string> ancestorIdSet;
+  if (id == "*") {
+    return ancestorIdSet;
+  }
+  ancestorIdSet.insert(id);
+  std::shared_ptr<sqlite3_stmt> stmt =
+      statementCache->get("treeAncestor", [this]() {
+        return "WITH RECURSIVE ancestor(id) AS (SELECT ?1 UNION SELECT `" +
+               tableName + "`.`" + parentIdColumnName + "` FROM `" +
+               tableName + "` JOIN ancestor ON `" + tableName + "`.`" +
+               idColumnName + "`=ancestor.id) SELECT id FROM ancestor "
+               "WHERE id IS NOT NULL;";
+      });
+  if (!stmt) {
+    return ancestorIdSet;
+  }
+  sqlite3_bind_text(stmt.get(), 1, id.c_str(), static_cast<int>(id.size()),
+                    SQLITE_STATIC);
+  while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+    const unsigned char *idChar = sqlite3_column_text(stmt.get(), 0);
+    if (idChar) {
+      ancestorIdSet.insert(reinterpret_cast<const char *>(idChar));
+    }
+  }
+  return ancestorIdSet;
+}
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
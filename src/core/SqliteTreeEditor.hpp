@@ -0,0 +1,121 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Moves, copies, and deletes subtrees of the tree table with set
+ * based SQL.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_TREE_EDITOR_H
+#define BOOKFILER_CORE_SQLITE_TREE_EDITOR_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteStatementCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Changes the shape of the tree stored in a table with one row per
+ * node and a parent id column. Rows are addressed by id in pages of
+ * pageSize ids, so a statement is prepared once and one statement runs per
+ * page no matter how many rows or how deep the subtrees are. Every call runs
+ * inside one savepoint and leaves the table unchanged on error.
+ */
+class SqliteTreeEditor {
+private:
+  std::shared_ptr<sqlite3> database;
+  std::shared_ptr<SqliteStatementCache> statementCache;
+  std::string tableName, idColumnName, parentIdColumnName;
+  /* every column of the table, copied by copyRows()
+   */
+  std::vector<std::string> columnNameList;
+
+  /* @return "?1,?2,...", one numbered parameter per id of a page
+   */
+  static std::string getInListSQL();
+  /* binds the ids of a page to the parameters of getInListSQL()
+   */
+  static void bindPage(sqlite3_stmt *stmt,
+                       const std::vector<std::string> &idList,
+                       std::size_t pageBegin);
+  std::string getSubtreeTableName() const;
+  /* Lists the rows and their subtrees in the subtree temp table, mapped to
+   * newIdSQL
+   * @param signature statement cache key of the newIdSQL variant
+   * @return 0 on success, else error code
+   */
+  int collectSubtree(const std::vector<std::string> &idList,
+                     const std::string &signature,
+                     const std::string &newIdSQL);
+  /* @return true if the id column holds integers
+   */
+  bool isIntegerId();
+  /* @return sqlite3 result code
+   */
+  int exec(const std::string &sqlQuery);
+  int rollback();
+
+public:
+  SqliteTreeEditor(std::shared_ptr<sqlite3> database_,
+                   std::shared_ptr<SqliteStatementCache> statementCache_,
+                   std::string tableName_, std::string idColumnName_,
+                   std::string parentIdColumnName_,
+                   std::vector<std::string> columnNameList_);
+
+  /* number of ids bound per statement
+   */
+  static const int pageSize = 256;
+  /* Sets the parent of rows, their subtrees move with them
+   * @param parentId the new parent, "*" for a NULL parent
+   * @return 0 on success, else error code
+   */
+  int moveRows(const std::vector<std::string> &idList,
+               const std::string &parentId);
+  /* Copies rows and their subtrees under a parent. The copies get new ids,
+   * random text ids or integer ids after the largest id. A row listed
+   * together with one of its ancestors is copied once, under the copy of
+   * the ancestor.
+   * @param parentId the parent of the copies, "*" for a NULL parent
+   * @param newIdList the id of every copy is appended
+   * @return 0 on success, else error code
+   */
+  int copyRows(const std::vector<std::string> &idList,
+               const std::string &parentId,
+               std::vector<std::string> &newIdList);
+  /* Deletes rows and their subtrees with one DELETE, however many rows the
+   * subtrees hold
+   * @param deletedIdList the id of every deleted row is appended
+   * @return 0 on success, else error code
+   */
+  int deleteRows(const std::vector<std::string> &idList,
+                 std::vector<std::string> &deletedIdList);
+  /* @return the id and the id of every ancestor of the row
+   */
+  std::unordered_set<std::string> getAncestorIdSet(const std::string &id);
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_TREE_EDITOR_H
+#endif
@@ -0,0 +1,206 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Buffers cell edits and writes them back in one transaction.
+ */
+
+#if DEPENDENCY_SQLITE
+
+// C++
+#include <algorithm> // std::stable_sort
+#include <numeric>   // std::iota
+#include <unordered_set>
+
+// Local Project
+#include "SqliteWriteBuffer.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+SqliteWriteBuffer::SqliteWriteBuffer(
+    std::shared_ptr<sqlite3> database_,
+    std::shared_ptr<SqliteStatementCache> statementCache_,
+    std::string tableName_, std::string idColumnName_)
+    : database(database_), statementCache(statementCache_),
+      tableName(tableName_), idColumnName(idColumnName_), valueData(1) {}
+
+void SqliteWriteBuffer::setInstrumentation(
+    std::shared_ptr<SqliteInstrumentation> instrumentation_) {
+  instrumentation = instrumentation_;
+}
+
+int SqliteWriteBuffer::add(const std::string &id,
+                           const std::string &columnName,
+                           const SqliteRowBlock &block, int rowNum,
+                           int columnNum) {
+  if (rowNum < 0 || rowNum >= block.getRowCount() || columnNum < 0 ||
+      columnNum >= block.getColumnCount()) {
+    return -1;
+  }
+  auto &columnEditMap = editMap[id];
+  auto editIt = columnEditMap.find(columnName);
+  int editNum = 0;
+  if (editIt == columnEditMap.end()) {
+    editNum = valueData.appendNullRow();
+    columnEditMap.emplace(columnName, editNum);
+    editList.push_back({id, columnName, editNum});
+  } else {
+    editNum = editIt->second;
+  }
+  valueData.setFromBlock(editNum, 0, block, rowNum, columnNum);
+  return 0;
+}
+
+int SqliteWriteBuffer::exec(const char *sqlQuery) {
+  return sqlite3_exec(database.get(), sqlQuery, nullptr, nullptr, nullptr);
+}
+
+bool SqliteWriteBuffer::isTransientError(int rc) {
+  switch (rc & 0xFF) {
+  case SQLITE_BUSY:
+  case SQLITE_LOCKED:
+  case SQLITE_INTERRUPT:
+  case SQLITE_NOMEM:
+  case SQLITE_IOERR:
+  case SQLITE_FULL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+int SqliteWriteBuffer::flush(std::vector<std::string> &updatedIdList,
+                             std::vector<Rejected> &rejectedList) {
+  if (editList.empty()) {
+    return 0;
+  }
+  SqliteInstrumentation::Timer timer(instrumentation.get(),
+                                     SqliteInstrumentation::Query::CellUpdate);
+
+  /* A savepoint outside of a transaction starts one, inside of one it nests,
+   * so the edits are written with one journal sync either way. A refused
+   * edit rolls back the savepoint and the remaining edits are written
+   * again, so each pass drops at most one edit.
+   */
+  int rc = SQLITE_OK;
+  int failedEditNum = -1;
+  do {
+    if (failedEditNum >= 0) {
+      const Edit &failedEdit = editList[failedEditNum];
+      rejectedList.push_back({failedEdit.id, failedEdit.columnName, rc,
+                              sqlite3_errmsg(database.get())});
+      exec("ROLLBACK TO bookfiler_write_buffer;");
+      exec("RELEASE bookfiler_write_buffer;");
+      auto editMapIt = editMap.find(failedEdit.id);
+      if (editMapIt != editMap.end()) {
+        editMapIt->second.erase(failedEdit.columnName);
+        if (editMapIt->second.empty()) {
+          editMap.erase(editMapIt);
+        }
+      }
+      editList.erase(editList.begin() + failedEditNum);
+      failedEditNum = -1;
+      if (editList.empty()) {
+        timer.setResult(0);
+        clear();
+        return 0;
+      }
+    }
+    rc = exec("SAVEPOINT bookfiler_write_buffer;");
+    if (rc != SQLITE_OK) {
+      errorMessage = sqlite3_errmsg(database.get());
+      timer.setResult(-1);
+      return -1;
+    }
+    // one statement per column, borrowed once for all edits of the column
+    int editCount = static_cast<int>(editList.size());
+    std::vector<int> editOrder(editCount);
+    std::iota(editOrder.begin(), editOrder.end(), 0);
+    std::stable_sort(editOrder.begin(), editOrder.end(), [&](int a, int b) {
+      return editList[a].columnName < editList[b].columnName;
+    });
+    std::shared_ptr<sqlite3_stmt> stmt;
+    int valueParam = 0, idParam = 0;
+    for (int orderNum = 0; orderNum < editCount && rc == SQLITE_OK;
+         orderNum++) {
+      int editNum = editOrder[orderNum];
+      const Edit &edit = editList[editNum];
+      if (orderNum == 0 ||
+          edit.columnName != editList[editOrder[orderNum - 1]].columnName) {
+        stmt = statementCache->get("update:" + edit.columnName, [&]() {
+          return "UPDATE `" + tableName + "` SET `" + edit.columnName +
+                 "`=:value WHERE `" + idColumnName + "`=:id;";
+        });
+        if (!stmt) {
+          // for example a column that no longer exists
+          rc = sqlite3_errcode(database.get());
+          rc = rc == SQLITE_OK ? SQLITE_ERROR : rc;
+          failedEditNum = editNum;
+          break;
+        }
+        valueParam = sqlite3_bind_parameter_index(stmt.get(), ":value");
+        idParam = sqlite3_bind_parameter_index(stmt.get(), ":id");
+      }
+      valueData.bindCell(stmt.get(), valueParam, edit.valueRowNum, 0);
+      sqlite3_bind_text(stmt.get(), idParam, edit.id.c_str(),
+                        static_cast<int>(edit.id.size()), SQLITE_STATIC);
+      rc = sqlite3_step(stmt.get());
+      sqlite3_reset(stmt.get());
+      rc = rc == SQLITE_DONE ? SQLITE_OK : rc;
+      if (rc != SQLITE_OK) {
+        failedEditNum = editNum;
+      }
+    }
+    stmt.reset();
+  } while (failedEditNum >= 0 && !isTransientError(rc));
+  if (rc != SQLITE_OK) {
+    errorMessage = sqlite3_errmsg(database.get());
+    exec("ROLLBACK TO bookfiler_write_buffer;");
+    exec("RELEASE bookfiler_write_buffer;");
+    timer.setResult(-2);
+    return -2;
+  }
+  rc = exec("RELEASE bookfiler_write_buffer;");
+  if (rc != SQLITE_OK) {
+    // for example SQLITE_BUSY, the transaction is still open
+    errorMessage = sqlite3_errmsg(database.get());
+    exec("ROLLBACK TO bookfiler_write_buffer;");
+    exec("RELEASE bookfiler_write_buffer;");
+    timer.setResult(-3);
+    return -3;
+  }
+
+  std::unordered_set<std::string> updatedIdSet;
+  for (auto &edit : editList) {
+    if (updatedIdSet.insert(edit.id).second) {
+      updatedIdList.push_back(edit.id);
+    }
+  }
+  timer.setResult(static_cast<int>(editList.size()));
+  clear();
+  return 0;
+}
+
+void SqliteWriteBuffer::clear() {
+  valueData.reset(1);
+  std::vector<Edit>().swap(editList);
+  editMap.clear();
+}
+
+const std::string &SqliteWriteBuffer::getErrorMessage() const {
+  return errorMessage;
+}
+
+bool SqliteWriteBuffer::empty() const { return editList.empty(); }
+
+std::size_t SqliteWriteBuffer::size() const { return editList.size(); }
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * @name BookFiler Widget - Sqlite Model
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Buffers cell edits and writes them back in one transaction.
+ */
+
+#if DEPENDENCY_SQLITE
+#ifndef BOOKFILER_CORE_SQLITE_WRITE_BUFFER_H
+#define BOOKFILER_CORE_SQLITE_WRITE_BUFFER_H
+
+// config
+#include "config.hpp"
+
+// C++
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+// Local Project
+#include "SqliteRowBlock.hpp"
+#include "SqliteStatementCache.hpp"
+
+/*
+ * bookfiler - widget
+ */
+namespace bookfiler {
+namespace widget {
+
+/*
+ * @brief Holds the edited cells until flush() writes them with one prepared
+ * UPDATE per column, all inside one savepoint. Editing the same cell again
+ * before the flush replaces the buffered value, so only the last value is
+ * written. The values keep their sqlite3 storage class.
+ */
+class SqliteWriteBuffer {
+private:
+  std::shared_ptr<sqlite3> database;
+  std::shared_ptr<SqliteStatementCache> statementCache;
+  std::string tableName, idColumnName;
+  /* one row per buffered edit, the value is in column 0
+   */
+  SqliteRowBlock valueData;
+  struct Edit {
+    std::string id, columnName;
+    /* row of the value in valueData
+     */
+    int valueRowNum;
+  };
+  std::vector<Edit> editList;
+  /* map id->column name->row of the edit in valueData
+   */
+  std::unordered_map<std::string, std::unordered_map<std::string, int>>
+      editMap;
+  /* counts every flush as one cell update query, may be null
+   */
+  std::shared_ptr<SqliteInstrumentation> instrumentation;
+  /* sqlite3 error message of the last flush that kept the edits
+   */
+  std::string errorMessage;
+
+  /* @return sqlite3 result code
+   */
+  int exec(const char *sqlQuery);
+  /* @return true for errors where writing the edit again may succeed
+   */
+  static bool isTransientError(int rc);
+
+public:
+  /* an edit dropped from the buffer because the database refused it
+   */
+  struct Rejected {
+    std::string id, columnName;
+    int rc;
+    std::string message;
+  };
+
+  SqliteWriteBuffer(std::shared_ptr<sqlite3> database_,
+                    std::shared_ptr<SqliteStatementCache> statementCache_,
+                    std::string tableName_, std::string idColumnName_);
+
+  void setInstrumentation(
+      std::shared_ptr<SqliteInstrumentation> instrumentation);
+  /* Buffers the new value of a cell
+   * @param id the row id
+   * @param columnName the sqlite3 column name
+   * @param block the block holding the new value
+   * @return 0 on success, else error code
+   */
+  int add(const std::string &id, const std::string &columnName,
+          const SqliteRowBlock &block, int rowNum, int columnNum);
+  /* Writes the buffered edits in one transaction. An edit the database
+   * refuses, for example with a constraint violation, is dropped and the
+   * others are written again without it. The buffer is cleared when the
+   * transaction commits and kept when it fails for another reason, for
+   * example SQLITE_BUSY.
+   * @param updatedIdList the ids of the updated rows are appended
+   * @param rejectedList the dropped edits are appended
+   * @return 0 on success, else error code
+   */
+  int flush(std::vector<std::string> &updatedIdList,
+            std::vector<Rejected> &rejectedList);
+  /* drops the buffered edits without writing them
+   */
+  void clear();
+  /* @return why the last failed flush kept the edits
+   */
+  const std::string &getErrorMessage() const;
+  bool empty() const;
+  /* number of buffered edits
+   */
+  std::size_t size() const;
+};
+
+} // namespace widget
+} // namespace bookfiler
+
+#endif // BOOKFILER_CORE_SQLITE_WRITE_BUFFER_H
+#endif
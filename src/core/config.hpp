@@ -9,18 +9,6 @@
 #ifndef BOOKFILER_LIBRARY_SORT_FILTER_TREE_WIDGET_CONFIG_H
 #define BOOKFILER_LIBRARY_SORT_FILTER_TREE_WIDGET_CONFIG_H
 
-#define BOOKFILER_QMODEL_SQLITE_MODEL_setData 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_PARENT 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_ROW_COUNT 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_COLUMN_COUNT 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_DATA 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_FLAGS 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_INDEX 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_SORT 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_rowCountBackend 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getRowId 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getDataBackend 0
-#define BOOKFILER_QMODEL_SQLITE_MODEL_INDEX_getDataCell 0
 #define BOOKFILER_LIBRARY_SORT_FILTER_TREE_WIDGET_TREE_VIEW_EXPAND 0
 
 // C++
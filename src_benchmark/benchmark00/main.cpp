@@ -0,0 +1,402 @@
+/*
+ * @name BookFiler Library - Sort Filter Tree Widget
+ * @author Branden Lee
+ * @version 1.00
+ * @license MIT
+ * @brief Super fast tree sorting and filtering tree widget.
+ */
+
+// C++
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/* sqlite3 3.33.0
+ * License: PublicDomain
+ */
+#include <sqlite3.h>
+
+/* QT 5.13.2
+ * License: LGPLv3
+ */
+#include <QCoreApplication>
+
+/* Google Benchmark
+ * License: Apache-2.0
+ */
+#include <benchmark/benchmark.h>
+
+// Bookfiler Libraries
+#include <BookFiler-Widget-QT-Sort-Filter-Tree/Interface.hpp>
+
+std::shared_ptr<sqlite3> getDatabase(int rowCount, int fanOut, int depth);
+int populateTree(std::shared_ptr<sqlite3> database, int rowCount, int fanOut,
+                 int depth);
+std::string genRandom(std::mt19937 &generator, int len);
+std::unique_ptr<bookfiler::widget::SqliteModel>
+createModel(std::shared_ptr<sqlite3> database);
+int expandAll(bookfiler::widget::SqliteModel &model,
+              const QModelIndex &parent);
+
+/* The name column, sorted and filtered on
+ */
+const int nameColumnNum = 2;
+
+/* Trees generated for each benchmark: total rows, children per row, and
+ * levels below the top level rows. Each --tree=rows,fanOut,depth flag adds
+ * a tree, the default trees are used without one.
+ */
+std::vector<std::vector<std::int64_t>> treeShapeList;
+
+static void treeArguments(benchmark::internal::Benchmark *benchmarkPtr) {
+  benchmarkPtr->ArgNames({"rows", "fanOut", "depth"});
+  if (treeShapeList.empty()) {
+    treeShapeList = {{1000, 10, 3},
+                     {10000, 100, 2},
+                     {100000, 32, 4},
+                     {100000, 100000, 1}};
+  }
+  for (auto &treeShape : treeShapeList) {
+    benchmarkPtr->Args(treeShape);
+  }
+}
+
+static void BM_Index(benchmark::State &state) {
+  auto model = createModel(getDatabase(state.range(0), state.range(1),
+                                       state.range(2)));
+  int rowCount = model->rowCount(QModelIndex());
+  for (auto _ : state) {
+    for (int rowNum = 0; rowNum < rowCount; rowNum++) {
+      benchmark::DoNotOptimize(model->index(rowNum, 0, QModelIndex()));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rowCount);
+}
+
+static void BM_Parent(benchmark::State &state) {
+  auto model = createModel(getDatabase(state.range(0), state.range(1),
+                                       state.range(2)));
+  // the first row of every child index
+  std::vector<QModelIndex> childList;
+  int rowCount = model->rowCount(QModelIndex());
+  for (int rowNum = 0; rowNum < rowCount; rowNum++) {
+    QModelIndex parent = model->index(rowNum, 0, QModelIndex());
+    if (model->rowCount(parent) > 0) {
+      childList.push_back(model->index(0, 0, parent));
+    }
+  }
+  for (auto _ : state) {
+    for (const QModelIndex &child : childList) {
+      benchmark::DoNotOptimize(model->parent(child));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * childList.size());
+}
+
+static void BM_RowCount(benchmark::State &state) {
+  auto model = createModel(getDatabase(state.range(0), state.range(1),
+                                       state.range(2)));
+  std::vector<QModelIndex> parentList;
+  int rowCount = model->rowCount(QModelIndex());
+  for (int rowNum = 0; rowNum < rowCount; rowNum++) {
+    parentList.push_back(model->index(rowNum, 0, QModelIndex()));
+  }
+  for (auto _ : state) {
+    for (const QModelIndex &parent : parentList) {
+      benchmark::DoNotOptimize(model->rowCount(parent));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * parentList.size());
+}
+
+static void BM_Data(benchmark::State &state) {
+  auto model = createModel(getDatabase(state.range(0), state.range(1),
+                                       state.range(2)));
+  int rowCount = model->rowCount(QModelIndex());
+  int columnCount = model->columnCount(QModelIndex());
+  for (auto _ : state) {
+    for (int rowNum = 0; rowNum < rowCount; rowNum++) {
+      for (int columnNum = 0; columnNum < columnCount; columnNum++) {
+        benchmark::DoNotOptimize(model->data(
+            model->index(rowNum, columnNum, QModelIndex()), Qt::DisplayRole));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rowCount * columnCount);
+}
+
+static void BM_Sort(benchmark::State &state) {
+  auto model = createModel(getDatabase(state.range(0), state.range(1),
+                                       state.range(2)));
+  model->rowCount(QModelIndex());
+  bool ascendingFlag = false;
+  for (auto _ : state) {
+    model->sort(nameColumnNum, ascendingFlag ? Qt::AscendingOrder
+                                             : Qt::DescendingOrder);
+    benchmark::DoNotOptimize(model->rowCount(QModelIndex()));
+    ascendingFlag = !ascendingFlag;
+  }
+}
+
+static void BM_SetFilter(benchmark::State &state) {
+  auto model = createModel(getDatabase(state.range(0), state.range(1),
+                                       state.range(2)));
+  /* setFilter() does not reload the view, setRoot() does. Two tokens whose
+   * filters keep a different number of top level rows are picked, so a
+   * filter that was not applied shows as an unchanged row count. The first
+   * filter builds the full text index.
+   */
+  std::vector<std::string> tokenList;
+  std::vector<int> rowCountList;
+  for (char token : std::string("abcdefghijklmnopqrstuvwxyz0123456789")) {
+    model->setFilter({{"name", std::string(1, token), "match"}});
+    model->setRoot("*");
+    int rowCount = model->rowCount(QModelIndex());
+    if (rowCountList.empty() || rowCount != rowCountList.front()) {
+      tokenList.push_back(std::string(1, token));
+      rowCountList.push_back(rowCount);
+    }
+    if (tokenList.size() == 2) {
+      break;
+    }
+  }
+  if (tokenList.size() < 2) {
+    state.SkipWithError("every token keeps the same rows");
+    return;
+  }
+  std::size_t tokenNum = 0;
+  for (auto _ : state) {
+    model->setFilter({{"name", tokenList[tokenNum], "match"}});
+    model->setRoot("*");
+    int rowCount = model->rowCount(QModelIndex());
+    if (rowCount != rowCountList[tokenNum]) {
+      state.SkipWithError("the filter did not change the rows");
+      break;
+    }
+    tokenNum = (tokenNum + 1) % tokenList.size();
+  }
+}
+
+static void BM_ExpandAll(benchmark::State &state) {
+  std::shared_ptr<sqlite3> database =
+      getDatabase(state.range(0), state.range(1), state.range(2));
+  int expandedCount = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto model = createModel(database);
+    state.ResumeTiming();
+    expandedCount = expandAll(*model, QModelIndex());
+    state.PauseTiming();
+    model.reset();
+    state.ResumeTiming();
+  }
+  state.counters["expanded"] = expandedCount;
+  state.SetItemsProcessed(state.iterations() * expandedCount);
+}
+
+int parseTreeArg(const std::string &arg) {
+  std::vector<std::int64_t> treeShape;
+  std::size_t beginPos = 0;
+  while (beginPos <= arg.size()) {
+    std::size_t endPos = arg.find(',', beginPos);
+    if (endPos == std::string::npos) {
+      endPos = arg.size();
+    }
+    try {
+      treeShape.push_back(std::stoll(arg.substr(beginPos, endPos - beginPos)));
+    } catch (const std::exception &) {
+      return -1;
+    }
+    beginPos = endPos + 1;
+  }
+  if (treeShape.size() != 3 || treeShape[0] <= 0 || treeShape[1] <= 0 ||
+      treeShape[2] < 0) {
+    return -1;
+  }
+  treeShapeList.push_back(treeShape);
+  return 0;
+}
+
+/* Registered after the command line is read, because the tree shapes are
+ * taken when a benchmark is registered
+ */
+void registerBenchmarks() {
+  benchmark::RegisterBenchmark("BM_Index", BM_Index)->Apply(treeArguments);
+  benchmark::RegisterBenchmark("BM_Parent", BM_Parent)->Apply(treeArguments);
+  benchmark::RegisterBenchmark("BM_RowCount", BM_RowCount)
+      ->Apply(treeArguments);
+  benchmark::RegisterBenchmark("BM_Data", BM_Data)->Apply(treeArguments);
+  benchmark::RegisterBenchmark("BM_Sort", BM_Sort)->Apply(treeArguments);
+  benchmark::RegisterBenchmark("BM_SetFilter", BM_SetFilter)
+      ->Apply(treeArguments);
+  benchmark::RegisterBenchmark("BM_ExpandAll", BM_ExpandAll)
+      ->Apply(treeArguments)
+      ->Unit(benchmark::kMillisecond);
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication qtApp(argc, argv);
+
+  /* Report JSON unless another format is asked for, so results can be
+   * compared across releases. The --tree flags are taken out before the
+   * benchmark flags are parsed.
+   */
+  std::vector<char *> argList{argv[0]};
+  std::string formatArg = "--benchmark_format=json";
+  argList.push_back(&formatArg[0]);
+  for (int argNum = 1; argNum < argc; argNum++) {
+    std::string arg = argv[argNum];
+    if (arg.rfind("--tree=", 0) != 0) {
+      argList.push_back(argv[argNum]);
+    } else if (parseTreeArg(arg.substr(7)) != 0) {
+      std::cout << "--tree expects rows,fanOut,depth: " << arg << std::endl;
+      return 1;
+    }
+  }
+  registerBenchmarks();
+  int argListCount = static_cast<int>(argList.size());
+  benchmark::Initialize(&argListCount, argList.data());
+  if (benchmark::ReportUnrecognizedArguments(argListCount, argList.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
+
+std::shared_ptr<sqlite3> getDatabase(int rowCount, int fanOut, int depth) {
+  // generating large trees is slow, each one is shared by all benchmarks
+  static std::map<std::tuple<int, int, int>, std::shared_ptr<sqlite3>>
+      databaseMap;
+  auto key = std::make_tuple(rowCount, fanOut, depth);
+  auto findIt = databaseMap.find(key);
+  if (findIt != databaseMap.end()) {
+    return findIt->second;
+  }
+
+  sqlite3 *dbPtr = nullptr;
+  int rc = sqlite3_open(":memory:", &dbPtr);
+  if (rc) {
+    std::cout << "sqlite3_open ERROR:\n" << sqlite3_errmsg(dbPtr) << std::endl;
+    return std::shared_ptr<sqlite3>();
+  }
+  std::shared_ptr<sqlite3> database(nullptr);
+  database.reset(dbPtr, sqlite3_close);
+  rc = populateTree(database, rowCount, fanOut, depth);
+  if (rc < 0) {
+    std::cout << "populateTree ERROR: " << rc << std::endl;
+  }
+  databaseMap.insert({key, database});
+  return database;
+}
+
+std::unique_ptr<bookfiler::widget::SqliteModel>
+createModel(std::shared_ptr<sqlite3> database) {
+  std::unique_ptr<bookfiler::widget::SqliteModel> model =
+      std::make_unique<bookfiler::widget::SqliteModel>(
+          database, "testTable",
+          std::vector<boost::bimap<std::string, std::string>::value_type>{
+              {"id", "guid"},
+              {"parentId", "parent_guid"},
+              {"name", "name"},
+              {"value", "value"}});
+  model->setRoot("*");
+  return model;
+}
+
+int expandAll(bookfiler::widget::SqliteModel &model,
+              const QModelIndex &parent) {
+  int expandedCount = 0;
+  int rowCount = model.rowCount(parent);
+  for (int rowNum = 0; rowNum < rowCount; rowNum++) {
+    QModelIndex child = model.index(rowNum, 0, parent);
+    expandedCount++;
+    if (model.hasChildren(child)) {
+      expandedCount += expandAll(model, child);
+    }
+  }
+  return expandedCount;
+}
+
+std::string genRandom(std::mt19937 &generator, int len) {
+  static const char alphanum[] = "0123456789"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "abcdefghijklmnopqrstuvwxyz";
+  std::uniform_int_distribution<int> distribution(0, sizeof(alphanum) - 2);
+  std::string tmp_s;
+  tmp_s.reserve(len);
+  for (int i = 0; i < len; ++i) {
+    tmp_s += alphanum[distribution(generator)];
+  }
+  return tmp_s;
+}
+
+int populateTree(std::shared_ptr<sqlite3> database, int rowCount, int fanOut,
+                 int depth) {
+  int rc = sqlite3_exec(database.get(),
+                        "CREATE TABLE testTable(guid text(32) PRIMARY KEY NOT "
+                        "NULL, parent_guid text(32), name text(2048) NOT "
+                        "NULL, value text(2048) NOT NULL);"
+                        "CREATE INDEX testTable_parent ON "
+                        "testTable(parent_guid);",
+                        nullptr, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    return -1;
+  }
+
+  sqlite3_stmt *stmt = nullptr;
+  rc = sqlite3_prepare_v2(database.get(),
+                          "INSERT INTO testTable (guid,parent_guid,name,value) "
+                          "VALUES (?1,?2,?3,?4);",
+                          -1, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    return -2;
+  }
+
+  /* Fill the tree breadth first. Every row gets fanOut children until the
+   * depth or the row count is reached. The generator is seeded so every run
+   * measures the same tree.
+   */
+  std::mt19937 generator(rowCount ^ (fanOut << 8) ^ (depth << 16));
+  std::vector<std::string> levelList{""};
+  int insertedCount = 0;
+  sqlite3_exec(database.get(), "BEGIN;", nullptr, nullptr, nullptr);
+  for (int level = 0; level <= depth && insertedCount < rowCount; level++) {
+    std::vector<std::string> nextLevelList;
+    for (auto &parentGuid : levelList) {
+      for (int childNum = 0; childNum < fanOut && insertedCount < rowCount;
+           childNum++) {
+        std::string guid = genRandom(generator, 32);
+        std::string name = genRandom(generator, 16);
+        std::string value = genRandom(generator, 64);
+        sqlite3_bind_text(stmt, 1, guid.c_str(), -1, SQLITE_TRANSIENT);
+        if (parentGuid.empty()) {
+          sqlite3_bind_null(stmt, 2);
+        } else {
+          sqlite3_bind_text(stmt, 2, parentGuid.c_str(), -1,
+                            SQLITE_TRANSIENT);
+        }
+        sqlite3_bind_text(stmt, 3, name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 4, value.c_str(), -1, SQLITE_TRANSIENT);
+        rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE) {
+          sqlite3_finalize(stmt);
+          sqlite3_exec(database.get(), "ROLLBACK;", nullptr, nullptr, nullptr);
+          return -3;
+        }
+        nextLevelList.push_back(guid);
+        insertedCount++;
+      }
+    }
+    levelList.swap(nextLevelList);
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_exec(database.get(), "COMMIT;", nullptr, nullptr, nullptr);
+  return insertedCount;
+}